@@ -6,10 +6,10 @@ out vec4 fragColor;
 
 uniform sampler2D colorSampler;
 
-//|XgGtFNgf[^
+//ポストエフェクトデータ
 layout(std140) uniform PostEffectData
 {
-	mat4x4 matColor;	//Fϊs
+	mat4x4 matColor;	//色変換行列
 }postEffect;
 
 void main()
@@ -10,6 +10,6 @@ void main()
 {
 	fragColor = texture(colorSampler,inTexCoord);
 
-	const float numShades = 3;	//e̒iK
+	const float numShades = 3;	//影の段階
 	fragColor.rgb = ceil(fragColor.rgb * numShades) * (1/numShades);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 410
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec3 vNormal;
+layout(location = 4) in uvec4 vBoneIndex;
+layout(location = 5) in vec4 vWeight;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outTexCoord;
+layout(location = 2) out vec3 outWorldPosition;
+layout(location = 3) out vec3 outWorldNormal;
+layout(location = 4) flat out int outTextureLayer;
+
+
+layout(std140) uniform VertexData
+{
+	mat4 matMVP;
+	mat4 matModel;
+	mat3x4 matNormal;
+	vec4 color;
+	ivec4 textureLayer;
+}vertexData;
+
+//行列パレット(各要素はアフィン変換行列の転置の上3行)
+layout(std140) uniform SkinningData
+{
+	mat3x4 palette[256];
+}skinningData;
+
+void main()
+{
+	//影響するボーンの行列を重み付きで合成してから、座標と法線に掛ける
+	mat3x4 matSkin = skinningData.palette[vBoneIndex.x] * vWeight.x +
+		skinningData.palette[vBoneIndex.y] * vWeight.y +
+		skinningData.palette[vBoneIndex.z] * vWeight.z +
+		skinningData.palette[vBoneIndex.w] * vWeight.w;
+	vec3 position = vec4(vPosition, 1.0) * matSkin;
+	vec3 normal = vec4(vNormal, 0.0) * matSkin;
+
+	outColor = vColor * vertexData.color;
+	outTexCoord = vTexCoord;
+	outTextureLayer = vertexData.textureLayer.x;
+	outWorldPosition = (vertexData.matModel * vec4(position, 1.0)).xyz;
+	outWorldNormal = mat3(vertexData.matNormal) * normalize(normal);
+	gl_Position = vertexData.matMVP * vec4(position, 1.0);
+}
\ No newline at end of file
@@ -4,24 +4,26 @@ layout(location = 0) in vec4 inColor;
 layout(location = 1) in vec2 inTexCoord;
 layout(location = 2) in vec3 inWorldPosition;
 layout(location = 3) in vec3 inWorldNormal;
+layout(location = 4) flat in int inTextureLayer;
 
 out vec4 fragColor;
 
-uniform sampler2D colorSampler;
+//エンティティのテクスチャはすべてテクスチャ配列のレイヤーになっている
+uniform sampler2DArray colorSampler;
 
 struct PointLight
 {
-	vec4 position;	//W([hWn)
-	vec4 color;		//邳
+	vec4 position;	//座標(ワールド座標系)
+	vec4 color;		//明るさ
 };
 
-const int maxLightCount = 4 ; //Cg̐
+const int maxLightCount = 4 ; //ライトの数
 	
-//CeBOp[^
+//ライティングパラメータ
 layout(std140) uniform LightData
 {
-	vec4 ambientColor;	//
-	PointLight light[maxLightCount];	//Cg̃Xg
+	vec4 ambientColor;	//環境光
+	PointLight light[maxLightCount];	//ライトのリスト
 }lightData;
 
 void main(){
@@ -34,9 +36,9 @@ void main(){
 		lightColor += lightData.light[i].color.rgb * cosTheta * lightPower;
 	}
 
-	fragColor = inColor * texture(colorSampler,inTexCoord);
+	fragColor = inColor * texture(colorSampler, vec3(inTexCoord, inTextureLayer));
 	//fragColor.rgb *= lightColor;
 
-	const float numShades = 2;	//e̒iK
+	const float numShades = 2;	//影の段階
 	fragColor.rgb *= ceil(lightColor) * (1/numShades);
 }
\ No newline at end of file
@@ -8,6 +8,7 @@ layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec2 outTexCoord;
 layout(location = 2) out vec3 outWorldPosition;
 layout(location = 3) out vec3 outWorldNormal;
+layout(location = 4) flat out int outTextureLayer;
 
 
 layout(std140) uniform VertexData
@@ -16,16 +17,19 @@ layout(std140) uniform VertexData
 	mat4 matModel;
 	mat3x4 matNormal;
 	vec4 color;
+	ivec4 textureLayer;
 }vertexData;
 
 void main()
 {
 	outColor = vColor * vertexData.color;
-	outTexCoord = vTexCoord; 
+	outTexCoord = vTexCoord;
+	outTextureLayer = vertexData.textureLayer.x; 
 	
 	outWorldPosition = (vertexData.matModel * vec4(vPosition,1.0)).xyz;
 
-	outWorldNormal = mat3(vertexData.matNormal) * vNormal;
+	//量子化した法線は長さが1とは限らないので正規化する
+	outWorldNormal = mat3(vertexData.matNormal) * normalize(vNormal);
 
 	gl_Position = vertexData.matMVP * vec4(vPosition,1.0);
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 430
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec3 vNormal;
+layout(location = 4) in uint vDrawId;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outTexCoord;
+layout(location = 2) out vec3 outWorldPosition;
+layout(location = 3) out vec3 outWorldNormal;
+layout(location = 4) flat out int outTextureLayer;
+
+
+struct VertexData
+{
+	mat4 matMVP;
+	mat4 matModel;
+	mat3x4 matNormal;
+	vec4 color;
+	ivec4 textureLayer;
+};
+
+//エンティティ用UBOをそのまま配列として読む(間接描画コマンドのbaseInstanceが添字になる)
+layout(std430, binding = 0) readonly buffer VertexDataList
+{
+	VertexData vertexDataList[];
+};
+
+void main()
+{
+	VertexData vertexData = vertexDataList[vDrawId];
+
+	outColor = vColor * vertexData.color;
+	outTexCoord = vTexCoord;
+	outTextureLayer = vertexData.textureLayer.x; 
+	
+	outWorldPosition = (vertexData.matModel * vec4(vPosition,1.0)).xyz;
+
+	//量子化した法線は長さが1とは限らないので正規化する
+	outWorldNormal = mat3(vertexData.matNormal) * normalize(vNormal);
+
+	gl_Position = vertexData.matMVP * vec4(vPosition,1.0);
+}
\ No newline at end of file
@@ -0,0 +1,620 @@
+/**
+*	@file AnimationClip.cpp
+*/
+#include "AnimationClip.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+namespace Skeletal
+{
+	namespace /* unnamed */
+	{
+		//smallest-threeで保存する3要素の絶対値の上限(1/sqrt(2))
+		const float smallestThreeRange = 0.70710678f;
+		//smallest-threeの1要素あたりの最大値(15ビット)
+		const float smallestThreeScale = 32767.0f;
+		//ベクトルの1要素あたりの最大値(16ビット)
+		const float vectorScale = 65535.0f;
+		//フレーム番号を格納できる最大のフレーム数
+		const size_t maxFrameCount = 65536;
+
+		/**
+		*最短経路で補間できるよう符号をそろえた四元数を取得する
+		*/
+		glm::quat SameHemisphere(const glm::quat& q0, const glm::quat& q1)
+		{
+			if (glm::dot(q0, q1) < 0)
+			{
+				return glm::quat(-q1.w, -q1.x, -q1.y, -q1.z);
+			}
+			return q1;
+		}
+
+		/**
+		*2つの回転の間の角度を取得する
+		*
+		*内積のacosは角度が小さいと精度が足りないので、差分の回転の虚部と実部からatan2で求める
+		*/
+		float AngleBetween(const glm::quat& q0, const glm::quat& q1)
+		{
+			const double w0 = q0.w, x0 = q0.x, y0 = q0.y, z0 = q0.z;
+			const double w1 = q1.w, x1 = q1.x, y1 = q1.y, z1 = q1.z;
+			const double w = w0 * w1 + x0 * x1 + y0 * y1 + z0 * z1;
+			const double x = w0 * x1 - w1 * x0 - (y0 * z1 - z0 * y1);
+			const double y = w0 * y1 - w1 * y0 - (z0 * x1 - x0 * z1);
+			const double z = w0 * z1 - w1 * z0 - (x0 * y1 - y0 * x1);
+			return static_cast<float>(2.0 * atan2(sqrt(x * x + y * y + z * z), fabs(w)));
+		}
+
+		/**
+		*ベクトルの差の大きさを取得する
+		*/
+		float VectorDistance(const glm::vec3& v0, const glm::vec3& v1)
+		{
+			return glm::length(v1 - v0);
+		}
+
+		/**
+		*ベクトルの要素ごとの差の最大値を取得する
+		*/
+		float MaxComponentDistance(const glm::vec3& v0, const glm::vec3& v1)
+		{
+			const glm::vec3 d = glm::abs(v1 - v0);
+			return std::max(d.x, std::max(d.y, d.z));
+		}
+
+		/**
+		*ベクトルを線形補間する
+		*/
+		glm::vec3 LerpVector(const glm::vec3& v0, const glm::vec3& v1, float t)
+		{
+			return glm::mix(v0, v1, t);
+		}
+
+		/**
+		*四元数を正規化線形補間する
+		*/
+		glm::quat LerpRotation(const glm::quat& q0, const glm::quat& q1, float t)
+		{
+			return glm::normalize(q0 * (1.0f - t) + SameHemisphere(q0, q1) * t);
+		}
+
+		/**
+		*トラックのキーフレームを間引く
+		*
+		*@param	raw			圧縮前の全フレームの値
+		*@param	decoded		全フレームを量子化して戻した値
+		*@param	tolerance	許容誤差
+		*@param	lerp		補間関数
+		*@param	distance	誤差を求める関数
+		*@param	keyFrames	残すキーのフレーム番号の格納先
+		*
+		*先頭から貪欲に、補間した値が全フレームで許容誤差に収まる範囲までキーを飛ばす
+		*量子化後の値で判定するので、量子化の誤差も含めて許容誤差に収まる
+		*/
+		template<typename T, typename Lerp, typename Distance>
+		void ReduceKeys(const std::vector<T>& raw, const std::vector<T>& decoded, float tolerance,
+			Lerp lerp, Distance distance, std::vector<uint16_t>& keyFrames)
+		{
+			keyFrames.clear();
+			const size_t count = raw.size();
+			keyFrames.push_back(0);
+			if (count < 2)
+			{
+				return;
+			}
+
+			//全フレームが最初のキーで表せるなら、キーは1つでよい
+			bool isConstant = true;
+			for (size_t i = 1; i < count && isConstant; ++i)
+			{
+				isConstant = distance(decoded[0], raw[i]) <= tolerance;
+			}
+			if (isConstant)
+			{
+				return;
+			}
+
+			const auto isValid = [&](size_t first, size_t last) {
+				for (size_t i = first + 1; i < last; ++i)
+				{
+					const float t = static_cast<float>(i - first) / static_cast<float>(last - first);
+					if (distance(lerp(decoded[first], decoded[last], t), raw[i]) > tolerance)
+					{
+						return false;
+					}
+				}
+				return true;
+			};
+			size_t first = 0;
+			while (first < count - 1)
+			{
+				size_t last = first + 1;
+				while (last + 1 < count && isValid(first, last + 1))
+				{
+					++last;
+				}
+				keyFrames.push_back(static_cast<uint16_t>(last));
+				first = last;
+			}
+		}
+
+		/**
+		*フレーム番号を含むキーの区間を探す
+		*
+		*@param	frameList	トラックのキーのフレーム番号
+		*@param	count		トラックのキー数(2以上)
+		*@param	frame		探すフレーム番号
+		*
+		*@return 区間の先頭のキー番号(0からcount-2まで)
+		*/
+		size_t FindKey(const uint16_t* frameList, size_t count, float frame)
+		{
+			const uint16_t* p = std::upper_bound(frameList + 1, frameList + count - 1, frame,
+				[](float f, uint16_t key) { return f < static_cast<float>(key); });
+			return static_cast<size_t>(p - frameList) - 1;
+		}
+
+		/**
+		*キーの区間内の補間係数を取得する
+		*/
+		float KeyRatio(const uint16_t* frameList, size_t key, float frame)
+		{
+			const float f0 = static_cast<float>(frameList[key]);
+			const float f1 = static_cast<float>(frameList[key + 1]);
+			return std::max(0.0f, std::min(1.0f, (frame - f0) / (f1 - f0)));
+		}
+
+	} // unnamed namespace
+
+	/**
+	*ベクトルを16ビットに量子化する
+	*
+	*@param	v		量子化するベクトル
+	*@param	range	量子化する範囲
+	*
+	*@return 量子化した値
+	*/
+	Clip::PackedKey Clip::Encode(const glm::vec3& v, const Range& range)
+	{
+		PackedKey key;
+		for (int i = 0; i < 3; ++i)
+		{
+			float n = 0;
+			if (range.extent[i] > 0)
+			{
+				n = (v[i] - range.minimum[i]) / range.extent[i];
+			}
+			n = std::max(0.0f, std::min(1.0f, n));
+			key.value[i] = static_cast<uint16_t>(n * vectorScale + 0.5f);
+		}
+		return key;
+	}
+
+	/**
+	*四元数をsmallest-three形式で量子化する
+	*
+	*@param	q	量子化する四元数
+	*
+	*@return 量子化した値
+	*
+	*絶対値が最大の要素を省き、残りの3要素を15ビットずつで保存する
+	*省いた要素の番号は上位2要素の最上位ビットに1ビットずつ格納する
+	*省いた要素が正になるよう全体の符号をそろえれば、残りの要素から復元できる
+	*/
+	Clip::PackedKey Clip::Encode(const glm::quat& q)
+	{
+		const glm::quat nq = glm::normalize(q);
+		float c[4] = { nq.x, nq.y, nq.z, nq.w };
+		int largest = 0;
+		for (int i = 1; i < 4; ++i)
+		{
+			if (fabs(c[i]) > fabs(c[largest]))
+			{
+				largest = i;
+			}
+		}
+		const float sign = c[largest] < 0 ? -1.0f : 1.0f;
+		PackedKey key;
+		for (int i = 0, n = 0; i < 4; ++i)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			float v = (c[i] * sign + smallestThreeRange) / (smallestThreeRange * 2);
+			v = std::max(0.0f, std::min(1.0f, v));
+			key.value[n++] = static_cast<uint16_t>(v * smallestThreeScale + 0.5f);
+		}
+		key.value[0] |= static_cast<uint16_t>((largest >> 1) << 15);
+		key.value[1] |= static_cast<uint16_t>((largest & 1) << 15);
+		return key;
+	}
+
+	/**
+	*16ビットに量子化したベクトルを展開する
+	*
+	*@param	key		量子化した値
+	*@param	range	量子化した範囲
+	*
+	*@return 展開したベクトル
+	*/
+	glm::vec3 Clip::Decode(const PackedKey& key, const Range& range)
+	{
+		return range.minimum + range.extent * glm::vec3(
+			static_cast<float>(key.value[0]) / vectorScale,
+			static_cast<float>(key.value[1]) / vectorScale,
+			static_cast<float>(key.value[2]) / vectorScale);
+	}
+
+	/**
+	*smallest-three形式の四元数を展開する
+	*
+	*@param	key	量子化した値
+	*
+	*@return 展開した四元数
+	*/
+	glm::quat Clip::Decode(const PackedKey& key)
+	{
+		const int largest = ((key.value[0] >> 15) << 1) | (key.value[1] >> 15);
+		float c[4];
+		float sum = 0;
+		for (int i = 0, n = 0; i < 4; ++i)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			const float v = static_cast<float>(key.value[n++] & 0x7fff) / smallestThreeScale;
+			c[i] = v * (smallestThreeRange * 2) - smallestThreeRange;
+			sum += c[i] * c[i];
+		}
+		c[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+		return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+	}
+
+	/**
+	*圧縮前のクリップからクリップを作成する
+	*
+	*@param	raw			圧縮前のクリップ
+	*@param	settings	圧縮の許容誤差
+	*@param	stats		圧縮結果の統計の格納先(不要ならnullptr)
+	*
+	*@return 作成したクリップ
+	*		作成できなかった場合はnullptr
+	*/
+	ClipPtr Clip::Create(const RawClip& raw, const CompressionSettings& settings, CompressionStats* stats)
+	{
+		if (raw.keyList.size() != raw.frameCount * raw.boneCount)
+		{
+			std::cerr << "ERROR: " << raw.name << " のキー数(" << raw.keyList.size() <<
+				")がフレーム数とボーン数に一致しません" << std::endl;
+			return nullptr;
+		}
+		if (raw.frameCount > maxFrameCount)
+		{
+			std::cerr << "ERROR: " << raw.name << " のフレーム数(" << raw.frameCount <<
+				")が上限(" << maxFrameCount << ")を超えています" << std::endl;
+			return nullptr;
+		}
+
+		struct Impl : Clip { Impl() {} ~Impl() {} };
+		std::shared_ptr<Impl> clip = std::make_shared<Impl>();
+		clip->name = raw.name;
+		clip->frameRate = raw.frameRate;
+		clip->frameCount = raw.frameCount;
+		clip->boneCount = raw.boneCount;
+		clip->translationTrack.offsetList.reserve(raw.boneCount + 1);
+		clip->rotationTrack.offsetList.reserve(raw.boneCount + 1);
+		clip->scaleTrack.offsetList.reserve(raw.boneCount + 1);
+		clip->translationRange.resize(raw.boneCount);
+		clip->scaleRange.resize(raw.boneCount);
+
+		std::vector<glm::vec3> rawVector(raw.frameCount);
+		std::vector<glm::vec3> decodedVector(raw.frameCount);
+		std::vector<glm::quat> rawRotation(raw.frameCount);
+		std::vector<glm::quat> decodedRotation(raw.frameCount);
+		std::vector<PackedKey> packedList(raw.frameCount);
+		std::vector<uint16_t> keyFrames;
+
+		//トラックに残すキーを追加する
+		const auto appendKeys = [&](TrackSet& track) {
+			track.offsetList.push_back(static_cast<uint32_t>(track.keyList.size()));
+			for (uint16_t frame : keyFrames)
+			{
+				track.frameList.push_back(frame);
+				track.keyList.push_back(packedList[frame]);
+			}
+		};
+		//平行移動と拡大率のトラックを作成する
+		const auto compressVector = [&](TrackSet& track, Range& range, float tolerance, float(*distance)(const glm::vec3&, const glm::vec3&)) {
+			glm::vec3 minimum(FLT_MAX);
+			glm::vec3 maximum(-FLT_MAX);
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				minimum = glm::min(minimum, rawVector[frame]);
+				maximum = glm::max(maximum, rawVector[frame]);
+			}
+			range.minimum = raw.frameCount ? minimum : glm::vec3(0);
+			range.extent = raw.frameCount ? maximum - minimum : glm::vec3(0);
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				packedList[frame] = Encode(rawVector[frame], range);
+				decodedVector[frame] = Decode(packedList[frame], range);
+			}
+			ReduceKeys(rawVector, decodedVector, tolerance, LerpVector, distance, keyFrames);
+			appendKeys(track);
+		};
+
+		for (size_t bone = 0; bone < raw.boneCount; ++bone)
+		{
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				rawVector[frame] = raw.keyList[frame * raw.boneCount + bone].translation;
+			}
+			if (raw.frameCount)
+			{
+				compressVector(clip->translationTrack, clip->translationRange[bone],
+					settings.translationTolerance, VectorDistance);
+			}
+			else
+			{
+				clip->translationTrack.offsetList.push_back(0);
+			}
+
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				rawVector[frame] = raw.keyList[frame * raw.boneCount + bone].scale;
+			}
+			if (raw.frameCount)
+			{
+				compressVector(clip->scaleTrack, clip->scaleRange[bone],
+					settings.scaleTolerance, MaxComponentDistance);
+			}
+			else
+			{
+				clip->scaleTrack.offsetList.push_back(0);
+			}
+
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				rawRotation[frame] = raw.keyList[frame * raw.boneCount + bone].rotation;
+				packedList[frame] = Encode(rawRotation[frame]);
+				decodedRotation[frame] = Decode(packedList[frame]);
+			}
+			if (raw.frameCount)
+			{
+				ReduceKeys(rawRotation, decodedRotation, settings.rotationTolerance, LerpRotation,
+					AngleBetween, keyFrames);
+				appendKeys(clip->rotationTrack);
+			}
+			else
+			{
+				clip->rotationTrack.offsetList.push_back(0);
+			}
+		}
+		clip->translationTrack.offsetList.push_back(static_cast<uint32_t>(clip->translationTrack.keyList.size()));
+		clip->rotationTrack.offsetList.push_back(static_cast<uint32_t>(clip->rotationTrack.keyList.size()));
+		clip->scaleTrack.offsetList.push_back(static_cast<uint32_t>(clip->scaleTrack.keyList.size()));
+
+		if (stats)
+		{
+			//圧縮前の全フレームをサンプリングし直して誤差を求める
+			CompressionStats s;
+			s.rawBytes = raw.keyList.size() * sizeof(Transform);
+			s.compressedBytes = clip->ByteSize();
+			s.ratio = s.compressedBytes ? static_cast<float>(s.rawBytes) / static_cast<float>(s.compressedBytes) : 0;
+			s.rawKeyCount = raw.keyList.size() * 3;
+			s.keyCount = clip->translationTrack.keyList.size() + clip->rotationTrack.keyList.size() +
+				clip->scaleTrack.keyList.size();
+			std::vector<Transform> pose(raw.boneCount);
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				clip->SampleFrame(static_cast<float>(frame), pose.data());
+				const Transform* key = &raw.keyList[frame * raw.boneCount];
+				for (size_t bone = 0; bone < raw.boneCount; ++bone)
+				{
+					s.maxTranslationError = std::max(s.maxTranslationError,
+						VectorDistance(pose[bone].translation, key[bone].translation));
+					s.maxRotationError = std::max(s.maxRotationError,
+						AngleBetween(pose[bone].rotation, key[bone].rotation));
+					s.maxScaleError = std::max(s.maxScaleError,
+						MaxComponentDistance(pose[bone].scale, key[bone].scale));
+				}
+			}
+			*stats = s;
+		}
+		return clip;
+	}
+
+	/**
+	*クリップの長さを取得する
+	*
+	*@return 最初のフレームから最後のフレームまでの秒数
+	*/
+	double Clip::Duration() const
+	{
+		if (frameCount < 2 || frameRate <= 0)
+		{
+			return 0;
+		}
+		return static_cast<double>(frameCount - 1) / frameRate;
+	}
+
+	/**
+	*指定した時刻の姿勢を取得する
+	*
+	*@param	time	クリップの先頭からの経過時間(秒)
+	*@param	loop	ループ再生するならtrue、最後のフレームで止めるならfalse
+	*@param	pose	姿勢の格納先(boneCount個の要素が必要)
+	*/
+	void Clip::Sample(double time, bool loop, Transform* pose) const
+	{
+		if (frameCount == 0 || !pose)
+		{
+			return;
+		}
+		const double duration = Duration();
+		if (duration <= 0)
+		{
+			SampleFrame(0, pose);
+			return;
+		}
+		if (loop)
+		{
+			time = fmod(time, duration);
+			if (time < 0)
+			{
+				time += duration;
+			}
+		}
+		else
+		{
+			time = std::max(0.0, std::min(time, duration));
+		}
+		SampleFrame(static_cast<float>(time * frameRate), pose);
+	}
+
+	/**
+	*指定したフレームの姿勢を取得する
+	*
+	*@param	frame	フレーム番号(小数部は前後のキーの補間に使う)
+	*@param	pose	姿勢の格納先(boneCount個の要素が必要)
+	*
+	*メモリを順番に読むよう、種類ごとに全ボーンのトラックを処理する
+	*各トラックでは前後2つのキーだけを二分探索で見つけて展開する
+	*回転は間隔が短いので球面線形補間ではなく、正規化線形補間で近似する
+	*/
+	void Clip::SampleFrame(float frame, Transform* pose) const
+	{
+		const auto sampleVector = [this, frame, pose](const TrackSet& track, const Range* range,
+			glm::vec3 Transform::*member) {
+			const uint32_t* offset = track.offsetList.data();
+			const uint16_t* frameList = track.frameList.data();
+			const PackedKey* keyList = track.keyList.data();
+			for (size_t i = 0; i < boneCount; ++i)
+			{
+				const size_t count = offset[i + 1] - offset[i];
+				if (count == 1)
+				{
+					pose[i].*member = Decode(keyList[offset[i]], range[i]);
+					continue;
+				}
+				const size_t key = offset[i] + FindKey(frameList + offset[i], count, frame);
+				const float t = KeyRatio(frameList, key, frame);
+				pose[i].*member = glm::mix(Decode(keyList[key], range[i]), Decode(keyList[key + 1], range[i]), t);
+			}
+		};
+		sampleVector(translationTrack, translationRange.data(), &Transform::translation);
+		sampleVector(scaleTrack, scaleRange.data(), &Transform::scale);
+
+		const uint32_t* offset = rotationTrack.offsetList.data();
+		const uint16_t* frameList = rotationTrack.frameList.data();
+		const PackedKey* keyList = rotationTrack.keyList.data();
+		for (size_t i = 0; i < boneCount; ++i)
+		{
+			const size_t count = offset[i + 1] - offset[i];
+			if (count == 1)
+			{
+				pose[i].rotation = Decode(keyList[offset[i]]);
+				continue;
+			}
+			const size_t key = offset[i] + FindKey(frameList + offset[i], count, frame);
+			const float t = KeyRatio(frameList, key, frame);
+			pose[i].rotation = LerpRotation(Decode(keyList[key]), Decode(keyList[key + 1]), t);
+		}
+	}
+
+	/**
+	*トラックのバイト数を取得する
+	*
+	*@return 配列の要素が占めるバイト数
+	*/
+	size_t Clip::TrackSet::ByteSize() const
+	{
+		return offsetList.size() * sizeof(uint32_t) + frameList.size() * sizeof(uint16_t) +
+			keyList.size() * sizeof(PackedKey);
+	}
+
+	/**
+	*クリップのバイト数を取得する
+	*
+	*@return キーと量子化範囲が占めるバイト数
+	*/
+	size_t Clip::ByteSize() const
+	{
+		return translationTrack.ByteSize() + rotationTrack.ByteSize() + scaleTrack.ByteSize() +
+			(translationRange.size() + scaleRange.size()) * sizeof(Range);
+	}
+
+	/**
+	*クリップの圧縮率と再生速度を計測して出力する
+	*
+	*@param	os	出力先
+	*
+	*止まっているボーン、ゆっくり動くボーン、細かく揺れるボーンを混ぜた合成クリップを圧縮し、
+	*圧縮率と最大誤差、1ミリ秒あたりにサンプリングできる姿勢の数を表示する
+	*/
+	void RunClipBenchmark(std::ostream& os)
+	{
+		static const size_t boneCount = 64;
+		static const size_t frameCount = 300;
+		static const int sampleCount = 10000;
+
+		RawClip raw;
+		raw.name = "benchmark";
+		raw.frameCount = frameCount;
+		raw.boneCount = boneCount;
+		raw.keyList.resize(frameCount * boneCount);
+		for (size_t frame = 0; frame < frameCount; ++frame)
+		{
+			const float t = static_cast<float>(frame) / raw.frameRate;
+			for (size_t bone = 0; bone < boneCount; ++bone)
+			{
+				Transform& key = raw.keyList[frame * boneCount + bone];
+				key.translation = glm::vec3(0, 10.0f, 0);
+				switch (bone % 4)
+				{
+				case 0:
+					break;
+				case 1:
+					key.rotation = glm::angleAxis(sinf(t) * 0.5f, glm::vec3(1, 0, 0));
+					break;
+				case 2:
+					key.rotation = glm::angleAxis(sinf(t * 3.0f + static_cast<float>(bone)), glm::vec3(0, 0, 1));
+					break;
+				default:
+					key.rotation = glm::angleAxis(sinf(t * 7.0f) * 0.3f, glm::normalize(glm::vec3(1, 1, 0)));
+					key.translation += glm::vec3(sinf(t * 2.0f) * 5.0f, 0, 0);
+					break;
+				}
+			}
+		}
+
+		CompressionStats stats;
+		const ClipPtr clip = Clip::Create(raw, CompressionSettings(), &stats);
+		if (!clip)
+		{
+			return;
+		}
+		std::vector<Transform> pose(boneCount);
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < sampleCount; ++i)
+		{
+			clip->Sample(static_cast<double>(i) * 0.0123, true, pose.data());
+		}
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		os << "Clip compression (" << boneCount << " bones x " << frameCount << " frames)\n";
+		os << "  size        : " << stats.rawBytes << " -> " << stats.compressedBytes << " bytes (x" <<
+			std::fixed << std::setprecision(2) << stats.ratio << ")\n";
+		os << "  keys        : " << stats.keyCount << " / " << stats.rawKeyCount << "\n";
+		os << "  sample      : " << std::setprecision(1) << sampleCount / elapsed.count() << " poses/ms\n";
+		os << std::defaultfloat << "  max error   : t=" << stats.maxTranslationError << " r=" <<
+			stats.maxRotationError << " s=" << stats.maxScaleError << std::endl;
+	}
+}
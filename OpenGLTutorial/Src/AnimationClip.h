@@ -0,0 +1,155 @@
+/**
+*	@file AnimationClip.h
+*/
+#pragma once
+#include "Memory.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iosfwd>
+#include <stdint.h>
+
+namespace Skeletal
+{
+	class Clip;
+	typedef std::shared_ptr<const Clip> ClipPtr;	///<アニメーションクリップポインタ型
+
+	/**
+	*	ボーンの姿勢(親ボーンからの相対値)
+	*/
+	struct Transform
+	{
+		glm::vec3 translation = glm::vec3(0);	///<平行移動
+		glm::quat rotation;	///<回転
+		glm::vec3 scale = glm::vec3(1);	///<拡大率
+	};
+
+	/**
+	*	圧縮前のアニメーションクリップ
+	*
+	*	一定間隔でサンプリングした全ボーンの姿勢を持つ
+	*	読み込み時の作業用で、再生にはClipに圧縮したものを使う
+	*/
+	struct RawClip
+	{
+		std::string name;	///<クリップ名
+		float frameRate = 30;	///<1秒あたりのフレーム数
+		size_t frameCount = 0;	///<フレーム数
+		size_t boneCount = 0;	///<1フレームあたりのボーン数
+		std::vector<Transform> keyList;	///<姿勢の配列([フレーム番号 * boneCount + ボーン番号])
+	};
+
+	/**
+	*	圧縮の許容誤差
+	*
+	*	キーフレームの削減は、量子化後の値で補間した結果がこの範囲に収まる間だけ行う
+	*/
+	struct CompressionSettings
+	{
+		float translationTolerance = 0.01f;	///<平行移動の許容誤差(モデルの単位)
+		float rotationTolerance = 0.001f;	///<回転の許容誤差(ラジアン)
+		float scaleTolerance = 0.001f;	///<拡大率の許容誤差
+	};
+
+	/**
+	*	圧縮結果の統計
+	*
+	*	誤差は圧縮前の全フレームを圧縮後のクリップからサンプリングし直して求める
+	*/
+	struct CompressionStats
+	{
+		size_t rawBytes = 0;	///<圧縮前のキーのバイト数
+		size_t compressedBytes = 0;	///<圧縮後のバイト数
+		float ratio = 0;	///<圧縮率(rawBytes / compressedBytes)
+		size_t rawKeyCount = 0;	///<圧縮前のトラックあたりキー数の合計
+		size_t keyCount = 0;	///<削減後のキー数の合計
+		float maxTranslationError = 0;	///<平行移動の最大誤差
+		float maxRotationError = 0;	///<回転の最大誤差(ラジアン)
+		float maxScaleError = 0;	///<拡大率の最大誤差
+	};
+
+	/**
+	*	圧縮したアニメーションクリップ
+	*
+	*	ボーンごとに平行移動、回転、拡大率の3つのトラックを持ち、各トラックは誤差の範囲内で
+	*	キーフレームを間引いてある
+	*	回転はsmallest-three形式の48ビット、平行移動と拡大率はトラックごとの範囲で16ビットに量子化する
+	*	同じ種類のトラックのフレーム番号とキーはそれぞれ1つの配列に詰めてあり(SoA)、
+	*	サンプリングでは前後2つのキーだけを展開する
+	*
+	*	作成後は書き換えないので、複数のキャラクターやスレッドから共有できる
+	*/
+	class Clip
+	{
+	public:
+		static ClipPtr Create(const RawClip& raw, const CompressionSettings& settings = CompressionSettings(),
+			CompressionStats* stats = nullptr);
+
+		double Duration() const;
+		void Sample(double time, bool loop, Transform* pose) const;
+
+		const std::string& Name() const { return name; }
+		float FrameRate() const { return frameRate; }
+		size_t FrameCount() const { return frameCount; }
+		size_t BoneCount() const { return boneCount; }
+		size_t ByteSize() const;
+
+	private:
+		Clip() = default;
+		~Clip() = default;
+		Clip(const Clip&) = delete;
+		Clip& operator = (const Clip&) = delete;
+
+		/**
+		*	16ビットに量子化したベクトルまたはsmallest-three形式の四元数
+		*/
+		struct PackedKey
+		{
+			uint16_t value[3];
+		};
+
+		/**
+		*	同じ種類のトラックをまとめたもの
+		*
+		*	トラックiのキーは[offsetList[i], offsetList[i + 1])の範囲にある
+		*/
+		struct TrackSet
+		{
+			Memory::Vector<uint32_t, Memory::Tag::Animation> offsetList;	///<各トラックの先頭キー番号
+			Memory::Vector<uint16_t, Memory::Tag::Animation> frameList;	///<各キーのフレーム番号
+			Memory::Vector<PackedKey, Memory::Tag::Animation> keyList;	///<各キーの量子化した値
+
+			size_t ByteSize() const;
+		};
+
+		/**
+		*	ベクトルのトラックを量子化する範囲
+		*/
+		struct Range
+		{
+			glm::vec3 minimum;	///<最小値
+			glm::vec3 extent;	///<最大値と最小値の差
+		};
+
+		static PackedKey Encode(const glm::vec3& v, const Range& range);
+		static PackedKey Encode(const glm::quat& q);
+		static glm::vec3 Decode(const PackedKey& key, const Range& range);
+		static glm::quat Decode(const PackedKey& key);
+		void SampleFrame(float frame, Transform* pose) const;
+
+	private:
+		std::string name;	///<クリップ名
+		float frameRate = 30;	///<1秒あたりのフレーム数
+		size_t frameCount = 0;	///<フレーム数
+		size_t boneCount = 0;	///<ボーン数
+		TrackSet translationTrack;	///<平行移動のトラック
+		TrackSet rotationTrack;	///<回転のトラック
+		TrackSet scaleTrack;	///<拡大率のトラック
+		Memory::Vector<Range, Memory::Tag::Animation> translationRange;	///<平行移動の量子化範囲
+		Memory::Vector<Range, Memory::Tag::Animation> scaleRange;	///<拡大率の量子化範囲
+	};
+
+	void RunClipBenchmark(std::ostream& os);
+}
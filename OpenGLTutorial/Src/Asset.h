@@ -0,0 +1,204 @@
+/**
+*	@file Asset.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+
+/**
+*	アセットの名前とハンドルを扱うための名前空間
+*/
+namespace Asset
+{
+	//名前のハッシュ値の型
+	typedef uint32_t NameHash;
+
+	//アセットハンドルの型(登録順の連番)
+	typedef int32_t Handle;
+
+	//無効なハンドル
+	static const Handle invalidHandle = -1;
+
+	/**
+	*文字列のFNV-1aハッシュ値を計算する
+	*
+	*@param	s	0終端文字列
+	*@param	h	途中までのハッシュ値
+	*
+	*@return ハッシュ値
+	*
+	*文字列リテラルに対してはコンパイル時に計算される
+	*/
+	constexpr NameHash HashName(const char* s, NameHash h = 2166136261u)
+	{
+		return *s ? HashName(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u) : h;
+	}
+	static_assert(HashName("") == 2166136261u && HashName("a") == 0xe40c292cu,
+		"HashNameはコンパイル時に評価できなければならない");
+
+	/**
+	*文字列のFNV-1aハッシュ値を計算する(実行時用)
+	*
+	*@param	s	0終端文字列
+	*
+	*@return ハッシュ値
+	*/
+	inline NameHash HashNameRuntime(const char* s)
+	{
+		NameHash h = 2166136261u;
+		for (; *s; ++s)
+		{
+			h = (h ^ static_cast<uint8_t>(*s)) * 16777619u;
+		}
+		return h;
+	}
+
+	/**
+	*	ハッシュ化されたアセット名
+	*
+	*	文字列リテラルから暗黙に作成でき、その場合はコンパイル時にハッシュ値が決まる
+	*	実行時の文字列からはFromStringで作成する
+	*/
+	struct Name
+	{
+		template<size_t N>
+		constexpr Name(const char(&s)[N]) : hash(HashName(s)) {}
+		Name(const std::string& s) : hash(HashNameRuntime(s.c_str())) {}
+
+		static Name FromString(const char* s) { return Name(HashNameRuntime(s), 0); }
+
+		NameHash hash;
+
+	private:
+		constexpr Name(NameHash h, int) : hash(h) {}
+	};
+
+	/**
+	*	名前からハンドルを引けるアセットの登録先
+	*
+	*	アセットは登録順に連番のハンドルを持ち、ハンドルからの取得は配列の添字だけで済む
+	*	名前による検索は登録時と初回の解決時だけに使うこと
+	*/
+	template<typename T>
+	class Registry
+	{
+	public:
+		/**
+		*アセットを登録する
+		*
+		*@param	name	アセット名
+		*@param	asset	登録するアセット
+		*
+		*@return 登録したアセットのハンドル
+		*		同名のアセットが登録済みの場合はそのハンドルを返す
+		*		ハッシュ値が別名のアセットと衝突した場合はinvalidHandleを返す
+		*/
+		Handle Add(const char* name, const T& asset)
+		{
+			const NameHash hash = HashNameRuntime(name);
+			const auto itr = index.find(hash);
+			if (itr != index.end())
+			{
+				if (names[itr->second] != name)
+				{
+					std::cerr << "ERROR: アセット名 '" << name << "' のハッシュ値が '" <<
+						names[itr->second] << "' と衝突しています" << std::endl;
+					return invalidHandle;
+				}
+				return itr->second;
+			}
+			const Handle handle = static_cast<Handle>(items.size());
+			items.push_back(asset);
+			names.push_back(name);
+			index.insert(std::make_pair(hash, handle));
+			return handle;
+		}
+
+		/**
+		*アセットの登録を解除する
+		*
+		*@param	handle	アセットのハンドル
+		*
+		*@retval true	解除した
+		*@retval false	登録されていないハンドルだった
+		*
+		*ハンドルは再利用されないので、他のアセットのハンドルは変わらない
+		*解除したハンドルをGetに渡すと空のアセットが返る
+		*/
+		bool Remove(Handle handle)
+		{
+			if (handle < 0 || handle >= static_cast<Handle>(items.size()) || names[handle].empty())
+			{
+				return false;
+			}
+			const auto itr = index.find(HashNameRuntime(names[handle].c_str()));
+			if (itr != index.end() && itr->second == handle)
+			{
+				index.erase(itr);
+			}
+			items[handle] = T{};
+			names[handle].clear();
+			return true;
+		}
+
+		/**
+		*アセットのハンドルを検索する
+		*
+		*@param	name	アセット名
+		*
+		*@return nameに対応するハンドル
+		*		見つからない場合はinvalidHandleを返す
+		*/
+		Handle Find(Name name) const
+		{
+			const auto itr = index.find(name.hash);
+			return itr != index.end() ? itr->second : invalidHandle;
+		}
+
+		/**
+		*アセットを取得する
+		*
+		*@param	handle	アセットのハンドル
+		*
+		*@return handleに対応するアセット
+		*		範囲外のハンドルの場合は空のアセットを返す
+		*/
+		const T& Get(Handle handle) const
+		{
+			if (handle < 0 || handle >= static_cast<Handle>(items.size()))
+			{
+				static const T dummy{};
+				return dummy;
+			}
+			return items[handle];
+		}
+
+		/**
+		*アセット名を取得する(デバッグ用)
+		*
+		*@param	handle	アセットのハンドル
+		*
+		*@return handleに対応するアセット名
+		*/
+		const std::string& GetName(Handle handle) const
+		{
+			if (handle < 0 || handle >= static_cast<Handle>(names.size()))
+			{
+				static const std::string dummy;
+				return dummy;
+			}
+			return names[handle];
+		}
+
+		size_t Size() const { return items.size(); }
+
+	private:
+		std::vector<T> items;	///<アセットの配列(添字がハンドル)
+		std::vector<std::string> names;	///<アセット名の配列(衝突検出とデバッグ用)
+		std::unordered_map<NameHash, Handle> index;	///<名前のハッシュ値からハンドルへの対応表
+	};
+}
@@ -0,0 +1,132 @@
+/**
+*	@file AssetLoader.cpp
+*/
+#include "AssetLoader.h"
+#include "JobSystem.h"
+#include <chrono>
+
+/**
+*読み込みを開始する
+*
+*@param	decode	ワーカースレッドで実行する関数
+*@param	upload	描画スレッドで実行する関数
+*@param	commit	シミュレーションスレッドで実行する関数
+*
+*@return 読み込み結果を受け取るためのFuture
+*		Commitが終わった時点で準備完了になる
+*
+*Decodeは時間がかかるので、フレームの処理のWaitに巻き込まれないようにバックグラウンドジョブとして実行する
+*Initの前に呼び出された場合、Decodeは呼び出したスレッドで実行される
+*/
+AssetLoader::Future AssetLoader::Load(const StepFuncType& decode, const StepFuncType& upload,
+	const CommitFuncType& commit)
+{
+	TaskPtr task = std::make_shared<Task>();
+	task->decode = decode;
+	task->upload = upload;
+	task->commit = commit;
+	Future future = task->promise.get_future().share();
+	++pendingCount;
+
+	const auto func = [this, task]() {
+		task->isSucceeded = !task->decode || task->decode();
+		task->decode = nullptr;
+		std::lock_guard<std::mutex> lock(mutex);
+		//失敗した場合は転送せずに結果を通知する
+		(task->isSucceeded ? uploadQueue : commitQueue).push_back(task);
+	};
+	if (jobSystem)
+	{
+		jobSystem->RunBackground(func);
+	}
+	else
+	{
+		func();
+	}
+	return future;
+}
+
+/**
+*既に結果が決まっているFutureを作成する
+*
+*@param	result	読み込み結果
+*
+*@return 準備完了のFuture
+*
+*読み込み済みのアセットを再度要求されたときに使う
+*/
+AssetLoader::Future AssetLoader::MakeReadyFuture(bool result)
+{
+	std::promise<bool> promise;
+	promise.set_value(result);
+	return promise.get_future().share();
+}
+
+/**
+*Upload待ちのタスクをGLに転送する
+*
+*@param	budgetSeconds	この呼び出しで転送に使ってよい時間(秒)
+*
+*GLのコンテキストを持つスレッドから、毎フレーム呼び出すこと
+*1つの転送は分割できないので、少なくとも1つは時間に関わらず処理する
+*転送の関数がDeferを呼び出した場合、そのタスクをキューの先頭に戻して次のフレームに続きを行う
+*/
+void AssetLoader::Upload(double budgetSeconds)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const Clock::time_point start = Clock::now();
+	for (;;)
+	{
+		TaskPtr task;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (uploadQueue.empty())
+			{
+				return;
+			}
+			task = uploadQueue.front();
+			uploadQueue.pop_front();
+		}
+		isUploadDeferred = false;
+		task->isSucceeded = !task->upload || task->upload();
+		if (isUploadDeferred && task->isSucceeded)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			uploadQueue.push_front(task);
+			return;
+		}
+		task->upload = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			commitQueue.push_back(task);
+		}
+		if (std::chrono::duration<double>(Clock::now() - start).count() >= budgetSeconds)
+		{
+			return;
+		}
+	}
+}
+
+/**
+*Commit待ちのタスクを完了させる
+*
+*シミュレーションスレッドから、毎フレームの更新の始めに呼び出すこと
+*/
+void AssetLoader::Commit()
+{
+	std::deque<TaskPtr> list;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		list.swap(commitQueue);
+	}
+	for (const TaskPtr& task : list)
+	{
+		bool result = task->isSucceeded;
+		if (task->commit)
+		{
+			result = task->commit(result);
+		}
+		task->promise.set_value(result);
+		--pendingCount;
+	}
+}
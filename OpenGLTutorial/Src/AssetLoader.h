@@ -0,0 +1,74 @@
+/**
+*	@file AssetLoader.h
+*/
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+class JobSystem;
+
+/**
+*	アセットを非同期に読み込むためのクラス
+*
+*	1つの読み込みは次の3段階で処理される
+*	- Decode: ファイルの読み込みと変換(ワーカースレッド、GLの関数は呼べない)
+*	- Upload: GLへの転送(描画スレッド、1フレームあたりの時間に上限がある)
+*	- Commit: アセットの登録(シミュレーションスレッド、終わるとFutureが準備完了になる)
+*	各段階の関数はtrueを返すと次の段階に進み、falseを返すと読み込み失敗としてCommitに進む
+*	Uploadの関数はDeferを呼び出すことで、残りの転送を次のフレームに回せる
+*/
+class AssetLoader
+{
+public:
+	//読み込み結果を受け取るための型(成功ならtrue)
+	typedef std::shared_future<bool> Future;
+
+	//各段階で実行する関数の型
+	typedef std::function<bool()> StepFuncType;
+
+	//Commitで実行する関数の型(引数は前の段階までが成功したかどうか)
+	typedef std::function<bool(bool)> CommitFuncType;
+
+	AssetLoader() = default;
+	~AssetLoader() = default;
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator = (const AssetLoader&) = delete;
+
+	void Init(JobSystem& js) { jobSystem = &js; }
+	Future Load(const StepFuncType& decode, const StepFuncType& upload, const CommitFuncType& commit);
+	static Future MakeReadyFuture(bool result);
+
+	void Upload(double budgetSeconds);
+	void Defer() { isUploadDeferred = true; }
+	void Commit();
+
+	size_t PendingCount() const { return pendingCount.load(); }
+
+private:
+	/**
+	*	読み込み1つ分のデータ
+	*/
+	struct Task
+	{
+		StepFuncType decode;
+		StepFuncType upload;
+		CommitFuncType commit;
+		std::promise<bool> promise;
+		bool isSucceeded = true;	///<前の段階までが成功したかどうか
+	};
+	typedef std::shared_ptr<Task> TaskPtr;
+
+	JobSystem* jobSystem = nullptr;
+
+	std::mutex mutex;	///<以下のキューを保護する
+	std::deque<TaskPtr> uploadQueue;	///<Upload待ちのタスク
+	std::deque<TaskPtr> commitQueue;	///<Commit待ちのタスク
+
+	std::atomic<size_t> pendingCount{ 0 };	///<完了していないタスクの数
+	bool isUploadDeferred = false;	///<実行中のUploadの関数がDeferを呼び出した(描画スレッド専用)
+};
@@ -3,6 +3,7 @@
 */
 
 #include "Audio.h"
+#include "Memory.h"
 #include <cri_adx2le.h>
 #include <iostream>
 #include <cstdint>
@@ -16,7 +17,7 @@ namespace Audio
 
 
 	/**
-	*	I[fBIVXepG[R[obN
+	*	オーディオシステム用エラーコールバック
 	*/
 	void ErrorCallback(const CriChar8* errid, CriUint32 p1, CriUint32 p2, CriUint32* parray)
 	{
@@ -24,28 +25,28 @@ namespace Audio
 		std::cerr << err << std::endl;
 	}
 
-	//I[fBIVXepAP[^
+	//オーディオシステム用アロケータ
 	void* Allocate(void* obj, CriUint32 size)
 	{
-		return new uint8_t[size];
+		return Memory::Allocate(Memory::Tag::Audio, size);
 	}
 
-	//I[fBIVXepŃAP[^
+	//オーディオシステム用でアロケータ
 	void Deallocate(void* obj, void* ptr)
 	{
-		delete[] static_cast<uint8_t*>(ptr);
+		Memory::Deallocate(ptr);
 	}
 
 	/**
-	*I[fBIVXe
+	*オーディオシステムを初期化する
 	*
-	*@param	acfPath	ACFt@C̃pX
-	*@param	acbPath	ACBt@C̃pX
-	*@param	awbPath	AWBt@C̃pX
-	*@param	dspBusName	D-BUS
+	*@param	acfPath	ACFファイルのパス
+	*@param	acbPath	ACBファイルのパス
+	*@param	awbPath	AWBファイルのパス
+	*@param	dspBusName	D-BUS名
 	*
-	*@retval	true	
-	*@retval	false	s
+	*@retval	true	初期化成功
+	*@retval	false	初期化失敗
 	*/
 	bool Initialize(const char* acfPath, const char* acbPath, const char* awbPath, const char* dspBusName)
 	{
@@ -85,7 +86,7 @@ namespace Audio
 	}
 
 	/**
-	*	I[fBIVXej
+	*	オーディオシステムを破棄する
 	*/
 	void Destroy()
 	{
@@ -116,7 +117,7 @@ namespace Audio
 	}
 
 	/**
-	*	I[fBIVXȅԂXV
+	*	オーディオシステムの状態を更新する
 	*/
 	void Update()
 	{
@@ -124,10 +125,10 @@ namespace Audio
 	}
 
 	/**
-	*	Đ
+	*	音声を再生する
 	*
-	*@param	playerId	ĐɎgpvC[ID
-	*@param	cueId		ĐL[ID
+	*@param	playerId	再生に使用するプレイヤーのID
+	*@param	cueId		再生するキューのID
 	*/
 	void Play(int playerId, int cueId)
 	{
@@ -136,9 +137,9 @@ namespace Audio
 	}
 
 	/**
-	*	~
+	*	音声を停止する
 	*
-	*@param	playerId	Đ~vC[ID
+	*@param	playerId	再生を停止するプレイヤーのID
 	*/
 	void Stop(int playerId)
 	{
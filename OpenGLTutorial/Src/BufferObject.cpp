@@ -4,12 +4,12 @@
 #include "BufferObject.h"
 
 /**
-*obt@IuWFNg쐬
+*バッファオブジェクトを作成する
 *
-*@param	target	obt@IuWFNg̎
-*@param	size	_f[^̃TCY
-*@param	data	_f[^ւ̃|C^
-*@param	usage	obt@IuWFNg̃ANZX^Cv
+*@param	target	バッファオブジェクトの種類
+*@param	size	頂点データのサイズ
+*@param	data	頂点データへのポインタ
+*@param	usage	バッファオブジェクトのアクセスタイプ
 */
 void BufferObject::Init(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
 {
@@ -21,7 +21,7 @@ void BufferObject::Init(GLenum target, GLsizeiptr size, const GLvoid* data, GLen
 }
 
 /**
-*	BufferObjectj
+*	BufferObjectを破棄する
 */
 void BufferObject::Destroy()
 {
@@ -33,10 +33,10 @@ void BufferObject::Destroy()
 }
 
 /**
-*VBO쐬
+*VBOを作成する
 *
-*@param	vbo	_obt@IuWFNgID
-*@param ibo	CfbNXobt@IuWFNgID
+*@param	vbo	頂点バッファオブジェクトのID
+*@param ibo	インデックスバッファオブジェクトのID
 */
 void VertexArrayObject::Init(GLuint vbo, GLuint ibo)
 {
@@ -49,7 +49,7 @@ void VertexArrayObject::Init(GLuint vbo, GLuint ibo)
 }
 
 /**
-*	VBOj
+*	VBOを破棄する
 */
 void VertexArrayObject::Destroy()
 {
@@ -61,14 +61,14 @@ void VertexArrayObject::Destroy()
 }
 
 /**
-*_Agr[gݒ肷
+*頂点アトリビュートを設定する
 *
-*@param index	_Agr[g̃CfbNX
-*@param	size	_Agr[g̗vf
-*@param	type	_Agr[ǧ^
-*@param	normalized	GL_TRUE = vf𐳋KAGL_FALSE = KȂ
-*@param	stride	̒_f[^܂ł̃oCg
-*@param	offset	_f[^擪̃oCgItZbg
+*@param index	頂点アトリビュートのインデックス
+*@param	size	頂点アトリビュートの要素数
+*@param	type	頂点アトリビュートの型
+*@param	normalized	GL_TRUE = 要素を正規化する、GL_FALSE = 正規化しない
+*@param	stride	次の頂点データまでのバイト数
+*@param	offset	頂点データ先頭からのバイトオフセット
 */
 void VertexArrayObject::VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
 {
@@ -77,7 +77,7 @@ void VertexArrayObject::VertexAttribPointer(GLuint index, GLint size, GLenum typ
 }
 
 /**
-*	VAOΏۂɂ
+*	VAOを処理対象にする
 */
 void VertexArrayObject::Bind() const
 {
@@ -85,7 +85,7 @@ void VertexArrayObject::Bind() const
 }
 
 /**
-*	VAOΏۂO
+*	VAOを処理対象から外す
 */
 void VertexArrayObject::Unbind() const
 {
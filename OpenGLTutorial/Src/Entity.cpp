@@ -3,37 +3,96 @@
 */
 
 #include "Entity.h"
+#include "JobSystem.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <algorithm>
+#include <math.h>
 
 /**
-*GeBeBɊւR[hi[閼O
+*エンティティに関するコードを格納する名前空間
 */
 namespace Entity
 {
 	/**
-	* VertexDataUBOɓ].
+	* VertexDataをUBOに転送する.
 	*
 	* @param entity
 	* @param ubo
 	* @param matViewProjection
+	* @param mesh	エンティティのメッシュ(量子化されていれば座標の復元に使う)
+	* @param texture	エンティティのテクスチャ(テクスチャ配列のレイヤーならその番号を渡す)
 	*/
-	void UpdateUniformVertexData(Entity& entity, void* ubo, const glm::mat4& matVP)
+	void UpdateUniformVertexData(Entity& entity, void* ubo, const glm::mat4& matVP,
+		const Mesh::Mesh* mesh, const Texture* texture)
 	{
 		Uniform::VertexData data;
 		data.matModel = entity.CalcModelMatrix();
 		data.matNormal = glm::mat4_cast(entity.Rotation());
+		//量子化した頂点座標は、モデル行列に復元行列を掛けてシェーダ内で元に戻す
+		if (mesh && mesh->Format() == Mesh::VertexFormat::Packed)
+		{
+			data.matModel = data.matModel * mesh->DequantizeMatrix();
+		}
 		data.matMVP = matVP * data.matModel;
 		data.color = entity.Color();
+		data.textureLayer = glm::ivec4(texture ? texture->Layer() : 0, 0, 0, 0);
 		memcpy(ubo, &data, sizeof(data));
 	}
 
 
 	/**
-	*ړE]Egks擾
+	*画面に映る大きさから詳細度を選ぶ
+	*
+	*@param	mesh		エンティティのメッシュ
+	*@param	matModel	エンティティのモデル行列
+	*@param	scale		エンティティの拡大率
+	*@param	currentLod	前のフレームで選んだ詳細度
+	*@param	matView		ビュー行列
+	*@param	matProj		プロジェクション行列
+	*@param	settings	詳細度を選ぶ基準
+	*
+	*@return 選んだ詳細度
+	*
+	*前のフレームの詳細度から1段階ずつ、ヒステリシスを考慮した基準を越えている間だけ移動する
+	*/
+	int SelectLod(const Mesh::Mesh& mesh, const glm::mat4& matModel, const glm::vec3& scale,
+		int currentLod, const glm::mat4& matView, const glm::mat4& matProj, const LodSettings& settings)
+	{
+		const int lodCount = mesh.LodCount();
+		if (lodCount <= 1)
+		{
+			return 0;
+		}
+		//境界ボックスを囲む球を、拡大率の最大値で大きくして使う
+		const glm::vec3 center = (mesh.BoundsMin() + mesh.BoundsMax()) * 0.5f;
+		const float radius = glm::length(mesh.BoundsMax() - mesh.BoundsMin()) * 0.5f *
+			std::max(fabsf(scale.x), std::max(fabsf(scale.y), fabsf(scale.z)));
+		const glm::vec4 posView = matView * matModel * glm::vec4(center, 1);
+		const float depth = -posView.z;
+		if (depth <= radius)
+		{
+			return 0;
+		}
+		//NDCの高さは2なので、直径(2r)の投影を2で割った値が画面の高さに占める割合になる
+		const float screenSize = radius * matProj[1][1] / depth;
+
+		int lod = std::min(currentLod, lodCount - 1);
+		while (lod < lodCount - 1 && screenSize < settings.screenSize[lod] * (1.0f - settings.hysteresis))
+		{
+			++lod;
+		}
+		while (lod > 0 && screenSize > settings.screenSize[lod - 1] * (1.0f + settings.hysteresis))
+		{
+			--lod;
+		}
+		return lod;
+	}
+
+	/**
+	*移動・回転・拡縮行列を取得する
 	*
-	*@return TRS	s
+	*@return TRS	行列
 	*/
 	glm::mat4 Entity::CalcModelMatrix() const
 	{
@@ -44,9 +103,9 @@ namespace Entity
 	}
 
 	/**
-	*GeBeBj
+	*エンティティを破棄する
 	*
-	*̊֐ĂяóAGeBeB𑀍삵Ă͂ȂȂ
+	*この関数を呼び出した後は、エンティティを操作してはならない
 	*/
 	void Entity::Destroy()
 	{
@@ -57,9 +116,9 @@ namespace Entity
 	}
 
 	/**
-	*gNXg؂藣
+	*自分自身をリンクリストから切り離す
 	*
-	*͂ǂɂڑĂȂԂɂȂ
+	*自分はどこにも接続されていない状態になる
 	*/
 	void Buffer::Link::Remove()
 	{
@@ -70,11 +129,11 @@ namespace Entity
 	}
 
 	/**
-	*NIuWFNg̎Oɒǉ
+	*リンクオブジェクトを自分の手前に追加する
 	*
-	*@param	p	ǉGCNIuWFNgւ̃|C^
+	*@param	p	追加する絵インクオブジェクトへのポインタ
 	*
-	*p̃NXg؂藣A̎Oɒǉ
+	*pを所属元のリンクリストから切り離し、自分の手前に追加する
 	*/
 	void Buffer::Link::Insert(Link* p)
 	{
@@ -86,14 +145,14 @@ namespace Entity
 	}
 
 	/**
-	*GeBeBobt@쐬
+	*エンティティバッファを作成する
 	*
-	*@param	maxEntityCount	GeBeB̍ő吔
-	*@param	uboSizePerEntity	GeBeBƂUniform Buffer̃oCg
-	*@param	bindingPoint	GeBeBpUBÕoCfBO|Cg
-	*@param	ubName		GeBeBpUniform Buffer̖O
+	*@param	maxEntityCount	扱えるエンティティの最大数
+	*@param	uboSizePerEntity	エンティティごとのUniform Bufferのバイト数
+	*@param	bindingPoint	エンティティ用UBOのバインディングポイント
+	*@param	ubName		エンティティ用Uniform Bufferの名前
 	*
-	*@return 쐬GeBeBobt@ւ̃|C^
+	*@return 作成したエンティティバッファへのポインタ
 	*/
 	BufferPtr Buffer::Create(size_t maxEntityCount, GLsizeiptr uboSizePerEntity,
 		int bindingPoint, const char* ubName)
@@ -102,15 +161,17 @@ namespace Entity
 		BufferPtr p = std::make_shared<Impl>();
 		if (!p)
 		{
-			std::cerr << "WARNING in Entity::Buffer::Create: obt@̍쐬Ɏs" << std::endl;
+			std::cerr << "WARNING in Entity::Buffer::Create: バッファの作成に失敗" << std::endl;
 			return{};
 		}
 		p->ubo = UniformBuffer::Create(
 			maxEntityCount * uboSizePerEntity, bindingPoint, ubName);
-		p->buffer.reset(new LinkEntity[maxEntityCount]);
+		p->buffer = std::unique_ptr<LinkEntity[], EntityArrayDeleter>(
+			Memory::NewArray<LinkEntity, Memory::Tag::Entity>(maxEntityCount),
+			EntityArrayDeleter(maxEntityCount));
 		if (!p->ubo || !p->buffer)
 		{
-			std::cerr << "WARNING in Entity:;Buffer::Create: obt@̍쐬Ɏs" << std::endl;
+			std::cerr << "WARNING in Entity:;Buffer::Create: バッファの作成に失敗" << std::endl;
 			return{};
 		}
 		p->bufferSize = maxEntityCount;
@@ -125,23 +186,24 @@ namespace Entity
 			offset += uboSizePerEntity;
 		}
 		p->collisionHandlerList.reserve(maxGroupId);
+		p->updateList.reserve(maxEntityCount);
 		return p;
 	}
 
 	/**
-	*GeBeBǉ
-	*
-	*@param groupId		GeBeB̃O[vID
-	*@param position	GeBeB̍W
-	*@param mesh		GeBeB̕\Ɏgp郁bV
-	*@param texture		GeBeB̕\ɎgeNX`
-	*@param	program		GeBeB̕\ɎgpVF[_vO
-	*@param func		GeBeB̏ԂXV֐(܂͊֐IuWFNg)
-	*
-	*@return ǉGeBeBւ̃|C^
-	*		ȏGeBeBǉłȂꍇnullptrԂ
-	*		]g嗦ݒ肷ꍇ͂̃|C^oRōs
-	*		̃|C^AvP[VŕێKv͂Ȃ
+	*エンティティを追加する
+	*
+	*@param groupId		エンティティのグループID
+	*@param position	エンティティの座標
+	*@param mesh		エンティティの表示に使用するメッシュ
+	*@param texture		エンティティの表示に使うテクスチャ
+	*@param	program		エンティティの表示に使用するシェーダプログラム
+	*@param func		エンティティの状態を更新する関数(または関数オブジェクト)
+	*
+	*@return 追加したエンティティへのポインタ
+	*		これ以上エンティティを追加できない場合はnullptrが返される
+	*		回転や拡大率を設定する場合はこのポインタ経由で行う
+	*		このポインタをアプリケーション側で保持する必要はない
 	*/
 	Entity* Buffer::AddEntity(int groupId, const glm::vec3& position, const Mesh::MeshPtr& mesh,
 		const TexturePtr& texture, const Shader::ProgramPtr& program, Entity::UpdateFuncType func)
@@ -149,52 +211,135 @@ namespace Entity
 		if (freeList.prev == freeList.next)
 		{
 			std::cerr << "WARNING in Entity::Buffer::AddEntity: "
-				"󂫃GeBeB܂" << std::endl;
+				"空きエンティティがありません" << std::endl;
 			return nullptr;
 		}
 		if (groupId < 0 || groupId > maxGroupId)
 		{
-			std::cerr << "ERROR in Entity::Buffer::AddEntity: ͈͊ÕO[vID ( " <<
-				groupId << " ) n܂\n O[vID0~" << maxGroupId <<
-				"łȂ΂Ȃ܂" << std::endl;
+			std::cerr << "ERROR in Entity::Buffer::AddEntity: 範囲外のグループID ( " <<
+				groupId << " ) が渡されました\n グループIDは0~" << maxGroupId <<
+				"でなければなりません" << std::endl;
 			return nullptr;
 		}
 
 		LinkEntity* entity = static_cast<LinkEntity*> (freeList.prev);
-		activeList[groupId].Insert(entity);
-
-		entity->groupId = groupId;
-		entity->position = position;
-		entity->rotation = glm::quat();
-		entity->scale = glm::vec3(1, 1, 1);
-		entity->velocity = glm::vec3();
-		entity->mesh = mesh;
-		entity->texture = texture;
-		entity->program = program;
-		entity->updateFunc = func;
-		entity->isActive = true;
+		InitEntity(*entity, groupId, position, mesh, texture, program, func);
 		return entity;
 
 	}
 
 	/**
-	*GeBeB폜
+	*プレハブからエンティティを追加する
+	*
+	*@param prefab		生成するエンティティのプレハブ
+	*@param position	エンティティの座標
 	*
-	*@param	폜GeBeB̃|C^
+	*@return 追加したエンティティへのポインタ
+	*		これ以上エンティティを追加できない場合はnullptrが返される
+	*/
+	Entity* Buffer::AddEntity(const Prefab& prefab, const glm::vec3& position)
+	{
+		Entity* entity = nullptr;
+		AddEntityBatch(prefab, &position, nullptr, 1, &entity);
+		return entity;
+	}
+
+	/**
+	*プレハブからエンティティをまとめて追加する
+	*
+	*@param prefab		生成するエンティティのプレハブ
+	*@param positions	エンティティの座標の配列(count個)
+	*@param velocities	エンティティの速度の配列(count個)
+	*					nullptrの場合はプレハブの速度を使う
+	*@param count		追加するエンティティの数
+	*@param out			追加したエンティティへのポインタを受け取る配列(count個)
+	*					不要ならnullptrでよい
+	*
+	*@return 実際に追加できたエンティティの数
+	*
+	*空きエンティティリストの末尾から連続してcount個を取り出し、一回のループで初期化する
+	*グループIDの検査はバッチ全体で一度だけ行う
+	*/
+	size_t Buffer::AddEntityBatch(const Prefab& prefab, const glm::vec3* positions,
+		const glm::vec3* velocities, size_t count, Entity** out)
+	{
+		if (prefab.groupId < 0 || prefab.groupId > maxGroupId)
+		{
+			std::cerr << "ERROR in Entity::Buffer::AddEntityBatch: 範囲外のグループID ( " <<
+				prefab.groupId << " ) が渡されました\n グループIDは0~" << maxGroupId <<
+				"でなければなりません" << std::endl;
+			return 0;
+		}
+		size_t n = 0;
+		for (; n < count; ++n)
+		{
+			if (freeList.next == &freeList)
+			{
+				std::cerr << "WARNING in Entity::Buffer::AddEntityBatch: "
+					"空きエンティティがありません" << std::endl;
+				break;
+			}
+			LinkEntity* entity = static_cast<LinkEntity*>(freeList.prev);
+			InitEntity(*entity, prefab.groupId, positions[n], prefab.mesh, prefab.texture,
+				prefab.program, prefab.updateFunc);
+			entity->velocity = velocities ? velocities[n] : prefab.velocity;
+			entity->colLocal = prefab.collision;
+			if (out)
+			{
+				out[n] = entity;
+			}
+		}
+		return n;
+	}
+
+	/**
+	*取り出したエンティティをアクティブリストに繋ぎ、初期状態にする
+	*
+	*@param e			初期化するエンティティ
+	*@param groupId		エンティティのグループID
+	*@param position	エンティティの座標
+	*@param mesh		エンティティの表示に使用するメッシュ
+	*@param texture		エンティティの表示に使うテクスチャ
+	*@param	program		エンティティの表示に使用するシェーダプログラム
+	*@param func		エンティティの状態を更新する関数(または関数オブジェクト)
+	*/
+	void Buffer::InitEntity(LinkEntity& e, int groupId, const glm::vec3& position,
+		const Mesh::MeshPtr& mesh, const TexturePtr& texture, const Shader::ProgramPtr& program,
+		const Entity::UpdateFuncType& func)
+	{
+		activeList[groupId].Insert(&e);
+
+		e.groupId = groupId;
+		e.position = position;
+		e.rotation = glm::quat();
+		e.scale = glm::vec3(1, 1, 1);
+		e.velocity = glm::vec3();
+		e.mesh = mesh;
+		e.texture = texture;
+		e.program = program;
+		e.updateFunc = func;
+		e.lod = 0;
+		e.isActive = true;
+	}
+
+	/**
+	*エンティティを削除する
+	*
+	*@param	削除するエンティティのポインタ
 	*/
 	void Buffer::RemoveEntity(Entity* entity)
 	{
 		if (!entity || !entity->isActive)
 		{
 			std::cerr << "WARNING in Entity::Buffer::RmoveEntity: "
-				"ANeBuȃGeBeB폜悤Ƃ܂" << std::endl;
+				"非アクティブなエンティティを削除しようとしました" << std::endl;
 			return;
 		}
 		LinkEntity* p = static_cast<LinkEntity*>(entity);
 		if (p < &buffer[0] || p >= &buffer[bufferSize])
 		{
 			std::cerr << "WARNING in Entity::Buffer::RemoveEntity: "
-				"قȂobt@擾GeBeB폜悤Ƃ܂" << std::endl;
+				"異なるバッファから取得したエンティティを削除しようとしました" << std::endl;
 			return;
 		}
 		if (p == itrUpdate)
@@ -206,6 +351,13 @@ namespace Entity
 			itrUpdateRhs = p->prev;
 		}
 		freeList.Insert(p);
+		//描画スレッドのスナップショットがまだ使っているかもしれないので、解放は描画スレッドに任せる
+		if (retireQueue)
+		{
+			retireQueue->Retire(std::move(p->mesh));
+			retireQueue->Retire(std::move(p->texture));
+			retireQueue->Retire(std::move(p->program));
+		}
 		p->mesh.reset();
 		p->texture.reset();
 		p->program.reset();
@@ -214,7 +366,7 @@ namespace Entity
 	}
 
 	/**
-	*	`m̏Փ˔
+	*	矩形同士の衝突判定
 	*/
 	bool HasCollision(const CollisionData& lhs, const CollisionData& rhs)
 	{
@@ -226,28 +378,72 @@ namespace Entity
 
 
 	/**
-	*ANeBuȃGeBeB̏ԂXV
+	*範囲処理をジョブシステムで並列に実行する
 	*
-	*@param	delta	O̍XV̌oߎ
-	*@param	matView	Views
-	*@param	matProj	Projections
+	*@param	jobSystem	使用するジョブシステム(nullptrなら呼び出したスレッドで実行する)
+	*@param	count		処理する要素数
+	*@param	func		[begin, end)の範囲を処理する関数
+	*
+	*要素数が少ない場合は、ジョブを分配する手間の方が大きいので並列化しない
+	*/
+	void ParallelForEntities(JobSystem* jobSystem, size_t count, const JobSystem::RangeFuncType& func)
+	{
+		static const size_t minParallelCount = 256;
+		if (jobSystem && count >= minParallelCount)
+		{
+			jobSystem->ParallelFor(count, 0, func);
+		}
+		else
+		{
+			func(0, count);
+		}
+	}
+
+	/**
+	*	アクティブなエンティティをupdateListに集める
 	*/
-	void Buffer::Update(double delta, const glm::mat4& matView, const glm::mat4& matProj)
+	void Buffer::GatherActiveEntities()
 	{
-		//Wƃ[hWn̏Փˌ`XV
+		updateList.clear();
 		for (int groupId = 0; groupId <= maxGroupId; ++groupId)
 		{
 			for (Link* itr = activeList[groupId].next; itr != &activeList[groupId];
 				itr = itr->next)
 			{
-				LinkEntity& e = *static_cast<LinkEntity*>(itr);
-				e.position += e.velocity * static_cast<float>(delta);
+				updateList.push_back(static_cast<LinkEntity*>(itr));
+			}
+		}
+	}
+
+	/**
+	*アクティブなエンティティの状態を更新する
+	*
+	*@param	delta		前回の更新からの経過時間
+	*@param	matView		View行列
+	*@param	matProj		Projection行列
+	*@param	renderData	描画データの書き込み先
+	*@param	jobSystem	座標と描画データの更新を並列化するためのジョブシステム(nullptrなら並列化しない)
+	*
+	*エンティティの更新関数と衝突解決ハンドラは、常に呼び出したスレッドで実行される
+	*GLの関数は呼び出さないので、描画スレッド以外から呼び出してもよい
+	*/
+	void Buffer::Update(double delta, const glm::mat4& matView, const glm::mat4& matProj,
+		RenderData& renderData, JobSystem* jobSystem)
+	{
+		//座標とワールド座標系の衝突形状を更新する
+		GatherActiveEntities();
+		const float deltaF = static_cast<float>(delta);
+		ParallelForEntities(jobSystem, updateList.size(), [this, deltaF](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				LinkEntity& e = *updateList[i];
+				e.position += e.velocity * deltaF;
 				e.colWorld.min = e.colLocal.min + e.position;
 				e.colWorld.max = e.colLocal.max + e.position;
 			}
-		}
+		});
 
-		//Փ˔s
+		//衝突判定を実行する
 		for (const auto& e : collisionHandlerList)
 		{
 			if (!e.handler)
@@ -276,7 +472,7 @@ namespace Entity
 			}
 		}
 
-		//eGeBeB̏ԂXV
+		//各エンティティの状態を更新する
 		//uint8_t* p = static_cast<uint8_t*>(ubo->MapBuffer());
 		for (int groupId = 0;groupId <= maxGroupId; ++groupId)
 		{
@@ -289,61 +485,280 @@ namespace Entity
 					e.updateFunc(e, delta);
 				}
 			}
-			itrUpdate = nullptr;
-			itrUpdateRhs = nullptr;
-			//ubo->UnmapBuffer();
-
-			uint8_t* p = static_cast<uint8_t*>(ubo->MapBuffer());
-			const glm::mat4 matVP = matProj * matView;
-			for (int groupId = 0; groupId <= maxGroupId; ++groupId) {
-				for (itrUpdate = activeList[groupId].next; itrUpdate != &activeList[groupId];
-					itrUpdate = itrUpdate->next) {
-					LinkEntity& e = *static_cast<LinkEntity*>(itrUpdate);
-					UpdateUniformVertexData(e, p + e.uboOffset, matVP);
+		}
+		itrUpdate = nullptr;
+		itrUpdateRhs = nullptr;
+
+		//更新関数でエンティティが増減している可能性があるので、集め直してから描画データを作る
+		GatherActiveEntities();
+		renderData.uboData.resize(static_cast<size_t>(ubo->Size()));
+		renderData.drawList.resize(updateList.size());
+		renderData.uboUsedSize = 0;
+		for (const LinkEntity* e : updateList)
+		{
+			renderData.uboUsedSize = std::max(renderData.uboUsedSize, e->uboOffset + uboSizePerEntity);
+		}
+		uint8_t* p = renderData.uboData.data();
+		DrawPacket* packet = renderData.drawList.data();
+		const glm::mat4 matVP = matProj * matView;
+		ParallelForEntities(jobSystem, updateList.size(),
+			[this, p, packet, &matVP, &matView, &matProj](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				LinkEntity& e = *updateList[i];
+				UpdateUniformVertexData(e, p + e.uboOffset, matVP, e.mesh.get(), e.texture.get());
+				if (e.mesh)
+				{
+					e.lod = SelectLod(*e.mesh, e.CalcModelMatrix(), e.scale, e.lod, matView, matProj, lodSettings);
+				}
+				packet[i].mesh = e.mesh.get();
+				if (e.texture)
+				{
+					e.texture->MarkUsed();
 				}
+				packet[i].texture = e.texture ? e.texture->Id() : 0;
+				packet[i].textureTarget = e.texture ? e.texture->Target() : GL_TEXTURE_2D;
+				packet[i].program = e.program.get();
+				packet[i].uboOffset = e.uboOffset;
+				packet[i].lod = e.lod;
 			}
-			ubo->UnmapBuffer();
+		});
+
+		//閾値の調整に使えるよう、詳細度ごとの描画数と三角形数を集計する
+		lodStats = LodStats();
+		for (const DrawPacket& e : renderData.drawList)
+		{
+			if (e.mesh && e.texture && e.program)
+			{
+				++lodStats.drawCount[e.lod];
+				lodStats.triangleCount[e.lod] += e.mesh->TriangleCount(e.lod);
+			}
+		}
+		renderData.lodStats = lodStats;
+	}
+
+	/**
+	*デストラクタ
+	*/
+	Buffer::~Buffer()
+	{
+		if (indirectBuffer)
+		{
+			glDeleteBuffers(1, &indirectBuffer);
 		}
 	}
 
 	/**
-	*ANeBuȃGeBeB`悷
+	*間接描画に使うシェーダを登録する
+	*
+	*@param	program			エンティティに設定されているシェーダ
+	*@param	indirectProgram	programの代わりに間接描画で使うシェーダ
+	*
+	*@retval true	登録成功
+	*@retval false	登録失敗(間接描画を使えない設定)
 	*
-	*@param	meshBuffer	`Ɏgp郁bVobt@ւ̃|C^
+	*indirectProgramは、エンティティ用UBOをVertexDataの配列としてSSBO(バインディングポイント0)から読み、
+	*頂点アトリビュート4の描画データ番号で自分の要素を選ぶ
+	*登録のないシェーダを使うエンティティは、従来どおり1つずつ描画する
 	*/
-	void Buffer::Draw(const Mesh::BufferPtr& meshBuffer) const
+	bool Buffer::IndirectProgram(const Shader::ProgramPtr& program, const Shader::ProgramPtr& indirectProgram)
 	{
-		meshBuffer->BindVAO();
-		for (int groupId = 0; groupId <= maxGroupId; ++groupId)
+		if (!program || !indirectProgram)
+		{
+			return false;
+		}
+		//SSBOの配列として読むので、エンティティごとの領域がVertexData1つ分でなければならない
+		if (uboSizePerEntity != sizeof(Uniform::VertexData) || bufferSize > Mesh::maxDrawIdCount)
 		{
-			for (const Link* itr = activeList[groupId].next;itr != &activeList[groupId]; itr = itr->next)
+			std::cerr << "WARNING in Entity::Buffer::IndirectProgram: このバッファは間接描画に対応していません" <<
+				std::endl;
+			return false;
+		}
+		for (auto& e : indirectProgramList)
+		{
+			if (e.first == program.get())
 			{
-				const LinkEntity& e = *static_cast<const LinkEntity*>(itr);
-				if (e.mesh && e.texture && e.program)
+				e.second = indirectProgram;
+				return true;
+			}
+		}
+		indirectProgramList.push_back(std::make_pair(program.get(), indirectProgram));
+		return true;
+	}
+
+	/**
+	*間接描画用のシェーダを検索する
+	*
+	*@param	program	エンティティに設定されているシェーダ
+	*
+	*@return 対応する間接描画用のシェーダ
+	*		登録されていなければnullptr
+	*/
+	Shader::Program* Buffer::FindIndirectProgram(const Shader::Program* program) const
+	{
+		for (const auto& e : indirectProgramList)
+		{
+			if (e.first == program)
+			{
+				return e.second.get();
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	*描画命令を1つだけ描画する
+	*
+	*@param	meshBuffer	描画に使用するメッシュバッファへのポインタ
+	*@param	e			描画命令
+	*@param	boundFormat	現在VAOを割り当てている頂点データの形式
+	*/
+	void Buffer::DrawPacketDirect(const Mesh::BufferPtr& meshBuffer, const DrawPacket& e,
+		Mesh::VertexFormat& boundFormat) const
+	{
+		if (e.mesh->Format() != boundFormat)
+		{
+			boundFormat = e.mesh->Format();
+			meshBuffer->BindVAO(boundFormat);
+		}
+		e.program->UseProgram();
+		e.program->BindTexture(GL_TEXTURE0, e.textureTarget, e.texture);
+		ubo->BindBufferRange(e.uboOffset, uboSizePerEntity);
+		e.mesh->Draw(meshBuffer, e.lod);
+	}
+
+	/**
+	*エンティティを描画する
+	*
+	*@param	meshBuffer	描画に使用するメッシュバッファへのポインタ
+	*@param	renderData	Updateで作成した描画データ
+	*
+	*エンティティのリストには触れないので、別スレッドでUpdateを実行中でもよい
+	*
+	*間接描画用のシェーダが登録されていれば、描画命令を頂点形式、シェーダ、テクスチャの順に並べ替え、
+	*全エンティティのマテリアルを1つの間接描画バッファに詰めて、同じ状態の範囲ごとに
+	*glMultiDrawElementsIndirectを1回だけ呼び出す
+	*これにより、エンティティが増えてもCPU側の描画命令の発行数はほとんど増えない
+	*同じ大きさのテクスチャは1つのテクスチャ配列のレイヤーになっているので、画像が違っても同じ範囲に入る
+	*/
+	void Buffer::Draw(const Mesh::BufferPtr& meshBuffer, const RenderData& renderData)
+	{
+		if (renderData.uboUsedSize > 0)
+		{
+			ubo->BufferSubData(renderData.uboData.data(), 0, renderData.uboUsedSize);
+		}
+		Mesh::VertexFormat boundFormat = Mesh::VertexFormat::Float;
+		meshBuffer->BindVAO(boundFormat);
+
+		//間接描画できないものはその場で描画し、残りを状態ごとに並べ替える
+		sortedDrawList.clear();
+		for (const DrawPacket& e : renderData.drawList)
+		{
+			if (e.mesh && e.texture && e.program)
+			{
+				if (FindIndirectProgram(e.program))
 				{
-					e.program->UseProgram();
-					e.program->BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, e.texture->Id());
-					ubo->BindBufferRange(e.uboOffset, uboSizePerEntity);
-					e.mesh->Draw(meshBuffer);
+					sortedDrawList.push_back(&e);
 				}
+				else
+				{
+					DrawPacketDirect(meshBuffer, e, boundFormat);
+				}
+			}
+		}
+		if (sortedDrawList.empty())
+		{
+			return;
+		}
+		std::sort(sortedDrawList.begin(), sortedDrawList.end(), [](const DrawPacket* lhs, const DrawPacket* rhs) {
+			if (lhs->mesh->Format() != rhs->mesh->Format())
+			{
+				return lhs->mesh->Format() < rhs->mesh->Format();
+			}
+			if (lhs->program != rhs->program)
+			{
+				return lhs->program < rhs->program;
+			}
+			return lhs->texture < rhs->texture;
+		});
+
+		//状態が変わるところで区切りながら、描画コマンドを作る
+		commandList.clear();
+		batchList.clear();
+		const DrawPacket* prev = nullptr;
+		for (const DrawPacket* e : sortedDrawList)
+		{
+			if (!prev || e->mesh->Format() != prev->mesh->Format() || e->program != prev->program ||
+				e->texture != prev->texture)
+			{
+				IndirectBatch batch;
+				batch.format = e->mesh->Format();
+				batch.program = FindIndirectProgram(e->program);
+				batch.texture = e->texture;
+				batch.textureTarget = e->textureTarget;
+				batch.firstCommand = commandList.size();
+				batch.commandCount = 0;
+				batchList.push_back(batch);
+				prev = e;
+			}
+			const GLuint drawId = static_cast<GLuint>(e->uboOffset / uboSizePerEntity);
+			batchList.back().commandCount += e->mesh->AppendDrawCommands(meshBuffer, e->lod, drawId, commandList);
+		}
+		if (commandList.empty())
+		{
+			return;
+		}
+
+		//コマンドは1回の転送でまとめて送る
+		const GLsizeiptr commandBytes = commandList.size() * sizeof(Mesh::DrawCommand);
+		if (!indirectBuffer)
+		{
+			glGenBuffers(1, &indirectBuffer);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		if (commandBytes > indirectBufferSize)
+		{
+			indirectBufferSize = std::max(commandBytes, indirectBufferSize * 2);
+		}
+		//前のフレームの描画が終わるのを待たないよう、毎回領域を確保し直す
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectBufferSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commandBytes, commandList.data());
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ubo->Id());
+		for (const IndirectBatch& batch : batchList)
+		{
+			if (batch.commandCount == 0)
+			{
+				continue;
+			}
+			if (batch.format != boundFormat)
+			{
+				boundFormat = batch.format;
+				meshBuffer->BindVAO(boundFormat);
 			}
+			batch.program->UseProgram();
+			batch.program->BindTexture(GL_TEXTURE0, batch.textureTarget, batch.texture);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				reinterpret_cast<const GLvoid*>(batch.firstCommand * sizeof(Mesh::DrawCommand)),
+				static_cast<GLsizei>(batch.commandCount), 0);
 		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	}
 
 	/**
-	*Փˉnhݒ肷
+	*衝突解決ハンドラを設定する
 	*
-	*@param	gid0	ՓˑΏۂ̃O[vID
-	*@param	gid1	ՓˑΏۂ̃O[vID
-	*@param	handler	Փˉnh
+	*@param	gid0	衝突対象のグループID
+	*@param	gid1	衝突対象のグループID
+	*@param	handler	衝突解決ハンドラ
 	*
-	*Փ˂ՓˉnhĂяoƂA菬O[vIDGeBeBɓn
-	*Ŏw肵O[vID̏Ƃ͖֌Wł邱Ƃɒ
+	*衝突が発生し衝突解決ハンドラが呼び出されるとき、より小さいグループIDを持つエンティティから先に渡される
+	*ここで指定したグループIDの順序とは無関係であることに注意
 	*ex)
 	*CollisionHandler(10,1,Func)
-	ƂR[hŃnho^ƂAՓ˂
-	*Funk(O[vID = 1̃GeBeBAO[vID = 10̃GeBeB
-	*̂悤ɌĂяo
+	というコードでハンドラを登録したとする、衝突が発生すると
+	*Funk(グループID = 1のエンティティ、グループのID = 10のエンティティ
+	*のように呼び出される
 	*/
 	void Buffer::CollisionHandler(int gid0, int gid1, CollisionHandlerType handler)
 	{
@@ -366,12 +781,12 @@ namespace Entity
 	}
 
 	/**
-	*Փˉnh擾
+	*衝突解決ハンドラを取得する
 	*
-	*@param	gid0	ՓˑΏۂ̃O[vID
-	*@param	gid1	ՓˑΏۂ̃O[vID
+	*@param	gid0	衝突対象のグループID
+	*@param	gid1	衝突対象のグループID
 	*
-	*@return Փˉnh
+	*@return 衝突解決ハンドラ
 	*/
 	const CollisionHandlerType& Buffer::CollisionHandler(int gid0, int gid1) const
 	{
@@ -392,7 +807,7 @@ namespace Entity
 	}
 
 	/**
-	*	SĂ̏Փˉnh폜
+	*	全ての衝突解決ハンドラを削除する
 	*/
 	void Buffer::ClearCollisionHandlerList()
 	{
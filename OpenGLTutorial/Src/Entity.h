@@ -7,27 +7,33 @@
 #include "Texture.h"
 #include "Shader.h"
 #include "UniformBuffer.h"
+#include "RetireQueue.h"
 #include <glm/glm.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <memory>
 #include <functional>
 #include <vector>
 #include "Uniform.h"
+#include "Memory.h"
+
+class JobSystem;
 
 namespace Entity
 {
 	class Entity;
 	class Buffer;
-	typedef std::shared_ptr<Buffer> BufferPtr; //GeBeBobt@|C^^
+	struct Prefab;
+	typedef std::shared_ptr<Buffer> BufferPtr; //エンティティバッファポインタ型
+	typedef std::shared_ptr<Prefab> PrefabPtr; //プレハブポインタ型
 
-	//Փˉnh^
+	//衝突解決ハンドラ型
 	typedef std::function<void(Entity&, Entity&)> CollisionHandlerType;
 
-	//O[vID̍ől
+	//グループIDの最大値
 	static const int maxGroupId = 31;
 
 	/**
-	*	Փ˔`
+	*	衝突判定形状
 	*/
 	struct CollisionData
 	{
@@ -36,14 +42,14 @@ namespace Entity
 	};
 
 	 /**
-	 *GeBeB
+	 *エンティティ
 	 */
 	class Entity
 	{
 		friend class Buffer;
 
 	public:
-		///ԍXV֐^
+		///状態更新関数型
 		typedef std::function<
 			void(Entity&, double) > UpdateFuncType;
 
@@ -74,31 +80,98 @@ namespace Entity
 		Entity& operator = (const Entity&) = default;
 
 	private:
-		//O[vID
+		//グループID
 		int groupId = -1;
-		//BufferNXւ̃|C^
+		//生成元のBufferクラスへのポインタ
 		Buffer* pBuffer = nullptr;
-		glm::vec3 position;		///<W
-		glm::vec3 scale = glm::vec3(1, 1, 1);		///<g嗦
-		glm::quat rotation;		///<]
-		glm::vec3 velocity;		///<x
-		UpdateFuncType updateFunc;	///<ԍXV֐
-		Mesh::MeshPtr mesh;		///<GeBeB`悷鎞Ɏg郁bVf[^
-		TexturePtr texture;		///<GeBeB`悷鎞ɎgeNX`
-		Shader::ProgramPtr program;	///GeBeB`悷鎞ɎgVF[_
-		GLintptr uboOffset;		///<UBÕGeBeBp̈ւ̃oCgItZbg
-		//[JWn̏Փˌ`
+		glm::vec3 position;		///<座標
+		glm::vec3 scale = glm::vec3(1, 1, 1);		///<拡大率
+		glm::quat rotation;		///<回転
+		glm::vec3 velocity;		///<速度
+		UpdateFuncType updateFunc;	///<状態更新関数
+		Mesh::MeshPtr mesh;		///<エンティティを描画する時に使われるメッシュデータ
+		TexturePtr texture;		///<エンティティを描画する時に使われるテクスチャ
+		Shader::ProgramPtr program;	///エンティティを描画する時に使われるシェーダ
+		GLintptr uboOffset;		///<UBOのエンティティ用領域へのバイトオフセット
+		//ローカル座標系の衝突形状
 		CollisionData colLocal;
-		//[hWn̏Փˌ`
+		//ワールド座標系の衝突形状
 		CollisionData colWorld;
-		//F
+		//色情報
 		glm::vec4 color = glm::vec4(1, 1, 1, 1);
+		int lod = 0;	///<前のフレームで選んだ詳細度(ヒステリシスに使う)
+
+		bool isActive = false;	///<アクティブなエンティティならtrue,非アクティブならfalse
+	};
 
-		bool isActive = false;	///<ANeBuȃGeBeBȂtrue,ANeBuȂfalse
+	/**
+	*	エンティティの雛形(プレハブ)
+	*
+	*	メッシュやテクスチャを登録時に一度だけ解決しておき、
+	*	生成のたびに名前で検索しなくて済むようにする
+	*/
+	struct Prefab
+	{
+		int groupId = -1;	///<グループID
+		Mesh::MeshPtr mesh;	///<表示に使うメッシュ
+		TexturePtr texture;	///<表示に使うテクスチャ
+		Shader::ProgramPtr program;	///<表示に使うシェーダ
+		CollisionData collision;	///<ローカル座標系の衝突形状
+		Entity::UpdateFuncType updateFunc;	///<状態更新関数
+		glm::vec3 velocity;	///<初期速度
 	};
 
 	/**
-	*GeBeBobt@
+	*	詳細度(LOD)を選ぶ基準
+	*
+	*	画面に映る大きさ(境界球の直径が画面の高さに占める割合)がscreenSize[i]を下回ると、
+	*	詳細度i+1を使う
+	*	境界付近で詳細度が毎フレーム切り替わらないよう、hysteresisの割合だけ基準をずらして判定する
+	*/
+	struct LodSettings
+	{
+		float screenSize[Mesh::maxLodCount - 1] = { 0.25f, 0.12f, 0.05f };	///<各詳細度に切り替える大きさ
+		float hysteresis = 0.1f;	///<切り替えを遅らせる割合
+	};
+
+	/**
+	*	1フレーム分の詳細度ごとの描画統計
+	*/
+	struct LodStats
+	{
+		size_t drawCount[Mesh::maxLodCount] = {};	///<詳細度ごとの描画数
+		size_t triangleCount[Mesh::maxLodCount] = {};	///<詳細度ごとの三角形数の合計
+	};
+
+	/**
+	*	描画スレッドに渡すエンティティ1つ分の描画命令
+	*
+	*	シミュレーション側でエンティティが削除されても描画に影響しないよう、必要な値だけを複製しておく
+	*	meshとprogramが指すオブジェクトは、エンティティの削除後もRetireQueueによってこの描画命令の間は生存する
+	*/
+	struct DrawPacket
+	{
+		const Mesh::Mesh* mesh;	///<描画するメッシュ
+		GLuint texture;	///<描画に使うテクスチャ
+		GLenum textureTarget;	///<テクスチャの種類(テクスチャ配列ならGL_TEXTURE_2D_ARRAY)
+		Shader::Program* program;	///<描画に使うシェーダ
+		GLintptr uboOffset;	///<UBOのエンティティ用領域へのバイトオフセット
+		int lod;	///<描画する詳細度
+	};
+
+	/**
+	*	1フレーム分のエンティティの描画データ
+	*/
+	struct RenderData
+	{
+		Memory::Vector<uint8_t, Memory::Tag::Entity> uboData;	///<UBOに転送するデータ
+		GLsizeiptr uboUsedSize = 0;	///<uboDataのうち転送が必要なバイト数
+		Memory::Vector<DrawPacket, Memory::Tag::Entity> drawList;	///<描画命令の配列
+		LodStats lodStats;	///<詳細度ごとの描画統計
+	};
+
+	/**
+	*エンティティバッファ
 	*/
 	class Buffer
 	{
@@ -108,22 +181,32 @@ namespace Entity
 
 		Entity* AddEntity(int grooupId, const glm::vec3& pos, const Mesh::MeshPtr& m, const TexturePtr& t,
 			const Shader::ProgramPtr& p, Entity::UpdateFuncType func);
+		Entity* AddEntity(const Prefab& prefab, const glm::vec3& pos);
+		size_t AddEntityBatch(const Prefab& prefab, const glm::vec3* positions,
+			const glm::vec3* velocities, size_t count, Entity** out = nullptr);
 		void RemoveEntity(Entity* entity);
-		void Update(double delta, const glm::mat4& matView, const glm::mat4& matProj);
-		void Draw(const Mesh::BufferPtr& meshBuffer) const;
+		void Update(double delta, const glm::mat4& matView, const glm::mat4& matProj,
+			RenderData& renderData, JobSystem* jobSystem = nullptr);
+		void Draw(const Mesh::BufferPtr& meshBuffer, const RenderData& renderData);
+		bool IndirectProgram(const Shader::ProgramPtr& program, const Shader::ProgramPtr& indirectProgram);
+		void SetRetireQueue(RetireQueue* queue) { retireQueue = queue; }
 
 		void CollisionHandler(int gid0, int gid1, CollisionHandlerType handler);
 		const CollisionHandlerType& CollisionHandler(int gid0, int gid1) const;
 		void ClearCollisionHandlerList();
 
+		void Lod(const LodSettings& settings) { lodSettings = settings; }
+		const LodSettings& Lod() const { return lodSettings; }
+		const LodStats& GetLodStats() const { return lodStats; }
+
 	private:
 		Buffer() = default;
-		~Buffer() = default;
+		~Buffer();
 		Buffer(const Buffer&) = delete;
 		Buffer& operator = (const Buffer&) = delete;
 
 	private:
-		//GeBeBpNXg
+		//エンティティ用リンクリスト
 		struct Link
 		{
 			void Insert(Link* e);
@@ -132,26 +215,42 @@ namespace Entity
 			Link* next = this;
 		};
 
-		//NtGeBeB
+		//リンク付きエンティティ
 		struct LinkEntity : public Link,public Entity{};
-		//NtGeBeBz̍폜p֐IuWFNg
-		struct EntityArrayDeleter { void operator() (LinkEntity* p) { delete[] p; } };
+		//リンク付きエンティティ配列の削除用関数オブジェクト
+		struct EntityArrayDeleter
+		{
+			EntityArrayDeleter() : count(0) {}
+			explicit EntityArrayDeleter(size_t n) : count(n) {}
+			void operator() (LinkEntity* p) { Memory::DeleteArray(p, count); }
+			size_t count;	///<配列の要素数
+		};
+
+		void GatherActiveEntities();
+		void DrawPacketDirect(const Mesh::BufferPtr& meshBuffer, const DrawPacket& e,
+			Mesh::VertexFormat& boundFormat) const;
+		Shader::Program* FindIndirectProgram(const Shader::Program* program) const;
+
+		void InitEntity(LinkEntity& e, int groupId, const glm::vec3& pos, const Mesh::MeshPtr& m,
+			const TexturePtr& t, const Shader::ProgramPtr& p, const Entity::UpdateFuncType& func);
 
-		//GeBeB̔z
+		//エンティティの配列
 		std::unique_ptr<LinkEntity[], EntityArrayDeleter> buffer;
-		//GeBeB̑
+		//エンティティの総数
 		size_t bufferSize;
-		//gp̃GeBeB̃NXg
+		//未使用のエンティティのリンクリスト
 		Link freeList;
-		//gp̃GeBeB̃NXg
+		//使用中のエンティティのリンクリスト
 		Link  activeList[maxGroupId + 1];
-		//eGeBeBgUniform Buffer̃oCg
+		//各エンティティが使えるUniform Bufferのバイト数
 		GLsizeiptr uboSizePerEntity;
-		//GeBeBpUBO
+		//エンティティ用UBO
 		UniformBufferPtr ubo;
-		//UpdateRemoveEntity̑ݍpɑΉ邽߂̃Ce[^
+		//UpdateとRemoveEntityの相互作用に対応するためのイテレータ
 		Link* itrUpdate = nullptr;
 		Link* itrUpdateRhs = nullptr;
+		//並列処理のためにアクティブなエンティティを集めた配列
+		std::vector<LinkEntity*> updateList;
 
 		struct CollisionHandlerInfo
 		{
@@ -159,6 +258,33 @@ namespace Entity
 			CollisionHandlerType handler;
 		};
 		std::vector<CollisionHandlerInfo> collisionHandlerList;
+
+		LodSettings lodSettings;	///<詳細度を選ぶ基準
+		RetireQueue* retireQueue = nullptr;	///<削除したエンティティのメッシュ、テクスチャ、シェーダを描画スレッドで手放す
+		LodStats lodStats;	///<最後のUpdateの詳細度ごとの描画統計
+
+		/**
+		*	同じ状態でまとめて描画する間接描画コマンドの範囲
+		*/
+		struct IndirectBatch
+		{
+			Mesh::VertexFormat format;	///<頂点データの形式
+			Shader::Program* program;	///<間接描画用のシェーダ
+			GLuint texture;	///<描画に使うテクスチャ
+			GLenum textureTarget;	///<テクスチャの種類
+			size_t firstCommand;	///<commandList内の先頭コマンド番号
+			size_t commandCount;	///<コマンド数
+		};
+
+		//通常のシェーダと、それに対応する間接描画用シェーダの組
+		std::vector<std::pair<const Shader::Program*, Shader::ProgramPtr>> indirectProgramList;
+
+		//以下は描画スレッドから使う
+		std::vector<const DrawPacket*> sortedDrawList;	///<状態ごとに並べ替えた描画命令
+		std::vector<Mesh::DrawCommand> commandList;	///<間接描画コマンドの配列
+		std::vector<IndirectBatch> batchList;	///<状態ごとのコマンドの範囲
+		GLuint indirectBuffer = 0;	///<間接描画コマンドを格納するバッファ
+		GLsizeiptr indirectBufferSize = 0;	///<indirectBufferのバイト数
 	};
 
 
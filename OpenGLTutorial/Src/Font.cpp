@@ -8,41 +8,33 @@
 #include <stdio.h>
 
 /**
-*	tHg`@\i[閼O
+*	フォント描画機能を格納する名前空間
 */
 namespace Font
 {
-	/**
-	*	tHgp_f[^^
-	*/
-	struct Vertex
-	{
-		glm::vec2 position;
-		glm::u16vec2 uv;
-		glm::u8vec4 color;
-	};
 
 	/**
-	*tHg`IuWFNg
+	*フォント描画オブジェクトを初期化する
 	*
-	*@param	maxChar	ő`敶
-	*@param	screen	`̃XN[̑傫
+	*@param	maxChar	最大描画文字数
+	*@param	screen	描画先のスクリーンの大きさ
 	*
-	*@retval	true	
-	*@retval	false	s
+	*@retval	true	初期化成功
+	*@retval	false	初期化失敗
 	*/
 	bool Renderer::Init(size_t maxChar, const glm::vec2& screen)
 	{
 		if (maxChar > (USHRT_MAX + 1) / 4)
 		{
-			std::cerr << "WARNING : " << maxChar << " ͐ݒ\ȍő啶𒴂Ă܂" << std::endl;
+			std::cerr << "WARNING : " << maxChar << " は設定可能な最大文字数を超えています" << std::endl;
 			maxChar = (USHRT_MAX + 1) / 4;
 		}
 
 		vboCapacity = static_cast<GLsizei>(4 * maxChar);
 		vbo.Init(GL_ARRAY_BUFFER, sizeof(Vertex) * vboCapacity, nullptr, GL_STREAM_DRAW);
+		vertexList.reserve(vboCapacity);
 		{
-			std::vector<GLushort>tmp;
+			Memory::Vector<GLushort, Memory::Tag::Font> tmp;
 			tmp.resize(maxChar * 6);
 			GLushort* p = tmp.data();
 			for (GLushort i = 0; i < maxChar * 4;i += 4)
@@ -72,23 +64,53 @@ namespace Font
 	}
 
 	/**
-	*tHgt@Cǂݍ
+	*フォントファイルを読み込む
 	*
-	*@param	filename tHgt@C
+	*@param	filename フォントファイル名
 	*
-	*@retval	true	ǂݍݐ
-	*@retval	false	ǂݍݎs
+	*@retval	true	読み込み成功
+	*@retval	false	読み込み失敗
 	*/
 	bool Renderer::LoadFromFile(const char* filename)
+	{
+		FontFile file;
+		if (!ParseFile(filename, file))
+		{
+			return false;
+		}
+		//テクスチャを読み込む
+		GameEngine& game = GameEngine::Instance();
+		if (!game.LoadTextureFromFile(file.texFilename.c_str(), false))
+		{
+			return false;
+		}
+		//描画のたびに名前で検索しなくて済むよう、ハンドルを保持しておく
+		Apply(file, game.FindTexture(file.texFilename));
+		return true;
+	}
+
+	/**
+	*フォントファイルを解析する
+	*
+	*@param	filename	フォントファイル名
+	*@param	out			解析結果の格納先
+	*
+	*@retval	true	解析成功
+	*@retval	false	解析失敗
+	*
+	*フォント画像は読み込まないので、texFilenameを使って別途読み込むこと
+	*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+	*/
+	bool Renderer::ParseFile(const char* filename, FontFile& out)
 	{
 		const std::unique_ptr<FILE, decltype(&fclose) > fp(fopen(filename, "r"), fclose);
 		if (!fp)
 		{
-			std::cerr << "ERROR : ' " << filename << " ' ̃I[vɎs" << std::endl;
+			std::cerr << "ERROR : ' " << filename << " ' のオープンに失敗" << std::endl;
 			return false;
 		}
 
-		//tHgt@C̏̍s
+		//フォントファイルの処理中の行
 		int line = 1;
 		int ret = fscanf(fp.get(),
 			"info face=%*s size=%*d bold=%*d italic=%*d charset=%*s unicode=%*d"
@@ -101,32 +123,34 @@ namespace Font
 			&scale.x, &scale.y);
 		if (ret < 2)
 		{
-			std::cerr << "ERROR : ' " << filename << " ' ̓ǂݍ݂Ɏs(line = " << line << ")" << std::endl;
+			std::cerr << "ERROR : ' " << filename << " ' の読み込みに失敗(line = " << line << ")" << std::endl;
 			return false;
 		}
 		const glm::vec2 reciprocalScale(1.0f / scale);
-		screenScale = scale / screenSize;
+		out.scale = scale;
 		++line;
 
 		char tex[128];
 		ret = fscanf(fp.get(), " page id=%*d file=%127s", tex);
 		if (ret < 1)
 		{
-			std::cerr << "ERROR : ' " << filename << " ' ̓ǂݍ݂Ɏs(line = " << line << ")" << std::endl;
+			std::cerr << "ERROR : ' " << filename << " ' の読み込みに失敗(line = " << line << ")" << std::endl;
 			return false;
 		}
-		texFilename.assign(tex + 1, tex + strlen(tex) - 1);
+		out.texFilename.assign(tex + 1, tex + strlen(tex) - 1);
 		++line;
 
 		int charCount;
 		ret = fscanf(fp.get(), " chars count = %d", &charCount);
 		if (ret < 1)
 		{
-			std::cerr << "ERROR : ' " << filename << " ' ̓ǂݍ݂Ɏs(line = " << line << ")" << std::endl;
+			std::cerr << "ERROR : ' " << filename << " ' の読み込みに失敗(line = " << line << ")" << std::endl;
 			return false;
 		}
 		++line;
 
+		Memory::Vector<FontInfo, Memory::Tag::Font>& fontList = out.fontList;
+		fontList.clear();
 		fontList.resize(128);
 		for (int i = 0;i < charCount; ++i)
 		{
@@ -138,7 +162,7 @@ namespace Font
 
 			if (ret < 8)
 			{
-				std::cerr << "ERROR : ' " << filename << " ' ̓ǂݍ݂Ɏs(line = " << line << ")" << std::endl;
+				std::cerr << "ERROR : ' " << filename << " ' の読み込みに失敗(line = " << line << ")" << std::endl;
 				return false;
 			}
 			font.uv *= reciprocalScale;
@@ -153,18 +177,30 @@ namespace Font
 			}
 			++line;
 		}
-		//eNX`ǂݍ
-		if (!GameEngine::Instance().LoadTextureFromFile(texFilename.c_str()))
-		{
-			return false;
-		}
 		return true;
 	}
 
 	/**
-	*Fݒ肷
+	*解析したフォントを使えるようにする
 	*
-	*@param	c E
+	*@param	file	ParseFileの解析結果(フォント情報は移動される)
+	*@param	tex		フォント画像のハンドル
+	*/
+	void Renderer::Apply(FontFile& file, Asset::Handle tex)
+	{
+		fontList.swap(file.fontList);
+		//フォント画像がアトラスに入っていれば、ページ内のUV範囲を使う
+		const TexturePtr& texture = GameEngine::Instance().GetTexture(tex);
+		uvRect = texture ? texture->UvRect() : glm::vec4(0, 0, 1, 1);
+		screenScale = file.scale / screenSize;
+		texFilename = file.texFilename;
+		texHandle = tex;
+	}
+
+	/**
+	*文字色を設定する
+	*
+	*@param	c 文字職
 	*/
 	void Renderer::Color(const glm::vec4& c)
 	{
@@ -172,9 +208,9 @@ namespace Font
 	}
 
 	/**
-	*F擾
+	*文字色を取得する
 	*
-	*@return F
+	*@return 文字色
 	*/
 	glm::vec4 Renderer::Color() const
 	{
@@ -182,21 +218,20 @@ namespace Font
 	}
 
 	/**
-	*ǉ
+	*文字列を追加する
 	*
-	*@param	position	\JnW
-	*@param	str			ǉ镶
+	*@param	position	表示開始座標
+	*@param	str			追加する文字列
 	*
-	*@retval true	ǉ
-	*@retval false	ǉs
+	*@retval true	追加成功
+	*@retval false	追加失敗
 	*/
 	bool Renderer::AddString(const glm::vec2& position, const char* str)
 	{
-		Vertex* p = pVBO + vboSize;
 		glm::vec2 pos = position;
 		for (const char* itr = str;*itr; ++itr)
 		{
-			if (vboSize + 4 > vboCapacity)
+			if (vertexList.size() + 4 > static_cast<size_t>(vboCapacity))
 			{
 				break;
 			}
@@ -205,20 +240,23 @@ namespace Font
 			{
 				const glm::vec2 size = font.size * screenScale * scale;
 				const glm::vec2 offsetedPos = pos + font.offset * scale;
+				const glm::vec2 uvScale(uvRect.z, uvRect.w);
+				const glm::vec2 uv = glm::vec2(uvRect) + font.uv * uvScale;
+				const glm::vec2 uvSize = font.size * uvScale;
+				vertexList.resize(vertexList.size() + 4);
+				Vertex* p = vertexList.data() + vertexList.size() - 4;
 				p[0].position = offsetedPos + glm::vec2(0, -size.y);
-				p[0].uv = font.uv * 65535.0f;
+				p[0].uv = uv * 65535.0f;
 				p[0].color = color;
 				p[1].position = offsetedPos + glm::vec2(size.x, -size.y);
-				p[1].uv = (font.uv + glm::vec2(font.size.x, 0)) * 65535.0f;
+				p[1].uv = (uv + glm::vec2(uvSize.x, 0)) * 65535.0f;
 				p[1].color = color;
 				p[2].position = offsetedPos + glm::vec2(size.x, 0);
-				p[2].uv = (font.uv + font.size) * 65535.0f;
+				p[2].uv = (uv + uvSize) * 65535.0f;
 				p[2].color = color;
 				p[3].position = offsetedPos;
-				p[3].uv = (font.uv + glm::vec2(0, font.size.y)) * 65535.0f;
+				p[3].uv = (uv + glm::vec2(0, uvSize.y)) * 65535.0f;
 				p[3].color = color;
-				p += 4;
-				vboSize += 4;
 			}
 			pos.x += font.xadvance * screenScale.x * scale.x;
 		}
@@ -226,53 +264,53 @@ namespace Font
 	}
 
 	/**
-	*	VBOVXeɃ}bsO
+	*	文字列の追加を開始する
+	*
+	*	前のフレームで追加した文字列は消去される
 	*/
-	void Renderer::MapBuffer()
+	void Renderer::BeginUpdate()
 	{
-		if (pVBO)
-		{
-			return;
-		}
-		glBindBuffer(GL_ARRAY_BUFFER, vbo.Id());
-		pVBO = static_cast<Vertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0,
-			sizeof(Vertex) * vboCapacity, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		vboSize = 0;
+		vertexList.clear();
 	}
 
 	/**
-	*	VBÕ}bsO폜
+	*文字列の追加を終了し、描画データを取り出す
+	*
+	*@param	out	描画データの格納先
+	*
+	*outの元の頂点データは、次のフレームの作業用として再利用される
+	*GLの関数は呼び出さないので、描画スレッド以外から呼び出してもよい
 	*/
-	void Renderer::UnmapBuffer()
+	void Renderer::EndUpdate(DrawData& out)
 	{
-		if (!pVBO || vboSize == 0)
-		{
-			return;
-		}
-		glBindBuffer(GL_ARRAY_BUFFER, vbo.Id());
-		glUnmapBuffer(GL_ARRAY_BUFFER);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		pVBO = nullptr;
+		out.vertexList.swap(vertexList);
+		vertexList.clear();
+		const TexturePtr& tex = GameEngine::Instance().GetTexture(texHandle);
+		out.texture = tex ? tex->Id() : 0;
 	}
 
 	/**
-	* tHg`悷
+	*フォントを描画する
+	*
+	*@param	data	EndUpdateで取り出した描画データ
 	*/
-	void Renderer::Draw() const
+	void Renderer::Draw(const DrawData& data) const
 	{
-		if (vboSize == 0)
+		const VertexList& vertexList = data.vertexList;
+		if (vertexList.empty() || !data.texture)
 		{
 			return;
 		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo.Id());
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * vertexList.size(), vertexList.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		vao.Bind();
 		glDisable(GL_DEPTH_TEST);
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		progFont->UseProgram();
-		progFont->BindTexture(GL_TEXTURE0, GL_TEXTURE_2D,
-			GameEngine::Instance().GetTexture(texFilename.c_str())->Id());
-		glDrawElements(GL_TRIANGLES, (vboSize / 4) * 6, GL_UNSIGNED_SHORT, 0);
+		progFont->BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, data.texture);
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(vertexList.size() / 4) * 6, GL_UNSIGNED_SHORT, 0);
 		vao.Unbind();
 	}
-}
\ No newline at end of file
+}
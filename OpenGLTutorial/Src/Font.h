@@ -5,31 +5,63 @@
 #include <GL/glew.h>
 #include "BufferObject.h"
 #include "Shader.h"
+#include "Asset.h"
+#include "Memory.h"
 #include <glm/glm.hpp>
 #include <vector>
 #include <string>
 
 namespace Font
 {
-	struct Vertex;
+	/**
+	*	フォント用頂点データ型
+	*/
+	struct Vertex
+	{
+		glm::vec2 position;
+		glm::u16vec2 uv;
+		glm::u8vec4 color;
+	};
 
-	//tHg
+	//描画スレッドに渡す頂点データの配列
+	typedef Memory::Vector<Vertex, Memory::Tag::Font> VertexList;
+
+	/**
+	*	描画スレッドに渡す1フレーム分の文字列の描画データ
+	*/
+	struct DrawData
+	{
+		VertexList vertexList;	///<頂点データ
+		GLuint texture = 0;	///<フォントテクスチャ
+	};
+
+	//フォント情報
 	struct FontInfo
 	{
-		//R[h
+		//文字コード
 		int id = -1;
-		//tHg摜̍eNX`W
+		//フォント画像の左上テクスチャ座標
 		glm::vec2 uv;
-		//tHg摜̃sNZTCY
+		//フォント画像のピクセルサイズ
 		glm::vec2 size;
-		//\ʒu炷
+		//表示位置をずらす距離
 		glm::vec2 offset;
-		//J[\i߂鋗
+		//カーソルを進める距離
 		float xadvance = 0;
 	};
 
 	/**
-	*	rbg}bvtHg`NX
+	*	フォントファイルを解析した結果
+	*/
+	struct FontFile
+	{
+		Memory::Vector<FontInfo, Memory::Tag::Font> fontList;	///<文字コード順のフォント情報
+		glm::vec2 scale;	///<フォント画像の大きさ
+		std::string texFilename;	///<フォント画像のファイル名
+	};
+
+	/**
+	*	ビットマップフォント描画クラス
 	*/
 	class Renderer
 	{
@@ -41,31 +73,34 @@ namespace Font
 
 		bool Init(size_t maxChar, const glm::vec2& ss);
 		bool LoadFromFile(const char* filename);
+		static bool ParseFile(const char* filename, FontFile& out);
+		void Apply(FontFile& file, Asset::Handle tex);
 
 		void Scale(const glm::vec2& s) { scale = s; }
 		const glm::vec2& Scale() const { return scale; }
 		void Color(const glm::vec4& c);
 		glm::vec4 Color() const;
 
-		void MapBuffer();
+		void BeginUpdate();
 		bool AddString(const glm::vec2& position, const char* str);
-		void UnmapBuffer();
-		void Draw() const;
+		void EndUpdate(DrawData& out);
+		void Draw(const DrawData& data) const;
 
 	private:
 		BufferObject vbo;
 		BufferObject ibo;
 		VertexArrayObject vao;
 		GLsizei vboCapacity = 0;
-		std::vector<FontInfo> fontList;
+		Memory::Vector<FontInfo, Memory::Tag::Font> fontList;
 		std::string texFilename;
+		Asset::Handle texHandle = Asset::invalidHandle;
+		glm::vec4 uvRect = glm::vec4(0, 0, 1, 1);	///<フォント画像のページ内のUV範囲(アトラスに入っていなければ全体)
 		Shader::ProgramPtr progFont;
 		glm::vec2 screenSize;
 		glm::vec2 screenScale;
 
 		glm::vec2 scale = glm::vec2(1, 1);
 		glm::u8vec4 color = glm::u8vec4(255, 255, 255, 255);
-		GLsizei vboSize = 0;
-		Vertex* pVBO = nullptr;
+		VertexList vertexList;	///<AddStringで作成中の頂点データ
 	};
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+/**
+*	@file FrameAllocator.cpp
+*/
+#include "FrameAllocator.h"
+#include <iostream>
+#include <string.h>
+
+/**
+*フレームアロケータを初期化する
+*
+*@param	bytesPerFrame	1フレームで確保できる最大バイト数
+*
+*@retval true	初期化成功
+*@retval false	初期化失敗
+*/
+bool FrameAllocator::Init(size_t bytesPerFrame)
+{
+	for (Arena& e : arena)
+	{
+		e.buffer.reset(new(std::nothrow) uint8_t[bytesPerFrame]);
+		if (!e.buffer)
+		{
+			std::cerr << "ERROR: フレームアロケータの作成に失敗(" << bytesPerFrame << "バイト)" << std::endl;
+			return false;
+		}
+		e.used = 0;
+		e.frame = 0;
+	}
+	capacity = bytesPerFrame;
+	current = 0;
+	frameNo = 0;
+	highWaterMark = 0;
+	failedCount = 0;
+	return true;
+}
+
+/**
+*	新しいフレームを開始する
+*
+*	2フレーム前に使っていた領域を空にして、現在の領域にする
+*	このフレーム以前に確保したメモリは、次のフレームの終わりまで有効
+*/
+void FrameAllocator::BeginFrame()
+{
+	++frameNo;
+	current = (current + 1) % arenaCount;
+	Arena& e = arena[current];
+#if FRAME_ALLOCATOR_DEBUG
+	//古いポインタ経由の読み書きが目立つように、解放した領域を埋めておく
+	if (e.buffer)
+	{
+		memset(e.buffer.get(), 0xdd, e.used);
+	}
+#endif
+	e.used = 0;
+	e.frame = frameNo;
+}
+
+/**
+*メモリを確保する
+*
+*@param	size		確保するバイト数
+*@param	alignment	アライメント(2の累乗)
+*
+*@return 確保したメモリへのポインタ
+*		容量が足りない場合はnullptr
+*/
+void* FrameAllocator::Allocate(size_t size, size_t alignment)
+{
+	Arena& e = arena[current];
+	if (!e.buffer)
+	{
+		return nullptr;
+	}
+	const uintptr_t base = reinterpret_cast<uintptr_t>(e.buffer.get());
+	const uintptr_t p = (base + e.used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+	const size_t end = static_cast<size_t>(p - base) + size;
+	if (end > capacity)
+	{
+		if (failedCount++ == 0)
+		{
+			std::cerr << "WARNING: フレームアロケータの容量が不足しています( " <<
+				end << '/' << capacity << " )" << std::endl;
+		}
+		return nullptr;
+	}
+	e.used = end;
+	if (end > highWaterMark)
+	{
+		highWaterMark = end;
+	}
+	return reinterpret_cast<void*>(p);
+}
+
+/**
+*ポインタが有効なフレームの領域を指しているか調べる
+*
+*@param	p	調べるポインタ
+*
+*@retval true	現在または1つ前のフレームで確保された領域を指している
+*@retval false	それ以外
+*/
+bool FrameAllocator::Contains(const void* p) const
+{
+	const uint8_t* bp = static_cast<const uint8_t*>(p);
+	for (const Arena& e : arena)
+	{
+		if (e.buffer && IsAlive(e.frame) && bp >= e.buffer.get() && bp < e.buffer.get() + e.used)
+		{
+			return true;
+		}
+	}
+	return false;
+}
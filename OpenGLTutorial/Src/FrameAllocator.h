@@ -0,0 +1,135 @@
+/**
+*	@file FrameAllocator.h
+*/
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <cassert>
+#include <memory>
+#include <new>
+#include <vector>
+
+//1を定義すると、フレームをまたいだメモリの使用を検出する
+#ifndef FRAME_ALLOCATOR_DEBUG
+#ifdef _DEBUG
+#define FRAME_ALLOCATOR_DEBUG 1
+#else
+#define FRAME_ALLOCATOR_DEBUG 0
+#endif
+#endif
+
+/**
+*	フレーム単位で解放される線形アロケータ
+*
+*	確保はポインタを進めるだけで、個別の解放は行わない
+*	2つの領域を交互に使うため、確保したメモリは次のフレームの終わりまで有効
+*	(GPUが前のフレームのデータを参照している間も上書きされない)
+*/
+class FrameAllocator
+{
+public:
+	FrameAllocator() = default;
+	~FrameAllocator() = default;
+	FrameAllocator(const FrameAllocator&) = delete;
+	FrameAllocator& operator = (const FrameAllocator&) = delete;
+
+	bool Init(size_t bytesPerFrame);
+	void BeginFrame();
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	/**
+	*T型の配列を確保する
+	*
+	*@param	count	要素数
+	*
+	*@return 確保した配列の先頭へのポインタ
+	*		容量が足りない場合はnullptr
+	*
+	*コンストラクタもデストラクタも呼ばれないので、トリビアルな型にだけ使うこと
+	*/
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	bool IsAlive(uint32_t frame) const { return frameNo - frame < arenaCount; }
+	bool Contains(const void* p) const;
+
+	uint32_t FrameNo() const { return frameNo; }
+	size_t Capacity() const { return capacity; }
+	size_t Used() const { return arena[current].used; }
+	size_t HighWaterMark() const { return highWaterMark; }
+	size_t FailedCount() const { return failedCount; }
+
+private:
+	static const int arenaCount = 2;	///<領域の数(処理中のフレーム数)
+
+	/**
+	*	1フレーム分の領域
+	*/
+	struct Arena
+	{
+		std::unique_ptr<uint8_t[]> buffer;	///<メモリ領域
+		size_t used = 0;	///<使用済みバイト数
+		uint32_t frame = 0;	///<この領域を使っているフレーム番号
+	};
+
+	Arena arena[arenaCount];
+	int current = 0;	///<現在のフレームが使う領域
+	uint32_t frameNo = 0;	///<現在のフレーム番号
+	size_t capacity = 0;	///<1領域あたりのバイト数
+	size_t highWaterMark = 0;	///<1フレームで使われた最大バイト数
+	size_t failedCount = 0;	///<容量不足で確保に失敗した回数
+};
+
+/**
+*	FrameAllocatorをSTLコンテナで使うためのアダプタ
+*
+*	deallocateは何もしない(フレームの切り替わりでまとめて解放される)
+*	FRAME_ALLOCATOR_DEBUGが1の場合、確保したフレームより後で
+*	コンテナを伸長・解放しようとすると assert で停止する
+*/
+template<typename T>
+class FrameStlAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit FrameStlAllocator(FrameAllocator& a) : allocator(&a), frame(a.FrameNo()) {}
+	template<typename U>
+	FrameStlAllocator(const FrameStlAllocator<U>& other) :
+		allocator(other.allocator), frame(other.frame) {}
+
+	T* allocate(size_t n)
+	{
+		//前のフレームで作ったコンテナに、今のフレームで要素を追加しようとしている
+		assert(!FRAME_ALLOCATOR_DEBUG || allocator->FrameNo() == frame);
+		T* p = allocator->AllocateArray<T>(n);
+		if (!p)
+		{
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+
+	void deallocate(T*, size_t)
+	{
+		//確保したフレームの領域が既に再利用されている
+		assert(!FRAME_ALLOCATOR_DEBUG || allocator->IsAlive(frame));
+	}
+
+	template<typename U>
+	bool operator == (const FrameStlAllocator<U>& rhs) const { return allocator == rhs.allocator; }
+	template<typename U>
+	bool operator != (const FrameStlAllocator<U>& rhs) const { return allocator != rhs.allocator; }
+
+private:
+	template<typename U> friend class FrameStlAllocator;
+	FrameAllocator* allocator;	///<メモリの確保元
+	uint32_t frame;	///<アダプタを作成したフレーム番号
+};
+
+//フレームアロケータを使う可変長配列
+template<typename T>
+using FrameVector = std::vector<T, FrameStlAllocator<T>>;
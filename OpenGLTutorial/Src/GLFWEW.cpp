@@ -5,14 +5,14 @@
 #include"GLFWEW.h"
 #include <iostream>
 
-///GLFWGLFWbv邽߂̖O𖼑O
+///GLFWとGLFWをラップするための名前を名前空間
 namespace GLFWEW
 {
 	/**
-	*GLFW̃G[񍐂
+	*GLFWからのエラー報告を処理する
 	*
-	*@param error G[ԍ
-	*@param desc G[̓e
+	*@param error エラー番号
+	*@param desc エラーの内容
 	*/
 	void ErrorCallback(int error, const char* desc)
 	{
@@ -20,9 +20,9 @@ namespace GLFWEW
 	}
 
 	/**
-	*	VOgCX^X擾
+	*	シングルトンインスタンスを取得する
 	*
-	*	@return Window̃VOgCX^X
+	*	@return Windowのシングルトンインスタンス
 	*/
 	Window& Window::Instance()
 	{
@@ -31,7 +31,7 @@ namespace GLFWEW
 	}
 
 	/**
-	*	RXgN^
+	*	コンストラクタ
 	*/
 	Window::Window() : isGLFWInitialized(false), isInitialized(false), window(nullptr)
 	{
@@ -39,7 +39,7 @@ namespace GLFWEW
 	}
 
 	/**
-	*	fXgN^
+	*	デストラクタ
 	*/
 	Window::~Window()
 	{
@@ -49,20 +49,20 @@ namespace GLFWEW
 		}
 	}
 	/**
-	*	GLFW/GLFW̏
+	*	GLFW/GLFWの初期化
 	*
-	*	@param	w EBhE̕`͈͂̕(sNZ)
-	*	@param	h EBhE̕`͈͂̍(sNZ)
-	*	@param	title EBhE^Cg(UTF-80I[)
+	*	@param	w ウィンドウの描画範囲の幅(ピクセル)
+	*	@param	h ウィンドウの描画範囲の高さ(ピクセル)
+	*	@param	title ウィンドウタイトル(UTF-8の0終端文字例)
 	*
-	*	@retval	true 
-	*	@retval	false s
+	*	@retval	true 初期化成功
+	*	@retval	false 初期化失敗
 	*/
 	bool Window::Init(int w, int h, const char* title)
 	{
 		if (isInitialized)
 		{
-			std::cerr << "ERROR: GLFWEW͊ɏĂ܂." << std::endl;
+			std::cerr << "ERROR: GLFWEWは既に初期化されています." << std::endl;
 			return false;
 		}
 		if (!isGLFWInitialized)
@@ -87,11 +87,11 @@ namespace GLFWEW
 
 		if (glewInit() != GLEW_OK)
 		{
-			std::cerr << "ERROR: GLEW̏Ɏs܂" << std::endl;
+			std::cerr << "ERROR: GLEWの初期化に失敗しました" << std::endl;
 			return false;
 		}
 
-		//`foCXƑΉo[Wo
+		//描画デバイスと対応バージョンを出力
 		const GLubyte* renderer = glGetString(GL_RENDERER);
 		std::cout << "Renderer: " << renderer << std::endl;
 		const GLubyte* version = glGetString(GL_VERSION);
@@ -101,10 +101,10 @@ namespace GLFWEW
 	}
 
 	/**
-	*	EBhEׂׂ
+	*	ウィンドウを閉じるべきか調べる
 	*
-	*	@retval true 
-	*	@retval false Ȃ
+	*	@retval true 閉じる
+	*	@retval false 閉じない
 	*/
 	bool Window::ShowldClose() const
 	{
@@ -112,7 +112,7 @@ namespace GLFWEW
 	}
 
 	/**
-	*	tgobt@؂ւ
+	*	フロントバッファを切り替える
 	*/
 	void Window::SwapBuffers() const
 	{
@@ -121,9 +121,9 @@ namespace GLFWEW
 	}
 
 	/**
-	*Q[pbh̏Ԃ擾
+	*ゲームパッドの状態を取得する
 	*
-	*@return Q[pbh̏
+	*@return ゲームパッドの状態
 	*/
 	const GamePad& Window::GetGamePad() const
 	{
@@ -131,43 +131,43 @@ namespace GLFWEW
 	}
 
 	/**
-	*WCXeBbÑAiO͑uID
+	*ジョイスティックのアナログ入力装置ID
 	*
-	*@note	XBOX360Rg[[
+	*@note	XBOX360コントローラー基準
 	*/
 	enum GLFWAXESID
 	{
-		GLFWAXESID_LeftX,	//XeBbNX
-		GLFWAXESID_LeftY,	//XeBbNY
-		GLFWAXESID_BackX,	//AiOgK[
-		GLFWAXESID_RightY,	//EXeBbNY
-		GLFWAXESID_RightX,	//EXeBbNX
+		GLFWAXESID_LeftX,	//左スティックのX軸
+		GLFWAXESID_LeftY,	//左スティックのY軸
+		GLFWAXESID_BackX,	//アナログトリガー
+		GLFWAXESID_RightY,	//右スティックのY軸
+		GLFWAXESID_RightX,	//右スティックのX軸
 	};
 
 	/**
-	*WCXeBbÑfW^͑uID
+	*ジョイスティックのデジタル入力装置ID
 	*
-	*@note	XBOX360Rg[[
+	*@note	XBOX360コントローラー基準
 	*/
 	enum GLFWBUTTONID
 	{
-		GLFWBUTTONID_A,		//A{^
-		GLFWBUTTONID_B,		//B{^
-		GLFWBUTTONID_X,		//X{^
-		GLFWBUTTONID_Y,		//Y{^
-		GLFWBUTTONID_L,		//L{^
-		GLFWBUTTONID_R,		//R{^
-		GLFWBUTTONID_Back,	//Back{^
-		GLFWBUTTONID_Start,	//Start{^
-		GLFWBUTTONID_LThumb,	//XeBbN{^
-		GLFWBUTTONID_RThumb,	//EXeBbN{^
-		GLFWBUTTONID_Up,	//L[
-		GLFWBUTTONID_Right,	//EL[
-		GLFWBUTTONID_Down,	//L[
+		GLFWBUTTONID_A,		//Aボタン
+		GLFWBUTTONID_B,		//Bボタン
+		GLFWBUTTONID_X,		//Xボタン
+		GLFWBUTTONID_Y,		//Yボタン
+		GLFWBUTTONID_L,		//Lボタン
+		GLFWBUTTONID_R,		//Rボタン
+		GLFWBUTTONID_Back,	//Backボタン
+		GLFWBUTTONID_Start,	//Startボタン
+		GLFWBUTTONID_LThumb,	//左スティックボタン
+		GLFWBUTTONID_RThumb,	//右スティックボタン
+		GLFWBUTTONID_Up,	//上キー
+		GLFWBUTTONID_Right,	//右キー
+		GLFWBUTTONID_Down,	//下キー
 	};
 
 	/**
-	*	Q[pbh̏ԂXV
+	*	ゲームパッドの状態を更新する
 	*/
 	void Window::UpdateGamePad()
 	{
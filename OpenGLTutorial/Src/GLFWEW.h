@@ -13,7 +13,7 @@
 namespace GLFWEW
 {
 	/**
-	*	GLFWGLEW̃bp[NX
+	*	GLFWとGLEWのラッパークラス
 	*/
 	class Window
 	{
@@ -4,21 +4,23 @@
 #include "GameEngine.h"
 #include "GLFWEW.h"
 #include "Audio.h"
+#include "TextureAtlas.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <thread>
 #include <time.h>
 
-///_f[^^
+///頂点データ型
 struct Vertex
 {
-	glm::vec3 position;	///<W
-	glm::vec4 color; ///<F
+	glm::vec3 position;	///<座標
+	glm::vec4 color; ///<色
 	glm::vec2 texCoord;
 };
 
 
-///_f[^
+///頂点データ
 const Vertex vertices[] = {
 	/*
 	{ { 1.0f,0.0f,1.0f,1.0f } ,{ -0.5f,-0.5f,0.5f } },
@@ -41,7 +43,7 @@ const Vertex vertices[] = {
 	{  {  0.5f, 0.3f,0.1f },{ 1.0f,1.0f,0.0f,1.0f } },
 	{  { -0.3f, 0.3f,0.1f },{ 1.0f,0.0f,0.0f,1.0f } },
 
-	//6p
+	//6角
 	{  { -0.3f, 0.3f,0.3f },{ 0.0f,0.0f,1.0f,1.0f } },
 	{  { -0.3f,-0.5f,0.3f },{ 0.0f,1.0f,1.0f,1.0f } },
 	{  {  0.5f,-0.5f,0.3f },{ 0.0f,0.0f,1.0f,1.0f } },
@@ -55,7 +57,7 @@ const Vertex vertices[] = {
 	{  { 0.5f,-0.5f,0.3f } ,{ 1.0f,0.0f,0.0f,1.0f }},
 	{  {  0.8f, 0.0f,0.3f },{ 1.0f,0.0f,0.0f,1.0f } },
 
-	//8p
+	//8角
 	{  { 0.0f,0.0f,0.0f },{ 0.5f,0.5f,0.5f,1.0f } },
 	{  { 0.0f,0.5f,0.0f },{ 0.5f,0.5f,0.5f,1.0f } },
 	{  { 0.3f,0.4f,0.0f },{ 0.5f,0.5f,0.5f,1.0f } },
@@ -101,7 +103,7 @@ const Vertex vertices[] = {
 
 };
 
-///CfbNXf[^
+///インデックスデータ
 const GLuint indices[] = {
 	/*
 	0,1,2,2,3,0,
@@ -117,21 +119,21 @@ const GLuint indices[] = {
 
 
 /**
-*`f[^
+*部分描画データ
 */
 struct RenderingPart
 {
-	GLsizei size;	///<`悷CfbNX
-	GLvoid* offset;	///<`JnCfbNX̃oCgItZbg
+	GLsizei size;	///<描画するインデックス数
+	GLvoid* offset;	///<描画開始インデックスのバイトオフセット
 };
 
 /**
-*RenderingPart쐬
+*RenderingPartを作成する
 *
-*@param	size `悷CfbNX
-*@param offset `JnCfbNX̃ItZbg(CfbNXP)
+*@param	size 描画するインデックス数
+*@param offset 描画開始インデックスのオフセット(インデックス単位)
 *
-*@return 쐬`IuWFNg
+*@return 作成した部分描画オブジェクト
 */
 constexpr RenderingPart MakeRenderingPart(GLsizei size, GLsizei offset)
 {
@@ -139,7 +141,7 @@ constexpr RenderingPart MakeRenderingPart(GLsizei size, GLsizei offset)
 }
 
 /**
-*`f[^Xg
+*部分描画データリスト
 */
 static const RenderingPart renderingParts[] = {
 	MakeRenderingPart(12,0),
@@ -148,12 +150,12 @@ static const RenderingPart renderingParts[] = {
 
 
 /**
-*Vertex Buffer Object쐬
+*Vertex Buffer Objectを作成する
 *
-*@param	size _f[^̃TCY
-*@param	data _f[^ւ̃|C^
+*@param	size 頂点データのサイズ
+*@param	data 頂点データへのポインタ
 *
-*@return	쐬VBO.
+*@return	作成したVBO.
 */
 GLuint CreateVBO(GLsizeiptr size, const GLvoid* data)
 {
@@ -166,12 +168,12 @@ GLuint CreateVBO(GLsizeiptr size, const GLvoid* data)
 }
 
 /**
-*Index Buffer Object쐬
+*Index Buffer Objectを作成する
 *
-*@param	size CfbNXf[^̃TCY
-*@param	data CfbNXf[^ւ̃|C^
+*@param	size インデックスデータのサイズ
+*@param	data インデックスデータへのポインタ
 *
-*@return	쐬IBO.
+*@return	作成したIBO.
 */
 GLuint CreateIBO(GLsizeiptr size, const GLvoid* data)
 {
@@ -184,11 +186,11 @@ GLuint CreateIBO(GLsizeiptr size, const GLvoid* data)
 }
 
 /**
-*_Agr[gݒ肷
+*頂点アトリビュートを設定する
 *
-*@param	index	_Agr[g̃CfbNX
-*@paran	cls		_f[^^
-*@param	mbr	_Agr[gɐݒ肷cls̃oϐ
+*@param	index	頂点アトリビュートのインデックス
+*@paran	cls		頂点データ型名
+*@param	mbr	頂点アトリビュートに設定するclsのメンバ変数名
 */
 #define SetVertexAttribPointer(index,cls,mbr)SetVertexAttribPointerI(\
 		index,	\
@@ -203,12 +205,12 @@ void SetVertexAttribPointerI(GLuint index, GLint size, GLsizei stride, const GLv
 }
 
 /**
-*Vertex Array Object쐬
+*Vertex Array Objectを作成する
 *
-*@param vbo VAOɊ֘AtVBO
-*@param ibo VAOɊ֘AtIBO	<-new!
+*@param vbo VAOに関連付けられるVBO
+*@param ibo VAOに関連付けられるIBO	<-new!
 *
-*@return	쐬VBO.
+*@return	作成したVBO.
 */
 GLuint CreateVAO(GLuint vbo, const GLuint ibo)
 {
@@ -227,9 +229,9 @@ GLuint CreateVAO(GLuint vbo, const GLuint ibo)
 
 
 /**
-*Q[GW̃CX^X擾
+*ゲームエンジンのインスタンスを取得する
 *
-*@return Q[GW̃CX^X
+*@return ゲームエンジンのインスタンス
 */
 GameEngine& GameEngine::Instance()
 {
@@ -238,17 +240,17 @@ GameEngine& GameEngine::Instance()
 }
 
 /**
-*Q[GW擾
+*ゲームエンジンを取得
 *
-*@param	w	EBhE̕`͈͂̕(sNZ)
-*@param	h	EBhE̕`͈͂̍(sNZ)
-*@param	title	EBhE^Cg(UTF-80I[)
+*@param	w	ウィンドウの描画範囲の幅(ピクセル)
+*@param	h	ウィンドウの描画範囲の高さ(ピクセル)
+*@param	title	ウィンドウタイトル(UTF-8の0終端文字列)
 *
-*@retval	true	
-*@retval	false	s
+*@retval	true	初期化成功
+*@retval	false	初期化失敗
 *
-*Run֐ĂяoOɁAxĂяoĂKv
-*xɐƁAȌ̌Ăяoł͉trueԂ
+*Run関数を呼び出す前に、一度だけ呼び出しておく必要がある
+*一度初期化に成功すると、以後の呼び出しでは何もせずにtrueを返す
 */
 bool GameEngine::Init(int w, int h, const char* title)
 {
@@ -261,7 +263,7 @@ bool GameEngine::Init(int w, int h, const char* title)
 		return false;
 	}
 
-	//---ɏǉ---
+	//---ここに初期化処理を追加する---
 	vbo = CreateVBO(sizeof(vertices), vertices);
 	ibo = CreateIBO(sizeof(indices), indices);
 	vao = CreateVAO(vbo, ibo);
@@ -270,25 +272,35 @@ bool GameEngine::Init(int w, int h, const char* title)
 	uboLight = UniformBuffer::Create(sizeof(Uniform::LightData), 1, "LightData");
 	uboPostEffect = UniformBuffer::Create(sizeof(Uniform::PostEffectData), 2, "PostEffectData");
 	//const GLuint shaderProgram = CreateShaderProgram(vsCode, fsCode);
-	//VF[_쐬R[h
+	//シェーダ作成コード
 	//const GLuint shaderProgram = Shader::CreateProgramFromFile("Res/Tutorial.vert", "Res/Tutorial.Frag");
 	progTutorial = Shader::Program::Create("Res/Tutorial.vert", "Res/Tutorial.Frag");
 	progColorFilter = Shader::Program::Create("Res/Colorfilter.vert", "Res/ColorFilter.Frag");
+	progSkinning = Shader::Program::Create("Res/Skinning.vert", "Res/Tutorial.frag");
 
 	offscreen = OffscreenBuffer::Create(800, 600);
-	if (!vbo || !ibo || !vao || !uboLight || !uboPostEffect || !progTutorial || !progColorFilter || !offscreen) //new!
+	if (!vbo || !ibo || !vao || !uboLight || !uboPostEffect || !progTutorial || !progColorFilter ||
+		!progSkinning || !offscreen) //new!
 	{
-		std::cerr << "ERROR: GameEngine ̏Ɏs" << std::endl;
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
 		return false;
 	}
 	progTutorial->UniformBlockBinding("VertexData", 0);
 	progTutorial->UniformBlockBinding("LightData", 1);
 	progColorFilter->UniformBlockBinding("PostEffectData", 2);
+	progSkinning->UniformBlockBinding("VertexData", 0);
+	progSkinning->UniformBlockBinding("LightData", 1);
+	progSkinning->UniformBlockBinding("SkinningData", 3);
+
+	//同じ大きさのエンティティ用テクスチャは、16枚ずつ1つのテクスチャ配列にまとめる
+	texturePool = TexturePool::Create(16);
+	//非同期に読み込むテクスチャは、リングを通して1フレームあたりの上限内で転送する
+	textureUploader = TextureUploader::Create(16 * 1024 * 1024);
 
 	meshBuffer = Mesh::Buffer::Create(10 * 1024, 30 * 1024);
 	if (!meshBuffer)
 	{
-		std::cerr << "ERROR: GameEngine ̏Ɏs" << std::endl;
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
 		return false;
 	}
 	//meshBuffer->LoadMeshFromFile("Res/Toroid.fbx");
@@ -296,11 +308,46 @@ bool GameEngine::Init(int w, int h, const char* title)
 	entityBuffer = Entity::Buffer::Create(1024,sizeof(Uniform::VertexData), 0, "VertexData");
 	if (!entityBuffer)
 	{
-		std::cerr << "ERROR: GameEngine ̏Ɏs" << std::endl;
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
+		return false;
+	}
+	//SSBOと間接描画が使えれば、progTutorialのエンティティをまとめて描画する
+	if (GLEW_VERSION_4_3)
+	{
+		progTutorialIndirect = Shader::Program::Create("Res/TutorialIndirect.vert", "Res/Tutorial.frag");
+		if (progTutorialIndirect)
+		{
+			progTutorialIndirect->UniformBlockBinding("LightData", 1);
+			entityBuffer->IndirectProgram(progTutorial, progTutorialIndirect);
+		}
+	}
+	skeletalBuffer = Skeletal::Buffer::Create(64, 256 * 1024, 0, 3);
+	if (!skeletalBuffer)
+	{
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
 		return false;
 	}
+	entityBuffer->SetRetireQueue(&retireQueue);
+	skeletalBuffer->SetRetireQueue(&retireQueue);
 	rand.seed(std::random_device()());
 
+	//1フレームの間だけ使う一時データ用
+	if (!frameAllocator.Init(1024 * 1024))
+	{
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
+		return false;
+	}
+
+	//メインスレッドもワーカーとして働くので、スレッドは論理コア数より1つ少なく作る
+	const unsigned int coreCount = std::thread::hardware_concurrency();
+	if (!jobSystem.Init(coreCount > 1 ? coreCount - 1 : 0))
+	{
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
+		return false;
+	}
+	assetLoader.Init(jobSystem);
+	textureManager = TextureManager::Create(assetLoader, texturePool, jobSystem, textureUploader, retireQueue);
+
 	fontRenderer.Init(1024, glm::vec2(800, 600));
 
 	isInitialized = true;
@@ -308,29 +355,137 @@ bool GameEngine::Init(int w, int h, const char* title)
 }
 
 /**
-*	Q[s
+*	ゲームを実行する
+*
+*	SimulationThread(true)が設定されている場合、状態の更新は別スレッドで行い、
+*	このスレッドは描画に専念する(1フレームの時間が更新と描画の合計ではなく、長い方になる)
 */
 void GameEngine::Run()
 {
 	GLFWEW::Window& window = GLFWEW::Window::Instance();
 
+	if (!useSimulationThread)
+	{
+		double prevTime = glfwGetTime();
+		while (!window.ShowldClose())
+		{
+			const double curTime = glfwGetTime();
+			const double delta = curTime - prevTime;
+			prevTime = curTime;
+			window.UpdateGamePad();
+			PostGamePad();
+			Update(glm::min(0.25, delta));
+			if (textureUploader)
+			{
+				textureUploader->BeginFrame(textureUploadBudget);
+			}
+			assetLoader.Upload(assetUploadBudget);
+			meshBuffer->CollectGarbage(retireQueue);
+			snapshotBuffer.Acquire();
+			retireQueue.Collect(snapshotBuffer.ReadBuffer().generation);
+			Render(snapshotBuffer.ReadBuffer());
+			window.SwapBuffers();
+		}
+		return;
+	}
+
+	isSimulationRunning = true;
+	std::thread simulationThread(&GameEngine::SimulationLoop, this);
+	while (!window.ShowldClose())
+	{
+		window.UpdateGamePad();
+		PostGamePad();
+		bool isAcquired;
+		{
+			std::lock_guard<std::mutex> lock(snapshotMutex);
+			isAcquired = snapshotBuffer.Acquire();
+		}
+		if (isAcquired)
+		{
+			snapshotCondition.notify_one();
+		}
+		if (textureUploader)
+		{
+			textureUploader->BeginFrame(textureUploadBudget);
+		}
+		assetLoader.Upload(assetUploadBudget);
+		meshBuffer->CollectGarbage(retireQueue);
+		retireQueue.Collect(snapshotBuffer.ReadBuffer().generation);
+		//新しいデータが無ければ、前回と同じ内容を描画する
+		Render(snapshotBuffer.ReadBuffer());
+		window.SwapBuffers();
+	}
+	{
+		std::lock_guard<std::mutex> lock(snapshotMutex);
+		isSimulationRunning = false;
+	}
+	snapshotCondition.notify_one();
+	simulationThread.join();
+}
+
+/**
+*	シミュレーションスレッドの処理
+*
+*	描画スレッドが前のフレームを受け取るまで待つので、描画より1フレーム以上先行しない
+*/
+void GameEngine::SimulationLoop()
+{
 	double prevTime = glfwGetTime();
-	while(!window.ShowldClose())
+	while (isSimulationRunning)
 	{
 		const double curTime = glfwGetTime();
 		const double delta = curTime - prevTime;
 		prevTime = curTime;
-		window.UpdateGamePad();
-		Update(glm::min(0.25,delta));
-		Render();
-		window.SwapBuffers();
+		Update(glm::min(0.25, delta));
+
+		std::unique_lock<std::mutex> lock(snapshotMutex);
+		snapshotCondition.wait(lock, [this]() {
+			return !snapshotBuffer.HasPending() || !isSimulationRunning;
+		});
 	}
 }
 
 /**
-*ԍXV֐ݒ肷
+*シミュレーションを別スレッドで実行するか設定する
+*
+*@param	enable	別スレッドで実行するならtrue、描画と同じスレッドで実行するならfalse
+*
+*Runを呼び出す前に設定すること
+*trueの場合、状態更新関数やエンティティの更新関数からGLの関数を呼び出してはならない
+*(テクスチャやメッシュの読み込みはRunの前に済ませておく)
+*/
+void GameEngine::SimulationThread(bool enable)
+{
+	useSimulationThread = enable;
+}
+
+/**
+*	描画スレッドで取得したゲームパッドの状態を、シミュレーションスレッドに渡す
+*
+*	シミュレーションが追いつかない場合でも押された瞬間を取りこぼさないよう、buttonDownは蓄積する
+*/
+void GameEngine::PostGamePad()
+{
+	const GamePad& pad = GLFWEW::Window::Instance().GetGamePad();
+	std::lock_guard<std::mutex> lock(gamePadMutex);
+	pendingGamePad.buttons = pad.buttons;
+	pendingGamePad.buttonDown |= pad.buttonDown;
+}
+
+/**
+*	描画スレッドから渡されたゲームパッドの状態を、このフレームの状態として取り込む
+*/
+void GameEngine::FetchGamePad()
+{
+	std::lock_guard<std::mutex> lock(gamePadMutex);
+	gamePad = pendingGamePad;
+	pendingGamePad.buttonDown = 0;
+}
+
+/**
+*状態更新関数を設定する
 *
-*@param	func	ݒ肷XV֐
+*@param	func	設定する更新関数
 */
 void GameEngine::UpdateFunc(const UpdateFuncType& func)
 {
@@ -338,9 +493,9 @@ void GameEngine::UpdateFunc(const UpdateFuncType& func)
 }
 
 /**
-*ԍXV֐擾
+*状態更新関数を取得する
 *
-*@return	ݒ肳ĂXV֐
+*@return	設定されている更新関数
 */
 const GameEngine::UpdateFuncType& GameEngine::UpdateFunc() const
 {
@@ -348,101 +503,612 @@ const GameEngine::UpdateFuncType& GameEngine::UpdateFunc() const
 }
 
 /**
-*eNX`ǂݍ
+*テクスチャを読み込む
 *
-*@param	filename	eNX`t@C
+*@param	filename	テクスチャファイル名
+*@param	isArrayLayer	true:テクスチャ配列のレイヤーとして読み込む(エンティティ用)
+*						false:単独の2Dテクスチャとして読み込む(フォントなど、sampler2Dで読むもの)
 *
-*@retval true	ǂݍ
-*@retval false	ǂݍݎs
+*@retval true	読み込み
+*@retval false	読み込み失敗
 */
-bool GameEngine::LoadTextureFromFile(const char* filename)
+bool GameEngine::LoadTextureFromFile(const char* filename, bool isArrayLayer)
 {
-	const auto itr = textureBuffer.find(filename);
-	if (itr != textureBuffer.end())
+	if (textureBuffer.Find(Asset::Name::FromString(filename)) != Asset::invalidHandle)
 	{
 		return true;
 	}
-	TexturePtr texture = Texture::LoadFromFile(filename);
+	TexturePtr texture;
+	if (isArrayLayer)
+	{
+		Texture::Image image;
+		if (Texture::DecodeFile(filename, image, true, &jobSystem))
+		{
+			texture = texturePool->Add(image);
+		}
+	}
+	else
+	{
+		texture = Texture::LoadFromFile(filename);
+	}
 	if (!texture)
 	{
 		return false;
 	}
-	textureBuffer.insert(std::make_pair(std::string(filename), texture));
+	if (textureBuffer.Add(filename, texture) == Asset::invalidHandle)
+	{
+		return false;
+	}
+	textureManager->Register(filename, texture);
 	return true;
 }
 
 /**
-*bVǂݍ
+*テクスチャアトラスを読み込む
+*
+*@param	listFilename	アトラスに入れる画像の一覧ファイル名
 *
-*@param filename	bVt@C
+*@retval true	読み込み成功
+*@retval false	読み込み失敗
 *
-*@retval true	ǂݍݐ 
-*@retval false	ǂݍݎs
+*アトラスに入った画像は元のファイル名で登録され、FindTextureやGetTextureでページの一部を指す
+*テクスチャとして取得できる(テクスチャ座標はTexture::TransformUvで変換する)
+*ページは単独の2Dテクスチャなので、フォントやUIのようにsampler2Dで読むものに使うこと
+*アトラスに入らなかった画像は登録されないので、通常どおり読み込むこと
 */
-bool GameEngine::LoadMeshFromFile(const char* filename)
+bool GameEngine::LoadTextureAtlas(const char* listFilename)
 {
-	return meshBuffer->LoadMeshFromFile(filename);
+	TextureAtlas::Atlas atlas;
+	if (!TextureAtlas::Load(listFilename, atlas))
+	{
+		return false;
+	}
+	std::vector<TexturePtr> pageList;
+	pageList.reserve(atlas.pageList.size());
+	for (const Texture::Image& image : atlas.pageList)
+	{
+		TexturePtr page = Texture::Create(image);
+		if (!page)
+		{
+			return false;
+		}
+		pageList.push_back(page);
+	}
+	for (const TextureAtlas::Entry& e : atlas.entryList)
+	{
+		if (textureBuffer.Find(Asset::Name::FromString(e.name.c_str())) != Asset::invalidHandle)
+		{
+			std::cerr << "WARNING: '" << e.name << "' は登録済みなので、アトラスの画像は使われません" << std::endl;
+			continue;
+		}
+		const TexturePtr texture = Texture::CreateRegion(pageList[e.page],
+			e.rect.x, e.rect.y, e.rect.width, e.rect.height);
+		if (!texture || textureBuffer.Add(e.name.c_str(), texture) == Asset::invalidHandle)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+*テクスチャのハンドルを検索する
+*
+*@param	filename	テクスチャファイル名
+*
+*@return filenameに対応するテクスチャのハンドル
+*		見つからない場合はAsset::invalidHandle
+*
+*描画のたびに呼ぶのではなく、取得したハンドルを保持して使うこと
+*/
+Asset::Handle GameEngine::FindTexture(Asset::Name filename) const
+{
+	return textureBuffer.Find(filename);
+}
+
+/**
+*テクスチャを取得する
+*
+*@param	handle	テクスチャのハンドル
+*
+*@return handleに対応するテクスチャ
+*/
+const TexturePtr& GameEngine::GetTexture(Asset::Handle handle) const
+{
+	return textureBuffer.Get(handle);
+}
+
+/**
+*テクスチャを取得する
+*
+*@param	filename	テクスチャファイル名
+*
+*@return filenameに対応するテクスチャ
+*/
+const TexturePtr& GameEngine::GetTexture(Asset::Name filename) const
+{
+	return textureBuffer.Get(textureBuffer.Find(filename));
 }
 
 /**
-*GeBeBǉ
+*メッシュを読み込む
+*
+*@param filename	メッシュファイル名
+*@param	format		頂点データの形式
+*
+*@retval true	読み込み成功 
+*@retval false	読み込み失敗
+*/
+bool GameEngine::LoadMeshFromFile(const char* filename, Mesh::VertexFormat format)
+{
+	return meshBuffer->LoadMeshFromFile(filename, format, &jobSystem);
+}
+
+/**
+*メッシュを破棄する
+*
+*@param	name	メッシュ名
+*
+*@retval true	破棄した
+*@retval false	nameに対応するメッシュがない
+*
+*メッシュは直ちに検索できなくなるが、GPU上の領域はエンティティやプレハブからの参照が
+*すべてなくなった後で解放される
+*/
+bool GameEngine::UnloadMesh(Asset::Name name)
+{
+	return meshBuffer->RemoveMesh(meshBuffer->FindMesh(name));
+}
+
+/**
+*テクスチャを破棄する
+*
+*@param	name	テクスチャファイル名
+*
+*@retval true	破棄した
+*@retval false	nameに対応するテクスチャがない
+*
+*テクスチャは直ちに検索できなくなり、GPUメモリの管理対象からも外れる
+*GPU上の領域は、エンティティやプレハブからの参照がすべてなくなり、
+*描画中のスナップショットが使わなくなった後で描画スレッドで解放される
+*/
+bool GameEngine::UnloadTexture(Asset::Name name)
+{
+	const Asset::Handle handle = textureBuffer.Find(name);
+	TexturePtr texture = textureBuffer.Get(handle);
+	if (!texture)
+	{
+		return false;
+	}
+	textureManager->Unregister(texture);
+	textureBuffer.Remove(handle);
+	retireQueue.Retire(std::move(texture));
+	return true;
+}
+
+/**
+*テクスチャを非同期に読み込む
+*
+*@param	filename	テクスチャファイル名
 *
-*@param	groupId		GeBeB̃O[vID
-*@param	pos	GeBeB̍W
-*@param	meshName	GeBeB̕\Ɏgp郁bV
-*@param	texName		GeBeB̕\ɎgeNX`t@C
-*@param	func		GeBeB̏ԂXV֐
+*@return 読み込み結果を受け取るためのFuture
+*		準備完了になった時点で、FindTextureやGetTextureで取得できる
 *
-*@return ǉGeBeBւ̃|C^
-*		ȏGeBeBǉłȂꍇnullptrԂ
-*		]g嗦͂̃|C^oRŐݒ肷
-*		ȂÃ|C^AvP[VŕێKv͂Ȃ
+*ファイルの読み込みはワーカースレッドで、GLへの転送は描画スレッドで行われる
+*大きな画像は1フレームの転送量の上限(TextureUploadBudget)に収まるよう、複数のフレームに分けて転送する
 */
-Entity::Entity* GameEngine::AddEntity(int groupId, const glm::vec3& pos, const char* meshName,
-	const char* texName, Entity::Entity::UpdateFuncType func,bool hasLight)
+AssetLoader::Future GameEngine::LoadTextureAsync(const char* filename)
+{
+	if (textureBuffer.Find(Asset::Name::FromString(filename)) != Asset::invalidHandle)
+	{
+		return AssetLoader::MakeReadyFuture(true);
+	}
+	struct Data
+	{
+		std::string filename;
+		Texture::Image image;
+		TexturePtr texture;
+		TextureUploader::Progress progress;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	data->filename = filename;
+	return assetLoader.Load(
+		[this, data]() {
+			return Texture::DecodeFile(data->filename.c_str(), data->image, true, &jobSystem);
+		},
+		[this, data]() {
+			if (!textureUploader)
+			{
+				data->texture = texturePool->Add(data->image);
+				data->image = Texture::Image();
+				return static_cast<bool>(data->texture);
+			}
+			if (!data->texture)
+			{
+				data->texture = texturePool->Allocate(data->image);
+				if (!data->texture)
+				{
+					return false;
+				}
+			}
+			if (!textureUploader->Upload(data->texture, data->image, data->progress))
+			{
+				assetLoader.Defer();
+				return true;
+			}
+			data->image = Texture::Image();
+			return true;
+		},
+		[this, data](bool result) {
+			const Asset::Handle handle = result ?
+				textureBuffer.Add(data->filename.c_str(), data->texture) : Asset::invalidHandle;
+			if (handle == Asset::invalidHandle)
+			{
+				std::cerr << "ERROR: '" << data->filename << "' の読み込みに失敗" << std::endl;
+				return false;
+			}
+			//同じ名前のテクスチャが先に登録されていた場合、管理はそちらで行っている
+			if (textureBuffer.Get(handle) == data->texture)
+			{
+				textureManager->Register(data->filename.c_str(), data->texture);
+			}
+			return true;
+		});
+}
+
+/**
+*メッシュを非同期に読み込む
+*
+*@param	filename	メッシュファイル名
+*@param	format		頂点データの形式
+*
+*@return 読み込み結果を受け取るためのFuture
+*		準備完了になった時点で、ファイルに含まれるメッシュを名前で取得できる
+*
+*FBXの読み込みと変換はワーカースレッドで、GLへの転送は描画スレッドで行われる
+*/
+AssetLoader::Future GameEngine::LoadMeshAsync(const char* filename, Mesh::VertexFormat format)
+{
+	struct Data
+	{
+		std::string filename;
+		Mesh::VertexFormat format;
+		Mesh::ImportDataPtr imported;
+		std::vector<Mesh::MeshPtr> meshList;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	data->filename = filename;
+	data->format = format;
+	const Mesh::BufferPtr buffer = meshBuffer;
+	JobSystem* const js = &jobSystem;
+	return assetLoader.Load(
+		[data, js]() {
+			data->imported = Mesh::Buffer::ImportFromFile(
+				data->filename.c_str(), data->format, js);
+			return static_cast<bool>(data->imported);
+		},
+		[data, buffer]() {
+			const bool result = buffer->Upload(*data->imported, data->meshList);
+			data->imported.reset();
+			return result;
+		},
+		[data, buffer](bool result) {
+			if (!result)
+			{
+				std::cerr << "ERROR: '" << data->filename << "' の読み込みに失敗" << std::endl;
+				return false;
+			}
+			for (const Mesh::MeshPtr& e : data->meshList)
+			{
+				buffer->AddMesh(e);
+			}
+			return true;
+		});
+}
+
+/**
+*フォントを非同期に読み込む
+*
+*@param	filename	フォントファイル名
+*
+*@return 読み込み結果を受け取るためのFuture
+*		準備完了になった時点で、AddStringに新しいフォントが使われる
+*/
+AssetLoader::Future GameEngine::LoadFontAsync(const char* filename)
+{
+	struct Data
+	{
+		std::string filename;
+		Font::FontFile file;
+		Texture::Image image;
+		TexturePtr texture;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	data->filename = filename;
+	return assetLoader.Load(
+		[data]() {
+			return Font::Renderer::ParseFile(data->filename.c_str(), data->file) &&
+				Texture::DecodeFile(data->file.texFilename.c_str(), data->image);
+		},
+		[data]() {
+			data->texture = Texture::Create(data->image);
+			data->image = Texture::Image();
+			return static_cast<bool>(data->texture);
+		},
+		[this, data](bool result) {
+			//同じフォント画像が登録済みなら、そちらが使われる
+			const Asset::Handle tex = result ?
+				textureBuffer.Add(data->file.texFilename.c_str(), data->texture) : Asset::invalidHandle;
+			if (tex == Asset::invalidHandle)
+			{
+				std::cerr << "ERROR: '" << data->filename << "' の読み込みに失敗" << std::endl;
+				return false;
+			}
+			fontRenderer.Apply(data->file, tex);
+			return true;
+		});
+}
+
+/**
+*スキンメッシュを非同期に読み込む
+*
+*@param	filename	FBXファイル名
+*
+*@return 読み込み結果を受け取るためのFuture
+*		準備完了になった時点で、AddCharacterにファイル名を指定できる
+*/
+AssetLoader::Future GameEngine::LoadSkinnedMeshAsync(const char* filename)
+{
+	struct Data
+	{
+		std::string filename;
+		Skeletal::SkinnedMeshPtr mesh;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	data->filename = filename;
+	const Skeletal::BufferPtr buffer = skeletalBuffer;
+	return assetLoader.Load(
+		[data]() {
+			data->mesh = Skeletal::Buffer::ImportFromFile(data->filename.c_str());
+			return static_cast<bool>(data->mesh);
+		},
+		[data, buffer]() {
+			return buffer->Upload(data->mesh);
+		},
+		[data, buffer](bool result) {
+			if (!result || buffer->AddMesh(data->mesh) == Asset::invalidHandle)
+			{
+				std::cerr << "ERROR: '" << data->filename << "' の読み込みに失敗" << std::endl;
+				return false;
+			}
+			return true;
+		});
+}
+
+/**
+*テクスチャがエンティティとキャラクターのシェーダで使えるか調べる
+*
+*@param	tex		調べるテクスチャ(nullptrならテクスチャなしとして使える)
+*
+*@retval true	使える
+*@retval false	テクスチャ配列のレイヤーではないので使えない
+*
+*Tutorial.fragとSkinning.vertのcolorSamplerはsampler2DArrayなので、
+*単独の2Dテクスチャ(アトラスやフォント、isArrayLayerをfalseにして読み込んだもの)では正しく描画できない
+*/
+static bool IsLayerTexture(const TexturePtr& tex)
+{
+	if (tex && tex->Target() != GL_TEXTURE_2D_ARRAY)
+	{
+		std::cerr << "ERROR: テクスチャ配列に入っていないテクスチャは、エンティティとキャラクターに使えません" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+*エンティティを追加する
+*
+*@param	groupId		エンティティのグループID
+*@param	pos	エンティティの座標
+*@param	meshName	エンティティの表示に使用するメッシュ名
+*@param	texName		エンティティの表示に使うテクスチャファイル名
+*@param	func		エンティティの状態を更新する関数
+*
+*@return 追加したエンティティへのポインタ
+*		これ以上エンティティを追加できない場合と、テクスチャがテクスチャ配列に入っていない場合はnullptrが返される
+*		回転や拡大率はこのポインタ経由で設定する
+*		なお、このポインタをアプリケーション側で保持する必要はない
+*/
+Entity::Entity* GameEngine::AddEntity(int groupId, const glm::vec3& pos, Asset::Name meshName,
+	Asset::Name texName, Entity::Entity::UpdateFuncType func,bool hasLight)
 {
 	const Mesh::MeshPtr& mesh = meshBuffer->GetMesh(meshName);
-	const TexturePtr& tex = textureBuffer.find(texName)->second;
+	const TexturePtr& tex = GetTexture(texName);
+	if (!IsLayerTexture(tex))
+	{
+		return nullptr;
+	}
 	return entityBuffer->AddEntity(groupId, pos, mesh, tex, progTutorial, func);
 }
 
 /**
-*GeBeB폜
+*プレハブを登録する
+*
+*@param	name		プレハブ名
+*@param	groupId		生成するエンティティのグループID
+*@param	meshName	エンティティの表示に使用するメッシュ名
+*@param	texName		エンティティの表示に使うテクスチャファイル名
+*@param	func		エンティティの状態を更新する関数
+*@param	collision	エンティティの衝突形状
+*@param	velocity	エンティティの初期速度
+*
+*@return 登録したプレハブへのポインタ
+*		メッシュまたはテクスチャが見つからないか、テクスチャがテクスチャ配列に入っていない場合は空のポインタが返される
+*
+*メッシュとテクスチャはここで一度だけ検索される
+*同名のプレハブが登録済みの場合は上書きする
+*/
+const Entity::PrefabPtr& GameEngine::RegisterPrefab(const char* name, int groupId,
+	Asset::Name meshName, Asset::Name texName, Entity::Entity::UpdateFuncType func,
+	const Entity::CollisionData& collision, const glm::vec3& velocity)
+{
+	static const Entity::PrefabPtr dummy;
+	const Mesh::MeshPtr& mesh = meshBuffer->GetMesh(meshName);
+	if (!mesh)
+	{
+		std::cerr << "ERROR: プレハブ '" << name << "' のメッシュが見つかりません" << std::endl;
+		return dummy;
+	}
+	const TexturePtr& tex = GetTexture(texName);
+	if (!tex)
+	{
+		std::cerr << "ERROR: プレハブ '" << name << "' のテクスチャが見つかりません" << std::endl;
+		return dummy;
+	}
+	if (!IsLayerTexture(tex))
+	{
+		return dummy;
+	}
+	Entity::PrefabPtr prefab = std::make_shared<Entity::Prefab>();
+	prefab->groupId = groupId;
+	prefab->mesh = mesh;
+	prefab->texture = tex;
+	prefab->program = progTutorial;
+	prefab->collision = collision;
+	prefab->updateFunc = func;
+	prefab->velocity = velocity;
+	Entity::PrefabPtr& p = prefabBuffer[name];
+	p = prefab;
+	return p;
+}
+
+/**
+*プレハブを取得する
+*
+*@param	name	プレハブ名
+*
+*@return nameに対応するプレハブへのポインタ
+*		見つからない場合は空のポインタが返される
+*
+*毎フレーム呼び出すのではなく、取得したポインタを保持して使うこと
+*/
+const Entity::PrefabPtr& GameEngine::GetPrefab(const char* name) const
+{
+	const auto itr = prefabBuffer.find(name);
+	if (itr == prefabBuffer.end())
+	{
+		static const Entity::PrefabPtr dummy;
+		return dummy;
+	}
+	return itr->second;
+}
+
+/**
+*プレハブからエンティティを追加する
 *
-*@param	폜GeBeB̃|C^
+*@param	prefab	生成するエンティティのプレハブ
+*@param	pos		エンティティの座標
+*
+*@return 追加したエンティティへのポインタ
+*		これ以上エンティティを追加できない場合はnullptrが返される
+*/
+Entity::Entity* GameEngine::AddEntity(const Entity::PrefabPtr& prefab, const glm::vec3& pos)
+{
+	if (!prefab)
+	{
+		return nullptr;
+	}
+	return entityBuffer->AddEntity(*prefab, pos);
+}
+
+/**
+*プレハブからエンティティをまとめて追加する
+*
+*@param	prefab		生成するエンティティのプレハブ
+*@param	positions	エンティティの座標の配列(count個)
+*@param	velocities	エンティティの速度の配列(count個)
+*					nullptrの場合はプレハブの速度を使う
+*@param	count		追加するエンティティの数
+*@param	out			追加したエンティティへのポインタを受け取る配列(count個)
+*
+*@return 実際に追加できたエンティティの数
+*/
+size_t GameEngine::SpawnBatch(const Entity::PrefabPtr& prefab, const glm::vec3* positions,
+	const glm::vec3* velocities, size_t count, Entity::Entity** out)
+{
+	if (!prefab)
+	{
+		return 0;
+	}
+	return entityBuffer->AddEntityBatch(*prefab, positions, velocities, count, out);
+}
+
+/**
+*キャラクターを追加する
+*
+*@param	pos			キャラクターの座標
+*@param	meshName	表示に使うスキンメッシュ名(FBXファイル名)
+*@param	texName		表示に使うテクスチャファイル名
+*
+*@return 追加したキャラクターへのポインタ
+*		追加できない場合はnullptrが返される
+*		スキンメッシュに最初のクリップがあれば、ループ再生が始まっている
+*/
+Skeletal::Character* GameEngine::AddCharacter(const glm::vec3& pos, Asset::Name meshName,
+	Asset::Name texName)
+{
+	const Skeletal::SkinnedMeshPtr& mesh = skeletalBuffer->GetMesh(meshName);
+	const TexturePtr& tex = textureBuffer.Get(textureBuffer.Find(texName));
+	if (!mesh || !tex)
+	{
+		std::cerr << "WARNING: キャラクターのメッシュかテクスチャが見つかりません" << std::endl;
+		return nullptr;
+	}
+	if (!IsLayerTexture(tex))
+	{
+		return nullptr;
+	}
+	return skeletalBuffer->AddCharacter(mesh, tex, pos);
+}
+
+/**
+*エンティティを削除する
+*
+*@param	削除するエンティティのポインタ
 */
 void GameEngine::RemoveEntity(Entity::Entity* e)
 {
 	entityBuffer->RemoveEntity(e);
 }
 /**
-*Cgݒ肷
+*ライトを設定する
 *
-*@param	indes	ݒ肷郉Cg̃CfbNX
-*@param	light	Cgf[^
+*@param	indes	設定するライトのインデックス
+*@param	light	ライトデータ
 */
 void GameEngine::Light(int index, const Uniform::PointLight& light)
 {
 	if (index < 0 || index >= Uniform::maxLightCount)
 	{
-		std::cerr << "WARNING: ' " << index << " ' ͕sȃCgCfbNXł" << std::endl;
+		std::cerr << "WARNING: ' " << index << " ' は不正なライトインデックスです" << std::endl;
 		return;
 	}
 	lightData.light[index] = light;
 }
 
 /**
-*Cg擾
+*ライトを取得する
 *
-*@param	index	擾郉Cg̃CfbNX
+*@param	index	取得するライトのインデックス
 *
-*@return Cgf[^
+*@return ライトデータ
 */
 const Uniform::PointLight& GameEngine::Light(int index) const
 {
 	if (index < 0 || index >= Uniform::maxLightCount)
 	{
-		std::cerr << "WARNING: ' " << index << " ' ͕sȃCgCfbNXł" << std::endl;
+		std::cerr << "WARNING: ' " << index << " ' は不正なライトインデックスです" << std::endl;
 		static const Uniform::PointLight dummy;
 		return dummy;
 	}
@@ -450,9 +1116,9 @@ const Uniform::PointLight& GameEngine::Light(int index) const
 }
 
 /**
-*ݒ肷
+*環境光を設定する
 *
-*@param color	̖邳
+*@param color	環境光の明るさ
 */
 void GameEngine::AmbientLight(const glm::vec4& color)
 {
@@ -460,9 +1126,9 @@ void GameEngine::AmbientLight(const glm::vec4& color)
 }
 
 /**
-*擾
+*環境光を取得する
 *
-*@return ̖邳
+*@return 環境光の明るさ
 */
 const glm::vec4& GameEngine::AmbientLight() const
 {
@@ -471,9 +1137,9 @@ const glm::vec4& GameEngine::AmbientLight() const
 
 
 /**
-*_̈ʒuƎpݒ肷
+*視点の位置と姿勢を設定する
 *
-*@param	cam	ݒ肷Jf[^
+*@param	cam	設定するカメラデータ
 */
 void GameEngine::Camera(const CameraData& cam)
 {
@@ -481,9 +1147,9 @@ void GameEngine::Camera(const CameraData& cam)
 }
 
 /**
-*_̈ʒuƎp擾
+*視点の位置と姿勢を取得する
 *
-*@return Jf[^
+*@return カメラデータ
 */
 const GameEngine::CameraData& GameEngine::Camera() const
 {
@@ -491,9 +1157,9 @@ const GameEngine::CameraData& GameEngine::Camera() const
 }
 
 /**
-*IuWFNg擾
+*乱数オブジェクトを取得する
 *
-*@return IuWFNg
+*@return 乱数オブジェクト
 */
 std::mt19937& GameEngine::Rand()
 {
@@ -501,27 +1167,43 @@ std::mt19937& GameEngine::Rand()
 }
 
 /**
-*	Q[pbh̏Ԃ擾
+*テクスチャのGPUメモリ使用量の上限を設定する
+*
+*@param	bytes	上限のバイト数
+*
+*上限を超えている間、しばらく使われていないテクスチャから順に縮小またはアンロードされる
+*/
+void GameEngine::TextureMemoryBudget(size_t bytes)
+{
+	TextureManager::Settings settings = textureManager->GetSettings();
+	settings.budgetBytes = bytes;
+	textureManager->SetSettings(settings);
+}
+
+/**
+*	ゲームパッドの状態を取得する
+*
+*	このフレームの更新を開始した時点の状態が返される
 */
 const GamePad& GameEngine::GetGamePad() const
 {
-	return GLFWEW::Window::Instance().GetGamePad();
+	return gamePad;
 }
 
 /**
-*Փˉnhݒ肷
+*衝突解決ハンドラを設定する
 *
-*@param	gid0	ՓˑΏۂ̃O[vID
-*@param	gid1	ՓˑΏۂ̃O[vID
-*@param	handler	Փˉnh
+*@param	gid0	衝突対象のグループID
+*@param	gid1	衝突対象のグループID
+*@param	handler	衝突解決ハンドラ
 *
-*Փ˂ՓˉnhĂяoƂA菬O[vIDGeBeBɓn
-*w肵O[vID̏Ƃ͖֌Wł邱Ƃɒӂ邱
+*衝突が発生し衝突解決ハンドラが呼び出されるとき、より小さいグループIDを持つエンティティから先に渡される
+*ここれ指定したグループIDの順序とは無関係であることに注意すること
 *ex)
 *	CollisionHandler(10,1,Func)
-*	ƂR[hŃnho^Ƃ@Փ˂
-*	Func(O[vID = 1 ̃GeBeBAO[vID = 10 ̃GeBeB)
-*	̂悤ɌĂяo
+*	というコードでハンドラを登録したとする　衝突が発生すると
+*	Func(グループID = 1 のエンティティ、グループID = 10 のエンティティ)
+*	のように呼び出される
 */
 void GameEngine::CollisionHandler(int gid0, int gid1, Entity::CollisionHandlerType handler)
 {
@@ -529,13 +1211,13 @@ void GameEngine::CollisionHandler(int gid0, int gid1, Entity::CollisionHandlerTy
 }
 
 /**
-*Փˉnh擾
+*衝突解決ハンドラを取得する
 
 *
-*@param	gid0	ՓˑΏۂ̃O[vID
-*@param	gid1	ՓˑΏۂ̃O[vID
+*@param	gid0	衝突対象のグループID
+*@param	gid1	衝突対象のグループID
 *
-*@return ՓˑΏۃnh
+*@return 衝突対象ハンドラ
 */
 const Entity::CollisionHandlerType& GameEngine::CollisionHandler(
 	int gid0, int gid1) const
@@ -544,7 +1226,7 @@ const Entity::CollisionHandlerType& GameEngine::CollisionHandler(
 }
 
 /**
-*	Փˉnh̃XgNA
+*	衝突解決ハンドラのリストをクリアする
 */
 void GameEngine::ClearCollsionHandlerList()
 {
@@ -578,14 +1260,15 @@ void GameEngine::StopAudio(int playerId)
 
 
 /**
-*	fXgN^
+*	デストラクタ
 */
 GameEngine::~GameEngine()
 {
-	//---ɏIǉ---
+	//---ここに終了処理を追加する---
 
 	updateFunc = nullptr;
 
+	jobSystem.Shutdown();
 	Audio::Destroy();
 
 	if (vao)
@@ -603,33 +1286,48 @@ GameEngine::~GameEngine()
 }
 
 /**
-*Q[̏ԂXV
+*ゲームの状態を更新する
 *
-*@param delta	O̍XV̌oߎ(b)
+*@param delta	前回の更新からの経過時間(秒)
 */
 void GameEngine::Update(double delta)
 {
-	fontRenderer.MapBuffer();
+	frameAllocator.BeginFrame();
+	FetchGamePad();
+	assetLoader.Commit();
+	fontRenderer.BeginUpdate();
 	if (updateFunc)
 	{
 		updateFunc(delta);
 	}
-	//---ɍXVǉ---
+	//---ここに更新処理を追加する---
 	const glm::mat4x4 matProj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 1.0f, 200.0f);
 
 	const glm::mat4x4 matView = glm::lookAt(camera.position, camera.target, camera.up);
-	entityBuffer->Update(delta, matView, matProj);
-
-	fontRenderer.UnmapBuffer();
 
+	//描画に必要なデータをスナップショットに書き出して、描画スレッドに公開する
+	RenderSnapshot& snapshot = snapshotBuffer.WriteBuffer();
+	entityBuffer->Update(delta, matView, matProj, snapshot.entity, &jobSystem);
+	skeletalBuffer->Update(delta, matView, matProj, snapshot.skeletal, &jobSystem);
+	fontRenderer.EndUpdate(snapshot.font);
+	snapshot.lightData = lightData;
+	snapshot.generation = retireQueue.Publish();
+	snapshotBuffer.Publish();
+
+	//このフレームで使われたテクスチャが決まったので、常駐状況を更新する
+	textureManager->Update();
 }
 
 /**
-*	Q[̏Ԃ`悷
+*ゲームの状態を描画する
+*
+*@param	snapshot	描画するフレームのデータ
+*
+*GLのコンテキストを持つスレッドから呼び出すこと
 */
-void GameEngine::Render() const
+void GameEngine::Render(const RenderSnapshot& snapshot)
 {
-	//---ɕ`揈ǉ---		
+	//---ここに描画処理を追加する---		
 	glBindFramebuffer(GL_FRAMEBUFFER, offscreen->GetFramebuffer());
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -640,8 +1338,9 @@ void GameEngine::Render() const
 	glClearColor(0.1f, 0.3f, 0.5f, 1.0f);
 	glClearDepth(1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	uboLight->BufferSubData(&lightData);
-	entityBuffer->Draw(meshBuffer);
+	uboLight->BufferSubData(&snapshot.lightData);
+	entityBuffer->Draw(meshBuffer, snapshot.entity);
+	skeletalBuffer->Draw(snapshot.skeletal, progTutorial, progSkinning, &jobSystem);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glDisable(GL_DEPTH_TEST);
@@ -656,6 +1355,6 @@ void GameEngine::Render() const
 	glDrawElements(GL_TRIANGLES, renderingParts[1].size,
 		GL_UNSIGNED_INT, renderingParts[1].offset);
 
-	fontRenderer.Draw();
+	fontRenderer.Draw(snapshot.font);
 }
 
@@ -7,25 +7,37 @@
 #include "OffscreenBuffer.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "TextureUploader.h"
+#include "TextureManager.h"
 #include "Mesh.h"
 #include "Entity.h"
+#include "Skeletal.h"
 #include "Uniform.h"
 #include "GamePad.h"
 #include "Font.h"
+#include "Asset.h"
+#include "FrameAllocator.h"
+#include "JobSystem.h"
+#include "TripleBuffer.h"
+#include "AssetLoader.h"
+#include "RetireQueue.h"
 #include <glm/glm.hpp>
 #include <functional>
 #include <random>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 /**
-*	Q[GWNX
+*	ゲームエンジンクラス
 */
 class GameEngine
 {
 public:
-	//Q[ԂXV֐̌^
+	//ゲーム状態を更新する関数の型
 	typedef std::function<void(double)> UpdateFuncType;
 
-	//Jf[^
+	//カメラデータ
 	struct CameraData
 	{
 		glm::vec3 position;
@@ -38,13 +50,49 @@ public:
 	void Run();
 	void UpdateFunc(const UpdateFuncType& func);
 	const UpdateFuncType& UpdateFunc() const;
-
-	//---Ƀo֐ǉ---
-	bool LoadTextureFromFile(const char* filename);
-	bool LoadMeshFromFile(const char* filename);
-	Entity::Entity* AddEntity(int groupId, const glm::vec3& pos, const char* meshName,
-		const char* texName, Entity::Entity::UpdateFuncType func,bool hasLight = true);
+	void SimulationThread(bool enable);
+	bool SimulationThread() const { return useSimulationThread; }
+
+	//---ここにメンバ関数を追加する---
+	bool LoadTextureFromFile(const char* filename, bool isArrayLayer = true);
+	bool LoadTextureAtlas(const char* listFilename);
+	bool LoadMeshFromFile(const char* filename,
+		Mesh::VertexFormat format = Mesh::VertexFormat::Float);
+	AssetLoader::Future LoadTextureAsync(const char* filename);
+	AssetLoader::Future LoadMeshAsync(const char* filename,
+		Mesh::VertexFormat format = Mesh::VertexFormat::Float);
+	AssetLoader::Future LoadFontAsync(const char* filename);
+	AssetLoader::Future LoadSkinnedMeshAsync(const char* filename);
+	bool UnloadMesh(Asset::Name name);
+	bool UnloadTexture(Asset::Name name);
+	size_t PendingAssetCount() const { return assetLoader.PendingCount(); }
+	void AssetUploadBudget(double seconds) { assetUploadBudget = seconds; }
+	double AssetUploadBudget() const { return assetUploadBudget; }
+	void TextureUploadBudget(size_t bytes) { textureUploadBudget = bytes; }
+	size_t TextureUploadBudget() const { return textureUploadBudget; }
+	void TextureMemoryBudget(size_t bytes);
+	size_t TextureMemoryBudget() const { return textureManager->GetSettings().budgetBytes; }
+	TextureManager::Stats GetTextureStats() const { return textureManager->GetStats(); }
+	void DumpTextureStats(std::ostream& os) const { textureManager->DumpStats(os); }
+	Asset::Handle FindTexture(Asset::Name filename) const;
+	const TexturePtr& GetTexture(Asset::Handle handle) const;
+	const TexturePtr& GetTexture(Asset::Name filename) const;
+	Entity::Entity* AddEntity(int groupId, const glm::vec3& pos, Asset::Name meshName,
+		Asset::Name texName, Entity::Entity::UpdateFuncType func,bool hasLight = true);
 	void RemoveEntity(Entity::Entity*);
+	const Entity::PrefabPtr& RegisterPrefab(const char* name, int groupId, Asset::Name meshName,
+		Asset::Name texName, Entity::Entity::UpdateFuncType func,
+		const Entity::CollisionData& collision, const glm::vec3& velocity = glm::vec3());
+	const Entity::PrefabPtr& GetPrefab(const char* name) const;
+	Entity::Entity* AddEntity(const Entity::PrefabPtr& prefab, const glm::vec3& pos);
+	size_t SpawnBatch(const Entity::PrefabPtr& prefab, const glm::vec3* positions,
+		const glm::vec3* velocities, size_t count, Entity::Entity** out = nullptr);
+	Skeletal::Character* AddCharacter(const glm::vec3& pos, Asset::Name meshName, Asset::Name texName);
+	void SkinningMode(Skeletal::SkinningMode mode) { skeletalBuffer->Mode(mode); }
+	Skeletal::SkinningMode SkinningMode() const { return skeletalBuffer->Mode(); }
+	void LodSettings(const Entity::LodSettings& settings) { entityBuffer->Lod(settings); }
+	const Entity::LodSettings& LodSettings() const { return entityBuffer->Lod(); }
+	const Entity::LodStats& GetLodStats() const { return entityBuffer->GetLodStats(); }
 	void Light(int index, const Uniform::PointLight& light);
 	const Uniform::PointLight& Light(int index) const;
 	void AmbientLight(const glm::vec4& color);
@@ -52,6 +100,8 @@ public:
 	void Camera(const CameraData& cam);
 	const CameraData& Camera() const;
 	std::mt19937& Rand();
+	FrameAllocator& GetFrameAllocator() { return frameAllocator; }
+	JobSystem& GetJobSystem() { return jobSystem; }
 	const GamePad& GetGamePad() const;
 
 	bool InitAudio(const char* acfPath, const char* acbPath, const char* awbPath, const char* dspBusName);
@@ -77,24 +127,49 @@ public:
 	void Score(int s) { score = s; }
 	int Score() const { return score; }
 
-	const TexturePtr& GetTexture(const char* filename) const
-	{
-		return textureBuffer.find(filename)->second;
-	}
-
 private:
 	GameEngine() = default;
 	~GameEngine();
 	GameEngine(const GameEngine&) = delete;
+
+	/**
+	*	シミュレーションスレッドから描画スレッドに渡す1フレーム分のデータ
+	*
+	*	公開後は書き換えられないので、描画スレッドはロックせずに参照できる
+	*/
+	struct RenderSnapshot
+	{
+		Entity::RenderData entity;	///<エンティティの変換行列と描画命令
+		Skeletal::RenderData skeletal;	///<キャラクターの行列パレットと描画命令
+		Font::DrawData font;	///<文字列の頂点データとフォントテクスチャ
+		Uniform::LightData lightData;	///<ライトの設定
+		uint64_t generation = 0;	///<スナップショットの世代(RetireQueue::Publishの戻り値)
+	};
+
 	void Update(double delta);
-	void Render() const;
+	void Render(const RenderSnapshot& snapshot);
+	void SimulationLoop();
+	void PostGamePad();
+	void FetchGamePad();
 
 private:
 	bool isInitialized = false;
 	UpdateFuncType updateFunc;
 
+	//シミュレーションスレッド関連
+	bool useSimulationThread = false;
+	std::atomic<bool> isSimulationRunning{ false };
+	TripleBuffer<RenderSnapshot> snapshotBuffer;
+	std::mutex snapshotMutex;
+	std::condition_variable snapshotCondition;
+
+	//描画スレッドで取得したゲームパッドの状態を、シミュレーションスレッドに渡すための変数
+	std::mutex gamePadMutex;
+	GamePad pendingGamePad{};
+	GamePad gamePad{};
+
 private:
-	//---Ƀoϐǉ---
+	//---ここにメンバ変数を追加する---
 	GLuint vbo = 0;
 	GLuint ibo = 0;
 	GLuint vao = 0;
@@ -102,13 +177,28 @@ private:
 	UniformBufferPtr uboPostEffect;
 	Shader::ProgramPtr progTutorial;
 	Shader::ProgramPtr progColorFilter;
+	Shader::ProgramPtr progSkinning;
+	Shader::ProgramPtr progTutorialIndirect;	///<progTutorialの間接描画版(GL4.3以降でのみ作成)
 	OffscreenBufferPtr offscreen;
 
-	std::unordered_map<std::string, TexturePtr> textureBuffer;
+	Asset::Registry<TexturePtr> textureBuffer;
+	TexturePoolPtr texturePool;	///<エンティティ用テクスチャを詰めるテクスチャ配列のプール
+	std::unordered_map<std::string, Entity::PrefabPtr> prefabBuffer;
 	Mesh::BufferPtr meshBuffer;
 	Entity::BufferPtr entityBuffer;
+	Skeletal::BufferPtr skeletalBuffer;
 
 	Font::Renderer fontRenderer;
+	FrameAllocator frameAllocator;
+	JobSystem jobSystem;
+	AssetLoader assetLoader;
+	double assetUploadBudget = 0.002;	///<1フレームでアセットの転送に使ってよい時間(秒)
+	TextureUploaderPtr textureUploader;	///<テクスチャを分割して転送する(永続的なマップが使えなければnullptr)
+	size_t textureUploadBudget = 4 * 1024 * 1024;	///<1フレームでテクスチャの転送に使ってよいバイト数
+	TextureManagerPtr textureManager;	///<テクスチャのGPUメモリ使用量を上限内に収める
+	//描画中のスナップショットが参照しているオブジェクトを安全に解放する
+	//メッシュバッファなどより先に破棄されるよう、それらより後ろで宣言する
+	RetireQueue retireQueue;
 
 	Uniform::LightData lightData;
 	CameraData camera;
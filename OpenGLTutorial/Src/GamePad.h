@@ -5,7 +5,7 @@
 #include <stdint.h>
 
 /**
-*	Q[pbh
+*	ゲームパッド情報
 */
 struct GamePad
 {
@@ -23,8 +23,8 @@ struct GamePad
 		L			= 0x0200,
 		R			= 0x0400,
 	};
-	//ĂԃtO
+	//押されている間フラグが立つ
 	uint32_t buttons;
-	//ꂽuԂtO
+	//押された瞬間だけフラグが立つ
 	uint32_t buttonDown;
 };
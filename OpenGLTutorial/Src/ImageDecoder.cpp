@@ -0,0 +1,1435 @@
+/**
+*	@file ImageDecoder.cpp
+*/
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "Memory.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <string.h>
+#include <limits.h>
+
+namespace ImageDecoder
+{
+	namespace /* unnamed */
+	{
+		/**
+		*	JobSystemがあれば並列に、なければこのスレッドで実行する
+		*/
+		void ForEach(JobSystem* jobSystem, size_t count, size_t grainSize, const JobSystem::RangeFuncType& func)
+		{
+			if (jobSystem && count > grainSize)
+			{
+				jobSystem->ParallelFor(count, grainSize, func);
+			}
+			else
+			{
+				func(0, count);
+			}
+		}
+
+		/**
+		*	ビッグエンディアンの16bit値を読む
+		*/
+		uint32_t Get16BE(const uint8_t* p)
+		{
+			return (uint32_t(p[0]) << 8) | p[1];
+		}
+
+		/**
+		*	ビッグエンディアンの32bit値を読む
+		*/
+		uint32_t Get32BE(const uint8_t* p)
+		{
+			return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+		}
+
+		//---------------------------------------------------------------------
+		// JPEG
+		//---------------------------------------------------------------------
+
+		//ジグザグ順の位置から8x8ブロック内の位置への変換表
+		const uint8_t zigzag[64] = {
+			0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+		};
+
+		const int fastBits = 9;	///<ハフマン符号を表引きで復号するビット数
+
+		/**
+		*	JPEGのハフマン符号表
+		*
+		*	fastBits以下の符号は表引きで、それより長い符号は符号長ごとの最大値と比べて復号する
+		*/
+		struct JpegHuffman
+		{
+			bool isDefined = false;
+			uint8_t fastLength[1 << fastBits];
+			uint8_t fastValue[1 << fastBits];
+			int32_t maxCode[18];
+			int32_t valueOffset[18];
+			uint8_t valueList[256];
+
+			bool Build(const uint8_t* countList, const uint8_t* values, size_t valueCount);
+		};
+
+		/**
+		*	符号長ごとの符号数と値の一覧から符号表を作る
+		*/
+		bool JpegHuffman::Build(const uint8_t* countList, const uint8_t* values, size_t valueCount)
+		{
+			if (valueCount > 256)
+			{
+				return false;
+			}
+			memcpy(valueList, values, valueCount);
+			memset(fastLength, 0, sizeof(fastLength));
+			int32_t code = 0;
+			int32_t k = 0;
+			for (int length = 1; length <= 16; ++length)
+			{
+				valueOffset[length] = k - code;
+				for (int i = 0; i < countList[length - 1]; ++i, ++code, ++k)
+				{
+					if (length <= fastBits)
+					{
+						const int first = code << (fastBits - length);
+						for (int n = 0; n < (1 << (fastBits - length)); ++n)
+						{
+							fastLength[first + n] = static_cast<uint8_t>(length);
+							fastValue[first + n] = valueList[k];
+						}
+					}
+				}
+				maxCode[length] = countList[length - 1] ? code - 1 : -1;
+				if (code > (1 << length))
+				{
+					return false;	//符号が多すぎる
+				}
+				code <<= 1;
+			}
+			isDefined = true;
+			return true;
+		}
+
+		/**
+		*	エントロピー符号化データを読むビットリーダー
+		*
+		*	0xFFの後の詰め物の0x00を読み飛ばし、マーカーに達したら以降は0を返す
+		*/
+		struct JpegBitReader
+		{
+			JpegBitReader(const uint8_t* begin, const uint8_t* end) : p(begin), end(end) {}
+
+			void Fill()
+			{
+				while (count <= 24)
+				{
+					uint32_t b = 0;
+					if (p < end)
+					{
+						b = *p;
+						if (b != 0xff)
+						{
+							++p;
+						}
+						else if (p + 1 < end && p[1] == 0x00)
+						{
+							p += 2;
+						}
+						else
+						{
+							p = end;
+							b = 0;
+						}
+					}
+					bits |= b << (24 - count);
+					count += 8;
+				}
+			}
+			uint32_t Peek16() { Fill(); return bits >> 16; }
+			void Skip(int n) { bits <<= n; count -= n; }
+			int Get(int n)
+			{
+				if (n == 0)
+				{
+					return 0;
+				}
+				Fill();
+				const int v = static_cast<int>(bits >> (32 - n));
+				Skip(n);
+				return v;
+			}
+
+			const uint8_t* p;
+			const uint8_t* end;
+			uint32_t bits = 0;	///<上位ビットから詰めたビット列
+			int count = 0;	///<bitsの有効なビット数
+		};
+
+		/**
+		*	ハフマン符号を1つ復号する
+		*
+		*@return 復号した値(符号が不正な場合は-1)
+		*/
+		int DecodeHuffman(JpegBitReader& reader, const JpegHuffman& table)
+		{
+			const uint32_t peek = reader.Peek16();
+			const uint32_t index = peek >> (16 - fastBits);
+			if (table.fastLength[index])
+			{
+				reader.Skip(table.fastLength[index]);
+				return table.fastValue[index];
+			}
+			for (int length = fastBits + 1; length <= 16; ++length)
+			{
+				const int32_t code = static_cast<int32_t>(peek >> (16 - length));
+				if (code <= table.maxCode[length])
+				{
+					reader.Skip(length);
+					return table.valueList[code + table.valueOffset[length]];
+				}
+			}
+			return -1;
+		}
+
+		/**
+		*	読み取ったビット列を符号付きの値に変換する
+		*/
+		int Extend(int v, int bitCount)
+		{
+			return v < (1 << (bitCount - 1)) ? v - (1 << bitCount) + 1 : v;
+		}
+
+		/**
+		*	JPEGの色成分1つ分の情報
+		*/
+		struct JpegComponent
+		{
+			int id = 0;
+			int h = 1;	///<水平方向のサンプリング係数
+			int v = 1;	///<垂直方向のサンプリング係数
+			int quantTable = 0;
+			int dcTable = 0;
+			int acTable = 0;
+			int planeWidth = 0;	///<展開先の平面の幅(MCUの境界まで含む)
+			int planeHeight = 0;	///<展開先の平面の高さ(MCUの境界まで含む)
+		};
+
+		/**
+		*	JPEGのヘッダから読み取った情報
+		*/
+		struct JpegHeader
+		{
+			int width = 0;
+			int height = 0;
+			int componentCount = 0;
+			JpegComponent componentList[3];
+			uint16_t quantTable[4][64];	///<ジグザグ順の量子化テーブル
+			JpegHuffman dcTable[4];
+			JpegHuffman acTable[4];
+			int restartInterval = 0;	///<リスタート区間のMCU数(0なら区間なし)
+			int adobeTransform = -1;	///<Adobeマーカーの色変換(0ならRGB、-1はマーカーなし)
+			int hMax = 1;
+			int vMax = 1;
+			int mcuCountX = 0;
+			int mcuCountY = 0;
+			size_t scanOffset = 0;	///<エントロピー符号化データの先頭
+		};
+
+		/**
+		*	JPEGのヘッダを解析する
+		*
+		*@param	data	ファイルの内容
+		*@param	size	ファイルのバイト数
+		*@param	header	解析結果の格納先
+		*
+		*@retval true	ベースラインJPEGで、スキャンの先頭まで解析できた
+		*@retval false	JPEGでないか、対応していない形式
+		*/
+		bool ParseJpeg(const uint8_t* data, size_t size, JpegHeader& header)
+		{
+			if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+			{
+				return false;
+			}
+			bool hasFrame = false;
+			size_t pos = 2;
+			while (pos + 4 <= size)
+			{
+				if (data[pos] != 0xff)
+				{
+					return false;
+				}
+				const uint8_t marker = data[pos + 1];
+				if (marker == 0xff)
+				{
+					++pos;	//詰め物
+					continue;
+				}
+				pos += 2;
+				if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8))
+				{
+					continue;	//長さを持たないマーカー
+				}
+				if (marker == 0xd9)
+				{
+					return false;	//スキャンの前に終わった
+				}
+				const size_t length = Get16BE(data + pos);
+				if (length < 2 || pos + length > size)
+				{
+					return false;
+				}
+				const uint8_t* seg = data + pos + 2;
+				const size_t segSize = length - 2;
+				switch (marker)
+				{
+				case 0xdb:	//DQT
+					for (size_t i = 0; i < segSize;)
+					{
+						const int precision = seg[i] >> 4;
+						const int id = seg[i] & 15;
+						const size_t tableSize = precision ? 128 : 64;
+						if (id > 3 || i + 1 + tableSize > segSize)
+						{
+							return false;
+						}
+						for (int n = 0; n < 64; ++n)
+						{
+							header.quantTable[id][n] = static_cast<uint16_t>(
+								precision ? Get16BE(seg + i + 1 + n * 2) : seg[i + 1 + n]);
+						}
+						i += 1 + tableSize;
+					}
+					break;
+
+				case 0xc4:	//DHT
+					for (size_t i = 0; i < segSize;)
+					{
+						if (i + 17 > segSize)
+						{
+							return false;
+						}
+						const int tableClass = seg[i] >> 4;
+						const int id = seg[i] & 15;
+						size_t valueCount = 0;
+						for (int n = 0; n < 16; ++n)
+						{
+							valueCount += seg[i + 1 + n];
+						}
+						if (tableClass > 1 || id > 3 || i + 17 + valueCount > segSize)
+						{
+							return false;
+						}
+						JpegHuffman& table = tableClass ? header.acTable[id] : header.dcTable[id];
+						if (!table.Build(seg + i + 1, seg + i + 17, valueCount))
+						{
+							return false;
+						}
+						i += 17 + valueCount;
+					}
+					break;
+
+				case 0xc0:	//SOF0(ベースライン)
+				case 0xc1:	//SOF1(拡張シーケンシャル、ハフマン符号)
+					if (segSize < 6 || seg[0] != 8)
+					{
+						return false;
+					}
+					header.height = Get16BE(seg + 1);
+					header.width = Get16BE(seg + 3);
+					header.componentCount = seg[5];
+					if (header.width == 0 || header.height == 0 ||
+						(header.componentCount != 1 && header.componentCount != 3) ||
+						segSize < 6 + size_t(header.componentCount) * 3)
+					{
+						return false;
+					}
+					for (int i = 0; i < header.componentCount; ++i)
+					{
+						JpegComponent& c = header.componentList[i];
+						c.id = seg[6 + i * 3];
+						c.h = seg[7 + i * 3] >> 4;
+						c.v = seg[7 + i * 3] & 15;
+						c.quantTable = seg[8 + i * 3];
+						if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.quantTable > 3)
+						{
+							return false;
+						}
+					}
+					hasFrame = true;
+					break;
+
+				case 0xc2: case 0xc3: case 0xc5: case 0xc6: case 0xc7:
+				case 0xc9: case 0xca: case 0xcb: case 0xcd: case 0xce: case 0xcf:
+					std::cerr << "ERROR: プログレッシブ/算術符号/ロスレスのJPEGには対応していません" << std::endl;
+					return false;
+
+				case 0xdd:	//DRI
+					if (segSize < 2)
+					{
+						return false;
+					}
+					header.restartInterval = Get16BE(seg);
+					break;
+
+				case 0xee:	//APP14(Adobe)
+					if (segSize >= 12 && memcmp(seg, "Adobe", 5) == 0)
+					{
+						header.adobeTransform = seg[11];
+					}
+					break;
+
+				case 0xda:	//SOS
+				{
+					if (!hasFrame || segSize < 1 || seg[0] != header.componentCount ||
+						segSize < 1 + size_t(header.componentCount) * 2)
+					{
+						return false;	//全成分を1つのスキャンに含むものだけに対応する
+					}
+					for (int i = 0; i < header.componentCount; ++i)
+					{
+						JpegComponent& c = header.componentList[i];
+						if (seg[1 + i * 2] != c.id)
+						{
+							return false;
+						}
+						c.dcTable = seg[2 + i * 2] >> 4;
+						c.acTable = seg[2 + i * 2] & 15;
+						if (c.dcTable > 3 || c.acTable > 3 ||
+							!header.dcTable[c.dcTable].isDefined || !header.acTable[c.acTable].isDefined)
+						{
+							return false;
+						}
+					}
+
+					//グレースケールはMCUが1ブロックになる
+					if (header.componentCount == 1)
+					{
+						header.componentList[0].h = 1;
+						header.componentList[0].v = 1;
+					}
+					for (int i = 0; i < header.componentCount; ++i)
+					{
+						header.hMax = std::max(header.hMax, header.componentList[i].h);
+						header.vMax = std::max(header.vMax, header.componentList[i].v);
+					}
+					header.mcuCountX = (header.width + header.hMax * 8 - 1) / (header.hMax * 8);
+					header.mcuCountY = (header.height + header.vMax * 8 - 1) / (header.vMax * 8);
+					for (int i = 0; i < header.componentCount; ++i)
+					{
+						JpegComponent& c = header.componentList[i];
+						c.planeWidth = header.mcuCountX * c.h * 8;
+						c.planeHeight = header.mcuCountY * c.v * 8;
+					}
+					header.scanOffset = pos + length;
+					return true;
+				}
+
+				default:
+					break;	//APPnやCOMなどは読み飛ばす
+				}
+				pos += length;
+			}
+			return false;
+		}
+
+		/**
+		*	8x8の逆DCTの係数表
+		*/
+		struct IdctTable
+		{
+			IdctTable()
+			{
+				const double pi = 3.14159265358979323846;
+				for (int x = 0; x < 8; ++x)
+				{
+					for (int u = 0; u < 8; ++u)
+					{
+						const double c = u == 0 ? sqrt(0.5) : 1.0;
+						cosine[x][u] = static_cast<float>(c * 0.5 * cos((2 * x + 1) * u * pi / 16));
+					}
+				}
+			}
+			float cosine[8][8];	///<[空間の位置][周波数]
+		};
+
+		/**
+		*	8x8ブロックを逆DCTして平面に書き込む
+		*
+		*@param	coef	ブロック内の位置に並べた逆量子化済みの係数
+		*@param	dst		書き込み先の左上
+		*@param	stride	書き込み先の1行のバイト数
+		*/
+		void InverseDct(const int* coef, uint8_t* dst, int stride)
+		{
+			static const IdctTable table;
+			bool hasAc = false;
+			for (int i = 1; i < 64 && !hasAc; ++i)
+			{
+				hasAc = coef[i] != 0;
+			}
+			if (!hasAc)
+			{
+				//直流成分だけなら全画素が同じ値になる
+				const int value = static_cast<int>(lroundf(coef[0] * 0.125f)) + 128;
+				const uint8_t c = static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+				for (int y = 0; y < 8; ++y)
+				{
+					memset(dst + y * stride, c, 8);
+				}
+				return;
+			}
+
+			//行ごとに横方向、次に列ごとに縦方向の逆DCTを行う
+			float tmp[64];
+			for (int y = 0; y < 8; ++y)
+			{
+				const int* row = coef + y * 8;
+				for (int x = 0; x < 8; ++x)
+				{
+					float sum = 0;
+					for (int u = 0; u < 8; ++u)
+					{
+						sum += table.cosine[x][u] * row[u];
+					}
+					tmp[y * 8 + x] = sum;
+				}
+			}
+			for (int x = 0; x < 8; ++x)
+			{
+				for (int y = 0; y < 8; ++y)
+				{
+					float sum = 0;
+					for (int v = 0; v < 8; ++v)
+					{
+						sum += table.cosine[y][v] * tmp[v * 8 + x];
+					}
+					const int value = static_cast<int>(lroundf(sum)) + 128;
+					dst[y * stride + x] = static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+				}
+			}
+		}
+
+		/**
+		*	8x8ブロック1つ分の係数を復号する
+		*
+		*@param	reader		ビットリーダー
+		*@param	header		ヘッダ情報
+		*@param	component	ブロックの色成分
+		*@param	dcPredictor	直流成分の予測値(更新される)
+		*@param	coef		逆量子化した係数の格納先(ブロック内の位置の順)
+		*
+		*@retval true	復号成功
+		*@retval false	符号が不正
+		*/
+		bool DecodeBlock(JpegBitReader& reader, const JpegHeader& header, const JpegComponent& component,
+			int& dcPredictor, int* coef)
+		{
+			const uint16_t* quant = header.quantTable[component.quantTable];
+			memset(coef, 0, sizeof(int) * 64);
+			const int dcBits = DecodeHuffman(reader, header.dcTable[component.dcTable]);
+			if (dcBits < 0 || dcBits > 11)
+			{
+				return false;
+			}
+			dcPredictor += dcBits ? Extend(reader.Get(dcBits), dcBits) : 0;
+			coef[0] = dcPredictor * quant[0];
+
+			const JpegHuffman& acTable = header.acTable[component.acTable];
+			for (int k = 1; k < 64;)
+			{
+				const int rs = DecodeHuffman(reader, acTable);
+				if (rs < 0)
+				{
+					return false;
+				}
+				const int run = rs >> 4;
+				const int bitCount = rs & 15;
+				if (bitCount == 0)
+				{
+					if (run != 15)
+					{
+						break;	//EOB
+					}
+					k += 16;
+					continue;
+				}
+				k += run;
+				if (k > 63)
+				{
+					return false;
+				}
+				coef[zigzag[k]] = Extend(reader.Get(bitCount), bitCount) * quant[k];
+				++k;
+			}
+			return true;
+		}
+
+		/**
+		*	リスタート区間1つ分のMCUを復号する
+		*
+		*@param	header		ヘッダ情報
+		*@param	begin		区間のエントロピー符号化データの先頭
+		*@param	end			区間のエントロピー符号化データの終端(リスタートマーカーを含まない)
+		*@param	firstMcu	区間の最初のMCUの番号
+		*@param	mcuCount	区間のMCUの数
+		*@param	planeList	成分ごとの展開先
+		*
+		*区間の先頭では直流成分の予測値が0に戻るので、区間どうしは独立に復号できる
+		*/
+		bool DecodeInterval(const JpegHeader& header, const uint8_t* begin, const uint8_t* end,
+			int firstMcu, int mcuCount, uint8_t* const* planeList)
+		{
+			JpegBitReader reader(begin, end);
+			int dcPredictor[3] = {};
+			int coef[64];
+			for (int mcu = firstMcu; mcu < firstMcu + mcuCount; ++mcu)
+			{
+				const int mcuX = mcu % header.mcuCountX;
+				const int mcuY = mcu / header.mcuCountX;
+				for (int i = 0; i < header.componentCount; ++i)
+				{
+					const JpegComponent& c = header.componentList[i];
+					for (int by = 0; by < c.v; ++by)
+					{
+						for (int bx = 0; bx < c.h; ++bx)
+						{
+							if (!DecodeBlock(reader, header, c, dcPredictor[i], coef))
+							{
+								return false;
+							}
+							const int x = (mcuX * c.h + bx) * 8;
+							const int y = (mcuY * c.v + by) * 8;
+							InverseDct(coef, planeList[i] + size_t(y) * c.planeWidth + x, c.planeWidth);
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		/**
+		*	JPEGを展開する
+		*/
+		bool DecodeJpeg(const uint8_t* data, size_t size, const Info& info, uint8_t* output, JobSystem* jobSystem)
+		{
+			JpegHeader header;
+			if (!ParseJpeg(data, size, header))
+			{
+				return false;
+			}
+
+			//リスタートマーカーの位置で区間に分ける
+			std::vector<const uint8_t*> beginList(1, data + header.scanOffset);
+			std::vector<const uint8_t*> endList;
+			size_t pos = header.scanOffset;
+			while (pos + 1 < size)
+			{
+				if (data[pos] != 0xff || data[pos + 1] == 0x00)
+				{
+					pos += data[pos] == 0xff ? 2 : 1;
+					continue;
+				}
+				if (data[pos + 1] == 0xff)
+				{
+					++pos;
+					continue;
+				}
+				if (data[pos + 1] >= 0xd0 && data[pos + 1] <= 0xd7)
+				{
+					endList.push_back(data + pos);
+					beginList.push_back(data + pos + 2);
+					pos += 2;
+					continue;
+				}
+				break;	//スキャンの終わり
+			}
+			endList.push_back(data + std::min(pos, size));
+
+			const int totalMcuCount = header.mcuCountX * header.mcuCountY;
+			const int interval = header.restartInterval ? header.restartInterval : totalMcuCount;
+			const size_t intervalCount = size_t((totalMcuCount + interval - 1) / interval);
+			if (beginList.size() < intervalCount)
+			{
+				//リスタートマーカーが足りない場合、残りのMCUを復号できない
+				std::cerr << "ERROR: JPEGのリスタートマーカーが足りません(" << beginList.size() - 1 << "/" <<
+					intervalCount - 1 << ")" << std::endl;
+				return false;
+			}
+
+			Memory::Vector<uint8_t, Memory::Tag::Texture> planeBuffer[3];
+			uint8_t* planeList[3] = {};
+			for (int i = 0; i < header.componentCount; ++i)
+			{
+				const JpegComponent& c = header.componentList[i];
+				planeBuffer[i].resize(size_t(c.planeWidth) * c.planeHeight);
+				planeList[i] = planeBuffer[i].data();
+			}
+			std::atomic<bool> isSucceeded(true);
+			ForEach(jobSystem, intervalCount, 1, [&](size_t first, size_t last) {
+				for (size_t i = first; i < last; ++i)
+				{
+					const int firstMcu = static_cast<int>(i) * interval;
+					const int mcuCount = std::min(interval, totalMcuCount - firstMcu);
+					if (!DecodeInterval(header, beginList[i], endList[i], firstMcu, mcuCount, planeList))
+					{
+						isSucceeded = false;
+					}
+				}
+			});
+			if (!isSucceeded)
+			{
+				std::cerr << "ERROR: JPEGのデータが壊れています" << std::endl;
+				return false;
+			}
+
+			//色空間を変換し、下の行から順に書き込む
+			const bool isYCbCr = header.componentCount == 3 && header.adobeTransform != 0 &&
+				!(header.componentList[0].id == 'R' && header.componentList[1].id == 'G');
+			const size_t rowBytes = info.RowBytes();
+			ForEach(jobSystem, header.height, 16, [&](size_t first, size_t last) {
+				for (size_t y = first; y < last; ++y)
+				{
+					uint8_t* dst = output + rowBytes * (header.height - 1 - y);
+					const uint8_t* rowList[3];
+					for (int i = 0; i < header.componentCount; ++i)
+					{
+						const JpegComponent& c = header.componentList[i];
+						rowList[i] = planeList[i] + (y * c.v / header.vMax) * c.planeWidth;
+					}
+					if (header.componentCount == 1)
+					{
+						memcpy(dst, rowList[0], header.width);
+						continue;
+					}
+					const JpegComponent* c = header.componentList;
+					for (int x = 0; x < header.width; ++x, dst += 3)
+					{
+						const int c0 = rowList[0][x * c[0].h / header.hMax];
+						const int c1 = rowList[1][x * c[1].h / header.hMax];
+						const int c2 = rowList[2][x * c[2].h / header.hMax];
+						if (!isYCbCr)
+						{
+							dst[0] = static_cast<uint8_t>(c0);
+							dst[1] = static_cast<uint8_t>(c1);
+							dst[2] = static_cast<uint8_t>(c2);
+							continue;
+						}
+						//JFIFの定義による変換(16bit固定小数点)
+						const int yy = (c0 << 16) + 32768;
+						const int cb = c1 - 128;
+						const int cr = c2 - 128;
+						const int r = (yy + 91881 * cr) >> 16;
+						const int g = (yy - 22554 * cb - 46802 * cr) >> 16;
+						const int b = (yy + 116130 * cb) >> 16;
+						dst[0] = static_cast<uint8_t>(std::min(std::max(r, 0), 255));
+						dst[1] = static_cast<uint8_t>(std::min(std::max(g, 0), 255));
+						dst[2] = static_cast<uint8_t>(std::min(std::max(b, 0), 255));
+					}
+				}
+			});
+			return true;
+		}
+
+		//---------------------------------------------------------------------
+		// PNG (zlib)
+		//---------------------------------------------------------------------
+
+		/**
+		*	deflateのビットリーダー(下位ビットから読む)
+		*/
+		struct InflateReader
+		{
+			InflateReader(const uint8_t* begin, const uint8_t* end) : p(begin), end(end) {}
+
+			void Need(int n)
+			{
+				while (count < n)
+				{
+					uint64_t b = 0;
+					if (p < end)
+					{
+						b = *p++;
+					}
+					else
+					{
+						++overrun;
+					}
+					bits |= b << count;
+					count += 8;
+				}
+			}
+			uint32_t Get(int n)
+			{
+				if (n == 0)
+				{
+					return 0;
+				}
+				Need(n);
+				const uint32_t v = static_cast<uint32_t>(bits & ((uint64_t(1) << n) - 1));
+				bits >>= n;
+				count -= n;
+				return v;
+			}
+			bool IsOverrun() const { return overrun * 8 > count; }	//実際に終端を超えて読んだか
+
+			const uint8_t* p;
+			const uint8_t* end;
+			uint64_t bits = 0;
+			int count = 0;
+			int overrun = 0;	///<終端を超えて補った0のバイト数
+		};
+
+		/**
+		*	deflateのハフマン符号表
+		*
+		*	fastBits以下の符号は表引きで、それより長い符号は1ビットずつ正準符号をたどって復号する
+		*/
+		struct InflateHuffman
+		{
+			uint16_t fast[1 << fastBits];	///<(値 << 4) | 符号長、0なら表にない
+			uint16_t countList[16];
+			uint16_t symbolList[288];
+
+			bool Build(const uint8_t* lengthList, int symbolCount);
+			int Decode(InflateReader& reader) const;
+		};
+
+		/**
+		*	値ごとの符号長から符号表を作る
+		*/
+		bool InflateHuffman::Build(const uint8_t* lengthList, int symbolCount)
+		{
+			memset(countList, 0, sizeof(countList));
+			memset(fast, 0, sizeof(fast));
+			for (int i = 0; i < symbolCount; ++i)
+			{
+				++countList[lengthList[i]];
+			}
+			countList[0] = 0;
+			int left = 1;
+			for (int length = 1; length < 16; ++length)
+			{
+				left = (left << 1) - countList[length];
+				if (left < 0)
+				{
+					return false;	//符号が多すぎる
+				}
+			}
+			uint16_t offset[16] = {};
+			uint16_t nextCode[16] = {};
+			for (int length = 1; length < 15; ++length)
+			{
+				offset[length + 1] = offset[length] + countList[length];
+			}
+			for (int length = 1, code = 0; length < 16; ++length)
+			{
+				code = (code + countList[length - 1]) << 1;
+				nextCode[length] = static_cast<uint16_t>(code);
+			}
+			for (int i = 0; i < symbolCount; ++i)
+			{
+				const int length = lengthList[i];
+				if (length == 0)
+				{
+					continue;
+				}
+				symbolList[offset[length]++] = static_cast<uint16_t>(i);
+				const int code = nextCode[length]++;
+				if (length <= fastBits)
+				{
+					//deflateの符号は上位ビットから格納されるので、ビット順を反転して表を引く
+					int reversed = 0;
+					for (int b = 0; b < length; ++b)
+					{
+						reversed |= ((code >> b) & 1) << (length - 1 - b);
+					}
+					for (int n = reversed; n < (1 << fastBits); n += 1 << length)
+					{
+						fast[n] = static_cast<uint16_t>((i << 4) | length);
+					}
+				}
+			}
+			return true;
+		}
+
+		/**
+		*	ハフマン符号を1つ復号する
+		*
+		*@return 復号した値(符号が不正な場合は-1)
+		*/
+		int InflateHuffman::Decode(InflateReader& reader) const
+		{
+			reader.Need(fastBits);
+			const uint16_t e = fast[reader.bits & ((1 << fastBits) - 1)];
+			if (e)
+			{
+				reader.Get(e & 15);
+				return e >> 4;
+			}
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for (int length = 1; length < 16; ++length)
+			{
+				code |= static_cast<int>(reader.Get(1));
+				const int count = countList[length];
+				if (code - count < first)
+				{
+					return symbolList[index + (code - first)];
+				}
+				index += count;
+				first += count;
+				first <<= 1;
+				code <<= 1;
+			}
+			return -1;
+		}
+
+		/**
+		*	zlib形式のデータを展開する
+		*
+		*@param	src			圧縮データ
+		*@param	srcSize		圧縮データのバイト数
+		*@param	dst			展開先
+		*@param	dstSize		展開後のバイト数(これより多くても少なくても失敗とする)
+		*/
+		bool Inflate(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+		{
+			static const uint16_t lengthBase[29] = {
+				3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+				35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const uint8_t lengthExtra[29] = {
+				0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const uint16_t distanceBase[30] = {
+				1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+				257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const uint8_t distanceExtra[30] = {
+				0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+			static const uint8_t codeLengthOrder[19] = {
+				16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			if (srcSize < 2 || (src[0] & 15) != 8 || ((src[0] << 8) | src[1]) % 31 || (src[1] & 0x20))
+			{
+				return false;
+			}
+			InflateReader reader(src + 2, src + srcSize);
+			size_t written = 0;
+			InflateHuffman literal;
+			InflateHuffman distance;
+			for (bool isFinal = false; !isFinal;)
+			{
+				isFinal = reader.Get(1) != 0;
+				const uint32_t type = reader.Get(2);
+				if (type == 0)
+				{
+					//無圧縮ブロック
+					reader.Get(reader.count % 8);
+					const uint32_t length = reader.Get(16);
+					const uint32_t inverse = reader.Get(16);
+					if ((length ^ 0xffff) != inverse || written + length > dstSize)
+					{
+						return false;
+					}
+					uint32_t i = 0;
+					for (; i < length && reader.count > 0; ++i)
+					{
+						dst[written++] = static_cast<uint8_t>(reader.Get(8));
+					}
+					const size_t rest = length - i;
+					if (size_t(reader.end - reader.p) < rest)
+					{
+						return false;
+					}
+					memcpy(dst + written, reader.p, rest);
+					reader.p += rest;
+					written += rest;
+					continue;
+				}
+				if (type == 1)
+				{
+					//固定ハフマン符号
+					uint8_t lengthList[288 + 32];
+					memset(lengthList, 8, 144);
+					memset(lengthList + 144, 9, 112);
+					memset(lengthList + 256, 7, 24);
+					memset(lengthList + 280, 8, 8);
+					memset(lengthList + 288, 5, 32);
+					literal.Build(lengthList, 288);
+					distance.Build(lengthList + 288, 30);
+				}
+				else if (type == 2)
+				{
+					//動的ハフマン符号
+					const int literalCount = reader.Get(5) + 257;
+					const int distanceCount = reader.Get(5) + 1;
+					const int codeLengthCount = reader.Get(4) + 4;
+					uint8_t codeLengthList[19] = {};
+					for (int i = 0; i < codeLengthCount; ++i)
+					{
+						codeLengthList[codeLengthOrder[i]] = static_cast<uint8_t>(reader.Get(3));
+					}
+					InflateHuffman codeLength;
+					if (literalCount > 286 || distanceCount > 30 || !codeLength.Build(codeLengthList, 19))
+					{
+						return false;
+					}
+					uint8_t lengthList[288 + 32] = {};
+					for (int i = 0; i < literalCount + distanceCount;)
+					{
+						const int symbol = codeLength.Decode(reader);
+						if (symbol < 0)
+						{
+							return false;
+						}
+						if (symbol < 16)
+						{
+							lengthList[i++] = static_cast<uint8_t>(symbol);
+							continue;
+						}
+						int repeat = 0;
+						uint8_t value = 0;
+						if (symbol == 16)
+						{
+							if (i == 0)
+							{
+								return false;
+							}
+							value = lengthList[i - 1];
+							repeat = 3 + reader.Get(2);
+						}
+						else if (symbol == 17)
+						{
+							repeat = 3 + reader.Get(3);
+						}
+						else
+						{
+							repeat = 11 + reader.Get(7);
+						}
+						if (i + repeat > literalCount + distanceCount)
+						{
+							return false;
+						}
+						for (; repeat > 0; --repeat)
+						{
+							lengthList[i++] = value;
+						}
+					}
+					if (!literal.Build(lengthList, literalCount) ||
+						!distance.Build(lengthList + literalCount, distanceCount))
+					{
+						return false;
+					}
+				}
+				else
+				{
+					return false;
+				}
+
+				//符号化されたブロック
+				for (;;)
+				{
+					const int symbol = literal.Decode(reader);
+					if (symbol < 0 || reader.IsOverrun())
+					{
+						return false;
+					}
+					if (symbol < 256)
+					{
+						if (written >= dstSize)
+						{
+							return false;
+						}
+						dst[written++] = static_cast<uint8_t>(symbol);
+						continue;
+					}
+					if (symbol == 256)
+					{
+						break;
+					}
+					const int lengthIndex = symbol - 257;
+					if (lengthIndex >= 29)
+					{
+						return false;
+					}
+					const size_t length = lengthBase[lengthIndex] + reader.Get(lengthExtra[lengthIndex]);
+					const int distanceIndex = distance.Decode(reader);
+					if (distanceIndex < 0 || distanceIndex >= 30)
+					{
+						return false;
+					}
+					const size_t dist = distanceBase[distanceIndex] + reader.Get(distanceExtra[distanceIndex]);
+					if (dist > written || written + length > dstSize)
+					{
+						return false;
+					}
+					//範囲が重なることがあるので、1バイトずつ複写する
+					const uint8_t* from = dst + written - dist;
+					for (size_t i = 0; i < length; ++i)
+					{
+						dst[written + i] = from[i];
+					}
+					written += length;
+				}
+			}
+			return written == dstSize && !reader.IsOverrun();
+		}
+
+		/**
+		*	PNGのヘッダから読み取った情報
+		*/
+		struct PngHeader
+		{
+			int width = 0;
+			int height = 0;
+			int bitDepth = 0;
+			int colorType = 0;
+			int sourceChannelCount = 0;	///<ファイル内の1画素の要素数
+			uint8_t palette[256][4];	///<RGBA
+			int paletteCount = 0;
+			bool hasTransparency = false;	///<パレットにtRNSがある
+			std::vector<std::pair<const uint8_t*, size_t>> dataList;	///<IDATチャンクの内容
+			size_t dataSize = 0;	///<IDATの合計バイト数
+		};
+
+		/**
+		*	PNGのチャンクを解析する
+		*/
+		bool ParsePng(const uint8_t* data, size_t size, PngHeader& header)
+		{
+			static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			if (size < 8 + 25 || memcmp(data, signature, 8) != 0)
+			{
+				return false;
+			}
+			bool hasHeader = false;
+			for (size_t pos = 8; pos + 12 <= size;)
+			{
+				const size_t length = Get32BE(data + pos);
+				const uint8_t* type = data + pos + 4;
+				const uint8_t* body = data + pos + 8;
+				if (length > size - pos - 12)
+				{
+					return false;
+				}
+				if (memcmp(type, "IHDR", 4) == 0)
+				{
+					if (length < 13)
+					{
+						return false;
+					}
+					header.width = static_cast<int>(Get32BE(body));
+					header.height = static_cast<int>(Get32BE(body + 4));
+					header.bitDepth = body[8];
+					header.colorType = body[9];
+					if (body[10] != 0 || body[11] != 0)
+					{
+						return false;
+					}
+					if (body[12] != 0)
+					{
+						std::cerr << "ERROR: インターレースしたPNGには対応していません" << std::endl;
+						return false;
+					}
+					switch (header.colorType)
+					{
+					case 0: header.sourceChannelCount = 1; break;
+					case 2: header.sourceChannelCount = 3; break;
+					case 3: header.sourceChannelCount = 1; break;
+					case 4: header.sourceChannelCount = 2; break;
+					case 6: header.sourceChannelCount = 4; break;
+					default: return false;
+					}
+					const int bd = header.bitDepth;
+					const bool isValidDepth = header.colorType == 0 ? (bd == 1 || bd == 2 || bd == 4 || bd == 8 || bd == 16) :
+						header.colorType == 3 ? (bd == 1 || bd == 2 || bd == 4 || bd == 8) : (bd == 8 || bd == 16);
+					if (!isValidDepth || header.width <= 0 || header.height <= 0)
+					{
+						return false;
+					}
+					hasHeader = true;
+				}
+				else if (memcmp(type, "PLTE", 4) == 0)
+				{
+					header.paletteCount = static_cast<int>(std::min<size_t>(length / 3, 256));
+					for (int i = 0; i < header.paletteCount; ++i)
+					{
+						header.palette[i][0] = body[i * 3 + 0];
+						header.palette[i][1] = body[i * 3 + 1];
+						header.palette[i][2] = body[i * 3 + 2];
+						header.palette[i][3] = 255;
+					}
+				}
+				else if (memcmp(type, "tRNS", 4) == 0)
+				{
+					if (header.colorType == 3)
+					{
+						for (size_t i = 0; i < length && i < 256; ++i)
+						{
+							header.palette[i][3] = body[i];
+						}
+						header.hasTransparency = true;
+					}
+				}
+				else if (memcmp(type, "IDAT", 4) == 0)
+				{
+					header.dataList.push_back(std::make_pair(body, length));
+					header.dataSize += length;
+				}
+				else if (memcmp(type, "IEND", 4) == 0)
+				{
+					break;
+				}
+				pos += 12 + length;
+			}
+			return hasHeader && header.dataSize > 0 && (header.colorType != 3 || header.paletteCount > 0);
+		}
+
+		/**
+		*	Paethフィルタの予測値
+		*/
+		int Paeth(int a, int b, int c)
+		{
+			const int p = a + b - c;
+			const int pa = abs(p - a);
+			const int pb = abs(p - b);
+			const int pc = abs(p - c);
+			return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+		}
+
+		/**
+		*	PNGを展開する
+		*/
+		bool DecodePng(const uint8_t* data, size_t size, const Info& info, uint8_t* output, JobSystem* jobSystem)
+		{
+			PngHeader header;
+			if (!ParsePng(data, size, header))
+			{
+				return false;
+			}
+
+			//IDATが複数ある場合だけ連結する
+			Memory::Vector<uint8_t, Memory::Tag::Texture> joined;
+			const uint8_t* compressed = header.dataList[0].first;
+			if (header.dataList.size() > 1)
+			{
+				joined.reserve(header.dataSize);
+				for (const auto& e : header.dataList)
+				{
+					joined.insert(joined.end(), e.first, e.first + e.second);
+				}
+				compressed = joined.data();
+			}
+
+			//展開と逆フィルタは前の行に依存するので、順番に処理する
+			const size_t stride = (size_t(header.width) * header.sourceChannelCount * header.bitDepth + 7) / 8;
+			const int pixelBytes = std::max(1, header.sourceChannelCount * header.bitDepth / 8);
+			Memory::Vector<uint8_t, Memory::Tag::Texture> raw((stride + 1) * header.height);
+			if (!Inflate(compressed, header.dataSize, raw.data(), raw.size()))
+			{
+				std::cerr << "ERROR: PNGのデータが壊れています" << std::endl;
+				return false;
+			}
+			for (int y = 0; y < header.height; ++y)
+			{
+				uint8_t* row = raw.data() + (stride + 1) * y + 1;
+				const uint8_t* prev = y ? row - (stride + 1) : nullptr;
+				switch (row[-1])
+				{
+				case 0:
+					break;
+				case 1:
+					for (size_t i = pixelBytes; i < stride; ++i)
+					{
+						row[i] = static_cast<uint8_t>(row[i] + row[i - pixelBytes]);
+					}
+					break;
+				case 2:
+					for (size_t i = 0; prev && i < stride; ++i)
+					{
+						row[i] = static_cast<uint8_t>(row[i] + prev[i]);
+					}
+					break;
+				case 3:
+					for (size_t i = 0; i < stride; ++i)
+					{
+						const int a = i >= size_t(pixelBytes) ? row[i - pixelBytes] : 0;
+						const int b = prev ? prev[i] : 0;
+						row[i] = static_cast<uint8_t>(row[i] + ((a + b) >> 1));
+					}
+					break;
+				case 4:
+					for (size_t i = 0; i < stride; ++i)
+					{
+						const int a = i >= size_t(pixelBytes) ? row[i - pixelBytes] : 0;
+						const int b = prev ? prev[i] : 0;
+						const int c = (prev && i >= size_t(pixelBytes)) ? prev[i - pixelBytes] : 0;
+						row[i] = static_cast<uint8_t>(row[i] + Paeth(a, b, c));
+					}
+					break;
+				default:
+					std::cerr << "ERROR: PNGのフィルタの種類が不正です" << std::endl;
+					return false;
+				}
+			}
+
+			//要素を8bitに揃え、下の行から順に書き込む
+			const size_t rowBytes = info.RowBytes();
+			const int bitDepth = header.bitDepth;
+			const int sourceChannelCount = header.sourceChannelCount;
+			ForEach(jobSystem, header.height, 32, [&](size_t first, size_t last) {
+				for (size_t y = first; y < last; ++y)
+				{
+					const uint8_t* src = raw.data() + (stride + 1) * y + 1;
+					uint8_t* dst = output + rowBytes * (header.height - 1 - y);
+					for (int x = 0; x < header.width; ++x, dst += info.channelCount)
+					{
+						uint8_t sample[4];
+						for (int c = 0; c < sourceChannelCount; ++c)
+						{
+							const size_t i = size_t(x) * sourceChannelCount + c;
+							if (bitDepth == 8)
+							{
+								sample[c] = src[i];
+							}
+							else if (bitDepth == 16)
+							{
+								sample[c] = src[i * 2];
+							}
+							else
+							{
+								const size_t bit = i * bitDepth;
+								const int mask = (1 << bitDepth) - 1;
+								const int v = (src[bit / 8] >> (8 - bitDepth - bit % 8)) & mask;
+								sample[c] = static_cast<uint8_t>(header.colorType == 3 ? v : v * 255 / mask);
+							}
+						}
+						switch (header.colorType)
+						{
+						case 0:
+							dst[0] = sample[0];
+							break;
+						case 2:
+						case 6:
+							memcpy(dst, sample, info.channelCount);
+							break;
+						case 3:
+							memcpy(dst, header.palette[std::min<int>(sample[0], header.paletteCount - 1)], info.channelCount);
+							break;
+						case 4:
+							dst[0] = dst[1] = dst[2] = sample[0];
+							dst[3] = sample[1];
+							break;
+						}
+					}
+				}
+			});
+			return true;
+		}
+
+	} // unnamed namespace
+
+	/**
+	*画像ファイルの形式を判別する
+	*
+	*@param	data	ファイルの内容
+	*@param	size	ファイルのバイト数
+	*
+	*@return 判別した形式(JPEGでもPNGでもなければFormat::Unknown)
+	*/
+	Format Detect(const uint8_t* data, size_t size)
+	{
+		if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+		{
+			return Format::Jpeg;
+		}
+		if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)
+		{
+			return Format::Png;
+		}
+		return Format::Unknown;
+	}
+
+	/**
+	*画像の大きさと展開後の形式を調べる
+	*
+	*@param	data	ファイルの内容
+	*@param	size	ファイルのバイト数
+	*@param	info	調べた情報の格納先
+	*
+	*@retval true	展開できる画像だった
+	*@retval false	JPEGでもPNGでもないか、対応していない形式
+	*/
+	bool ReadInfo(const uint8_t* data, size_t size, Info& info)
+	{
+		info = Info();
+		info.format = Detect(data, size);
+		if (info.format == Format::Jpeg)
+		{
+			JpegHeader header;
+			if (!ParseJpeg(data, size, header))
+			{
+				return false;
+			}
+			info.width = header.width;
+			info.height = header.height;
+			info.channelCount = header.componentCount;
+			if (header.restartInterval)
+			{
+				const int mcuCount = header.mcuCountX * header.mcuCountY;
+				info.restartIntervalCount = (mcuCount + header.restartInterval - 1) / header.restartInterval;
+			}
+			return true;
+		}
+		if (info.format == Format::Png)
+		{
+			PngHeader header;
+			if (!ParsePng(data, size, header))
+			{
+				return false;
+			}
+			info.width = header.width;
+			info.height = header.height;
+			switch (header.colorType)
+			{
+			case 0: info.channelCount = 1; break;
+			case 2: info.channelCount = 3; break;
+			case 3: info.channelCount = header.hasTransparency ? 4 : 3; break;
+			default: info.channelCount = 4; break;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	*画像を展開する
+	*
+	*@param	data		ファイルの内容
+	*@param	size		ファイルのバイト数
+	*@param	info		ReadInfoで調べた情報
+	*@param	output		展開先(info.ImageBytes()バイト以上)
+	*@param	jobSystem	並列に処理するためのジョブシステム(nullptrなら並列化しない)
+	*
+	*@retval true	展開成功
+	*@retval false	データが壊れている
+	*
+	*JPEGはリスタート区間ごとに、色変換はJPEGとPNGのどちらも行ごとに並列に処理する
+	*outputはGL_PIXEL_UNPACK_BUFFERをマップしたメモリでもよい(読み出しは行わない)
+	*/
+	bool Decode(const uint8_t* data, size_t size, const Info& info, uint8_t* output, JobSystem* jobSystem)
+	{
+		switch (info.format)
+		{
+		case Format::Jpeg: return DecodeJpeg(data, size, info, output, jobSystem);
+		case Format::Png: return DecodePng(data, size, info, output, jobSystem);
+		default: return false;
+		}
+	}
+}
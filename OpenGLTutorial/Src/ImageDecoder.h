@@ -0,0 +1,47 @@
+/**
+*	@file ImageDecoder.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class JobSystem;
+
+/**
+*	JPEGとPNGの展開
+*
+*	ReadInfoで大きさと画素の形式を調べてから、呼び出し側が用意したメモリにDecodeで展開する
+*	展開先はGLへ直接転送できる形(下の行から順、行の先頭は4バイト境界)になる
+*/
+namespace ImageDecoder
+{
+	/**
+	*	画像ファイルの形式
+	*/
+	enum class Format
+	{
+		Unknown,
+		Jpeg,	///<ベースラインJPEG(ハフマン符号、8bit精度)
+		Png,	///<インターレースなしのPNG
+	};
+
+	/**
+	*	画像の情報
+	*/
+	struct Info
+	{
+		Format format = Format::Unknown;
+		int width = 0;	///<幅(ピクセル数)
+		int height = 0;	///<高さ(ピクセル数)
+		int channelCount = 0;	///<展開後の1画素の要素数(1:グレースケール 3:RGB 4:RGBA)
+		int restartIntervalCount = 1;	///<JPEGのリスタート区間の数(この単位で並列に展開する)
+
+		size_t RowBytes() const { return (size_t(width) * channelCount + 3) & ~size_t(3); }
+		size_t ImageBytes() const { return RowBytes() * height; }
+	};
+
+	Format Detect(const uint8_t* data, size_t size);
+	bool ReadInfo(const uint8_t* data, size_t size, Info& info);
+	bool Decode(const uint8_t* data, size_t size, const Info& info, uint8_t* output,
+		JobSystem* jobSystem = nullptr);
+}
@@ -0,0 +1,608 @@
+/**
+*	@file JobSystem.cpp
+*/
+#include "JobSystem.h"
+#include <iostream>
+#include <system_error>
+
+/**
+*	ジョブ1つ分のデータ
+*/
+struct JobCounter::Job
+{
+	JobSystem::FuncType func;	///<実行する関数
+	JobCounter* counter;	///<終了時に減らすカウンタ(nullptrなら何もしない)
+};
+
+namespace /* unnamed */
+{
+	//現在のスレッドが属するジョブシステムとワーカー番号
+	thread_local const JobSystem* currentSystem = nullptr;
+	thread_local size_t currentWorker = 0;
+
+	//ワーカー以外のスレッドを表す番号
+	const size_t externalWorker = static_cast<size_t>(-1);
+
+	//仕事が見つからないときに眠る前に試す回数
+	const int spinCount = 64;
+
+	typedef std::chrono::high_resolution_clock Clock;
+}
+
+/**
+*	コンストラクタ
+*/
+JobSystem::Deque::Deque() : top(0), bottom(0), buffer(new std::atomic<Job*>[capacity])
+{
+}
+
+/**
+*ジョブを末尾に追加する(所有ワーカー専用)
+*
+*@param	job	追加するジョブ
+*
+*@retval true	追加成功
+*@retval false	デックが一杯
+*/
+bool JobSystem::Deque::Push(Job* job)
+{
+	const int64_t b = bottom.load(std::memory_order_relaxed);
+	const int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= capacity)
+	{
+		return false;
+	}
+	buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+*ジョブを末尾から取り出す(所有ワーカー専用)
+*
+*@return 取り出したジョブ
+*		空の場合はnullptr
+*/
+JobSystem::Job* JobSystem::Deque::Pop()
+{
+	const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		//最後の1つはStealと取り合いになる
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+/**
+*ジョブを先頭から盗む
+*
+*@return 盗んだジョブ
+*		空の場合や他のスレッドとの取り合いに負けた場合はnullptr
+*/
+JobSystem::Job* JobSystem::Deque::Steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+	{
+		return nullptr;
+	}
+	Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+	return job;
+}
+
+/**
+*	デストラクタ
+*/
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+/**
+*ジョブシステムを初期化する
+*
+*@param	workerThreadCount	作成するワーカースレッドの数
+*							呼び出したスレッドもワーカー0として数えられるので、
+*							総ワーカー数はworkerThreadCount + 1になる
+*
+*@retval true	初期化成功
+*@retval false	初期化失敗
+*
+*Init を呼び出したスレッドがメインスレッドとして扱われる
+*/
+bool JobSystem::Init(size_t workerThreadCount)
+{
+	if (isRunning)
+	{
+		return true;
+	}
+	const size_t count = workerThreadCount + 1;
+	workerList.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::unique_ptr<Worker> w(new Worker);
+		w->busyNanoseconds = 0;
+		w->jobCount = 0;
+		w->stealCount = 0;
+		workerList.push_back(std::move(w));
+	}
+	currentSystem = this;
+	currentWorker = 0;
+	isRunning = true;
+	for (size_t i = 1; i < count; ++i)
+	{
+		try
+		{
+			workerList[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+		}
+		catch (const std::system_error& e)
+		{
+			//作成済みのスレッドだけで動かす(スレッドの無いワーカーのデックは使われない)
+			std::cerr << "ERROR: ワーカースレッドの作成に失敗(" << e.what() << ")" << std::endl;
+			break;
+		}
+		++threadCount;
+	}
+	statsStartTime = Clock::now();
+	return true;
+}
+
+/**
+*	全てのワーカースレッドを停止する
+*
+*	実行待ちのジョブは破棄される
+*/
+void JobSystem::Shutdown()
+{
+	if (!isRunning)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		isRunning = false;
+	}
+	sleepCondition.notify_all();
+	for (auto& w : workerList)
+	{
+		if (w->thread.joinable())
+		{
+			w->thread.join();
+		}
+	}
+	for (auto& w : workerList)
+	{
+		while (Job* job = w->deque.Pop())
+		{
+			delete job;
+		}
+	}
+	for (Job* job : globalQueue)
+	{
+		delete job;
+	}
+	globalQueue.clear();
+	for (Job* job : backgroundQueue)
+	{
+		delete job;
+	}
+	backgroundQueue.clear();
+	backgroundQueuedCount = 0;
+	threadCount = 0;
+	workerList.clear();
+	if (currentSystem == this)
+	{
+		currentSystem = nullptr;
+	}
+}
+
+/**
+*ジョブを登録する
+*
+*@param	func		実行する関数
+*@param	counter		ジョブの完了を待つためのカウンタ(不要ならnullptr)
+*@param	dependency	このカウンタが0になるまでジョブの実行を遅らせる(不要ならnullptr)
+*
+*Initの前やShutdownの後に呼び出された場合は、その場で関数を実行する
+*/
+void JobSystem::Run(const FuncType& func, JobCounter* counter, JobCounter* dependency)
+{
+	if (counter)
+	{
+		counter->value.fetch_add(1, std::memory_order_acq_rel);
+	}
+	Job* job = new Job{ func, counter };
+	if (!isRunning)
+	{
+		if (dependency)
+		{
+			Wait(*dependency);
+		}
+		Execute(job, 0);
+		return;
+	}
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->Value() > 0)
+		{
+			dependency->waitingList.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+/**
+*時間のかかるジョブを登録する
+*
+*@param	func	実行する関数
+*
+*ファイルの読み込みやデコードのように、フレームの処理を待たせたくないジョブに使う
+*登録したジョブはワーカースレッドが他に仕事の無いときにだけ実行し、Wait中のスレッドは実行しない
+*フレームのジョブを処理できるように、同時に実行するのはワーカースレッド数-1個までにする
+*Initの前やShutdownの後、ワーカースレッドが無い場合は、その場で関数を実行する
+*/
+void JobSystem::RunBackground(const FuncType& func)
+{
+	Job* job = new Job{ func, nullptr };
+	if (!isRunning || threadCount == 0)
+	{
+		Execute(job, currentSystem == this ? currentWorker : externalWorker);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(globalMutex);
+		backgroundQueue.push_back(job);
+	}
+	++backgroundQueuedCount;
+	if (sleepingCount.load() > 0)
+	{
+		sleepCondition.notify_one();
+	}
+}
+
+/**
+*範囲を分割して並列に処理するジョブを登録する
+*
+*@param	count		処理する要素数
+*@param	grainSize	1つのジョブが処理する要素数の目安(0なら自動で決める)
+*@param	func		[begin, end)の範囲を処理する関数
+*@param	counter		全ての範囲の完了を待つためのカウンタ
+*@param	dependency	このカウンタが0になるまで実行を遅らせる(不要ならnullptr)
+*/
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const RangeFuncType& func,
+	JobCounter& counter, JobCounter* dependency)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (grainSize == 0)
+	{
+		//ワーカー1つあたり4分割程度にして、負荷の偏りを盗みで均せるようにする
+		const size_t divisions = (workerList.empty() ? 1 : workerList.size()) * 4;
+		grainSize = (count + divisions - 1) / divisions;
+	}
+	for (size_t begin = 0; begin < count; begin += grainSize)
+	{
+		const size_t end = count - begin < grainSize ? count : begin + grainSize;
+		Run([func, begin, end]() { func(begin, end); }, &counter, dependency);
+	}
+}
+
+/**
+*範囲を分割して並列に処理し、全ての完了を待つ
+*
+*@param	count		処理する要素数
+*@param	grainSize	1つのジョブが処理する要素数の目安(0なら自動で決める)
+*@param	func		[begin, end)の範囲を処理する関数
+*/
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const RangeFuncType& func)
+{
+	JobCounter counter;
+	ParallelFor(count, grainSize, func, counter);
+	Wait(counter);
+}
+
+/**
+*カウンタが0になるまで待つ
+*
+*@param	counter	待つカウンタ
+*
+*待っている間、呼び出したスレッドも実行可能なジョブを処理する
+*RunBackgroundで登録されたジョブは処理しないので、待ち時間が長引くことはない
+*/
+void JobSystem::Wait(JobCounter& counter)
+{
+	const size_t index = currentSystem == this ? currentWorker : externalWorker;
+	while (counter.Value() > 0)
+	{
+		if (Job* job = isRunning ? GetJob(index) : nullptr)
+		{
+			Execute(job, index);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+	//Releaseがまだカウンタに触れている可能性があるので、終わるのを待つ
+	std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+/**
+*ワーカーの統計を取得する
+*
+*@param	worker	ワーカー番号(0がメインスレッド)
+*
+*@return ワーカーの統計
+*/
+JobSystem::WorkerStats JobSystem::GetStats(size_t worker) const
+{
+	WorkerStats stats;
+	if (worker >= workerList.size())
+	{
+		return stats;
+	}
+	const Worker& w = *workerList[worker];
+	stats.busySeconds = static_cast<double>(w.busyNanoseconds.load()) * 1e-9;
+	stats.jobCount = w.jobCount.load();
+	stats.stealCount = w.stealCount.load();
+	const double elapsed = std::chrono::duration<double>(Clock::now() - statsStartTime).count();
+	stats.utilisation = elapsed > 0 ? stats.busySeconds / elapsed : 0;
+	return stats;
+}
+
+/**
+*	全ワーカーの統計を0に戻す
+*/
+void JobSystem::ResetStats()
+{
+	for (auto& w : workerList)
+	{
+		w->busyNanoseconds = 0;
+		w->jobCount = 0;
+		w->stealCount = 0;
+	}
+	statsStartTime = Clock::now();
+}
+
+/**
+*ワーカースレッドの処理
+*
+*@param	index	ワーカー番号
+*/
+void JobSystem::WorkerMain(size_t index)
+{
+	currentSystem = this;
+	currentWorker = index;
+	int idle = 0;
+	while (isRunning)
+	{
+		if (Job* job = GetJob(index))
+		{
+			Execute(job, index);
+			idle = 0;
+			continue;
+		}
+		if (Job* job = GetBackgroundJob())
+		{
+			Execute(job, index);
+			--backgroundRunningCount;
+			idle = 0;
+			continue;
+		}
+		if (++idle < spinCount)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		//しばらく仕事が無ければ、登録されるまで眠る
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		++sleepingCount;
+		sleepCondition.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+			return !isRunning || queuedCount.load() > 0 || backgroundQueuedCount.load() > 0;
+		});
+		--sleepingCount;
+		idle = 0;
+	}
+}
+
+/**
+*ジョブを実行待ちにする
+*
+*@param	job	実行待ちにするジョブ
+*
+*ワーカーからは自分のデックに、それ以外のスレッドからは共有キューに追加する
+*/
+void JobSystem::Push(Job* job)
+{
+	if (currentSystem == this && currentWorker < workerList.size())
+	{
+		if (!workerList[currentWorker]->deque.Push(job))
+		{
+			//デックが一杯なら、その場で実行してしまう
+			Execute(job, currentWorker);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(globalMutex);
+		globalQueue.push_back(job);
+	}
+	++queuedCount;
+	if (sleepingCount.load() > 0)
+	{
+		sleepCondition.notify_one();
+	}
+}
+
+/**
+*実行するジョブを探す
+*
+*@param	index	探すワーカーの番号(ワーカー以外のスレッドならexternalWorker)
+*
+*@return 見つかったジョブ
+*		無ければnullptr
+*
+*自分のデック、共有キュー、他のワーカーのデックの順に探す
+*/
+JobSystem::Job* JobSystem::GetJob(size_t index)
+{
+	if (queuedCount.load(std::memory_order_relaxed) <= 0)
+	{
+		return nullptr;
+	}
+	const size_t count = workerList.size();
+	Job* job = index < count ? workerList[index]->deque.Pop() : nullptr;
+	if (!job)
+	{
+		std::lock_guard<std::mutex> lock(globalMutex);
+		if (!globalQueue.empty())
+		{
+			job = globalQueue.front();
+			globalQueue.pop_front();
+		}
+	}
+	if (!job)
+	{
+		//盗む相手は偏らないように乱数で選ぶ
+		static thread_local uint32_t rng = 1;
+		rng = rng * 1664525u + 1013904223u;
+		const size_t start = (rng >> 8) % count;
+		for (size_t i = 0; i < count && !job; ++i)
+		{
+			const size_t victim = (start + i) % count;
+			if (victim != index)
+			{
+				job = workerList[victim]->deque.Steal();
+			}
+		}
+		if (job && index < count)
+		{
+			++workerList[index]->stealCount;
+		}
+	}
+	if (job)
+	{
+		--queuedCount;
+	}
+	return job;
+}
+
+/**
+*実行するバックグラウンドジョブを探す(ワーカースレッド専用)
+*
+*@return 見つかったジョブ
+*		無い場合や、同時に実行できる数に達している場合はnullptr
+*
+*取り出したジョブの実行が終わったら、backgroundRunningCountを1減らすこと
+*/
+JobSystem::Job* JobSystem::GetBackgroundJob()
+{
+	if (backgroundQueuedCount.load(std::memory_order_relaxed) <= 0)
+	{
+		return nullptr;
+	}
+	const int maxRunning = threadCount > 1 ? static_cast<int>(threadCount - 1) : 1;
+	if (++backgroundRunningCount > maxRunning)
+	{
+		--backgroundRunningCount;
+		return nullptr;
+	}
+	Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(globalMutex);
+		if (!backgroundQueue.empty())
+		{
+			job = backgroundQueue.front();
+			backgroundQueue.pop_front();
+		}
+	}
+	if (!job)
+	{
+		--backgroundRunningCount;
+		return nullptr;
+	}
+	--backgroundQueuedCount;
+	return job;
+}
+
+/**
+*ジョブを実行する
+*
+*@param	job		実行するジョブ
+*@param	index	実行するワーカーの番号
+*/
+void JobSystem::Execute(Job* job, size_t index)
+{
+	const Clock::time_point start = Clock::now();
+	job->func();
+	const Clock::time_point end = Clock::now();
+	if (index < workerList.size())
+	{
+		Worker& w = *workerList[index];
+		w.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		++w.jobCount;
+	}
+	JobCounter* counter = job->counter;
+	delete job;
+	if (counter)
+	{
+		Release(counter);
+	}
+}
+
+/**
+*カウンタを1減らす
+*
+*@param	counter	減らすカウンタ
+*
+*0になった場合は、このカウンタを待っていたジョブを実行待ちにする
+*/
+void JobSystem::Release(JobCounter* counter)
+{
+	std::vector<Job*> list;
+	{
+		//Waitから戻ったスレッドがカウンタを破棄できるのは、このロックが外れた後になる
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (counter->value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return;
+		}
+		list.swap(counter->waitingList);
+	}
+	for (Job* job : list)
+	{
+		if (isRunning)
+		{
+			Push(job);
+		}
+		else
+		{
+			Execute(job, 0);
+		}
+	}
+}
@@ -0,0 +1,152 @@
+/**
+*	@file JobSystem.h
+*/
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <chrono>
+
+class JobSystem;
+
+/**
+*	ジョブの完了を待つためのカウンタ
+*
+*	ジョブを登録するとカウンタが1増え、ジョブが終了すると1減る
+*	値が0になったとき、このカウンタを依存先として登録されたジョブが実行可能になる
+*/
+class JobCounter
+{
+public:
+	JobCounter() : value(0) {}
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator = (const JobCounter&) = delete;
+
+	int Value() const { return value.load(std::memory_order_acquire); }
+	bool IsDone() const { return Value() == 0; }
+
+private:
+	friend class JobSystem;
+	struct Job;
+
+	std::atomic<int> value;	///<未完了のジョブ数
+	std::mutex mutex;	///<waitingListを保護する
+	std::vector<Job*> waitingList;	///<このカウンタが0になるのを待っているジョブ
+};
+
+/**
+*	ワークスティーリング方式のジョブスケジューラ
+*
+*	ワーカーごとにChase-Levデックを持ち、自分のデックが空になると他のワーカーから盗む
+*	メインスレッドはワーカー0として扱われ、Wait中は自分でもジョブを実行する
+*	RunBackgroundで登録した時間のかかるジョブは、ワーカースレッドが暇なときにだけ実行し、Wait中には実行しない
+*/
+class JobSystem
+{
+public:
+	//ジョブとして実行する関数の型
+	typedef std::function<void()> FuncType;
+
+	//ParallelForで範囲ごとに実行する関数の型(begin以上end未満)
+	typedef std::function<void(size_t begin, size_t end)> RangeFuncType;
+
+	/**
+	*	ワーカーごとの統計
+	*/
+	struct WorkerStats
+	{
+		double busySeconds = 0;	///<ジョブを実行していた時間(秒)
+		size_t jobCount = 0;	///<実行したジョブの数
+		size_t stealCount = 0;	///<他のワーカーから盗んだジョブの数
+		double utilisation = 0;	///<ResetStatsからの経過時間に対するbusySecondsの割合
+	};
+
+	JobSystem() = default;
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator = (const JobSystem&) = delete;
+
+	bool Init(size_t workerThreadCount);
+	void Shutdown();
+
+	void Run(const FuncType& func, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+	void RunBackground(const FuncType& func);
+	void ParallelFor(size_t count, size_t grainSize, const RangeFuncType& func,
+		JobCounter& counter, JobCounter* dependency = nullptr);
+	void ParallelFor(size_t count, size_t grainSize, const RangeFuncType& func);
+	void Wait(JobCounter& counter);
+
+	size_t WorkerCount() const { return workerList.size(); }
+	WorkerStats GetStats(size_t worker) const;
+	void ResetStats();
+
+private:
+	typedef JobCounter::Job Job;
+
+	/**
+	*	Chase-Levのワークスティーリングデック
+	*
+	*	Push/Popは所有ワーカーだけが、Stealは任意のスレッドが呼び出せる
+	*/
+	class Deque
+	{
+	public:
+		static const int64_t capacity = 4096;	///<格納できるジョブの数(2の累乗)
+
+		Deque();
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+		std::unique_ptr<std::atomic<Job*>[]> buffer;
+	};
+
+	/**
+	*	ワーカー1つ分のデータ
+	*/
+	struct Worker
+	{
+		Deque deque;
+		std::thread thread;	///<ワーカー0(メインスレッド)では使わない
+		std::atomic<int64_t> busyNanoseconds;
+		std::atomic<size_t> jobCount;
+		std::atomic<size_t> stealCount;
+	};
+
+	void WorkerMain(size_t index);
+	void Push(Job* job);
+	Job* GetJob(size_t index);
+	Job* GetBackgroundJob();
+	void Execute(Job* job, size_t index);
+	void Release(JobCounter* counter);
+
+private:
+	std::vector<std::unique_ptr<Worker>> workerList;
+
+	//ワーカー以外のスレッドから登録されたジョブ
+	std::mutex globalMutex;
+	std::deque<Job*> globalQueue;
+	std::deque<Job*> backgroundQueue;	///<RunBackgroundで登録されたジョブ(ワーカースレッドだけが取り出す)
+
+	//仕事の無いワーカーを眠らせるための変数
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	std::atomic<int> queuedCount{ 0 };
+	std::atomic<int> sleepingCount{ 0 };
+	std::atomic<int> backgroundQueuedCount{ 0 };
+	std::atomic<int> backgroundRunningCount{ 0 };	///<実行中のバックグラウンドジョブの数
+	size_t threadCount = 0;	///<作成できたワーカースレッドの数
+
+	std::atomic<bool> isRunning{ false };
+	std::chrono::high_resolution_clock::time_point statsStartTime;
+};
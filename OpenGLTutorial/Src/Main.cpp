@@ -3,10 +3,15 @@
 */
 
 #include "GameEngine.h"
+#include "TextureCooker.h"
 #include "C:/Users/tatsu/Desktop/OpenGLTutorial/OpenGLTutorial/Res/Audio/SampleSound_acf.h"
 #include "C:/Users/tatsu/Desktop/OpenGLTutorial/OpenGLTutorial/Res/Audio/SampleCueSheet.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <string.h>
 
 
 //エンティティの衝突グループID
@@ -215,18 +220,13 @@ struct UpdatePlayer
 			shotInterval -= delta;
 			if (shotInterval <= 0)
 			{
-				glm::vec3 pos = entity.Position();
-				pos.x -= 0.3f;
-				for (int i = 0;i < 2; ++i)
+				if (!prefabShot)
 				{
-					if (Entity::Entity* p = game.AddEntity(EntityGroupId_PlayerShot, pos,
-						"NormalShot", "Res/Player.bmp", UpdatePlayerShot()))
-					{
-						p->Velocity(glm::vec3(0, 0, 80));
-						p->Collision(collsionDataList[EntityGroupId_PlayerShot]);
-					}
-					pos.x += 0.6f;
+					prefabShot = game.GetPrefab("NormalShot");
 				}
+				const glm::vec3 pos = entity.Position();
+				const glm::vec3 shotPos[] = { pos - glm::vec3(0.3f, 0, 0), pos + glm::vec3(0.3f, 0, 0) };
+				game.SpawnBatch(prefabShot, shotPos, nullptr, 2);
 				shotInterval = 0.25;
 
 				game.PlayAudio(0, CRI_SAMPLECUESHEET_PLAYERSHOT);
@@ -241,9 +241,28 @@ struct UpdatePlayer
 	}
 private:
 	double shotInterval = 0;
+	Entity::PrefabPtr prefabShot;
 };
 
 
+/**
+*	エンティティのプレハブを登録する
+*
+*	メッシュとテクスチャの読み込みが終わってから呼び出すこと
+*/
+void RegisterPrefabs()
+{
+	GameEngine& game = GameEngine::Instance();
+	game.RegisterPrefab("Toroid", EntityGroupId_Enemy, "Toroid", "Res/Toroid.bmp",
+		UpdateToroid(), collsionDataList[EntityGroupId_Enemy]);
+	game.RegisterPrefab("NormalShot", EntityGroupId_PlayerShot, "NormalShot", "Res/Player.bmp",
+		UpdatePlayerShot(), collsionDataList[EntityGroupId_PlayerShot], glm::vec3(0, 0, 80));
+	game.RegisterPrefab("Aircraft", EntityGroupId_Player, "Aircraft", "Res/Player.bmp",
+		UpdatePlayer(), collsionDataList[EntityGroupId_Player]);
+	game.RegisterPrefab("Blast", EntityGroupId_Others, "Blast", "Res/Toroid.bmp",
+		UpdateBlast(), Entity::CollisionData());
+}
+
 /**
 *ゲームの状態を更新する
 *
@@ -258,10 +277,35 @@ struct Update
 	{
 		GameEngine& game = GameEngine::Instance();
 
+		//読み込みが終わるまでは、読み込み中の表示だけを行う
+		if (!isLoaded)
+		{
+			for (const AssetLoader::Future& e : loadingList)
+			{
+				if (e.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				{
+					game.FontScale(glm::vec2(2));
+					game.FontColor(glm::vec4(1));
+					game.AddString(glm::vec2(-0.3f, 0), "Now Loading...");
+					return;
+				}
+			}
+			loadingList.clear();
+			RegisterPrefabs();
+			isLoaded = true;
+
+			//読み込み直後のメモリ使用量とメッシュ、画像の読み込み時間、テクスチャの常駐状況を表示する
+			Memory::DumpStats(std::cout);
+			Mesh::DumpImportStats(std::cout);
+			Texture::DumpDecodeStats(std::cout);
+			game.DumpTextureStats(std::cout);
+			Skeletal::DumpImportStats(std::cout);
+		}
+
 		if (!pPlayer)
 		{
-			pPlayer = game.AddEntity(EntityGroupId_Player, glm::vec3(0, 0, 2), "Aircraft", "Res/Player.bmp", UpdatePlayer());
-			pPlayer->Collision(collsionDataList[EntityGroupId_Player]);
+			pPlayer = game.AddEntity(game.GetPrefab("Aircraft"), glm::vec3(0, 0, 2));
+			prefabToroid = game.GetPrefab("Toroid");
 		}
 
 		game.Camera({ glm::vec4(0,20,-8,1),glm::vec3(0,0,12),glm::vec3(0,0,1) });
@@ -275,15 +319,16 @@ struct Update
 		{
 			const std::uniform_real_distribution<> rndInterval(1, 1);
 			const std::uniform_int_distribution<> rndAddingCount(1, 5);
-			for (int i = rndAddingCount(game.Rand());i > 0; --i)
+			//出現させる敵の座標と速度をまとめて作ってから、一度に追加する
+			glm::vec3 pos[5];
+			glm::vec3 vel[5];
+			const int addingCount = rndAddingCount(game.Rand());
+			for (int i = 0; i < addingCount; ++i)
 			{
-				const glm::vec3 pos(distributerX(game.Rand()), 0, distributerZ(game.Rand()));
-				if (Entity::Entity* p = game.AddEntity(EntityGroupId_Enemy, pos, "Toroid", "Res/Toroid.bmp", UpdateToroid()))
-				{
-					p->Velocity(glm::vec3(pos.x < 0 ? 1.0f : -0.1f, 0, -10));
-					p->Collision(collsionDataList[EntityGroupId_Enemy]);
-				}
+				pos[i] = glm::vec3(distributerX(game.Rand()), 0, distributerZ(game.Rand()));
+				vel[i] = glm::vec3(pos[i].x < 0 ? 1.0f : -0.1f, 0, -10);
 			}
+			game.SpawnBatch(prefabToroid, pos, vel, addingCount);
 			interval = rndInterval(game.Rand());
 		}
 
@@ -293,9 +338,28 @@ struct Update
 		game.FontColor(glm::vec4(1));
 		game.AddString(glm::vec2(-0.2f, 0.9f), str);
 
+		//詳細度の閾値を調整するとき用に、詳細度ごとの描画数と三角形数を表示する
+		if (isLodStatsVisible)
+		{
+			const Entity::LodStats& lodStats = game.GetLodStats();
+			char lodStr[128];
+			int len = snprintf(lodStr, sizeof(lodStr), "LOD");
+			for (int i = 0; i < Mesh::maxLodCount && len > 0 && len < static_cast<int>(sizeof(lodStr)); ++i)
+			{
+				len += snprintf(lodStr + len, sizeof(lodStr) - len, " %d:%d/%d", i,
+					static_cast<int>(lodStats.drawCount[i]), static_cast<int>(lodStats.triangleCount[i]));
+			}
+			game.FontScale(glm::vec2(0.75f));
+			game.AddString(glm::vec2(-0.95f, -0.9f), lodStr);
+		}
+
 	}
 	double interval = 0;
 	Entity::Entity* pPlayer = nullptr;
+	Entity::PrefabPtr prefabToroid;
+	std::vector<AssetLoader::Future> loadingList;	///<読み込み中のアセット
+	bool isLoaded = false;
+	bool isLodStatsVisible = false;	///<詳細度の統計を表示するかどうか
 };
 
 
@@ -305,8 +369,8 @@ struct Update
 void PlayerShotAndEntityCollisionHandler(Entity::Entity& lhs, Entity::Entity& rhs)
 {
 	GameEngine& game = GameEngine::Instance();
-	if (Entity::Entity* p = game.AddEntity(EntityGroupId_Others, rhs.Position(),
-		"Blast", "Res/Toroid.bmp", UpdateBlast()))
+	static const Entity::PrefabPtr& prefabBlast = game.GetPrefab("Blast");
+	if (Entity::Entity* p = game.AddEntity(prefabBlast, rhs.Position()))
 	{
 		const std::uniform_real_distribution<float> rotRange(0.0f, glm::pi<float>() * 2);
 		p->Rotation(glm::quat(glm::vec3(0, rotRange(game.Rand()), 0)));
@@ -338,8 +402,31 @@ GLuint CreateUBO(GLsizeiptr size, const GLvoid* data = nullptr)
 
 
 ///エントリーポイント
-int main()
+int main(int argc, char** argv)
 {
+	//"--cook-textures"を指定すると、Res以下の画像をミップマップ付きの圧縮DDSに変換して終了する
+	if (argc > 1 && strcmp(argv[1], "--cook-textures") == 0)
+	{
+		const unsigned int coreCount = std::thread::hardware_concurrency();
+		JobSystem jobSystem;
+		jobSystem.Init(coreCount > 1 ? coreCount - 1 : 0);
+		const bool isSucceeded = TextureCooker::CookDirectory("Res", TextureCooker::Settings(), &jobSystem, std::cout);
+		jobSystem.Shutdown();
+		return isSucceeded ? 0 : 1;
+	}
+
+	//"--benchmark"を指定すると、CPUスキニングとアニメーションクリップの速度を計測して終了する
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		const unsigned int coreCount = std::thread::hardware_concurrency();
+		JobSystem jobSystem;
+		jobSystem.Init(coreCount > 1 ? coreCount - 1 : 0);
+		Skeletal::RunSkinningBenchmark(std::cout, &jobSystem);
+		Skeletal::RunClipBenchmark(std::cout);
+		jobSystem.Shutdown();
+		return 0;
+	}
+
 	GameEngine& game = GameEngine::Instance();
 	if (!game.Init(800, 600, "OpenGL Tutorial"))
 	{
@@ -350,21 +437,32 @@ int main()
 		return 1;
 	}
 
+	//フォント画像と小さなUI用画像は、1枚のアトラスにまとめて読み込む
+	game.LoadTextureAtlas("Res/Ui.atlas");
+
+	//読み込み中の表示に使うフォントだけは、先に読み込んでおく
+	game.LoadFontFromFile("Res/font/UniNeue.fnt");
+
+	//残りのアセットはワーカースレッドで読み込み、その間も画面を更新し続ける
+	Update update;
+	//"--show-lod"を指定すると、詳細度ごとの描画数と三角形数を画面に表示する
+	update.isLodStatsVisible = argc > 1 && strcmp(argv[1], "--show-lod") == 0;
 	//TexturePtr tex = Texture::LoadFromFile("Res/Sparrow.bmp");
-	game.LoadTextureFromFile("Res/Toroid.bmp");
-	game.LoadTextureFromFile("Res/Player.bmp");
+	update.loadingList.push_back(game.LoadTextureAsync("Res/Toroid.bmp"));
+	update.loadingList.push_back(game.LoadTextureAsync("Res/Player.bmp"));
 	//game.LoadTextureFromFile("Res/Sparrow.bmp");
 
-	game.LoadMeshFromFile("Res/Toroid.fbx");
-	game.LoadMeshFromFile("Res/Player.fbx");
-	game.LoadMeshFromFile("Res/Blast.fbx");
-
-	game.LoadFontFromFile("Res/font/UniNeue.fnt");
+	//敵と弾は数が多いので、頂点データを量子化してメモリと帯域を節約する
+	update.loadingList.push_back(game.LoadMeshAsync("Res/Toroid.fbx", Mesh::VertexFormat::Packed));
+	update.loadingList.push_back(game.LoadMeshAsync("Res/Player.fbx"));
+	update.loadingList.push_back(game.LoadMeshAsync("Res/Blast.fbx", Mesh::VertexFormat::Packed));
 
 	game.CollisionHandler(EntityGroupId_PlayerShot, EntityGroupId_Enemy,
 		&PlayerShotAndEntityCollisionHandler);
 
-	game.UpdateFunc(Update());
+	game.UpdateFunc(update);
+	//更新と描画を別スレッドで並行して行う
+	game.SimulationThread(true);
 	game.Run();
 
 	return 0;
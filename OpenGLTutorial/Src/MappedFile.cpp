@@ -0,0 +1,131 @@
+/**
+*	@file MappedFile.cpp
+*/
+#include "MappedFile.h"
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+*ファイルをメモリにマップする
+*
+*@param	filename	ファイル名
+*
+*@retval true	マップ成功
+*@retval false	マップ失敗(ファイルが存在しない、または空の場合も含む)
+*
+*既に開いているファイルは閉じられる
+*/
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!p)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = static_cast<const uint8_t*>(p);
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		return false;
+	}
+	data = static_cast<const uint8_t*>(p);
+	size = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+/**
+*	マップを解除してファイルを閉じる
+*/
+void MappedFile::Close()
+{
+	if (!data)
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+/**
+*指定した範囲のページを読み込んでおく
+*
+*@param	offset	範囲の先頭
+*@param	length	範囲のバイト数(ファイルの終端を超える分は無視する)
+*
+*マップしたページは最初に触れたときに読み込まれるので、
+*ワーカースレッドで先に触れておけば、後で読むスレッドがディスクを待たずに済む
+*/
+void MappedFile::Prefetch(size_t offset, size_t length) const
+{
+	if (!data || offset >= size)
+	{
+		return;
+	}
+	const size_t end = offset + std::min(length, size - offset);
+	const size_t pageSize = 4096;
+	uint8_t sum = 0;
+	for (size_t i = offset; i < end; i += pageSize)
+	{
+		sum += data[i];
+	}
+	sum += data[end - 1];
+	static volatile uint8_t sink;
+	sink = sum;	//最適化で読み込みが消されないようにする
+}
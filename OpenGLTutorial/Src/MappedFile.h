@@ -0,0 +1,36 @@
+/**
+*	@file MappedFile.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+*	読み込み専用でメモリにマップしたファイル
+*
+*	ファイルの内容はページ単位で必要になったときに読み込まれる
+*/
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool Open(const char* filename);
+	void Close();
+	void Prefetch(size_t offset, size_t length) const;
+
+	bool IsOpen() const { return data != nullptr; }
+	const uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+#ifdef _WIN32
+	void* fileHandle = nullptr;	///<ファイルのハンドル
+	void* mappingHandle = nullptr;	///<ファイルマッピングオブジェクトのハンドル
+#endif
+	const uint8_t* data = nullptr;	///<マップしたメモリの先頭
+	size_t size = 0;	///<ファイルのバイト数
+};
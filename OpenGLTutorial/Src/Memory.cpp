@@ -0,0 +1,241 @@
+/**
+*	@file Memory.cpp
+*/
+#include "Memory.h"
+#include <atomic>
+#include <iomanip>
+#include <string.h>
+
+namespace Memory
+{
+	/**
+	*	確保したブロックの直前に置く管理情報
+	*/
+	struct Header
+	{
+		size_t size;	///<要求されたバイト数
+		uint16_t offset;	///<確保元ブロックの先頭からのバイト数
+		uint16_t alignment;	///<確保時のアライメント
+		uint16_t tag;	///<確保したタグ
+		uint16_t magic;	///<破損検出用の値
+	};
+	static_assert(sizeof(Header) <= 16, "Headerは16バイト以内でなければならない");
+
+	const uint16_t headerMagic = 0x4d4d;
+	const size_t tagCount = static_cast<size_t>(Tag::Count);
+
+	/**
+	*	タグごとの統計(複数のスレッドから更新される可能性がある)
+	*/
+	struct AtomicStats
+	{
+		std::atomic<size_t> liveBytes;
+		std::atomic<size_t> peakBytes;
+		std::atomic<size_t> liveCount;
+		std::atomic<size_t> allocCount;
+	};
+
+	AtomicStats statsList[tagCount];
+	Allocator* allocatorList[tagCount];
+
+	/**
+	*	標準のヒープから確保するアロケータ
+	*/
+	class HeapAllocator : public Allocator
+	{
+	public:
+		void* Allocate(size_t size) override { return ::operator new(size, std::nothrow); }
+		void Deallocate(void* p, size_t) override { ::operator delete(p); }
+	};
+	HeapAllocator heapAllocator;
+
+	/**
+	*アロケータを差し替える
+	*
+	*@param	tag			差し替えるタグ
+	*@param	allocator	新しいアロケータ(nullptrなら標準のヒープに戻す)
+	*
+	*そのタグでメモリを確保する前に設定すること
+	*確保済みのブロックは、確保したときのアロケータで解放される必要がある
+	*/
+	void SetAllocator(Tag tag, Allocator* allocator)
+	{
+		allocatorList[static_cast<size_t>(tag)] = allocator;
+	}
+
+	/**
+	*アロケータを取得する
+	*
+	*@param	tag	取得するタグ
+	*
+	*@return tagに設定されているアロケータ
+	*/
+	Allocator* GetAllocator(Tag tag)
+	{
+		Allocator* p = allocatorList[static_cast<size_t>(tag)];
+		return p ? p : &heapAllocator;
+	}
+
+	/**
+	*タグを付けてメモリを確保する
+	*
+	*@param	tag			確保するサブシステムのタグ
+	*@param	size		確保するバイト数
+	*@param	alignment	アライメント(2の累乗、32768以下)
+	*
+	*@return 確保したメモリへのポインタ
+	*		確保に失敗した場合はnullptr
+	*/
+	void* Allocate(Tag tag, size_t size, size_t alignment)
+	{
+		if (alignment < sizeof(Header))
+		{
+			alignment = sizeof(Header);
+		}
+		//mallocは8バイト境界しか保証しないので、ヘッダと最大alignment-1バイトの詰め物の両方を確保する
+		const size_t total = size + sizeof(Header) + alignment - 1;
+		uint8_t* raw = static_cast<uint8_t*>(GetAllocator(tag)->Allocate(total));
+		if (!raw)
+		{
+			return nullptr;
+		}
+		const uintptr_t addr = (reinterpret_cast<uintptr_t>(raw) + sizeof(Header) + alignment - 1) &
+			~static_cast<uintptr_t>(alignment - 1);
+		uint8_t* p = reinterpret_cast<uint8_t*>(addr);
+		Header* h = reinterpret_cast<Header*>(p) - 1;
+		h->size = size;
+		h->offset = static_cast<uint16_t>(p - raw);
+		h->alignment = static_cast<uint16_t>(alignment);
+		h->tag = static_cast<uint16_t>(tag);
+		h->magic = headerMagic;
+
+		AtomicStats& s = statsList[static_cast<size_t>(tag)];
+		const size_t live = s.liveBytes.fetch_add(size) + size;
+		size_t peak = s.peakBytes.load();
+		while (live > peak && !s.peakBytes.compare_exchange_weak(peak, live))
+		{
+		}
+		++s.liveCount;
+		++s.allocCount;
+		return p;
+	}
+
+	/**
+	*メモリを解放する
+	*
+	*@param	p	Allocateで確保したメモリへのポインタ
+	*/
+	void Deallocate(void* p)
+	{
+		if (!p)
+		{
+			return;
+		}
+		Header* h = static_cast<Header*>(p) - 1;
+		if (h->magic != headerMagic || h->tag >= tagCount)
+		{
+			std::cerr << "ERROR: Memory::Deallocate: 管理外のポインタ(" << p << ")を解放しようとしました" << std::endl;
+			return;
+		}
+		const Tag tag = static_cast<Tag>(h->tag);
+		const size_t size = h->size;
+		uint8_t* raw = static_cast<uint8_t*>(p) - h->offset;
+		const size_t total = size + sizeof(Header) + h->alignment - 1;
+		h->magic = 0;
+
+		AtomicStats& s = statsList[h->tag];
+		s.liveBytes -= size;
+		--s.liveCount;
+		GetAllocator(tag)->Deallocate(raw, total);
+	}
+
+	/**
+	*確保済みのメモリの大きさを変更する
+	*
+	*@param	p		Allocateで確保したメモリへのポインタ(nullptrの場合はTag::Otherで新規に確保する)
+	*@param	size	新しいバイト数
+	*
+	*@return 新しいメモリへのポインタ
+	*		失敗した場合はnullptrを返し、元のメモリはそのまま残る
+	*/
+	void* Reallocate(void* p, size_t size)
+	{
+		if (!p)
+		{
+			return Allocate(Tag::Other, size);
+		}
+		const Header* h = static_cast<Header*>(p) - 1;
+		void* newPtr = Allocate(static_cast<Tag>(h->tag), size);
+		if (!newPtr)
+		{
+			return nullptr;
+		}
+		memcpy(newPtr, p, h->size < size ? h->size : size);
+		Deallocate(p);
+		return newPtr;
+	}
+
+	/**
+	*統計を取得する
+	*
+	*@param	tag	取得するタグ
+	*
+	*@return tagのメモリ使用統計
+	*/
+	Stats GetStats(Tag tag)
+	{
+		const AtomicStats& s = statsList[static_cast<size_t>(tag)];
+		Stats stats;
+		stats.liveBytes = s.liveBytes.load();
+		stats.peakBytes = s.peakBytes.load();
+		stats.liveCount = s.liveCount.load();
+		stats.allocCount = s.allocCount.load();
+		return stats;
+	}
+
+	/**
+	*最大使用量を現在の使用量に戻す
+	*
+	*@param	tag	対象のタグ
+	*
+	*読み込み中などの区間ごとのピークを計測するときに使う
+	*/
+	void ResetPeak(Tag tag)
+	{
+		AtomicStats& s = statsList[static_cast<size_t>(tag)];
+		s.peakBytes = s.liveBytes.load();
+	}
+
+	/**
+	*タグ名を取得する
+	*
+	*@param	tag	タグ
+	*
+	*@return タグ名
+	*/
+	const char* TagName(Tag tag)
+	{
+		static const char* const names[] = { "Audio", "Mesh", "Texture", "Entity", "Font", "Animation", "Other" };
+		static_assert(sizeof(names) / sizeof(names[0]) == tagCount, "タグ名の数が合っていない");
+		const size_t i = static_cast<size_t>(tag);
+		return i < tagCount ? names[i] : "(unknown)";
+	}
+
+	/**
+	*全タグの統計を出力する
+	*
+	*@param	os	出力先
+	*/
+	void DumpStats(std::ostream& os)
+	{
+		os << "Memory stats (tag / live bytes / peak bytes / live blocks / total allocs)\n";
+		for (size_t i = 0; i < tagCount; ++i)
+		{
+			const Stats s = GetStats(static_cast<Tag>(i));
+			os << "  " << std::left << std::setw(8) << TagName(static_cast<Tag>(i)) << std::right <<
+				std::setw(12) << s.liveBytes << std::setw(12) << s.peakBytes <<
+				std::setw(10) << s.liveCount << std::setw(10) << s.allocCount << '\n';
+		}
+		os << std::flush;
+	}
+}
@@ -0,0 +1,145 @@
+/**
+*	@file Memory.h
+*/
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <iostream>
+
+/**
+*	サブシステムごとにメモリ使用量を記録するための名前空間
+*/
+namespace Memory
+{
+	/**
+	*	メモリを使うサブシステムの種類
+	*/
+	enum class Tag
+	{
+		Audio,
+		Mesh,
+		Texture,
+		Entity,
+		Font,
+		Animation,
+		Other,
+
+		Count,	///<タグの数
+	};
+
+	/**
+	*	確保元となるアロケータのインターフェイス
+	*
+	*	SetAllocatorでタグごとに差し替えられる(プールやアリーナなど)
+	*	統計はこのインターフェイスの外側で記録するので、実装側で数える必要はない
+	*/
+	class Allocator
+	{
+	public:
+		virtual ~Allocator() = default;
+		virtual void* Allocate(size_t size) = 0;
+		virtual void Deallocate(void* p, size_t size) = 0;
+	};
+
+	/**
+	*	タグごとのメモリ使用統計
+	*/
+	struct Stats
+	{
+		size_t liveBytes = 0;	///<現在確保されているバイト数
+		size_t peakBytes = 0;	///<liveBytesの最大値
+		size_t liveCount = 0;	///<現在確保されているブロック数
+		size_t allocCount = 0;	///<これまでの確保回数
+	};
+
+	void SetAllocator(Tag tag, Allocator* allocator);
+	Allocator* GetAllocator(Tag tag);
+
+	void* Allocate(Tag tag, size_t size, size_t alignment = 16);
+	void* Reallocate(void* p, size_t size);
+	void Deallocate(void* p);
+
+	Stats GetStats(Tag tag);
+	void ResetPeak(Tag tag);
+	const char* TagName(Tag tag);
+	void DumpStats(std::ostream& os);
+
+	/**
+	*	タグ付きでメモリを確保するSTLアロケータ
+	*/
+	template<typename T, Tag tag>
+	class StlAllocator
+	{
+	public:
+		typedef T value_type;
+		template<typename U> struct rebind { typedef StlAllocator<U, tag> other; };
+
+		StlAllocator() = default;
+		template<typename U>
+		StlAllocator(const StlAllocator<U, tag>&) {}
+
+		T* allocate(size_t n)
+		{
+			void* p = Allocate(tag, sizeof(T) * n, alignof(T) > 16 ? alignof(T) : 16);
+			if (!p)
+			{
+				throw std::bad_alloc();
+			}
+			return static_cast<T*>(p);
+		}
+		void deallocate(T* p, size_t) { Deallocate(p); }
+
+		template<typename U>
+		bool operator == (const StlAllocator<U, tag>&) const { return true; }
+		template<typename U>
+		bool operator != (const StlAllocator<U, tag>&) const { return false; }
+	};
+
+	//タグ付きの可変長配列
+	template<typename T, Tag tag>
+	using Vector = std::vector<T, StlAllocator<T, tag>>;
+
+	/**
+	*タグ付きで配列を作成する
+	*
+	*@param	count	要素数
+	*
+	*@return 作成した配列へのポインタ
+	*		DeleteArrayで破棄すること
+	*/
+	template<typename T, Tag tag>
+	T* NewArray(size_t count)
+	{
+		T* p = static_cast<T*>(Allocate(tag, sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16));
+		if (p)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				new(p + i) T;
+			}
+		}
+		return p;
+	}
+
+	/**
+	*NewArrayで作成した配列を破棄する
+	*
+	*@param	p		配列へのポインタ
+	*@param	count	要素数
+	*/
+	template<typename T>
+	void DeleteArray(T* p, size_t count)
+	{
+		if (!p)
+		{
+			return;
+		}
+		for (size_t i = count; i > 0; --i)
+		{
+			p[i - 1].~T();
+		}
+		Deallocate(p);
+	}
+}
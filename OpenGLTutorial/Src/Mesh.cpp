@@ -2,30 +2,56 @@
 *@file Mesh.cpp
 */
 #include "Mesh.h"
+#include "Memory.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "JobSystem.h"
 #include <fbxsdk.h>
 #include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 /**
-*	ff[^Ǘ̂߂̖O
+*	モデルデータ管理のための名前空間
 */
 namespace Mesh
 {
-	//_f[^^
+	//頂点データ型
 	struct Vertex
 	{
-		glm::vec3 position;	///W
-		glm::vec4 color;	///F
-		glm::vec2 texCoord;	///eNX`W
-		glm::vec3 normal;	///@
+		glm::vec3 position;	///座標
+		glm::vec4 color;	///色
+		glm::vec2 texCoord;	///テクスチャ座標
+		glm::vec3 normal;	///法線
+	};
+
+	//量子化した頂点データ型
+	struct PackedVertex
+	{
+		int16_t position[4];	///座標(メッシュの境界ボックス内を16bitで量子化、wは未使用)
+		uint8_t color[4];	///色(unorm8)
+		uint16_t texCoord[2];	///テクスチャ座標(半精度浮動小数点数)
+		uint32_t normal;	///法線(snorm 10:10:10:2)
 	};
 
 	/**
-	*Vertex Buffer Object쐬
+	*Vertex Buffer Objectを作成する
 	*
-	*@param	size _f[^̃TCY
-	*@param	data _f[^ւ̃|C^
+	*@param	size 頂点データのサイズ
+	*@param	data 頂点データへのポインタ
 	*
-	*@return	쐬VBO.
+	*@return	作成したVBO.
 	*/
 	GLuint CreateVBO(GLsizeiptr size, const GLvoid* data)
 	{
@@ -38,12 +64,12 @@ namespace Mesh
 	}
 
 	/**
-	*Index Buffer Object쐬
+	*Index Buffer Objectを作成する
 	*
-	*@param	size CfbNXf[^̃TCY
-	*@param	data CfbNXf[^ւ̃|C^
+	*@param	size インデックスデータのサイズ
+	*@param	data インデックスデータへのポインタ
 	*
-	*@return	쐬IBO.
+	*@return	作成したIBO.
 	*/
 	GLuint CreateIBO(GLsizeiptr size, const GLvoid* data)
 	{
@@ -56,11 +82,11 @@ namespace Mesh
 	}
 
 	/**
-	*_Agr[gݒ肷
+	*頂点アトリビュートを設定する
 	*
-	*@param	index	_Agr[g̃CfbNX
-	*@paran	cls		_f[^^
-	*@param	mbr	_Agr[gɐݒ肷cls̃oϐ
+	*@param	index	頂点アトリビュートのインデックス
+	*@paran	cls		頂点データ型名
+	*@param	mbr	頂点アトリビュートに設定するclsのメンバ変数名
 	*/
 #define SetVertexAttribPointer(index,cls,mbr)SetVertexAttribPointerI(\
 		index,	\
@@ -76,14 +102,31 @@ namespace Mesh
 	}
 
 	/**
-	*Vertex Array Object쐬
+	*描画データ番号の頂点アトリビュートを設定する
+	*
+	*@param	drawIdVbo	描画データ番号のVBO
+	*
+	*インスタンスごとに1つ進むので、間接描画コマンドのbaseInstanceがそのまま番号になる
+	*gl_DrawIDを使わないので、ARB_shader_draw_parametersがなくても動く
+	*/
+	void SetDrawIdAttribPointer(GLuint drawIdVbo)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo);
+		glEnableVertexAttribArray(4);
+		glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+		glVertexAttribDivisor(4, 1);
+	}
+
+	/**
+	*Vertex Array Objectを作成する
 	*
-	*@param vbo VAOɊ֘AtVBO
-	*@param ibo VAOɊ֘AtIBO	<-new!
+	*@param vbo VAOに関連付けられるVBO
+	*@param ibo VAOに関連付けられるIBO	<-new!
+	*@param drawIdVbo	描画データ番号のVBO
 	*
-	*@return	쐬VBO.
+	*@return	作成したVBO.
 	*/
-	GLuint CreateVAO(GLuint vbo, const GLuint ibo)
+	GLuint CreateVAO(GLuint vbo, const GLuint ibo, GLuint drawIdVbo)
 	{
 		GLuint vao = 0;
 		glGenVertexArrays(1, &vao);
@@ -93,17 +136,54 @@ namespace Mesh
 		SetVertexAttribPointer(1, Vertex, color);
 		SetVertexAttribPointer(2, Vertex, texCoord);
 		SetVertexAttribPointer(3, Vertex, normal);
+		SetDrawIdAttribPointer(drawIdVbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBindVertexArray(0);
+		return vao;
+	}
+
+	/**
+	*量子化した頂点データ用のVertex Array Objectを作成する
+	*
+	*@param vbo VAOに関連付けられるVBO
+	*@param ibo VAOに関連付けられるIBO
+	*@param drawIdVbo	描画データ番号のVBO
+	*
+	*@return	作成したVAO.
+	*
+	*頂点シェーダの入力はCreateVAOと同じ型になるよう、GL側で浮動小数点数に変換させる
+	*/
+	GLuint CreatePackedVAO(GLuint vbo, const GLuint ibo, GLuint drawIdVbo)
+	{
+		GLuint vao = 0;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		const GLsizei stride = sizeof(PackedVertex);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride,
+			reinterpret_cast<GLvoid*>(offsetof(PackedVertex, position)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+			reinterpret_cast<GLvoid*>(offsetof(PackedVertex, color)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+			reinterpret_cast<GLvoid*>(offsetof(PackedVertex, texCoord)));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+			reinterpret_cast<GLvoid*>(offsetof(PackedVertex, normal)));
+		SetDrawIdAttribPointer(drawIdVbo);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 		glBindVertexArray(0);
 		return vao;
 	}
 
 	/**
-	*FBXxNgglmxNgɕϊ
+	*FBXベクトルをglmベクトルに変換する
 	*
-	*@param	fbxVec FBXxNg
+	*@param	fbxVec FBXベクトル
 	*
-	*@return glm xNg
+	*@return glm ベクトル
 	*/
 	template<typename T>
 	glm::vec4 ToVec4(const T& fbxVec)
@@ -126,7 +206,7 @@ namespace Mesh
 	}
 
 	/**
-	*	FBXIuWFNgj邽߂̃wp[\
+	*	FBXオブジェクトを破棄するためのヘルパー構造体
 	*/
 	template<typename T>
 	struct Deleter
@@ -135,58 +215,141 @@ namespace Mesh
 	};
 
 	/**
-	*	}eẢf[^
+	*	マテリアルの仮データ
 	*/
 	struct TemporaryMaterial
 	{
 		glm::vec4 color = glm::vec4(1);
-		std::vector<uint32_t> indexBuffer;
-		std::vector<Vertex> vertexBuffer;
+		Memory::Vector<uint32_t, Memory::Tag::Mesh> indexBuffer;
+		Memory::Vector<Vertex, Memory::Tag::Mesh> vertexBuffer;
 		std::vector<std::string> textureName;
+		//簡略化した詳細度のインデックス(詳細度1から順に並び、頂点はvertexBufferを共有する)
+		std::vector<Memory::Vector<uint32_t, Memory::Tag::Mesh>> lodIndexBuffer;
 	};
 
 	/**
-	*	bV̉f[^
+	*	メッシュの仮データ
 	*/
 	struct TemporaryMesh
 	{
 		std::string name;
 		std::vector<TemporaryMaterial> materialList;
+		int lodCount = 1;	///<詳細度の数(元のメッシュを含む)
 	};
 
 	/**
-	*	FBXf[^𒆊ԃf[^ɕϊNX
+	*	FBX SDK用のメモリ確保関数群
+	*
+	*	SDK内部の確保もMesh タグとして記録するために使う
+	*/
+	void* FbxMalloc(size_t size)
+	{
+		return Memory::Allocate(Memory::Tag::Mesh, size);
+	}
+	void* FbxCalloc(size_t count, size_t size)
+	{
+		void* p = Memory::Allocate(Memory::Tag::Mesh, count * size);
+		if (p)
+		{
+			memset(p, 0, count * size);
+		}
+		return p;
+	}
+	void* FbxRealloc(void* p, size_t size)
+	{
+		if (!p)
+		{
+			return FbxMalloc(size);
+		}
+		return Memory::Reallocate(p, size);
+	}
+	void FbxFree(void* p)
+	{
+		Memory::Deallocate(p);
+	}
+
+	/**
+	*	FBX SDKのメモリ確保関数を設定する
+	*
+	*	SDKのオブジェクトを作成する前に一度だけ呼び出すこと
+	*/
+	void SetupFbxAllocator()
+	{
+		static bool isInitialized = false;
+		if (isInitialized)
+		{
+			return;
+		}
+		FbxSetMallocHandler(FbxMalloc);
+		FbxSetCallocHandler(FbxCalloc);
+		FbxSetReallocHandler(FbxRealloc);
+		FbxSetFreeHandler(FbxFree);
+		isInitialized = true;
+	}
+
+	/**
+	*	FBXデータを中間データに変換するクラス
+	*
+	*	ノードの走査と変換行列の評価は1つのスレッドで行い、
+	*	メッシュの変換はノード単位、さらに大きなノードはポリゴンの範囲単位で並列に行う
 	*/
 	struct FbxLoader
 	{
+		explicit FbxLoader(JobSystem* js = nullptr) : jobSystem(js) {}
 		bool Load(const char* filename);
-		bool Convert(FbxNode* node);
-		bool LoadMesh(FbxNode* node);
+		void Convert(FbxNode* node);
+		bool LoadMesh(FbxNode* node, const FbxAMatrix& matTRS, TemporaryMesh& mesh);
 
+		JobSystem* jobSystem;	///<並列処理に使うジョブシステム(nullptrなら並列化しない)
+		std::vector<FbxNode*> nodeList;	///<メッシュを持つノードのリスト
+		std::vector<FbxAMatrix> transformList;	///<nodeListの各ノードの変換行列
 		std::vector<TemporaryMesh> meshList;
 	};
 
 	/**
-	*FBXt@Cǂݍ
+	*範囲を分割して並列に処理する
+	*
+	*@param	jobSystem	使用するジョブシステム(nullptrなら呼び出したスレッドで処理する)
+	*@param	count		処理する要素数
+	*@param	func		[begin, end)の範囲を処理する関数
+	*
+	*1要素ずつジョブにするので、要素は十分に大きな処理単位にしておくこと
+	*/
+	void ParallelForMesh(JobSystem* jobSystem, size_t count, const JobSystem::RangeFuncType& func)
+	{
+		if (jobSystem && count > 1)
+		{
+			jobSystem->ParallelFor(count, 1, func);
+		}
+		else
+		{
+			func(0, count);
+		}
+	}
+
+	/**
+	*FBXファイルを読み込む
 	*
-	*@param filename FBXt@C
+	*@param filename FBXファイル名
 	*
-	*@retval true	ǂݍݐ
-	*@retval  false	ǂݍݎs
+	*@retval true	読み込み成功
+	*@retval  false	読み込み失敗
+	*
+	*FbxManagerはファイルごとに作成するので、別のファイルを同時に読み込んでもよい
 	*/
 	bool FbxLoader::Load(const char* filename)
 	{
 		std::unique_ptr<FbxManager, Deleter<FbxManager>> fbxManager(FbxManager::Create());
 		if (!fbxManager)
 		{
-			std::cerr << "ERROR: " << filename << " ̓ǂݍ݂Ɏs(FbxManager̍쐬Ɏs)" <<
+			std::cerr << "ERROR: " << filename << " の読み込みに失敗(FbxManagerの作成に失敗)" <<
 				std::endl;
 			return false;
 		}
 		FbxScene* fbxScene = FbxScene::Create(fbxManager.get(), "");
 		if (!fbxScene)
 		{
-			std::cerr << "ERROR: " << filename << " ̓ǂݍ݂Ɏs(FbxManager̍쐬Ɏs)" <<
+			std::cerr << "ERROR: " << filename << " の読み込みに失敗(FbxManagerの作成に失敗)" <<
 				std::endl;
 			return false;
 		}
@@ -199,55 +362,217 @@ namespace Mesh
 			const bool importStatus = fbxImporter->Initialize(filename);
 			if (!importStatus || !fbxImporter->Import(fbxScene))
 			{
-				std::cerr << "ERROR: " << filename << " ̓ǂݍ݂Ɏs\n" <<
+				std::cerr << "ERROR: " << filename << " の読み込みに失敗\n" <<
 					fbxImporter->GetStatus().GetErrorString() << std::endl;
 				return false;
 			}
 		}
-		if (!Convert(fbxScene->GetRootNode()))
+		nodeList.clear();
+		transformList.clear();
+		Convert(fbxScene->GetRootNode());
+
+		meshList.resize(nodeList.size());
+		std::atomic<bool> isSucceeded(true);
+		ParallelForMesh(jobSystem, nodeList.size(), [this, &isSucceeded](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (!LoadMesh(nodeList[i], transformList[i], meshList[i]))
+				{
+					isSucceeded = false;
+				}
+			}
+		});
+		if (!isSucceeded)
 		{
-			std::cerr << "ERROR: " << filename << " ̕ϊɎs" << std::endl;
+			std::cerr << "ERROR: " << filename << " の変換に失敗" << std::endl;
 			return false;
 		}
 		return true;
 	}
 
 	/**
-	*FBXf[^f[^ɕϊ
+	*メッシュを持つノードを集める
 	*
-	*@param	fbxNode ϊΏۂFBXm[hւ̃|C^
+	*@param	fbxNode 走査するFBXノードへのポインタ
 	*
-	*@retval true	ϊ
-	*@retval false	ϊs
+	*変換行列の評価はSDK内部のキャッシュを更新するので、ここで1つのスレッドから行っておく
 	*/
-	bool FbxLoader::Convert(FbxNode* fbxNode)
+	void FbxLoader::Convert(FbxNode* fbxNode)
 	{
 		if (!fbxNode)
 		{
-			return true;
+			return;
 		}
-		if (!LoadMesh(fbxNode))
+		if (fbxNode->GetMesh())
 		{
-			return false;
+			nodeList.push_back(fbxNode);
+			transformList.push_back(fbxNode->EvaluateGlobalTransform());
 		}
 		const int childCount = fbxNode->GetChildCount();
 		for (int i = 0; i < childCount; ++i)
 		{
-			if (!Convert(fbxNode->GetChild(i)))
-				return false;
+			Convert(fbxNode->GetChild(i));
 		}
-		return true;
 	}
 
 	/**
-	*FBXbVf[^ɕϊ
+	*	メッシュ読み込み1回分の記録
+	*/
+	struct ImportRecord
+	{
+		std::string filename;
+		bool isCacheHit;
+		double seconds;
+	};
+	/**
+	*	頂点データの量子化1回分の記録
+	*/
+	struct PackRecord
+	{
+		std::string name;
+		float positionError;	///<座標の誤差の最大値
+		float positionErrorRatio;	///<座標の誤差の最大値の、バウンディングボックスの大きさに対する割合
+		float normalError;	///<法線の角度の誤差の最大値(度)
+	};
+	/**
+	*	頂点キャッシュ最適化1回分の記録
+	*/
+	struct OptimizeRecord
+	{
+		std::string name;
+		size_t vertexCount[2];	///<最適化前後の頂点数
+		float acmr[2];	///<最適化前後のACMR
+	};
+	/**
+	*	詳細度(LOD)作成1回分の記録
+	*/
+	struct LodRecord
+	{
+		std::string name;
+		std::vector<size_t> triangleCount;	///<詳細度ごとの三角形数
+		std::vector<float> error;	///<詳細度ごとの誤差の最大値(詳細度0は常に0)
+	};
+	std::mutex importRecordMutex;
+	std::vector<ImportRecord> importRecordList;
+	std::vector<PackRecord> packRecordList;
+	std::vector<OptimizeRecord> optimizeRecordList;
+	std::vector<LodRecord> lodRecordList;
+
+	/**
+	*仮データの頂点をまとめ、頂点キャッシュが効くように並べ替える
+	*
+	*@param	mesh	最適化するメッシュ
+	*
+	*最適化前後の頂点数とACMRを記録し、DumpImportStatsで表示する
+	*/
+	void OptimizeMesh(TemporaryMesh& mesh)
+	{
+		size_t vertexCount[2] = {};
+		float acmr[2] = {};
+		size_t triCount = 0;
+		for (TemporaryMaterial& e : mesh.materialList)
+		{
+			const size_t indexCount = e.indexBuffer.size();
+			const size_t tris = indexCount / 3;
+			vertexCount[0] += e.vertexBuffer.size();
+			acmr[0] += MeshOptimizer::CalcACMR(e.indexBuffer.data(), indexCount,
+				e.vertexBuffer.size()) * tris;
+
+			size_t count = MeshOptimizer::WeldVertices(e.vertexBuffer.data(),
+				e.vertexBuffer.size(), sizeof(Vertex), e.indexBuffer.data(), indexCount);
+			MeshOptimizer::OptimizeVertexCache(e.indexBuffer.data(), indexCount, count);
+			count = MeshOptimizer::OptimizeVertexFetch(e.vertexBuffer.data(), count,
+				sizeof(Vertex), e.indexBuffer.data(), indexCount);
+			e.vertexBuffer.resize(count);
+			e.vertexBuffer.shrink_to_fit();
+
+			vertexCount[1] += count;
+			acmr[1] += MeshOptimizer::CalcACMR(e.indexBuffer.data(), indexCount, count) * tris;
+			triCount += tris;
+		}
+		if (triCount)
+		{
+			acmr[0] /= static_cast<float>(triCount);
+			acmr[1] /= static_cast<float>(triCount);
+		}
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		optimizeRecordList.push_back({ mesh.name, { vertexCount[0], vertexCount[1] }, { acmr[0], acmr[1] } });
+	}
+
+	/**
+	*仮データから簡略化した詳細度(LOD)を作成する
+	*
+	*@param	mesh	OptimizeMeshで最適化したメッシュ
+	*
+	*詳細度ごとに直前の詳細度の三角形数を半分にすることを目指し、誤差の許容値を倍にしていく
+	*マテリアルの境界やテクスチャ座標の継ぎ目は動かさないので、詳細度間でも隙間はできない
+	*三角形があまり減らなくなったら、それ以上の詳細度は作らない
+	*詳細度ごとの三角形数と誤差を記録し、DumpImportStatsで表示する
+	*/
+	void BuildLodChain(TemporaryMesh& mesh)
+	{
+		static const size_t minTriangleCount = 64;
+		static const float firstError = 0.01f;
+		static const float minReduction = 0.75f;
+
+		size_t triCount = 0;
+		for (const TemporaryMaterial& e : mesh.materialList)
+		{
+			triCount += e.indexBuffer.size() / 3;
+		}
+		LodRecord record{ mesh.name, { triCount }, { 0.0f } };
+		mesh.lodCount = 1;
+		float targetError = firstError;
+		while (mesh.lodCount < maxLodCount && triCount >= minTriangleCount)
+		{
+			size_t lodTriCount = 0;
+			float maxError = 0;
+			for (TemporaryMaterial& e : mesh.materialList)
+			{
+				const Memory::Vector<uint32_t, Memory::Tag::Mesh>& src =
+					mesh.lodCount == 1 ? e.indexBuffer : e.lodIndexBuffer.back();
+				Memory::Vector<uint32_t, Memory::Tag::Mesh> dst(src.size());
+				float error = 0;
+				const size_t count = MeshOptimizer::SimplifyMesh(dst.data(), src.data(), src.size(),
+					e.vertexBuffer.data(), e.vertexBuffer.size(), sizeof(Vertex),
+					src.size() / 6 * 3, targetError, &error);
+				dst.resize(count);
+				MeshOptimizer::OptimizeVertexCache(dst.data(), count, e.vertexBuffer.size());
+				e.lodIndexBuffer.push_back(std::move(dst));
+				lodTriCount += count / 3;
+				maxError = std::max(maxError, error);
+			}
+			if (static_cast<float>(lodTriCount) > static_cast<float>(triCount) * minReduction)
+			{
+				for (TemporaryMaterial& e : mesh.materialList)
+				{
+					e.lodIndexBuffer.pop_back();
+				}
+				break;
+			}
+			record.triangleCount.push_back(lodTriCount);
+			record.error.push_back(maxError);
+			triCount = lodTriCount;
+			++mesh.lodCount;
+			targetError *= 2;
+		}
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		lodRecordList.push_back(std::move(record));
+	}
+
+	/**
+	*FBXメッシュを仮データに変換する
 	*
-	*@param	fbxNode ϊΏۂFBXm[hւ̃|C^
+	*@param	fbxNode 変換対象のFBXノードへのポインタ
+	*@param	matTRS	ノードの変換行列
+	*@param	mesh	変換結果を格納する仮データ
 	*
-	*@retval true	ϊ
-	*@retval false	ϊs
+	*@retval true	変換成功
+	*@retval false	変換失敗
+	*
+	*ノードごとに別のジョブから呼び出される
 	*/
-	bool FbxLoader::LoadMesh(FbxNode* fbxNode)
+	bool FbxLoader::LoadMesh(FbxNode* fbxNode, const FbxAMatrix& matTRS, TemporaryMesh& mesh)
 	{
 		FbxMesh* fbxMesh = fbxNode->GetMesh();
 		if (!fbxMesh)
@@ -255,15 +580,14 @@ namespace Mesh
 			return true;
 		}
 
-		TemporaryMesh mesh;
 		mesh.name = fbxNode->GetName();
 
 		if (!fbxMesh->IsTriangleMesh())
 		{
-			std::cerr << "WARNING: " << mesh.name << " ɂ͎Op`ȊO̖ʂ܂܂Ă܂" << std::endl;
+			std::cerr << "WARNING: " << mesh.name << " には三角形以外の面が含まれています" << std::endl;
 		}
 
-		//}eAǂݎ
+		//マテリアル情報を読み取る
 		const int materialCount = fbxNode->GetMaterialCount();
 		mesh.materialList.reserve(materialCount);
 		for (int i = 0;i < materialCount; ++i)
@@ -271,7 +595,7 @@ namespace Mesh
 			TemporaryMaterial material;
 			if (FbxSurfaceMaterial* fbxMaterial = fbxNode->GetMaterial(i))
 			{
-				//}eA̐Fǂݎ
+				//マテリアルの色情報を読み取る
 				const FbxClassId classId = fbxMaterial->GetClassId();
 				if (classId == FbxSurfaceLambert::ClassId ||
 					classId == FbxSurfacePhong::ClassId)
@@ -289,18 +613,18 @@ namespace Mesh
 			mesh.materialList.push_back(TemporaryMaterial());
 		}
 
-		//_vf̗L𒲂ׂ
+		//頂点要素の有無を調べる
 		const bool hasColor = fbxMesh->GetElementVertexColorCount() > 0;
 		const bool hasTexcoord = fbxMesh->GetElementUVCount() > 0;
 		const bool hasNormal = fbxMesh->GetElementNormalCount() > 0;
 
-		//UVZbg̃Xg擾
+		//UVセット名のリストを取得する
 		FbxStringList uvSetNameList;
 		fbxMesh->GetUVSetNames(uvSetNameList);
 
-		//Fǂݎ鏀
-		//@note W/UV/@ȊÕp[^ɂ͒ړǂݎ֐pӂĂȂ
-		//		uFbxGeoMetryElement???vNXǂݎKv
+		//色情報を読み取る準備
+		//@note 座標/UV/法線以外のパラメータには直接読み取る関数が用意されていないため
+		//		「FbxGeoMetryElement???」クラスから読み取る必要がある
 		FbxGeometryElement::EMappingMode colorMappingMode = FbxLayerElement::eNone;
 		bool isColorDirectRef = true;
 		const FbxLayerElementArrayTemplate<int>* colorIndexList = nullptr;
@@ -315,7 +639,7 @@ namespace Mesh
 			colorList = &fbxColorList->GetDirectArray();
 		}
 
-		//_x̃}eAɑ邩}eACfbNXXg擾
+		//頂点が度のマテリアルに属するかを示すマテリアルインデックスリストを取得する
 		const FbxLayerElementArrayTemplate<int>* materialIndexList = nullptr;
 		if (FbxGeometryElementMaterial* fbxMaterialLayer = fbxMesh->GetElementMaterial())
 		{
@@ -323,92 +647,127 @@ namespace Mesh
 		}
 
 
-		//|SɊÂāAf[^obt@̗eʂ\񂷂
+		//ポリゴンをブロックに分け、ブロックごと・マテリアルごとの頂点数を数える
+		//ブロック単位の数を先頭から累積すると、各ブロックが書き込む位置が決まるので
+		//ブロックを並列に変換しても、頂点の並びは1スレッドで変換した場合と同じになる
+		//(仮データバッファもちょうどの容量で確保でき、push_backによる再確保も避けられる)
+		static const int polygonsPerBlock = 4096;
 		const int polygonCount = fbxMesh->GetPolygonCount();
-		for (auto& e : mesh.materialList)
+		const size_t blockCount = (polygonCount + polygonsPerBlock - 1) / polygonsPerBlock;
+		const size_t meshMaterialCount = mesh.materialList.size();
+		const auto getMaterialIndex = [materialIndexList, meshMaterialCount](int polygonIndex) {
+			const int index = materialIndexList ? (*materialIndexList)[polygonIndex] : 0;
+			return (index >= 0 && static_cast<size_t>(index) < meshMaterialCount) ? index : 0;
+		};
+		std::vector<size_t> blockOffsetList(blockCount * meshMaterialCount, 0);
+		ParallelForMesh(jobSystem, blockCount, [&](size_t begin, size_t end) {
+			for (size_t block = begin; block < end; ++block)
+			{
+				size_t* vertexCountList = &blockOffsetList[block * meshMaterialCount];
+				const int polygonEnd = std::min(static_cast<int>(block + 1) * polygonsPerBlock, polygonCount);
+				for (int polygonIndex = static_cast<int>(block) * polygonsPerBlock; polygonIndex < polygonEnd; ++polygonIndex)
+				{
+					vertexCountList[getMaterialIndex(polygonIndex)] += 3;
+				}
+			}
+		});
+		for (size_t i = 0; i < meshMaterialCount; ++i)
 		{
-			const size_t avarageCapacity = polygonCount / mesh.materialList.size();
-			e.indexBuffer.reserve(avarageCapacity);
-			e.vertexBuffer.reserve(avarageCapacity);
+			size_t vertexCount = 0;
+			for (size_t block = 0; block < blockCount; ++block)
+			{
+				const size_t count = blockOffsetList[block * meshMaterialCount + i];
+				blockOffsetList[block * meshMaterialCount + i] = vertexCount;
+				vertexCount += count;
+			}
+			mesh.materialList[i].indexBuffer.resize(vertexCount);
+			mesh.materialList[i].vertexBuffer.resize(vertexCount);
 		}
 
-
-
-		const FbxAMatrix matTRS(fbxNode->EvaluateGlobalTransform());
+		//@note 並列に呼び出すのは、メッシュの状態を変更しない読み取り関数だけにすること
 		const FbxAMatrix matR(FbxVector4(0, 0, 0), matTRS.GetR(), FbxVector4(1, 1, 1));
 		const FbxVector4* const fbxControlPoints = fbxMesh->GetControlPoints();
-		int polygonVertex = 0;
-		for (int polygonIndex = 0; polygonIndex < polygonCount;++polygonIndex)
-		{
-			for (int pos = 0;pos < 3; ++pos)
+		const char* const uvSetName = hasTexcoord ? static_cast<const char*>(uvSetNameList[0]) : nullptr;
+		ParallelForMesh(jobSystem, blockCount, [&](size_t begin, size_t end) {
+			for (size_t block = begin; block < end; ++block)
 			{
-				Vertex v;
-				const int cpIndex = fbxMesh->GetPolygonVertex(polygonIndex, pos);
-
-				//_W
-				v.position = ToVec3(matTRS.MultT(fbxControlPoints[cpIndex]));
-
-				//_\
-				v.color = glm::vec4(1);
-				if (hasColor)
+				const size_t* writeOffsetList = &blockOffsetList[block * meshMaterialCount];
+				std::vector<size_t> cursorList(writeOffsetList, writeOffsetList + meshMaterialCount);
+				const int polygonEnd = std::min(static_cast<int>(block + 1) * polygonsPerBlock, polygonCount);
+				for (int polygonIndex = static_cast<int>(block) * polygonsPerBlock; polygonIndex < polygonEnd; ++polygonIndex)
 				{
-					switch (colorMappingMode)
+					const int materialIndex = getMaterialIndex(polygonIndex);
+					TemporaryMaterial& materialData = mesh.materialList[materialIndex];
+					int polygonVertex = polygonIndex * 3;
+					for (int pos = 0; pos < 3; ++pos, ++polygonVertex)
 					{
-					case FbxLayerElement::eByControlPoint:
-							v.color = ToVec4((*colorList)[
-								isColorDirectRef ? cpIndex : (*colorIndexList)[cpIndex]]);
-						break;
-					case FbxLayerElement::eByPolygonVertex:
-						v.color = ToVec4((*colorList)[
-							isColorDirectRef ? polygonVertex : (*colorIndexList)[polygonVertex]]);
-						break;
-
-					default:
-						break;
-					}
-				}
+						Vertex v;
+						const int cpIndex = fbxMesh->GetPolygonVertex(polygonIndex, pos);
 
-				//UVW
-				v.texCoord = glm::vec2(0);
-				if (hasTexcoord)
-				{
-					FbxVector2 uv;
-					bool unmapped;
-					fbxMesh->GetPolygonVertexUV(polygonIndex, pos, uvSetNameList[0], uv, unmapped);
-					v.texCoord = ToVec2(uv);
-				}
+						//頂点座標
+						v.position = ToVec3(matTRS.MultT(fbxControlPoints[cpIndex]));
 
-				//@
-				v.normal = glm::vec3(0, 0, 1);
-				if (hasNormal)
-				{
-					FbxVector4 normal;
+						//頂点カラー
+						v.color = glm::vec4(1);
+						if (hasColor)
+						{
+							switch (colorMappingMode)
+							{
+							case FbxLayerElement::eByControlPoint:
+								v.color = ToVec4((*colorList)[
+									isColorDirectRef ? cpIndex : (*colorIndexList)[cpIndex]]);
+								break;
+							case FbxLayerElement::eByPolygonVertex:
+								v.color = ToVec4((*colorList)[
+									isColorDirectRef ? polygonVertex : (*colorIndexList)[polygonVertex]]);
+								break;
 
-					fbxMesh->GetPolygonVertexNormal(polygonIndex, pos, normal);
-					v.normal = glm::normalize(ToVec3(matR.MultT(normal)));
-				}
-				//_ɑΉ鉼}eAɁA_f[^ƃCfbNXf[^ǉ
-				TemporaryMaterial& materialData = mesh.materialList[
-					materialIndexList ? (*materialIndexList)[polygonIndex] : 0];
-				materialData.indexBuffer.push_back(
-					static_cast<uint32_t>(materialData.vertexBuffer.size()));
-				materialData.vertexBuffer.push_back(v);
+							default:
+								break;
+							}
+						}
 
-				++polygonVertex;
+						//UV座標
+						v.texCoord = glm::vec2(0);
+						if (hasTexcoord)
+						{
+							FbxVector2 uv;
+							bool unmapped;
+							fbxMesh->GetPolygonVertexUV(polygonIndex, pos, uvSetName, uv, unmapped);
+							v.texCoord = ToVec2(uv);
+						}
+
+						//法線
+						v.normal = glm::vec3(0, 0, 1);
+						if (hasNormal)
+						{
+							FbxVector4 normal;
+							fbxMesh->GetPolygonVertexNormal(polygonIndex, pos, normal);
+							v.normal = glm::normalize(ToVec3(matR.MultT(normal)));
+						}
+
+						//このブロックに割り当てられた位置に、頂点データとインデックスデータを書き込む
+						size_t& cursor = cursorList[materialIndex];
+						materialData.indexBuffer[cursor] = static_cast<uint32_t>(cursor);
+						materialData.vertexBuffer[cursor] = v;
+						++cursor;
+					}
+				}
 			}
-		}
-		meshList.push_back(std::move(mesh));
+		});
+		OptimizeMesh(mesh);
+		BuildLodChain(mesh);
 
 		return true;
 	}
 
 
 	/**
-	*RXgN^
+	*コンストラクタ
 	*
-	*@param	meshName	bVf[^
-	*@param	begin		`悷}eA̐퓬CfbNX
-	*@param	end			`悷}eȀI[CfbNX
+	*@param	meshName	メッシュデータ名
+	*@param	begin		描画するマテリアルの戦闘インデックス
+	*@param	end			描画するマテリアルの終端インデックス
 	*/
 	Mesh::Mesh(const std::string& meshName, size_t begin, size_t end) :
 		name(meshName), beginMaterial(begin), endMaterial(end)
@@ -417,38 +776,80 @@ namespace Mesh
 	}
 
 	/**
-	*bV`悷
+	*メッシュを描画する
 	*
-	*@param buffer	`Ɏgp郁bVobt@ւ̃|C^
+	*@param buffer	描画に使用するメッシュバッファへのポインタ
+	*@param	lod		描画する詳細度(0が最も詳細、LodCount()以上なら最も粗いものを使う)
 	*/
-	void Mesh::Draw(const BufferPtr& buffer) const
+	void Mesh::Draw(const BufferPtr& buffer, int lod) const
 	{
 		if (!buffer)
 		{
 			return;
 		}
-		if (buffer->GetMesh(name.c_str()).get() != this)
+		if (owner != buffer.get())
 		{
-			std::cerr << "WARNING: obt@ɑ݂ȂbV '" << name <<
-				" '`悵悤Ƃ܂" << std::endl;
+			std::cerr << "WARNING: バッファに存在しないメッシュ '" << name <<
+				" 'を描画しようとしました" << std::endl;
 			return;
 		}
-		for (size_t i = beginMaterial; i < endMaterial;++i)
+		const size_t materialsPerLod = (endMaterial - beginMaterial) / lodCount;
+		const size_t begin = beginMaterial + materialsPerLod * std::min(std::max(lod, 0), lodCount - 1);
+		for (size_t i = begin; i < begin + materialsPerLod; ++i)
 		{
 			const Material& m = buffer->GetMaterial(i);
 			glDrawElementsBaseVertex(GL_TRIANGLES, m.size, m.type, m.offset, m.baseVertex);
 		}
 	}
 
+	/**
+	*メッシュを描画する間接描画コマンドを追加する
+	*
+	*@param	buffer	メッシュを格納しているメッシュバッファ
+	*@param	lod		描画する詳細度
+	*@param	drawId	コマンドのbaseInstanceに設定する描画データ番号
+	*@param	out		コマンドの追加先
+	*
+	*@return 追加したコマンドの数
+	*
+	*マテリアル1つにつき1コマンドを追加する
+	*インデックスはすべてGL_UNSIGNED_INTなので、同じIBOのコマンドはまとめて描画できる
+	*/
+	size_t Mesh::AppendDrawCommands(const BufferPtr& buffer, int lod, GLuint drawId,
+		std::vector<DrawCommand>& out) const
+	{
+		if (!buffer || owner != buffer.get())
+		{
+			return 0;
+		}
+		const size_t materialsPerLod = (endMaterial - beginMaterial) / lodCount;
+		const size_t begin = beginMaterial + materialsPerLod * std::min(std::max(lod, 0), lodCount - 1);
+		for (size_t i = begin; i < begin + materialsPerLod; ++i)
+		{
+			const Material& m = buffer->GetMaterial(i);
+			DrawCommand cmd;
+			cmd.count = static_cast<GLuint>(m.size);
+			cmd.instanceCount = 1;
+			cmd.firstIndex = static_cast<GLuint>(reinterpret_cast<size_t>(m.offset) / sizeof(GLuint));
+			cmd.baseVertex = m.baseVertex;
+			cmd.baseInstance = drawId;
+			out.push_back(cmd);
+		}
+		return materialsPerLod;
+	}
+
 
 	/**
-	*bVobt@쐬
+	*メッシュバッファを作成する
 	*
-	*@param	vboSize	obt@Ɋi[\ȑ_
-	*@param	iboSize	obt@Ɋi[\ȑCfbNX
+	*@param	vboSize	バッファに格納可能な総頂点数の初期値
+	*@param	iboSize	バッファに格納可能な総インデックス数の初期値
+	*
+	*容量が足りなくなると、バッファは自動的に拡張される
 	*/
 	BufferPtr Buffer::Create(int vboSize, int iboSize)
 	{
+		SetupFbxAllocator();
 		struct Impl : Buffer{Impl() {} ~Impl() {} };
 		BufferPtr p = std::make_shared<Impl>();
 		p->vbo = CreateVBO(vboSize * sizeof(Vertex), nullptr);
@@ -456,24 +857,45 @@ namespace Mesh
 		{
 			return{};
 		}
+		p->vboAllocator.Reset(vboSize * sizeof(Vertex));
 		p->ibo = CreateIBO(iboSize * sizeof(uint32_t), nullptr);
 		if (!p->ibo)
 		{
 			return{};
 		}
-		p->vao = CreateVAO(p->vbo, p->ibo);
+		p->iboAllocator.Reset(iboSize * sizeof(uint32_t));
+		std::vector<GLuint> drawIdList(maxDrawIdCount);
+		for (GLuint i = 0; i < maxDrawIdCount; ++i)
+		{
+			drawIdList[i] = i;
+		}
+		p->drawIdVbo = CreateVBO(drawIdList.size() * sizeof(GLuint), drawIdList.data());
+		if (!p->drawIdVbo)
+		{
+			return{};
+		}
+		p->vao = CreateVAO(p->vbo, p->ibo, p->drawIdVbo);
 		if (!p->vao)
 		{
 			return{};
 		}
+		p->packedVao = CreatePackedVAO(p->vbo, p->ibo, p->drawIdVbo);
+		if (!p->packedVao)
+		{
+			return{};
+		}
 		return p;
 	}
 
 	/**
-	*	fXgN^
+	*	デストラクタ
 	*/
 	Buffer::~Buffer()
 	{
+		if (packedVao)
+		{
+			glDeleteVertexArrays(1, &packedVao);
+		}
 		if (vao)
 		{
 			glDeleteVertexArrays(1, &vao);
@@ -486,115 +908,1361 @@ namespace Mesh
 		{
 			glDeleteBuffers(1, &vbo);
 		}
+		if (drawIdVbo)
+		{
+			glDeleteBuffers(1, &drawIdVbo);
+		}
 	}
 
 	/**
-	*bVt@Cǂݍ
-	*
-	*@param filename	bVt@C
+	*	GLに転送する前のメッシュデータ
 	*
-	*@retval true	ǂݍݐ
-	*@retval false	ǂݍݎs
+	*	頂点とインデックスの実体は、FBXから変換した場合はsourceList、
+	*	キャッシュから読み込んだ場合はマップしたfileが持っている
 	*/
-	bool Buffer::LoadMeshFromFile(const char* filename)
+	struct ImportData
 	{
-		FbxLoader loader;
-		if (!loader.Load(filename))
+		//マテリアル1つ分の転送データ
+		//詳細度1以上のマテリアルは頂点を持たず(verticesはnullptr)、詳細度0の同じ位置のマテリアルの頂点を使う
+		struct MaterialRange
 		{
-			return false;
-		}
-		GLint64 vboSize = 0;
-		GLint64 iboSize = 0;
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glGetBufferParameteri64v(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &vboSize);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-		glGetBufferParameteri64v(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &iboSize);
-		for (TemporaryMesh& e : loader.meshList)
+			const Vertex* vertices;	///<頂点データの先頭
+			uint32_t vertexCount;	///<頂点数
+			const uint32_t* indices;	///<インデックスデータの先頭
+			uint32_t indexCount;	///<インデックス数
+			glm::vec4 color;	///<マテリアルの色
+		};
+
+		//メッシュ1つ分のデータ
+		struct MeshRange
 		{
-			for (TemporaryMaterial& material : e.materialList)
-			{
-				const GLsizeiptr verticesBytes = material.vertexBuffer.size() * sizeof(Vertex);
-				if (vboEnd + verticesBytes >= vboSize)
-				{
-					std::cerr << "WARNING: VBOTCYsĂ܂( " <<
-						vboEnd << '/' << vboSize << ' )' << std::endl;
-					continue;
-				}
-				const GLsizei indexSize = static_cast<GLsizei>(material.indexBuffer.size());
-				const GLsizeiptr indicesBytes = indexSize * sizeof(uint32_t);
-				if (iboEnd + indicesBytes >= iboSize)
-				{
-					std::cerr << "WARNING: IBOTCYsĂ܂( " <<
-						iboEnd << '/' << iboSize << ' )' << std::endl;
-					continue;
-				}
-				glBufferSubData(GL_ARRAY_BUFFER, vboEnd, verticesBytes,
-					material.vertexBuffer.data());
+			std::string name;	///<メッシュ名
+			uint32_t beginMaterial;	///<materialList内の先頭インデックス
+			uint32_t endMaterial;	///<materialList内の終端インデックス
+			uint32_t lodCount;	///<詳細度の数(マテリアルは詳細度0から順に同じ数ずつ並ぶ)
+			glm::vec3 boundsMin;	///<頂点座標の最小値
+			glm::vec3 boundsMax;	///<頂点座標の最大値
+		};
 
-				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, iboEnd, indicesBytes,
-					material.indexBuffer.data());
-				const GLint baseVertex = static_cast<uint32_t>(vboEnd / sizeof(Vertex));
-				materialList.push_back({ GL_UNSIGNED_INT,indexSize,
-					reinterpret_cast<GLvoid*>(iboEnd),baseVertex,material.color });
+		std::vector<MaterialRange> materialList;
+		std::vector<MeshRange> meshList;
+		std::vector<TemporaryMesh> sourceList;
+		MappedFile file;
+		VertexFormat format = VertexFormat::Float;	///<Uploadで転送するときの頂点データの形式
+	};
 
-				vboEnd += verticesBytes;
-				iboEnd += indicesBytes;
-			}
+	/**
+	*	メッシュキャッシュファイルの形式
+	*
+	*	CacheHeader, CacheMesh[meshCount], CacheMaterial[materialCount],
+	*	メッシュ名の文字列, 頂点データ, インデックスデータ の順に並ぶ
+	*	頂点データとインデックスデータはそのままglBufferSubDataに渡せる形式で格納する
+	*	詳細度1以上のマテリアルは頂点数0で、インデックスだけを持つ
+	*/
+	const char cacheMagic[4] = { 'M', 'S', 'H', 'C' };
+	const uint32_t cacheVersion = 3;
+	const char cacheDirectory[] = "Res/Cache";
+	const size_t cacheBlobAlignment = 16;
 
-			struct Impl : public Mesh
-			{
-				Impl(const std::string& n,size_t b,size_t e) : Mesh(n,b,e){}
-				~Impl(){}
-			};
-			const size_t endMaterial = materialList.size();
-			const size_t beginMaterial = endMaterial - e.materialList.size();
-			meshList.insert(std::make_pair(
-				e.name,std::make_shared<Impl>(e.name, beginMaterial, endMaterial)));
+	struct CacheHeader
+	{
+		char magic[4];	///<識別子("MSHC")
+		uint32_t version;	///<形式のバージョン
+		uint32_t vertexSize;	///<頂点データ1つのバイト数
+		uint32_t meshCount;	///<メッシュ数
+		uint32_t materialCount;	///<マテリアル数
+		uint32_t reserved;
+		uint64_t sourceSize;	///<変換元FBXファイルのバイト数
+		int64_t sourceTime;	///<変換元FBXファイルの更新時刻
+		uint64_t sourceHash;	///<変換元FBXファイルの内容のハッシュ値
+		uint64_t nameOffset;	///<メッシュ名の文字列の位置
+		uint64_t vertexOffset;	///<頂点データの位置
+		uint64_t indexOffset;	///<インデックスデータの位置
+		uint64_t fileSize;	///<キャッシュファイル全体のバイト数
+	};
+
+	struct CacheMesh
+	{
+		uint32_t nameOffset;	///<メッシュ名の文字列内の位置
+		uint32_t nameLength;	///<メッシュ名の文字数
+		uint32_t beginMaterial;
+		uint32_t endMaterial;
+		uint32_t lodCount;	///<詳細度の数
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct CacheMaterial
+	{
+		uint32_t vertexOffset;	///<頂点データ内の位置(頂点単位)
+		uint32_t vertexCount;
+		uint32_t indexOffset;	///<インデックスデータ内の位置(インデックス単位)
+		uint32_t indexCount;
+		float color[4];
+	};
+
+	/**
+	*	変換元ファイルの情報
+	*/
+	struct SourceInfo
+	{
+		uint64_t size = 0;
+		int64_t time = 0;
+		uint64_t hash = 0;
+	};
+
+	/**
+	*データの64bit FNV-1aハッシュ値を計算する
+	*
+	*@param	p		データの先頭
+	*@param	size	データのバイト数
+	*@param	hash	ハッシュ値の初期値
+	*
+	*@return ハッシュ値
+	*/
+	uint64_t Fnv1a(const void* p, size_t size, uint64_t hash = 14695981039346656037ULL)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(p);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	/**
+	*変換元ファイルのサイズと更新時刻を取得する
+	*
+	*@param	filename	ファイル名
+	*@param	info		情報の格納先
+	*
+	*@retval true	取得成功
+	*@retval false	ファイルが存在しない
+	*/
+	bool GetSourceInfo(const char* filename, SourceInfo& info)
+	{
+		struct stat st;
+		if (stat(filename, &st) != 0)
+		{
+			return false;
 		}
+		info.size = static_cast<uint64_t>(st.st_size);
+		info.time = static_cast<int64_t>(st.st_mtime);
 		return true;
 	}
 
 	/**
-	*bV擾
+	*ファイルの内容のハッシュ値を計算する
 	*
-	*@param	name	bV
+	*@param	filename	ファイル名
+	*@param	hash		ハッシュ値の格納先
 	*
-	*@return		nameɑΉ郁bVւ̃|C^
+	*@retval true	計算成功
+	*@retval false	ファイルを開けなかった
 	*/
-	const MeshPtr& Buffer::GetMesh(const char* name)const
+	bool HashFile(const char* filename, uint64_t& hash)
 	{
-		auto itr = meshList.find(name);
-		if (itr == meshList.end())
+		MappedFile file;
+		if (!file.Open(filename))
 		{
-			static const MeshPtr dummy;
-			return dummy;
+			return false;
 		}
-		return itr->second;
+		hash = Fnv1a(file.Data(), file.Size());
+		return true;
 	}
 
 	/**
-	*}eA擾
+	*メッシュファイル名に対応するキャッシュファイル名を作成する
 	*
-	*@param index	}eÃCfbNX
+	*@param	filename	メッシュファイル名
 	*
-	*@return indexɑΉ}eA
+	*@return キャッシュファイル名
 	*/
-	const Material& Buffer::GetMaterial(size_t index) const
+	std::string GetCachePath(const char* filename)
 	{
-		if (index >= materialList.size())
+		static const char hex[] = "0123456789abcdef";
+		const uint64_t hash = Fnv1a(filename, strlen(filename));
+		std::string path = cacheDirectory;
+		path += '/';
+		for (int shift = 60; shift >= 0; shift -= 4)
 		{
-			static const Material dummy{ GL_UNSIGNED_BYTE,0,0,0,glm::vec4(1) };
-			return dummy;
+			path += hex[(hash >> shift) & 0xf];
 		}
-		return materialList[index];
+		path += ".mshc";
+		return path;
 	}
 
 	/**
-	*	VVVAOOpenGL̏Ώۂɐݒ肷
+	*変換したメッシュデータから転送範囲を作成する
+	*
+	*@param	data	sourceListを設定済みのメッシュデータ
 	*/
-	void Buffer::BindVAO()const
+	void BuildRanges(ImportData& data)
 	{
-		glBindVertexArray(vao);
+		for (const TemporaryMesh& mesh : data.sourceList)
+		{
+			ImportData::MeshRange range;
+			range.name = mesh.name;
+			range.beginMaterial = static_cast<uint32_t>(data.materialList.size());
+			range.boundsMin = glm::vec3(FLT_MAX);
+			range.boundsMax = glm::vec3(-FLT_MAX);
+			for (const TemporaryMaterial& material : mesh.materialList)
+			{
+				data.materialList.push_back({
+					material.vertexBuffer.data(), static_cast<uint32_t>(material.vertexBuffer.size()),
+					material.indexBuffer.data(), static_cast<uint32_t>(material.indexBuffer.size()),
+					material.color });
+				for (const Vertex& v : material.vertexBuffer)
+				{
+					range.boundsMin = glm::min(range.boundsMin, v.position);
+					range.boundsMax = glm::max(range.boundsMax, v.position);
+				}
+			}
+			for (int lod = 1; lod < mesh.lodCount; ++lod)
+			{
+				for (const TemporaryMaterial& material : mesh.materialList)
+				{
+					const Memory::Vector<uint32_t, Memory::Tag::Mesh>& indices = material.lodIndexBuffer[lod - 1];
+					data.materialList.push_back({ nullptr, 0,
+						indices.data(), static_cast<uint32_t>(indices.size()), material.color });
+				}
+			}
+			range.endMaterial = static_cast<uint32_t>(data.materialList.size());
+			range.lodCount = static_cast<uint32_t>(mesh.lodCount);
+			if (range.boundsMin.x > range.boundsMax.x)
+			{
+				range.boundsMin = range.boundsMax = glm::vec3(0);
+			}
+			data.meshList.push_back(range);
+		}
+	}
+
+	/**
+	*キャッシュファイルを読み込む
+	*
+	*@param	cachePath	キャッシュファイル名
+	*@param	filename	変換元のメッシュファイル名
+	*@param	info		変換元ファイルの情報
+	*					サイズか更新時刻が異なる場合はハッシュ値を計算して格納する
+	*@param	data		読み込んだデータの格納先
+	*
+	*@retval true	キャッシュが有効だった
+	*@retval false	キャッシュが存在しないか、古いか壊れていた
+	*
+	*頂点とインデックスはコピーせず、マップしたファイルを直接参照する
+	*/
+	bool LoadCache(const std::string& cachePath, const char* filename,
+		SourceInfo& info, ImportData& data)
+	{
+		if (!data.file.Open(cachePath.c_str()))
+		{
+			return false;
+		}
+		const uint8_t* const base = data.file.Data();
+		const size_t fileSize = data.file.Size();
+		if (fileSize < sizeof(CacheHeader))
+		{
+			return false;
+		}
+		CacheHeader header;
+		memcpy(&header, base, sizeof(header));
+		if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+			header.version != cacheVersion || header.vertexSize != sizeof(Vertex) ||
+			header.fileSize != fileSize)
+		{
+			return false;
+		}
+		const uint64_t tableEnd = sizeof(CacheHeader) +
+			header.meshCount * sizeof(CacheMesh) + header.materialCount * sizeof(CacheMaterial);
+		if (tableEnd > header.nameOffset || header.nameOffset > header.vertexOffset ||
+			header.vertexOffset > header.indexOffset || header.indexOffset > fileSize ||
+			header.vertexOffset % cacheBlobAlignment || header.indexOffset % cacheBlobAlignment)
+		{
+			return false;
+		}
+
+		//サイズか更新時刻が違っても、内容が同じならキャッシュを使う
+		if (header.sourceSize != info.size || header.sourceTime != info.time)
+		{
+			if (header.sourceSize != info.size || !HashFile(filename, info.hash) ||
+				info.hash != header.sourceHash)
+			{
+				return false;
+			}
+		}
+
+		const Vertex* const vertices = reinterpret_cast<const Vertex*>(base + header.vertexOffset);
+		const uint32_t* const indices = reinterpret_cast<const uint32_t*>(base + header.indexOffset);
+		const uint64_t vertexCount = (header.indexOffset - header.vertexOffset) / sizeof(Vertex);
+		const uint64_t indexCount = (fileSize - header.indexOffset) / sizeof(uint32_t);
+		const CacheMaterial* const materials = reinterpret_cast<const CacheMaterial*>(
+			base + sizeof(CacheHeader) + header.meshCount * sizeof(CacheMesh));
+		data.materialList.reserve(header.materialCount);
+		for (uint32_t i = 0; i < header.materialCount; ++i)
+		{
+			CacheMaterial m;
+			memcpy(&m, materials + i, sizeof(m));
+			if (uint64_t(m.vertexOffset) + m.vertexCount > vertexCount ||
+				uint64_t(m.indexOffset) + m.indexCount > indexCount)
+			{
+				return false;
+			}
+			data.materialList.push_back({ vertices + m.vertexOffset, m.vertexCount,
+				indices + m.indexOffset, m.indexCount,
+				glm::vec4(m.color[0], m.color[1], m.color[2], m.color[3]) });
+		}
+
+		const CacheMesh* const meshes = reinterpret_cast<const CacheMesh*>(base + sizeof(CacheHeader));
+		const char* const names = reinterpret_cast<const char*>(base + header.nameOffset);
+		const uint64_t namesSize = header.vertexOffset - header.nameOffset;
+		data.meshList.reserve(header.meshCount);
+		for (uint32_t i = 0; i < header.meshCount; ++i)
+		{
+			CacheMesh m;
+			memcpy(&m, meshes + i, sizeof(m));
+			if (uint64_t(m.nameOffset) + m.nameLength > namesSize ||
+				m.beginMaterial > m.endMaterial || m.endMaterial > header.materialCount ||
+				m.lodCount == 0 || m.lodCount > static_cast<uint32_t>(maxLodCount) ||
+				(m.endMaterial - m.beginMaterial) % m.lodCount != 0)
+			{
+				return false;
+			}
+			ImportData::MeshRange range;
+			range.name.assign(names + m.nameOffset, m.nameLength);
+			range.beginMaterial = m.beginMaterial;
+			range.endMaterial = m.endMaterial;
+			range.lodCount = m.lodCount;
+			range.boundsMin = glm::vec3(m.boundsMin[0], m.boundsMin[1], m.boundsMin[2]);
+			range.boundsMax = glm::vec3(m.boundsMax[0], m.boundsMax[1], m.boundsMax[2]);
+			data.meshList.push_back(range);
+		}
+		return true;
+	}
+
+	/**
+	*ファイルに0を書き込んで、位置をalignの倍数に揃える
+	*/
+	void WritePadding(FILE* fp, uint64_t& pos, size_t align)
+	{
+		static const uint8_t zero[cacheBlobAlignment] = {};
+		const size_t padding = static_cast<size_t>((align - pos % align) % align);
+		fwrite(zero, 1, padding, fp);
+		pos += padding;
+	}
+
+	/**
+	*キャッシュファイルを作成する
+	*
+	*@param	cachePath	キャッシュファイル名
+	*@param	info		変換元ファイルの情報
+	*@param	data		書き込むメッシュデータ
+	*
+	*@retval true	作成成功
+	*@retval false	作成失敗
+	*
+	*書き込み途中のファイルが読まれないよう、一時ファイルに書いてから名前を変える
+	*/
+	bool SaveCache(const std::string& cachePath, const SourceInfo& info, const ImportData& data)
+	{
+#ifdef _WIN32
+		_mkdir(cacheDirectory);
+#else
+		mkdir(cacheDirectory, 0755);
+#endif
+		const std::string tmpPath = cachePath + ".tmp";
+		FILE* fp = fopen(tmpPath.c_str(), "wb");
+		if (!fp)
+		{
+			std::cerr << "WARNING: " << cachePath << "を作成できません" << std::endl;
+			return false;
+		}
+
+		std::vector<CacheMesh> meshes;
+		std::string names;
+		meshes.reserve(data.meshList.size());
+		for (const ImportData::MeshRange& e : data.meshList)
+		{
+			CacheMesh m;
+			m.nameOffset = static_cast<uint32_t>(names.size());
+			m.nameLength = static_cast<uint32_t>(e.name.size());
+			m.beginMaterial = e.beginMaterial;
+			m.endMaterial = e.endMaterial;
+			m.lodCount = e.lodCount;
+			for (int i = 0; i < 3; ++i)
+			{
+				m.boundsMin[i] = e.boundsMin[i];
+				m.boundsMax[i] = e.boundsMax[i];
+			}
+			meshes.push_back(m);
+			names += e.name;
+		}
+		std::vector<CacheMaterial> materials;
+		materials.reserve(data.materialList.size());
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		for (const ImportData::MaterialRange& e : data.materialList)
+		{
+			CacheMaterial m;
+			m.vertexOffset = vertexCount;
+			m.vertexCount = e.vertexCount;
+			m.indexOffset = indexCount;
+			m.indexCount = e.indexCount;
+			for (int i = 0; i < 4; ++i)
+			{
+				m.color[i] = e.color[i];
+			}
+			materials.push_back(m);
+			vertexCount += e.vertexCount;
+			indexCount += e.indexCount;
+		}
+
+		CacheHeader header = {};
+		memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = cacheVersion;
+		header.vertexSize = sizeof(Vertex);
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.materialCount = static_cast<uint32_t>(materials.size());
+		header.sourceSize = info.size;
+		header.sourceTime = info.time;
+		header.sourceHash = info.hash;
+		header.nameOffset = sizeof(CacheHeader) +
+			meshes.size() * sizeof(CacheMesh) + materials.size() * sizeof(CacheMaterial);
+		header.vertexOffset = header.nameOffset + names.size();
+		header.vertexOffset += (cacheBlobAlignment - header.vertexOffset % cacheBlobAlignment) % cacheBlobAlignment;
+		header.indexOffset = header.vertexOffset + uint64_t(vertexCount) * sizeof(Vertex);
+		header.indexOffset += (cacheBlobAlignment - header.indexOffset % cacheBlobAlignment) % cacheBlobAlignment;
+		header.fileSize = header.indexOffset + uint64_t(indexCount) * sizeof(uint32_t);
+
+		uint64_t pos = 0;
+		pos += fwrite(&header, 1, sizeof(header), fp);
+		pos += fwrite(meshes.data(), 1, meshes.size() * sizeof(CacheMesh), fp);
+		pos += fwrite(materials.data(), 1, materials.size() * sizeof(CacheMaterial), fp);
+		pos += fwrite(names.data(), 1, names.size(), fp);
+		WritePadding(fp, pos, cacheBlobAlignment);
+		for (const ImportData::MaterialRange& e : data.materialList)
+		{
+			pos += fwrite(e.vertices, 1, e.vertexCount * sizeof(Vertex), fp);
+		}
+		WritePadding(fp, pos, cacheBlobAlignment);
+		for (const ImportData::MaterialRange& e : data.materialList)
+		{
+			pos += fwrite(e.indices, 1, e.indexCount * sizeof(uint32_t), fp);
+		}
+		const bool isSucceeded = (fclose(fp) == 0) && (pos == header.fileSize);
+		if (!isSucceeded)
+		{
+			std::cerr << "WARNING: " << cachePath << "の書き込みに失敗しました" << std::endl;
+			remove(tmpPath.c_str());
+			return false;
+		}
+		remove(cachePath.c_str());
+		if (rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+		{
+			remove(tmpPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	*32bit浮動小数点数を半精度浮動小数点数に変換する
+	*
+	*@param	f	変換する値
+	*
+	*@return 半精度浮動小数点数のビット列(最近接丸め、範囲外は無限大になる)
+	*/
+	uint16_t ToHalf(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		const uint32_t sign = (x >> 16) & 0x8000;
+		const int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = x & 0x7fffff;
+		if (exponent >= 31)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+		if (exponent <= 0)
+		{
+			//非正規化数
+			if (exponent < -10)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			uint32_t h = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1)
+			{
+				++h;
+			}
+			return static_cast<uint16_t>(sign | h);
+		}
+		uint32_t h = sign | (exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000)
+		{
+			++h;	//繰り上がりで指数部が増えても正しい値になる
+		}
+		return static_cast<uint16_t>(h);
+	}
+
+	/**
+	*法線をsnorm 10:10:10:2形式に変換する
+	*/
+	uint32_t PackNormal(const glm::vec3& n)
+	{
+		uint32_t result = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float f = std::min(std::max(n[i], -1.0f), 1.0f);
+			const int32_t q = static_cast<int32_t>(floorf(f * 511.0f + 0.5f));
+			result |= (static_cast<uint32_t>(q) & 0x3ff) << (i * 10);
+		}
+		return result;
+	}
+
+	/**
+	*snorm 10:10:10:2形式の法線を復元する(GL 4.2以降の変換規則)
+	*/
+	glm::vec3 UnpackNormal(uint32_t packed)
+	{
+		glm::vec3 n;
+		for (int i = 0; i < 3; ++i)
+		{
+			int32_t q = static_cast<int32_t>((packed >> (i * 10)) & 0x3ff);
+			if (q >= 512)
+			{
+				q -= 1024;
+			}
+			n[i] = std::max(static_cast<float>(q) / 511.0f, -1.0f);
+		}
+		return n;
+	}
+
+	/**
+	*境界ボックスから頂点座標の量子化パラメータを計算する
+	*
+	*@param	boundsMin	頂点座標の最小値
+	*@param	boundsMax	頂点座標の最大値
+	*@param	offset		量子化の原点の格納先
+	*@param	scale		量子化した値1あたりの長さの格納先
+	*
+	*座標 = offset + scale * 量子化した値(-32767～32767)
+	*/
+	void CalcQuantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+		glm::vec3& offset, glm::vec3& scale)
+	{
+		offset = (boundsMin + boundsMax) * 0.5f;
+		scale = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f)) / 32767.0f;
+	}
+
+	/**
+	*頂点データを量子化する
+	*
+	*@param	src			量子化する頂点データ
+	*@param	count		頂点数
+	*@param	offset		量子化の原点
+	*@param	scale		量子化した値1あたりの長さ
+	*@param	dst			格納先(GLのバッファをマップしたメモリでもよい)
+	*@param	maxError	量子化誤差の最大値(x=座標, y=法線の角度(ラジアン))
+	*
+	*dstは書き込み専用として扱い、読み出さない
+	*/
+	void PackVertices(const Vertex* src, size_t count, const glm::vec3& offset,
+		const glm::vec3& scale, PackedVertex* dst, glm::vec2& maxError)
+	{
+		for (size_t v = 0; v < count; ++v)
+		{
+			const Vertex& e = src[v];
+			PackedVertex packed;
+			for (int k = 0; k < 3; ++k)
+			{
+				const float q = (e.position[k] - offset[k]) / scale[k];
+				packed.position[k] = static_cast<int16_t>(
+					floorf(std::min(std::max(q, -32767.0f), 32767.0f) + 0.5f));
+				const float decoded = offset[k] + scale[k] * packed.position[k];
+				maxError.x = std::max(maxError.x, fabsf(decoded - e.position[k]));
+			}
+			packed.position[3] = 0;
+			for (int k = 0; k < 4; ++k)
+			{
+				const float c = std::min(std::max(e.color[k], 0.0f), 1.0f);
+				packed.color[k] = static_cast<uint8_t>(c * 255.0f + 0.5f);
+			}
+			packed.texCoord[0] = ToHalf(e.texCoord.x);
+			packed.texCoord[1] = ToHalf(e.texCoord.y);
+			packed.normal = PackNormal(e.normal);
+			const glm::vec3 n = UnpackNormal(packed.normal);
+			const float len = glm::length(n) * glm::length(e.normal);
+			if (len > 0)
+			{
+				const float cosAngle = std::min(glm::dot(n, e.normal) / len, 1.0f);
+				maxError.y = std::max(maxError.y, acosf(cosAngle));
+			}
+			//書き込み結合メモリに対して効率よく書き込めるよう、1頂点分をまとめて書き込む
+			memcpy(dst + v, &packed, sizeof(packed));
+		}
+	}
+
+	/**
+	*GL_COPY_WRITE_BUFFERにバインドしたバッファの範囲を書き込み用にマップする
+	*
+	*@param	offset	マップする範囲の先頭位置
+	*@param	size	マップする範囲のバイト数
+	*
+	*@return マップしたメモリの先頭アドレス
+	*		sizeが0の場合や、マップに失敗した場合はnullptr
+	*
+	*確保したばかりの領域はGPUから参照されていないので、同期せずにマップする
+	*(解放した領域はRetireQueueでGPUの完了を待ってから空きに戻し、GrowBufferは空き領域をコピーしない)
+	*/
+	void* MapWriteRange(GLintptr offset, GLsizeiptr size)
+	{
+		if (size <= 0)
+		{
+			return nullptr;
+		}
+		return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+
+	/**
+	*メッシュをファイルから読み込む
+	*
+	*@param filename	メッシュファイル名
+	*@param	format		頂点データの形式
+	*@param	jobSystem	FBXの変換に使うジョブシステム(nullptrなら並列化しない)
+	*
+	*@retval true	読み込み成功
+	*@retval false	読み込み失敗
+	*/
+	bool Buffer::LoadMeshFromFile(const char* filename, VertexFormat format, JobSystem* jobSystem)
+	{
+		const ImportDataPtr data = ImportFromFile(filename, format, jobSystem);
+		if (!data)
+		{
+			return false;
+		}
+		std::vector<MeshPtr> meshes;
+		if (!Upload(*data, meshes))
+		{
+			return false;
+		}
+		for (const MeshPtr& e : meshes)
+		{
+			AddMesh(e);
+		}
+		return true;
+	}
+
+	/**
+	*ファイルからメッシュデータを読み込み、GLに転送できる形式に変換する
+	*
+	*@param	filename	メッシュファイル名
+	*@param	format		頂点データの形式
+	*@param	jobSystem	FBXの変換に使うジョブシステム(nullptrなら並列化しない)
+	*
+	*@return 変換したメッシュデータ
+	*		失敗した場合はnullptr
+	*
+	*有効なキャッシュがあればFBX SDKを使わずにキャッシュをマップする
+	*キャッシュがないか古い場合はFBXファイルを変換し、キャッシュを作り直す
+	*キャッシュは常にFloat形式で保存し、Packed形式はUploadでGLのバッファに直接量子化する
+	*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+	*/
+	ImportDataPtr Buffer::ImportFromFile(const char* filename, VertexFormat format, JobSystem* jobSystem)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		SourceInfo info;
+		if (!GetSourceInfo(filename, info))
+		{
+			std::cerr << "ERROR: " << filename << "が見つかりません" << std::endl;
+			return{};
+		}
+		const std::string cachePath = GetCachePath(filename);
+		ImportDataPtr data = std::make_shared<ImportData>();
+		bool isCacheHit = LoadCache(cachePath, filename, info, *data);
+		if (!isCacheHit)
+		{
+			data = std::make_shared<ImportData>();
+			FbxLoader loader(jobSystem);
+			if (!loader.Load(filename))
+			{
+				return{};
+			}
+			data->sourceList.swap(loader.meshList);
+			BuildRanges(*data);
+			if (info.hash || HashFile(filename, info.hash))
+			{
+				SaveCache(cachePath, info, *data);
+			}
+		}
+		data->format = format;
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		importRecordList.push_back({ filename, isCacheHit, elapsed.count() });
+		return data;
+	}
+
+	/**
+	*メッシュの読み込み時間を出力する
+	*
+	*@param	os	出力先
+	*
+	*キャッシュを使った読み込み(warm)とFBXからの変換(cold)を分けて集計する
+	*読み込み中のピークメモリとして、FBX SDK内部の確保を含むMeshタグの最大使用量も表示する
+	*FBXから変換したメッシュは、頂点キャッシュ最適化前後の頂点数とACMR、詳細度ごとの三角形数も表示する
+	*量子化した頂点形式で転送したメッシュは、量子化による誤差の最大値も表示する
+	*/
+	void DumpImportStats(std::ostream& os)
+	{
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		double total[2] = {};
+		int count[2] = {};
+		os << "Mesh import:" << std::endl;
+		for (const ImportRecord& e : importRecordList)
+		{
+			os << "  " << std::setw(5) << (e.isCacheHit ? "warm" : "cold") << std::setw(10) <<
+				std::fixed << std::setprecision(2) << e.seconds * 1000 << "ms  " << e.filename << std::endl;
+			total[e.isCacheHit] += e.seconds;
+			++count[e.isCacheHit];
+		}
+		os << "  cold: " << count[0] << " files " << total[0] * 1000 << "ms, warm: " <<
+			count[1] << " files " << total[1] * 1000 << "ms" << std::endl;
+		os << "  peak mesh memory: " << Memory::GetStats(Memory::Tag::Mesh).peakBytes / 1024 <<
+			"KB" << std::endl;
+		for (const OptimizeRecord& e : optimizeRecordList)
+		{
+			os << "  " << e.name << ": vertices " << e.vertexCount[0] << " -> " << e.vertexCount[1] <<
+				", ACMR " << std::fixed << std::setprecision(3) << e.acmr[0] << " -> " << e.acmr[1] << std::endl;
+		}
+		for (const LodRecord& e : lodRecordList)
+		{
+			os << "  " << e.name << ": LOD triangles " << e.triangleCount[0];
+			for (size_t i = 1; i < e.triangleCount.size(); ++i)
+			{
+				os << " -> " << e.triangleCount[i] << " (error " << std::fixed << std::setprecision(2) <<
+					e.error[i] * 100.0f << "%)";
+			}
+			os << std::endl;
+		}
+		if (!packRecordList.empty())
+		{
+			os << "  packed " << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " bytes/vertex:" << std::endl;
+		}
+		for (const PackRecord& e : packRecordList)
+		{
+			os << "    " << e.name << ": max position error " << std::setprecision(4) << e.positionError <<
+				" (" << std::setprecision(2) << e.positionErrorRatio * 100.0f << "% of bounds), max normal error " <<
+				e.normalError << " deg" << std::endl;
+		}
+		os.unsetf(std::ios::floatfield);
+	}
+
+	/**
+	*頂点データ1つ分のバイト数を取得する
+	*
+	*@param	format	頂点データの形式
+	*
+	*@return 頂点データ1つ分のバイト数
+	*/
+	GLsizeiptr VertexSize(VertexFormat format)
+	{
+		return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+
+	/**
+	*メッシュデータをGLのバッファに転送する
+	*
+	*@param	data	ImportFromFileで作成したメッシュデータ
+	*@param	out		作成したメッシュの格納先
+	*
+	*@retval true	転送成功
+	*@retval false	転送失敗
+	*
+	*作成したメッシュは、AddMeshで登録するまで名前で検索できない
+	*バッファの空きが足りない場合は、バッファを拡張してから転送する
+	*転送先の領域をマップして直接書き込むので、ドライバ内に中間コピーを作らない
+	*Packed形式の場合は、量子化した頂点をマップした領域に直接書き込む
+	*/
+	bool Buffer::Upload(const ImportData& data, std::vector<MeshPtr>& out)
+	{
+		//両方の形式が同じVBOを共有するので、頂点の位置はそれぞれの頂点サイズの倍数に揃える
+		const bool isPacked = data.format == VertexFormat::Packed;
+		const GLsizeiptr vertexSize = VertexSize(data.format);
+		const size_t firstOut = out.size();
+		for (const ImportData::MeshRange& e : data.meshList)
+		{
+			//メッシュ単位でVBOとIBOの領域を確保する
+			GLsizeiptr verticesBytes = 0;
+			GLsizeiptr indicesBytes = 0;
+			for (uint32_t i = e.beginMaterial; i < e.endMaterial; ++i)
+			{
+				verticesBytes += data.materialList[i].vertexCount * vertexSize;
+				indicesBytes += data.materialList[i].indexCount * sizeof(uint32_t);
+			}
+			const GLintptr vboOffset = AllocateRange(vbo, vboAllocator, verticesBytes, vertexSize);
+			const GLintptr iboOffset = AllocateRange(ibo, iboAllocator, indicesBytes, sizeof(uint32_t));
+			if (vboOffset < 0 || iboOffset < 0)
+			{
+				std::cerr << "ERROR: " << e.name << "を転送する領域を確保できません" << std::endl;
+				vboAllocator.Free(vboOffset, vboOffset < 0 ? 0 : verticesBytes);
+				iboAllocator.Free(iboOffset, iboOffset < 0 ? 0 : indicesBytes);
+				CancelUpload(out, firstOut);
+				return false;
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+			uint8_t* const mappedVertices = static_cast<uint8_t*>(MapWriteRange(vboOffset, verticesBytes));
+			if (verticesBytes > 0 && !mappedVertices)
+			{
+				std::cerr << "ERROR: " << e.name << "の転送先VBOをマップできません" << std::endl;
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				vboAllocator.Free(vboOffset, verticesBytes);
+				iboAllocator.Free(iboOffset, indicesBytes);
+				CancelUpload(out, firstOut);
+				return false;
+			}
+			const size_t materialCount = e.endMaterial - e.beginMaterial;
+			const size_t materialsPerLod = materialCount / e.lodCount;
+			const size_t beginMaterial = AllocateMaterials(materialCount);
+
+			glm::vec3 quantizeOffset;
+			glm::vec3 quantizeScale;
+			CalcQuantization(e.boundsMin, e.boundsMax, quantizeOffset, quantizeScale);
+			glm::vec2 maxError(0);
+			GLintptr vertexOffset = vboOffset;
+			for (uint32_t i = e.beginMaterial; i < e.endMaterial; ++i)
+			{
+				const ImportData::MaterialRange& material = data.materialList[i];
+				const GLsizeiptr bytes = material.vertexCount * vertexSize;
+				uint8_t* const dst = mappedVertices + (vertexOffset - vboOffset);
+				if (isPacked)
+				{
+					PackVertices(material.vertices, material.vertexCount, quantizeOffset,
+						quantizeScale, reinterpret_cast<PackedVertex*>(dst), maxError);
+				}
+				else if (bytes > 0)
+				{
+					memcpy(dst, material.vertices, bytes);
+				}
+				//詳細度1以上のマテリアルは、詳細度0の同じ位置のマテリアルの頂点を使う
+				const size_t index = i - e.beginMaterial;
+				Material& m = materialList[beginMaterial + index];
+				if (index < materialsPerLod)
+				{
+					m.baseVertex = static_cast<GLint>(vertexOffset / vertexSize);
+				}
+				else
+				{
+					m.baseVertex = materialList[beginMaterial + index % materialsPerLod].baseVertex;
+				}
+				m.color = material.color;
+				vertexOffset += bytes;
+			}
+			if (mappedVertices && !glUnmapBuffer(GL_COPY_WRITE_BUFFER))
+			{
+				std::cerr << "WARNING: " << e.name << "の頂点データが破損した可能性があります" << std::endl;
+			}
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+			uint8_t* const mappedIndices = static_cast<uint8_t*>(MapWriteRange(iboOffset, indicesBytes));
+			GLintptr indexOffset = iboOffset;
+			for (uint32_t i = e.beginMaterial; i < e.endMaterial; ++i)
+			{
+				const ImportData::MaterialRange& material = data.materialList[i];
+				const GLsizeiptr bytes = material.indexCount * sizeof(uint32_t);
+				if (mappedIndices && bytes > 0)
+				{
+					memcpy(mappedIndices + (indexOffset - iboOffset), material.indices, bytes);
+				}
+				else if (bytes > 0)
+				{
+					glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, bytes, material.indices);
+				}
+				Material& m = materialList[beginMaterial + i - e.beginMaterial];
+				m.type = GL_UNSIGNED_INT;
+				m.size = static_cast<GLsizei>(material.indexCount);
+				m.offset = reinterpret_cast<GLvoid*>(indexOffset);
+				indexOffset += bytes;
+			}
+			if (mappedIndices && !glUnmapBuffer(GL_COPY_WRITE_BUFFER))
+			{
+				std::cerr << "WARNING: " << e.name << "のインデックスデータが破損した可能性があります" << std::endl;
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			if (isPacked)
+			{
+				const float extent = std::max(std::max(quantizeScale.x, quantizeScale.y),
+					quantizeScale.z) * 32767.0f * 2.0f;
+				std::lock_guard<std::mutex> lock(importRecordMutex);
+				packRecordList.push_back({ e.name, maxError.x, maxError.x / extent,
+					maxError.y * 180.0f / 3.14159265f });
+			}
+
+			struct Impl : public Mesh
+			{
+				Impl(const std::string& n,size_t b,size_t e) : Mesh(n,b,e){}
+				~Impl(){}
+			};
+			const MeshPtr mesh = std::make_shared<Impl>(e.name, beginMaterial,
+				beginMaterial + materialCount);
+			mesh->owner = this;
+			mesh->vboOffset = vboOffset;
+			mesh->vboBytes = verticesBytes;
+			mesh->iboOffset = iboOffset;
+			mesh->iboBytes = indicesBytes;
+			mesh->boundsMin = e.boundsMin;
+			mesh->boundsMax = e.boundsMax;
+			mesh->format = data.format;
+			mesh->lodCount = static_cast<int>(e.lodCount);
+			for (size_t i = 0; i < materialCount; ++i)
+			{
+				mesh->lodTriangleCount[i / materialsPerLod] += data.materialList[e.beginMaterial + i].indexCount / 3;
+			}
+			if (isPacked)
+			{
+				mesh->matDequantize = glm::mat4(1);
+				mesh->matDequantize[0][0] = quantizeScale.x;
+				mesh->matDequantize[1][1] = quantizeScale.y;
+				mesh->matDequantize[2][2] = quantizeScale.z;
+				mesh->matDequantize[3] = glm::vec4(quantizeOffset, 1);
+			}
+			residentList.push_back(mesh);
+			out.push_back(mesh);
+		}
+		return true;
+	}
+
+	/**
+	*転送に失敗したとき、同じUploadで転送済みのメッシュを取り消す
+	*
+	*@param	out		Uploadに渡されたメッシュの格納先
+	*@param	first	このUploadで最初に追加されたメッシュの位置
+	*
+	*取り消すメッシュはまだ誰にも渡していないので、描画を待たずに領域を解放できる
+	*/
+	void Buffer::CancelUpload(std::vector<MeshPtr>& out, size_t first)
+	{
+		for (size_t i = first; i < out.size(); ++i)
+		{
+			FreeMesh(*out[i]);
+			residentList.erase(std::find(residentList.begin(), residentList.end(), out[i]));
+		}
+		out.resize(first);
+	}
+
+	/**
+	*バッファから領域を確保する
+	*
+	*@param	buffer		確保するGLバッファ(拡張した場合は新しいバッファに置き換わる)
+	*@param	allocator	bufferの空き領域
+	*@param	size		確保するバイト数
+	*@param	alignment	先頭位置をこの値の倍数に揃える
+	*
+	*@return 確保した領域の先頭位置
+	*		確保できなかった場合は-1
+	*		sizeが0の場合は何も確保せず0を返す
+	*/
+	GLintptr Buffer::AllocateRange(GLuint& buffer, RangeAllocator& allocator,
+		GLsizeiptr size, GLsizeiptr alignment)
+	{
+		if (size <= 0)
+		{
+			return 0;
+		}
+		size_t offset = allocator.Allocate(size, alignment);
+		if (offset == RangeAllocator::invalidOffset)
+		{
+			if (!GrowBuffer(buffer, allocator, size + alignment))
+			{
+				return -1;
+			}
+			offset = allocator.Allocate(size, alignment);
+			if (offset == RangeAllocator::invalidOffset)
+			{
+				return -1;
+			}
+		}
+		return static_cast<GLintptr>(offset);
+	}
+
+	/**
+	*GLバッファを拡張する
+	*
+	*@param	buffer		拡張するGLバッファ(新しいバッファに置き換わる)
+	*@param	allocator	bufferの空き領域
+	*@param	required	最低限必要な追加バイト数
+	*
+	*@retval true	拡張成功
+	*@retval false	拡張失敗
+	*
+	*新しいバッファに既存の内容をGPU上でコピーするので、確保済みの領域の位置は変わらない
+	*コピーするのは確保済みの領域だけにする
+	*空き領域までコピーすると、拡張後に確保した領域へのMapWriteRange(同期しない)の書き込みと、
+	*まだ終わっていないコピーが重なってしまう
+	*/
+	bool Buffer::GrowBuffer(GLuint& buffer, RangeAllocator& allocator, size_t required)
+	{
+		const size_t oldCapacity = allocator.Capacity();
+		const size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + required);
+		const GLuint newBuffer = &buffer == &ibo ?
+			CreateIBO(newCapacity, nullptr) : CreateVBO(newCapacity, nullptr);
+		if (!newBuffer)
+		{
+			return false;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		for (const RangeAllocator::Range& e : allocator.GetUsedRanges())
+		{
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				e.first, e.first, e.second);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = newBuffer;
+		allocator.Grow(newCapacity);
+		++(&buffer == &vbo ? vboGrowCount : iboGrowCount);
+		return RebuildVAO();
+	}
+
+	/**
+	*マテリアルの要素を連続して確保する
+	*
+	*@param	count	確保する要素数
+	*
+	*@return 確保した先頭要素のインデックス
+	*/
+	size_t Buffer::AllocateMaterials(size_t count)
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+		size_t begin = materialAllocator.Allocate(count);
+		if (begin == RangeAllocator::invalidOffset)
+		{
+			const size_t capacity = materialAllocator.Capacity();
+			materialAllocator.Grow(std::max(capacity * 2, capacity + count));
+			materialList.resize(materialAllocator.Capacity());
+			begin = materialAllocator.Allocate(count);
+		}
+		return begin;
+	}
+
+	/**
+	*VAOを作り直す
+	*
+	*@retval true	作成成功
+	*@retval false	作成失敗
+	*
+	*VBOやIBOを置き換えた後に呼び出す
+	*/
+	bool Buffer::RebuildVAO()
+	{
+		if (packedVao)
+		{
+			glDeleteVertexArrays(1, &packedVao);
+		}
+		if (vao)
+		{
+			glDeleteVertexArrays(1, &vao);
+		}
+		vao = CreateVAO(vbo, ibo, drawIdVbo);
+		packedVao = CreatePackedVAO(vbo, ibo, drawIdVbo);
+		return vao && packedVao;
+	}
+
+	/**
+	*メッシュが使っている領域を解放する
+	*
+	*@param	mesh	解放するメッシュ
+	*/
+	void Buffer::FreeMesh(Mesh& mesh)
+	{
+		vboAllocator.Free(mesh.vboOffset, mesh.vboBytes);
+		iboAllocator.Free(mesh.iboOffset, mesh.iboBytes);
+		materialAllocator.Free(mesh.beginMaterial, mesh.endMaterial - mesh.beginMaterial);
+		mesh.owner = nullptr;
+		mesh.vboBytes = 0;
+		mesh.iboBytes = 0;
+		mesh.beginMaterial = mesh.endMaterial = 0;
+	}
+
+	/**
+	*メッシュの登録を解除する
+	*
+	*@param	handle	解除するメッシュのハンドル
+	*
+	*@retval true	解除した
+	*@retval false	登録されていないハンドルだった
+	*
+	*解除したメッシュは名前で検索できなくなる
+	*GPU上の領域は、描画中のフレームが終わり、どのエンティティからも参照されなくなった後で
+	*CollectGarbageによって解放される
+	*/
+	bool Buffer::RemoveMesh(Asset::Handle handle)
+	{
+		const MeshPtr mesh = meshList.Get(handle);
+		if (!mesh)
+		{
+			return false;
+		}
+		meshList.Remove(handle);
+		mesh->handle = Asset::invalidHandle;
+		std::lock_guard<std::mutex> lock(removeMutex);
+		removeQueue.push_back(mesh);
+		return true;
+	}
+
+	/**
+	*登録解除されたメッシュの領域を解放する(描画スレッド専用)
+	*
+	*@param	retireQueue	描画中のスナップショットが使い終わるまで解放を遅らせるキュー
+	*
+	*毎フレーム1回呼び出すこと
+	*どのエンティティからも参照されなくなったメッシュは、それを描画しうるスナップショットが描画されなくなり、
+	*GPUがその描画を終えてから解放する(解放した領域はマップして上書きされるので、GPUの完了を待つ必要がある)
+	*解放によって断片化率がCompactThresholdを超えた場合は、バッファを詰め直す
+	*/
+	void Buffer::CollectGarbage(RetireQueue& retireQueue)
+	{
+		{
+			std::lock_guard<std::mutex> lock(removeMutex);
+			retiredList.insert(retiredList.end(), removeQueue.begin(), removeQueue.end());
+			removeQueue.clear();
+		}
+
+		for (auto itr = retiredList.begin(); itr != retiredList.end();)
+		{
+			//retiredListとresidentList以外に参照がなければ、これ以降のスナップショットには入らない
+			if (itr->use_count() > 2)
+			{
+				++itr;
+				continue;
+			}
+			const MeshPtr mesh = *itr;
+			itr = retiredList.erase(itr);
+			++scheduledCount;
+			retireQueue.Schedule([this, mesh]() {
+				FreeMesh(*mesh);
+				residentList.erase(std::find(residentList.begin(), residentList.end(), mesh));
+				--scheduledCount;
+				isFreed = true;
+			});
+		}
+
+		if (isFreed && compactThreshold > 0)
+		{
+			const Stats stats = GetStats();
+			if (stats.vertex.fragmentation > compactThreshold ||
+				stats.index.fragmentation > compactThreshold)
+			{
+				Compact();
+			}
+		}
+		isFreed = false;
+	}
+
+	/**
+	*メッシュを隙間なく詰め直す(描画スレッド専用)
+	*
+	*@retval true	詰め直した
+	*@retval false	新しいバッファを作成できなかった
+	*
+	*同じ容量の新しいバッファを作り、各メッシュをglCopyBufferSubDataでGPU上で移動する
+	*CPU側の頂点データは不要だが、一時的にバッファ2つ分のメモリを使う
+	*/
+	bool Buffer::Compact()
+	{
+		GLuint newVbo = CreateVBO(vboAllocator.Capacity(), nullptr);
+		GLuint newIbo = CreateIBO(iboAllocator.Capacity(), nullptr);
+		if (!newVbo || !newIbo)
+		{
+			glDeleteBuffers(1, &newVbo);
+			glDeleteBuffers(1, &newIbo);
+			return false;
+		}
+
+		//元の並び順を保つと、ほぼ前方への移動だけになる
+		std::vector<Mesh*> sorted;
+		sorted.reserve(residentList.size());
+		for (const MeshPtr& e : residentList)
+		{
+			sorted.push_back(e.get());
+		}
+		std::sort(sorted.begin(), sorted.end(),
+			[](const Mesh* a, const Mesh* b) { return a->vboOffset < b->vboOffset; });
+
+		vboAllocator.Reset(vboAllocator.Capacity());
+		iboAllocator.Reset(iboAllocator.Capacity());
+		glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newVbo);
+		for (Mesh* e : sorted)
+		{
+			if (e->vboBytes <= 0)
+			{
+				continue;
+			}
+			const GLsizeiptr vertexSize = VertexSize(e->format);
+			const GLintptr offset = static_cast<GLintptr>(vboAllocator.Allocate(e->vboBytes, vertexSize));
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				e->vboOffset, offset, e->vboBytes);
+			const GLint delta = static_cast<GLint>((offset - e->vboOffset) / vertexSize);
+			for (size_t i = e->beginMaterial; i < e->endMaterial; ++i)
+			{
+				materialList[i].baseVertex += delta;
+			}
+			e->vboOffset = offset;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, ibo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newIbo);
+		for (Mesh* e : sorted)
+		{
+			if (e->iboBytes <= 0)
+			{
+				continue;
+			}
+			const GLintptr offset = static_cast<GLintptr>(
+				iboAllocator.Allocate(e->iboBytes, sizeof(uint32_t)));
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				e->iboOffset, offset, e->iboBytes);
+			const GLintptr delta = offset - e->iboOffset;
+			for (size_t i = e->beginMaterial; i < e->endMaterial; ++i)
+			{
+				materialList[i].offset = reinterpret_cast<GLvoid*>(
+					reinterpret_cast<GLintptr>(materialList[i].offset) + delta);
+			}
+			e->iboOffset = offset;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ibo);
+		vbo = newVbo;
+		ibo = newIbo;
+		return RebuildVAO();
+	}
+
+	/**
+	*バッファの使用状況を取得する(描画スレッド専用)
+	*
+	*@return 使用状況
+	*/
+	Buffer::Stats Buffer::GetStats() const
+	{
+		Stats stats;
+		stats.vertex = vboAllocator.GetStats();
+		stats.index = iboAllocator.GetStats();
+		stats.meshCount = residentList.size();
+		stats.retiredCount = retiredList.size() + scheduledCount;
+		stats.vboGrowCount = vboGrowCount;
+		stats.iboGrowCount = iboGrowCount;
+		return stats;
+	}
+
+	/**
+	*バッファの使用状況を出力する(描画スレッド専用)
+	*
+	*@param	os	出力先
+	*/
+	void Buffer::DumpStats(std::ostream& os) const
+	{
+		const Stats stats = GetStats();
+		const RangeAllocator::Stats* const list[] = { &stats.vertex, &stats.index };
+		const size_t growCount[] = { stats.vboGrowCount, stats.iboGrowCount };
+		const char* const names[] = { "VBO", "IBO" };
+		os << "Mesh buffer: " << stats.meshCount << " meshes, " <<
+			stats.retiredCount << " retired" << std::endl;
+		for (int i = 0; i < 2; ++i)
+		{
+			const RangeAllocator::Stats& e = *list[i];
+			os << "  " << names[i] << ": " << e.usedSize << '/' << e.capacity << " bytes (" <<
+				static_cast<int>(e.occupancy * 100) << "%), " << e.freeBlockCount <<
+				" free blocks, largest " << e.largestFreeBlock << " bytes, fragmentation " <<
+				static_cast<int>(e.fragmentation * 100) << "%, grown " << growCount[i] << " times" << std::endl;
+		}
+	}
+
+	/**
+	*メッシュを登録して、名前で検索できるようにする
+	*
+	*@param	mesh	Uploadで作成したメッシュ
+	*
+	*@return 登録したメッシュのハンドル
+	*/
+	Asset::Handle Buffer::AddMesh(const MeshPtr& mesh)
+	{
+		mesh->handle = meshList.Add(mesh->name.c_str(), mesh);
+		return mesh->handle;
+	}
+
+	/**
+	*メッシュのハンドルを検索する
+	*
+	*@param	name	メッシュ名
+	*
+	*@return		nameに対応するメッシュのハンドル
+	*				見つからない場合はAsset::invalidHandle
+	*/
+	Asset::Handle Buffer::FindMesh(Asset::Name name) const
+	{
+		return meshList.Find(name);
+	}
+
+	/**
+	*メッシュを取得する
+	*
+	*@param	handle	メッシュのハンドル
+	*
+	*@return		handleに対応するメッシュへのポインタ
+	*/
+	const MeshPtr& Buffer::GetMesh(Asset::Handle handle) const
+	{
+		return meshList.Get(handle);
+	}
+
+	/**
+	*メッシュを取得する
+	*
+	*@param	name	メッシュ名
+	*
+	*@return		nameに対応するメッシュへのポインタ
+	*/
+	const MeshPtr& Buffer::GetMesh(Asset::Name name)const
+	{
+		return meshList.Get(meshList.Find(name));
+	}
+
+	/**
+	*マテリアルを取得する
+	*
+	*@param index	マテリアルのインデックス
+	*
+	*@return indexに対応するマテリアル
+	*/
+	const Material& Buffer::GetMaterial(size_t index) const
+	{
+		if (index >= materialList.size())
+		{
+			static const Material dummy{ GL_UNSIGNED_BYTE,0,0,0,glm::vec4(1) };
+			return dummy;
+		}
+		return materialList[index];
+	}
+
+	/**
+	*	VVVAOをOpenGLの処理対象に設定する
+	*
+	*@param	format	描画するメッシュの頂点データの形式
+	*/
+	void Buffer::BindVAO(VertexFormat format)const
+	{
+		glBindVertexArray(format == VertexFormat::Packed ? packedVao : vao);
 	}
 }
 
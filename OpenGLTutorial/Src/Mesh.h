@@ -3,40 +3,88 @@
 *@file Mesh.h
 */
 #include <GL/glew.h>
+#include "Asset.h"
+#include "RangeAllocator.h"
+#include "RetireQueue.h"
 #include <glm/glm.hpp>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <iosfwd>
+
+class JobSystem;
 
 namespace Mesh
 {
 	class Mesh;
 	class Buffer;
-	typedef std::shared_ptr<Mesh> MeshPtr;	///bVf[^|C^^
-	typedef std::shared_ptr<Buffer> BufferPtr;	///bVobt@|C^^
+	typedef std::shared_ptr<Mesh> MeshPtr;	///メッシュデータポインタ型
+	typedef std::shared_ptr<Buffer> BufferPtr;	///メッシュバッファポインタ型
+	struct ImportData;
+	typedef std::shared_ptr<ImportData> ImportDataPtr;	///GLに転送する前のメッシュデータポインタ型
+
+	//1つのメッシュが持てる詳細度(LOD)の最大数(元のメッシュを含む)
+	static const int maxLodCount = 4;
+
+	//間接描画でbaseInstanceとして渡せる描画データ番号の最大数
+	static const GLuint maxDrawIdCount = 65536;
+
+	/**
+	*	頂点データの形式
+	*/
+	enum class VertexFormat
+	{
+		Float,	///全要素を32bit浮動小数点数で格納する(48バイト)
+		Packed,	///各要素を量子化して格納する(20バイト)
+	};
 
 	/**
-	*	}eA\
+	*	マテリアル構造体
 	*/
 	struct Material
 	{
-		GLenum type;	///CfbNX̃f[^^
-		GLsizei size;	///`悷CfbNX
-		GLvoid* offset;	///`JnCfbNX̃oCgItZbg
-		GLint baseVertex;	///CfbNX0Ƃ݂Ȃ钸_z̈ʒu
-		glm::vec4 color;	///}eA̐F
+		GLenum type;	///インデックスのデータ型
+		GLsizei size;	///描画するインデックス数
+		GLvoid* offset;	///描画開始インデックスのバイトオフセット
+		GLint baseVertex;	///インデックス0とみなされる頂点配列内の位置
+		glm::vec4 color;	///マテリアルの色
 	};
 
 	/**
-	*	bV
+	*	glMultiDrawElementsIndirectに渡す描画コマンド
+	*
+	*	メンバの並びはGLのDrawElementsIndirectCommandと同じ
+	*	baseInstanceは頂点アトリビュート4(描画データ番号)として頂点シェーダに渡る
+	*/
+	struct DrawCommand
+	{
+		GLuint count;	///描画するインデックス数
+		GLuint instanceCount;	///インスタンス数
+		GLuint firstIndex;	///描画開始インデックス
+		GLint baseVertex;	///インデックス0とみなされる頂点配列内の位置
+		GLuint baseInstance;	///描画データ番号
+	};
+
+	/**
+	*	メッシュ
 	*/
 	class Mesh
 	{
 		friend class Buffer;
 	public:
 		const std::string& Name() const { return name; }
-		void Draw(const BufferPtr& buffer)const;
+		Asset::Handle Handle() const { return handle; }
+		const glm::vec3& BoundsMin() const { return boundsMin; }
+		const glm::vec3& BoundsMax() const { return boundsMax; }
+		VertexFormat Format() const { return format; }
+		const glm::mat4& DequantizeMatrix() const { return matDequantize; }
+		int LodCount() const { return lodCount; }
+		size_t TriangleCount(int lod) const { return lodTriangleCount[lod]; }
+		void Draw(const BufferPtr& buffer, int lod = 0)const;
+		size_t AppendDrawCommands(const BufferPtr& buffer, int lod, GLuint drawId,
+			std::vector<DrawCommand>& out) const;
 
 	private:
 		Mesh() = default;
@@ -46,24 +94,64 @@ namespace Mesh
 		Mesh& operator = (const Mesh&) = default;
 
 	private:
-		std::string name;	///bVf[^
-		std::vector<std::string> textureList;	///eNX`̃Xg
-		size_t beginMaterial = 0;	///`悷}eA퓬CfbNX
-		size_t endMaterial = 0;		///`悷}eȀI[CfbNX
+		std::string name;	///メッシュデータ名
+		Asset::Handle handle = Asset::invalidHandle;	///メッシュバッファ内のハンドル
+		const Buffer* owner = nullptr;	///データを格納しているメッシュバッファ
+		std::vector<std::string> textureList;	///テクスチャ名のリスト
+		size_t beginMaterial = 0;	///描画するマテリアル戦闘インデックス
+		size_t endMaterial = 0;		///描画するマテリアルの終端インデックス
+		int lodCount = 1;	///詳細度の数(マテリアルは詳細度ごとに同じ数ずつ並んでいる)
+		size_t lodTriangleCount[maxLodCount] = {};	///詳細度ごとの三角形数
+		GLintptr vboOffset = 0;	///VBO内の頂点データの位置
+		GLsizeiptr vboBytes = 0;	///頂点データのバイト数
+		GLintptr iboOffset = 0;	///IBO内のインデックスデータの位置
+		GLsizeiptr iboBytes = 0;	///インデックスデータのバイト数
+		glm::vec3 boundsMin = glm::vec3(0);	///頂点座標の最小値
+		glm::vec3 boundsMax = glm::vec3(0);	///頂点座標の最大値
+		VertexFormat format = VertexFormat::Float;	///頂点データの形式
+		glm::mat4 matDequantize = glm::mat4(1);	///量子化した頂点座標を元に戻す行列
 	};
 
 	/**
-	*	bVobt@
+	*	メッシュバッファ
 	*/
 	class Buffer
 	{
 	public:
+		/**
+		*	バッファの使用状況
+		*/
+		struct Stats
+		{
+			RangeAllocator::Stats vertex;	///VBOの使用状況(バイト単位)
+			RangeAllocator::Stats index;	///IBOの使用状況(バイト単位)
+			size_t meshCount;	///GPUに転送済みのメッシュ数
+			size_t retiredCount;	///解放待ちのメッシュ数
+			size_t vboGrowCount;	///VBOを拡張した回数
+			size_t iboGrowCount;	///IBOを拡張した回数
+		};
+
 		static BufferPtr Create(int vboSize, int iboSize);
 
-		bool LoadMeshFromFile(const char* filename);
-		const MeshPtr& GetMesh(const char* name) const;
+		bool LoadMeshFromFile(const char* filename, VertexFormat format = VertexFormat::Float,
+			JobSystem* jobSystem = nullptr);
+		static ImportDataPtr ImportFromFile(const char* filename,
+			VertexFormat format = VertexFormat::Float, JobSystem* jobSystem = nullptr);
+		bool Upload(const ImportData& data, std::vector<MeshPtr>& out);
+		Asset::Handle AddMesh(const MeshPtr& mesh);
+		Asset::Handle FindMesh(Asset::Name name) const;
+		const MeshPtr& GetMesh(Asset::Handle handle) const;
+		const MeshPtr& GetMesh(Asset::Name name) const;
 		const Material& GetMaterial(size_t index) const;
-		void BindVAO() const;
+		void BindVAO(VertexFormat format = VertexFormat::Float) const;
+
+		bool RemoveMesh(Asset::Handle handle);
+		void CollectGarbage(RetireQueue& retireQueue);
+		bool Compact();
+		void CompactThreshold(float threshold) { compactThreshold = threshold; }
+		float CompactThreshold() const { return compactThreshold; }
+		Stats GetStats() const;
+		void DumpStats(std::ostream& os) const;
 
 	private:
 		Buffer() = default;
@@ -71,13 +159,38 @@ namespace Mesh
 		Buffer(const Buffer&) = delete;
 		Buffer& operator = (const Buffer&) = delete;
 
+		GLintptr AllocateRange(GLuint& buffer, RangeAllocator& allocator,
+			GLsizeiptr size, GLsizeiptr alignment);
+		bool GrowBuffer(GLuint& buffer, RangeAllocator& allocator, size_t required);
+		void CancelUpload(std::vector<MeshPtr>& out, size_t first);
+		size_t AllocateMaterials(size_t count);
+		void FreeMesh(Mesh& mesh);
+		bool RebuildVAO();
+
 	private:
-		GLuint vbo = 0;	///f̒_f[^i[VBO
-		GLuint ibo = 0;	///f̃CfbNXf[^i[IBO
-		GLuint vao = 0;	///fpVAO
-		GLintptr vboEnd = 0;	///ǂݍݍςݒ_f[^̏I[
-		GLintptr iboEnd = 0;	///ǂݍݍς݃CfbNXf[^̏I[
-		std::vector<Material> materialList;	///}eAXg
-		std::unordered_map<std::string, MeshPtr> meshList;	///bVXg
+		GLuint vbo = 0;	///モデルの頂点データを格納するVBO
+		GLuint ibo = 0;	///モデルのインデックスデータを格納するIBO
+		GLuint vao = 0;	///モデル用VAO
+		GLuint packedVao = 0;	///量子化した頂点データ用VAO
+		GLuint drawIdVbo = 0;	///描画データ番号(0からmaxDrawIdCount-1まで)を格納するVBO
+		RangeAllocator vboAllocator;	///VBOの空き領域
+		RangeAllocator iboAllocator;	///IBOの空き領域
+		RangeAllocator materialAllocator;	///materialListの空き要素
+		std::vector<Material> materialList;	///マテリアルリスト
+		Asset::Registry<MeshPtr> meshList;	///メッシュリスト(シミュレーションスレッドから使う)
+
+		//以下は描画スレッドから使う
+		std::vector<MeshPtr> residentList;	///GPUに転送済みのメッシュ
+		std::vector<MeshPtr> retiredList;	///登録解除されたが、まだエンティティから参照されているメッシュ
+		size_t scheduledCount = 0;	///RetireQueueで解放を待っているメッシュ数
+		bool isFreed = false;	///前回のCollectGarbageから領域を解放したかどうか
+		size_t vboGrowCount = 0;	///VBOを拡張した回数
+		size_t iboGrowCount = 0;	///IBOを拡張した回数
+		float compactThreshold = 0;	///自動で詰め直す断片化率(0なら詰め直さない)
+
+		std::mutex removeMutex;	///removeQueueを保護する
+		std::vector<MeshPtr> removeQueue;	///RemoveMeshで登録解除されたメッシュ
 	};
+
+	void DumpImportStats(std::ostream& os);
 }
\ No newline at end of file
@@ -0,0 +1,725 @@
+/**
+*	@file MeshOptimizer.cpp
+*/
+#include "MeshOptimizer.h"
+#include "Memory.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace MeshOptimizer
+{
+	template<typename T>
+	using Vector = Memory::Vector<T, Memory::Tag::Mesh>;
+
+	//未使用であることを表すインデックス
+	const uint32_t invalidIndex = 0xffffffff;
+
+	/**
+	*バイト列のハッシュ値を計算する(FNV-1a)
+	*/
+	uint32_t HashBytes(const uint8_t* p, size_t size)
+	{
+		uint32_t hash = 2166136261U;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= p[i];
+			hash *= 16777619U;
+		}
+		return hash;
+	}
+
+	/**
+	*同じ内容の頂点を1つにまとめる
+	*
+	*@param	vertices	頂点データの先頭
+	*@param	vertexCount	頂点数
+	*@param	vertexSize	1頂点のバイト数
+	*@param	indices		インデックスデータの先頭(まとめた頂点を指すように書き換えられる)
+	*@param	indexCount	インデックス数
+	*
+	*@return まとめた後の頂点数
+	*		頂点データは前詰めされ、これ以降の内容は不定になる
+	*
+	*頂点はバイト単位で比較するので、-0と+0のように値が等しくても表現が違う頂点はまとめない
+	*/
+	size_t WeldVertices(void* vertices, size_t vertexCount, size_t vertexSize,
+		uint32_t* indices, size_t indexCount)
+	{
+		uint8_t* const bytes = static_cast<uint8_t*>(vertices);
+		size_t tableSize = 1;
+		while (tableSize < vertexCount * 2)
+		{
+			tableSize <<= 1;
+		}
+		Vector<uint32_t> table(tableSize, invalidIndex);
+		Vector<uint32_t> remap(vertexCount);
+		size_t uniqueCount = 0;
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			const uint8_t* const v = bytes + i * vertexSize;
+			size_t slot = HashBytes(v, vertexSize) & (tableSize - 1);
+			for (;;)
+			{
+				const uint32_t e = table[slot];
+				if (e == invalidIndex)
+				{
+					if (uniqueCount != i)
+					{
+						memcpy(bytes + uniqueCount * vertexSize, v, vertexSize);
+					}
+					table[slot] = static_cast<uint32_t>(uniqueCount);
+					remap[i] = static_cast<uint32_t>(uniqueCount);
+					++uniqueCount;
+					break;
+				}
+				if (memcmp(bytes + e * vertexSize, v, vertexSize) == 0)
+				{
+					remap[i] = e;
+					break;
+				}
+				slot = (slot + 1) & (tableSize - 1);
+			}
+		}
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			indices[i] = remap[indices[i]];
+		}
+		return uniqueCount;
+	}
+
+	/**
+	*頂点の評価値を計算する(Forsythの方法)
+	*
+	*@param	cachePos		キャッシュ内の位置(キャッシュにない場合は-1)
+	*@param	activeTriCount	この頂点を使う未出力の三角形の数
+	*@param	cacheSize		キャッシュのエントリ数
+	*
+	*@return 評価値
+	*/
+	float VertexScore(int cachePos, uint32_t activeTriCount, size_t cacheSize)
+	{
+		static const float lastTriScore = 0.75f;
+		static const float cacheDecayPower = 1.5f;
+		static const float valenceBoostScale = 2.0f;
+		static const float valenceBoostPower = 0.5f;
+
+		if (activeTriCount == 0)
+		{
+			return -1.0f;
+		}
+		float score = 0.0f;
+		if (cachePos >= 0)
+		{
+			if (cachePos < 3)
+			{
+				//直前の三角形の頂点は、同じ三角形を続けて選ばないよう固定値にする
+				score = lastTriScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / static_cast<float>(cacheSize - 3);
+				score = powf(1.0f - static_cast<float>(cachePos - 3) * scaler, cacheDecayPower);
+			}
+		}
+		//残りの三角形が少ない頂点を優先して、孤立した三角形を作らないようにする
+		score += valenceBoostScale * powf(static_cast<float>(activeTriCount), -valenceBoostPower);
+		return score;
+	}
+
+	/**
+	*頂点キャッシュが効きやすいように三角形の順序を並べ替える
+	*
+	*@param	indices		インデックスデータの先頭
+	*@param	indexCount	インデックス数(3の倍数)
+	*@param	vertexCount	頂点数
+	*@param	cacheSize	想定する頂点キャッシュのエントリ数
+	*
+	*Tom Forsythの"Linear-Speed Vertex Cache Optimisation"に基づく
+	*/
+	void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t cacheSize)
+	{
+		const size_t triCount = indexCount / 3;
+		if (triCount == 0 || cacheSize < 4)
+		{
+			return;
+		}
+
+		//頂点ごとに、その頂点を使う三角形のリストを作る
+		Vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t i = 0; i < triCount * 3; ++i)
+		{
+			++adjacencyOffset[indices[i] + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffset[v + 1] += adjacencyOffset[v];
+		}
+		Vector<uint32_t> activeTriCount(vertexCount, 0);
+		Vector<uint32_t> adjacency(triCount * 3);
+		for (size_t i = 0; i < triCount * 3; ++i)
+		{
+			const uint32_t v = indices[i];
+			adjacency[adjacencyOffset[v] + activeTriCount[v]] = static_cast<uint32_t>(i / 3);
+			++activeTriCount[v];
+		}
+
+		Vector<int> cachePos(vertexCount, -1);
+		Vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			vertexScore[v] = VertexScore(-1, activeTriCount[v], cacheSize);
+		}
+		Vector<float> triScore(triCount);
+		Vector<uint8_t> isAdded(triCount, 0);
+		size_t bestTri = 0;
+		for (size_t t = 0; t < triCount; ++t)
+		{
+			const uint32_t* const tri = indices + t * 3;
+			triScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+			if (triScore[t] > triScore[bestTri])
+			{
+				bestTri = t;
+			}
+		}
+
+		Vector<uint32_t> output(triCount * 3);
+		Vector<uint32_t> cache;
+		Vector<uint32_t> newCache;
+		cache.reserve(cacheSize + 3);
+		newCache.reserve(cacheSize + 3);
+		size_t scanCursor = 0;
+		for (size_t n = 0; n < triCount; ++n)
+		{
+			//キャッシュ内の頂点に未出力の三角形がなければ、全体から最も評価値の高いものを探す
+			if (bestTri == invalidIndex)
+			{
+				while (isAdded[scanCursor])
+				{
+					++scanCursor;
+				}
+				bestTri = scanCursor;
+				for (size_t t = scanCursor + 1; t < triCount; ++t)
+				{
+					if (!isAdded[t] && triScore[t] > triScore[bestTri])
+					{
+						bestTri = t;
+					}
+				}
+			}
+
+			const uint32_t* const tri = indices + bestTri * 3;
+			output[n * 3 + 0] = tri[0];
+			output[n * 3 + 1] = tri[1];
+			output[n * 3 + 2] = tri[2];
+			isAdded[bestTri] = 1;
+
+			//出力した三角形を各頂点の未出力リストから取り除く
+			newCache.clear();
+			for (int k = 0; k < 3; ++k)
+			{
+				const uint32_t v = tri[k];
+				uint32_t* const adj = &adjacency[adjacencyOffset[v]];
+				const uint32_t count = activeTriCount[v];
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					if (adj[i] == bestTri)
+					{
+						std::swap(adj[i], adj[count - 1]);
+						--activeTriCount[v];
+						break;
+					}
+				}
+				if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+				{
+					newCache.push_back(v);
+				}
+			}
+
+			//出力した三角形の頂点をキャッシュの先頭に移す
+			const size_t triVertexCount = newCache.size();
+			for (uint32_t v : cache)
+			{
+				const Vector<uint32_t>::iterator triEnd = newCache.begin() + triVertexCount;
+				if (std::find(newCache.begin(), triEnd, v) == triEnd)
+				{
+					newCache.push_back(v);
+				}
+			}
+
+			//キャッシュ内の頂点(追い出された頂点を含む)の評価値を更新する
+			for (size_t i = 0; i < newCache.size(); ++i)
+			{
+				const uint32_t v = newCache[i];
+				cachePos[v] = i < cacheSize ? static_cast<int>(i) : -1;
+				const float score = VertexScore(cachePos[v], activeTriCount[v], cacheSize);
+				const float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+				const uint32_t* const adj = &adjacency[adjacencyOffset[v]];
+				for (uint32_t j = 0; j < activeTriCount[v]; ++j)
+				{
+					triScore[adj[j]] += delta;
+				}
+			}
+			if (newCache.size() > cacheSize)
+			{
+				newCache.resize(cacheSize);
+			}
+
+			//次の三角形はキャッシュ内の頂点を使うものから選ぶ
+			bestTri = invalidIndex;
+			float bestScore = -FLT_MAX;
+			for (uint32_t v : newCache)
+			{
+				const uint32_t* const adj = &adjacency[adjacencyOffset[v]];
+				for (uint32_t j = 0; j < activeTriCount[v]; ++j)
+				{
+					if (triScore[adj[j]] > bestScore)
+					{
+						bestScore = triScore[adj[j]];
+						bestTri = adj[j];
+					}
+				}
+			}
+			cache.swap(newCache);
+		}
+		memcpy(indices, output.data(), triCount * 3 * sizeof(uint32_t));
+	}
+
+	/**
+	*頂点データをインデックスで最初に参照される順に並べ替える
+	*
+	*@param	vertices	頂点データの先頭
+	*@param	vertexCount	頂点数
+	*@param	vertexSize	1頂点のバイト数
+	*@param	indices		インデックスデータの先頭(並べ替えた頂点を指すように書き換えられる)
+	*@param	indexCount	インデックス数
+	*
+	*@return 並べ替えた後の頂点数(どのインデックスからも参照されない頂点は取り除かれる)
+	*
+	*OptimizeVertexCacheの後に呼び出すと、頂点の読み込みがメモリ上で連続しやすくなる
+	*/
+	size_t OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize,
+		uint32_t* indices, size_t indexCount)
+	{
+		uint8_t* const bytes = static_cast<uint8_t*>(vertices);
+		Vector<uint32_t> remap(vertexCount, invalidIndex);
+		Vector<uint8_t> sorted(vertexCount * vertexSize);
+		uint32_t nextVertex = 0;
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			const uint32_t v = indices[i];
+			if (remap[v] == invalidIndex)
+			{
+				memcpy(&sorted[nextVertex * vertexSize], bytes + v * vertexSize, vertexSize);
+				remap[v] = nextVertex++;
+			}
+			indices[i] = remap[v];
+		}
+		if (nextVertex)
+		{
+			memcpy(bytes, sorted.data(), nextVertex * vertexSize);
+		}
+		return nextVertex;
+	}
+
+	/**
+	*三角形あたりの平均キャッシュミス数(ACMR)を計算する
+	*
+	*@param	indices		インデックスデータの先頭
+	*@param	indexCount	インデックス数
+	*@param	vertexCount	頂点数
+	*@param	cacheSize	想定するFIFOキャッシュのエントリ数
+	*
+	*@return ACMR(0.5前後が理想値、最悪は3.0)
+	*/
+	float CalcACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t cacheSize)
+	{
+		const size_t triCount = indexCount / 3;
+		if (triCount == 0)
+		{
+			return 0.0f;
+		}
+		//最後にキャッシュへ入った時刻を記録し、時刻の差でキャッシュにあるかを判定する
+		Vector<size_t> timestamp(vertexCount, 0);
+		size_t time = cacheSize + 1;
+		size_t missCount = 0;
+		for (size_t i = 0; i < triCount * 3; ++i)
+		{
+			const uint32_t v = indices[i];
+			if (time - timestamp[v] > cacheSize)
+			{
+				timestamp[v] = time++;
+				++missCount;
+			}
+		}
+		return static_cast<float>(missCount) / static_cast<float>(triCount);
+	}
+
+	/**
+	*	頂点の位置の誤差を表す二次誤差行列
+	*
+	*	平面までの距離の2乗和を、対称4x4行列の上三角10要素で表す
+	*	weightは加えた平面の重み(面積)の合計で、誤差を距離の単位に戻すのに使う
+	*/
+	struct Quadric
+	{
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+		double weight;
+	};
+
+	/**
+	*二次誤差行列に平面を加える
+	*
+	*@param	q	加える先の二次誤差行列
+	*@param	n	平面の単位法線
+	*@param	d	平面の原点からの距離(n・p + d = 0)
+	*@param	w	平面の重み
+	*/
+	void AddPlane(Quadric& q, const double* n, double d, double w)
+	{
+		q.a00 += w * n[0] * n[0];
+		q.a01 += w * n[0] * n[1];
+		q.a02 += w * n[0] * n[2];
+		q.a03 += w * n[0] * d;
+		q.a11 += w * n[1] * n[1];
+		q.a12 += w * n[1] * n[2];
+		q.a13 += w * n[1] * d;
+		q.a22 += w * n[2] * n[2];
+		q.a23 += w * n[2] * d;
+		q.a33 += w * d * d;
+		q.weight += w;
+	}
+
+	/**
+	*2つの二次誤差行列を足し合わせる
+	*/
+	void AddQuadric(Quadric& q, const Quadric& r)
+	{
+		q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+		q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+		q.a22 += r.a22; q.a23 += r.a23;
+		q.a33 += r.a33;
+		q.weight += r.weight;
+	}
+
+	/**
+	*二次誤差行列で位置の誤差を評価する
+	*
+	*@param	q	二次誤差行列
+	*@param	p	評価する位置
+	*
+	*@return 平面までの距離の2乗の重み付き平均
+	*/
+	double EvaluateQuadric(const Quadric& q, const float* p)
+	{
+		const double x = p[0], y = p[1], z = p[2];
+		const double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + q.a33 +
+			2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z + q.a03 * x + q.a13 * y + q.a23 * z);
+		return q.weight > 0 ? std::max(r, 0.0) / q.weight : 0.0;
+	}
+
+	/**
+	*三角形の法線(正規化しない)を計算する
+	*/
+	void TriangleNormal(const float* p0, const float* p1, const float* p2, double* n)
+	{
+		const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	/**
+	*	辺を縮約する候補
+	*/
+	struct Collapse
+	{
+		uint32_t from;	///<取り除く頂点
+		uint32_t to;	///<残す頂点
+		double error;	///<縮約後の誤差(距離の2乗)
+	};
+
+	/**
+	*三角形の数を減らしたインデックスデータを作成する
+	*
+	*@param	dst					作成したインデックスの格納先(indexCount個の要素が必要)
+	*@param	indices				元のインデックスデータ
+	*@param	indexCount			元のインデックス数
+	*@param	vertices			頂点データの先頭(各頂点の先頭にfloat3の座標があること)
+	*@param	vertexCount			頂点数
+	*@param	vertexSize			1頂点のバイト数
+	*@param	targetIndexCount	目標のインデックス数
+	*@param	targetError			許容する誤差(境界ボックスの最大辺に対する比率)
+	*@param	resultError			実際の最大誤差の格納先(境界ボックスの最大辺に対する比率、不要ならnullptr)
+	*
+	*@return 作成したインデックス数
+	*		誤差が許容範囲を超える場合は、目標まで減らさずに終わる
+	*
+	*二次誤差(Garland-Heckbert)で評価した辺の縮約を、誤差の小さいものから繰り返す
+	*頂点は元の頂点のどれかに縮約し、新しい頂点は作らないので、頂点データは元のものをそのまま使える
+	*1辺しか三角形を持たない境界(マテリアルやテクスチャ座標の継ぎ目を含む)の頂点は動かさない
+	*/
+	size_t SimplifyMesh(uint32_t* dst, const uint32_t* indices, size_t indexCount,
+		const void* vertices, size_t vertexCount, size_t vertexSize,
+		size_t targetIndexCount, float targetError, float* resultError)
+	{
+		if (resultError)
+		{
+			*resultError = 0;
+		}
+		indexCount -= indexCount % 3;
+		if (dst != indices)
+		{
+			memmove(dst, indices, indexCount * sizeof(uint32_t));
+		}
+		if (indexCount <= targetIndexCount || vertexCount == 0)
+		{
+			return indexCount;
+		}
+
+		//誤差の許容値が形状の大きさに依存しないよう、座標を最大辺が1になるように正規化する
+		const uint8_t* const bytes = static_cast<const uint8_t*>(vertices);
+		Vector<float> position(vertexCount * 3);
+		float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			memcpy(&position[v * 3], bytes + v * vertexSize, sizeof(float) * 3);
+			for (int k = 0; k < 3; ++k)
+			{
+				boundsMin[k] = std::min(boundsMin[k], position[v * 3 + k]);
+				boundsMax[k] = std::max(boundsMax[k], position[v * 3 + k]);
+			}
+		}
+		const float extent = std::max(boundsMax[0] - boundsMin[0],
+			std::max(boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]));
+		if (!(extent > 0))
+		{
+			return indexCount;
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				position[v * 3 + k] = (position[v * 3 + k] - boundsMin[k]) / extent;
+			}
+		}
+
+		//辺ごとの三角形の数を数え、1つしかない辺の頂点を固定する
+		Vector<uint64_t> edges(indexCount);
+		const auto edgeKey = [](uint32_t a, uint32_t b) {
+			return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+		};
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				edges[i + k] = edgeKey(dst[i + k], dst[i + (k + 1) % 3]);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		Vector<uint8_t> isLocked(vertexCount, 0);
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i])
+			{
+				++j;
+			}
+			if (j - i == 1)
+			{
+				isLocked[static_cast<uint32_t>(edges[i] >> 32)] = 1;
+				isLocked[static_cast<uint32_t>(edges[i])] = 1;
+			}
+			i = j;
+		}
+
+		//各頂点に、隣接する三角形の平面を面積で重み付けして加える
+		Vector<Quadric> quadric(vertexCount, Quadric());
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			double n[3];
+			TriangleNormal(&position[dst[i] * 3], &position[dst[i + 1] * 3], &position[dst[i + 2] * 3], n);
+			const double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (len <= 0)
+			{
+				continue;
+			}
+			n[0] /= len;
+			n[1] /= len;
+			n[2] /= len;
+			const float* p0 = &position[dst[i] * 3];
+			const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+			for (int k = 0; k < 3; ++k)
+			{
+				AddPlane(quadric[dst[i + k]], n, d, len * 0.5);
+			}
+		}
+
+		const double errorLimit = static_cast<double>(targetError) * targetError;
+		double maxError = 0;
+		Vector<Collapse> collapses;
+		Vector<uint32_t> adjacencyOffset;
+		Vector<uint32_t> adjacency;
+		Vector<uint8_t> isTouched(vertexCount);
+		Vector<uint32_t> remap(vertexCount);
+		size_t count = indexCount;
+		while (count > targetIndexCount)
+		{
+			//現在の三角形から重複のない辺を集め、誤差の小さい方向の縮約を候補にする
+			edges.resize(count);
+			for (size_t i = 0; i < count; i += 3)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					edges[i + k] = edgeKey(dst[i + k], dst[i + (k + 1) % 3]);
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+			collapses.clear();
+			for (uint64_t e : edges)
+			{
+				const uint32_t a = static_cast<uint32_t>(e >> 32);
+				const uint32_t b = static_cast<uint32_t>(e);
+				Quadric q = quadric[a];
+				AddQuadric(q, quadric[b]);
+				const double errorAB = isLocked[a] ? DBL_MAX : EvaluateQuadric(q, &position[b * 3]);
+				const double errorBA = isLocked[b] ? DBL_MAX : EvaluateQuadric(q, &position[a * 3]);
+				if (errorAB == DBL_MAX && errorBA == DBL_MAX)
+				{
+					continue;
+				}
+				if (errorAB <= errorBA)
+				{
+					collapses.push_back({ a, b, errorAB });
+				}
+				else
+				{
+					collapses.push_back({ b, a, errorBA });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(),
+				[](const Collapse& l, const Collapse& r) { return l.error < r.error; });
+
+			//頂点ごとに、その頂点を使う三角形のリストを作る
+			adjacencyOffset.assign(vertexCount + 1, 0);
+			for (size_t i = 0; i < count; ++i)
+			{
+				++adjacencyOffset[dst[i] + 1];
+			}
+			for (size_t v = 0; v < vertexCount; ++v)
+			{
+				adjacencyOffset[v + 1] += adjacencyOffset[v];
+			}
+			adjacency.resize(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				adjacency[adjacencyOffset[dst[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+			for (size_t v = vertexCount; v > 0; --v)
+			{
+				adjacencyOffset[v] = adjacencyOffset[v - 1];
+			}
+			adjacencyOffset[0] = 0;
+
+			//1回の走査では、縮約した頂点の周りの三角形が変わらないものだけを縮約する
+			std::fill(isTouched.begin(), isTouched.end(), 0);
+			for (size_t v = 0; v < vertexCount; ++v)
+			{
+				remap[v] = static_cast<uint32_t>(v);
+			}
+			const size_t removeLimit = (count - targetIndexCount + 2) / 3;
+			size_t removedCount = 0;
+			size_t collapseCount = 0;
+			for (const Collapse& c : collapses)
+			{
+				if (c.error > errorLimit || removedCount >= removeLimit)
+				{
+					break;
+				}
+				if (isTouched[c.from] || isTouched[c.to])
+				{
+					continue;
+				}
+
+				//縮約で向きが大きく変わる三角形があれば、裏返りを避けるためにやめる
+				bool isFlipped = false;
+				size_t sharedCount = 0;
+				const float* const target = &position[c.to * 3];
+				for (uint32_t i = adjacencyOffset[c.from]; i < adjacencyOffset[c.from + 1] && !isFlipped; ++i)
+				{
+					const uint32_t* const tri = dst + adjacency[i] * 3;
+					if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+					{
+						++sharedCount;
+						continue;
+					}
+					const float* p[3];
+					const float* q[3];
+					for (int k = 0; k < 3; ++k)
+					{
+						p[k] = &position[tri[k] * 3];
+						q[k] = tri[k] == c.from ? target : p[k];
+					}
+					double n0[3], n1[3];
+					TriangleNormal(p[0], p[1], p[2], n0);
+					TriangleNormal(q[0], q[1], q[2], n1);
+					const double len0 = sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+					const double len1 = sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+					const double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+					isFlipped = len1 <= 0 || dot < 0.25 * len0 * len1;
+				}
+				if (isFlipped)
+				{
+					continue;
+				}
+
+				remap[c.from] = c.to;
+				AddQuadric(quadric[c.to], quadric[c.from]);
+				for (uint32_t i = adjacencyOffset[c.from]; i < adjacencyOffset[c.from + 1]; ++i)
+				{
+					const uint32_t* const tri = dst + adjacency[i] * 3;
+					isTouched[tri[0]] = isTouched[tri[1]] = isTouched[tri[2]] = 1;
+				}
+				isTouched[c.to] = 1;
+				removedCount += sharedCount;
+				maxError = std::max(maxError, c.error);
+				++collapseCount;
+			}
+			if (collapseCount == 0)
+			{
+				break;
+			}
+
+			//縮約した頂点を置き換え、面積のなくなった三角形を取り除く
+			size_t newCount = 0;
+			for (size_t i = 0; i < count; i += 3)
+			{
+				const uint32_t a = remap[dst[i]];
+				const uint32_t b = remap[dst[i + 1]];
+				const uint32_t c = remap[dst[i + 2]];
+				if (a != b && b != c && c != a)
+				{
+					dst[newCount++] = a;
+					dst[newCount++] = b;
+					dst[newCount++] = c;
+				}
+			}
+			count = newCount;
+		}
+		if (resultError)
+		{
+			*resultError = static_cast<float>(sqrt(maxError));
+		}
+		return count;
+	}
+}
@@ -0,0 +1,29 @@
+/**
+*	@file MeshOptimizer.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+*	メッシュの頂点とインデックスを描画向けに最適化する関数群
+*
+*	頂点データは型に依存しないよう、先頭アドレスと1頂点のバイト数で受け取る
+*/
+namespace MeshOptimizer
+{
+	//頂点キャッシュのシミュレーションに使うエントリ数
+	static const size_t defaultCacheSize = 32;
+
+	size_t WeldVertices(void* vertices, size_t vertexCount, size_t vertexSize,
+		uint32_t* indices, size_t indexCount);
+	void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t cacheSize = defaultCacheSize);
+	size_t OptimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize,
+		uint32_t* indices, size_t indexCount);
+	float CalcACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t cacheSize = defaultCacheSize);
+	size_t SimplifyMesh(uint32_t* dst, const uint32_t* indices, size_t indexCount,
+		const void* vertices, size_t vertexCount, size_t vertexSize,
+		size_t targetIndexCount, float targetError, float* resultError = nullptr);
+}
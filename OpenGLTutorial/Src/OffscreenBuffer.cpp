@@ -4,18 +4,18 @@
 #include "OffscreenBuffer.h"
 
 /**
-*ItXN[obt@쐬
+*オフスクリーンバッファを作成する
 *
-*@param	w	ItXN[obt@̕(sNZP)
-*@param h	ItXN[obt@̍(sNZP)
+*@param	w	オフスクリーンバッファの幅(ピクセル単位)
+*@param h	オフスクリーンバッファの高さ(ピクセル単位)
 *
-*@return 쐬ItXN[obt@ւ̃|C^
+*@return 作成したオフスクリーンバッファへのポインタ
 */
 OffscreenBufferPtr OffscreenBuffer::Create(int w, int h)
 {
 
 	struct Impl : OffscreenBuffer{
-		//vs2015privatełƂقȂƌĂ̂ŉLĊmF
+		//vs2015だとprivateですよとかあほなこと言ってくるので下記を書いて確認させる
 		Impl() {}
 		~Impl() {}
 	};
@@ -24,16 +24,16 @@ OffscreenBufferPtr OffscreenBuffer::Create(int w, int h)
 	{
 		return offscreen;
 	}
-	//eNX`쐬R[h
+	//テクスチャ作成コード
 	offscreen->tex = Texture::Create(w, h, GL_RGBA8, GL_RGBA, nullptr);
 
-	//[xobt@쐬
+	//深度バッファ作成
 	glGenRenderbuffers(1, &offscreen->depthbuffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, offscreen->depthbuffer);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-	//t[obt@쐬
+	//フレームバッファ作成
 	glGenFramebuffers(1, &offscreen->framebuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
 	glFramebufferRenderbuffer(
@@ -46,7 +46,7 @@ OffscreenBufferPtr OffscreenBuffer::Create(int w, int h)
 }
 
 /**
-*fXgN^
+*デストラクタ
 */
 OffscreenBuffer::~OffscreenBuffer()
 {
@@ -10,14 +10,14 @@ class OffscreenBuffer;
 typedef std::shared_ptr<OffscreenBuffer>OffscreenBufferPtr;
 
 /**
-*ItXN[obt@
+*オフスクリーンバッファ
 */
 class OffscreenBuffer
 {
 public:
 	static OffscreenBufferPtr Create(int w, int h);
-	GLuint GetFramebuffer() const { return framebuffer; }///<t[obt@擾
-	GLuint GetTexture() const { return tex -> Id(); }///<t[obt@peNX`擾
+	GLuint GetFramebuffer() const { return framebuffer; }///<フレームバッファを取得する
+	GLuint GetTexture() const { return tex -> Id(); }///<フレームバッファ用テクスチャを取得する
 
 private:
 	OffscreenBuffer() = default;
@@ -26,7 +26,7 @@ private:
 	~OffscreenBuffer();
 
 private:
-	TexturePtr tex; ///<t[obt@peNX`
-	GLuint depthbuffer = 0;///<[xobt@IuWFNg
-	GLuint framebuffer = 0;///<t[obt@IuWFNg
+	TexturePtr tex; ///<フレームバッファ用テクスチャ
+	GLuint depthbuffer = 0;///<深度バッファオブジェクト
+	GLuint framebuffer = 0;///<フレームバッファオブジェクト
 };
\ No newline at end of file
@@ -0,0 +1,187 @@
+/**
+*	@file RangeAllocator.cpp
+*/
+#include "RangeAllocator.h"
+
+/**
+*管理する範囲を初期化する
+*
+*@param	capacity	範囲の大きさ
+*
+*割り当て済みの範囲はすべて破棄される
+*/
+void RangeAllocator::Reset(size_t capacity)
+{
+	freeList.clear();
+	if (capacity > 0)
+	{
+		freeList.insert(std::make_pair(size_t(0), capacity));
+	}
+	this->capacity = capacity;
+	usedSize = 0;
+	allocationCount = 0;
+}
+
+/**
+*範囲を割り当てる
+*
+*@param	size		割り当てる大きさ
+*@param	alignment	先頭オフセットをこの値の倍数にする(2の累乗でなくてもよい)
+*
+*@return 割り当てた範囲の先頭オフセット
+*		空き領域が足りない場合はinvalidOffsetを返す
+*
+*先頭から順に探し、最初に収まった空き領域を使う
+*/
+size_t RangeAllocator::Allocate(size_t size, size_t alignment)
+{
+	if (size == 0 || alignment == 0)
+	{
+		return invalidOffset;
+	}
+	for (auto itr = freeList.begin(); itr != freeList.end(); ++itr)
+	{
+		const size_t blockBegin = itr->first;
+		const size_t blockEnd = itr->first + itr->second;
+		const size_t offset = (blockBegin + alignment - 1) / alignment * alignment;
+		if (offset + size > blockEnd)
+		{
+			continue;
+		}
+		//前後の余りを空き領域として残す
+		freeList.erase(itr);
+		if (offset > blockBegin)
+		{
+			freeList.insert(std::make_pair(blockBegin, offset - blockBegin));
+		}
+		if (offset + size < blockEnd)
+		{
+			freeList.insert(std::make_pair(offset + size, blockEnd - offset - size));
+		}
+		usedSize += size;
+		++allocationCount;
+		return offset;
+	}
+	return invalidOffset;
+}
+
+/**
+*範囲を解放する
+*
+*@param	offset	Allocateが返したオフセット
+*@param	size	Allocateに渡した大きさ
+*/
+void RangeAllocator::Free(size_t offset, size_t size)
+{
+	if (size == 0 || offset == invalidOffset)
+	{
+		return;
+	}
+	usedSize -= size;
+	--allocationCount;
+
+	//直後の空き領域と結合する
+	auto next = freeList.lower_bound(offset);
+	if (next != freeList.end() && next->first == offset + size)
+	{
+		size += next->second;
+		next = freeList.erase(next);
+	}
+	//直前の空き領域と結合する
+	if (next != freeList.begin())
+	{
+		auto prev = next;
+		--prev;
+		if (prev->first + prev->second == offset)
+		{
+			prev->second += size;
+			return;
+		}
+	}
+	freeList.insert(next, std::make_pair(offset, size));
+}
+
+/**
+*管理する範囲を後ろに広げる
+*
+*@param	newCapacity	新しい範囲の大きさ(現在より小さい場合は何もしない)
+*
+*割り当て済みの範囲のオフセットは変わらない
+*/
+void RangeAllocator::Grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity)
+	{
+		return;
+	}
+	const size_t oldCapacity = capacity;
+	capacity = newCapacity;
+	if (!freeList.empty())
+	{
+		auto last = freeList.end();
+		--last;
+		if (last->first + last->second == oldCapacity)
+		{
+			last->second += newCapacity - oldCapacity;
+			return;
+		}
+	}
+	freeList.insert(std::make_pair(oldCapacity, newCapacity - oldCapacity));
+}
+
+/**
+*割り当て済みの範囲を取得する
+*
+*@return 割り当て済みの範囲のリスト(オフセット順)
+*		隣接する割り当ては1つの範囲にまとめられる
+*/
+std::vector<RangeAllocator::Range> RangeAllocator::GetUsedRanges() const
+{
+	std::vector<Range> list;
+	size_t offset = 0;
+	for (const auto& e : freeList)
+	{
+		if (e.first > offset)
+		{
+			list.push_back(std::make_pair(offset, e.first - offset));
+		}
+		offset = e.first + e.second;
+	}
+	if (capacity > offset)
+	{
+		list.push_back(std::make_pair(offset, capacity - offset));
+	}
+	return list;
+}
+
+/**
+*使用状況の統計を取得する
+*
+*@return 統計
+*/
+RangeAllocator::Stats RangeAllocator::GetStats() const
+{
+	Stats stats;
+	stats.capacity = capacity;
+	stats.usedSize = usedSize;
+	stats.allocationCount = allocationCount;
+	stats.freeBlockCount = freeList.size();
+	for (const auto& e : freeList)
+	{
+		stats.freeSize += e.second;
+		if (e.second > stats.largestFreeBlock)
+		{
+			stats.largestFreeBlock = e.second;
+		}
+	}
+	if (capacity > 0)
+	{
+		stats.occupancy = static_cast<float>(usedSize) / static_cast<float>(capacity);
+	}
+	if (stats.freeSize > 0)
+	{
+		stats.fragmentation = 1.0f -
+			static_cast<float>(stats.largestFreeBlock) / static_cast<float>(stats.freeSize);
+	}
+	return stats;
+}
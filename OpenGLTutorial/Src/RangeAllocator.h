@@ -0,0 +1,58 @@
+/**
+*	@file RangeAllocator.h
+*/
+#pragma once
+#include <stddef.h>
+#include <map>
+#include <vector>
+#include <utility>
+
+/**
+*	連続した範囲を切り出して割り当てるアロケータ
+*
+*	自身はメモリを持たず、オフセットとサイズだけを管理する
+*	GLのバッファや配列の添字など、単位を問わず使える
+*	空き領域はオフセット順に管理し、解放時に隣接する空き領域と結合する
+*/
+class RangeAllocator
+{
+public:
+	//割り当てに失敗したことを表すオフセット
+	static const size_t invalidOffset = static_cast<size_t>(-1);
+
+	//範囲の型(オフセット, 大きさ)
+	typedef std::pair<size_t, size_t> Range;
+
+	/**
+	*	使用状況の統計
+	*/
+	struct Stats
+	{
+		size_t capacity = 0;	///<管理している範囲の大きさ
+		size_t usedSize = 0;	///<割り当て済みの大きさ
+		size_t freeSize = 0;	///<空き領域の合計
+		size_t freeBlockCount = 0;	///<空き領域の数
+		size_t largestFreeBlock = 0;	///<最大の空き領域の大きさ
+		size_t allocationCount = 0;	///<割り当て中の範囲の数
+		float occupancy = 0;	///<使用率(usedSize / capacity)
+		float fragmentation = 0;	///<断片化率(1 - largestFreeBlock / freeSize)
+	};
+
+	RangeAllocator() = default;
+	explicit RangeAllocator(size_t capacity) { Reset(capacity); }
+
+	void Reset(size_t capacity);
+	size_t Allocate(size_t size, size_t alignment = 1);
+	void Free(size_t offset, size_t size);
+	void Grow(size_t newCapacity);
+
+	size_t Capacity() const { return capacity; }
+	Stats GetStats() const;
+	std::vector<Range> GetUsedRanges() const;
+
+private:
+	std::map<size_t, size_t> freeList;	///<空き領域(オフセット -> 大きさ)
+	size_t capacity = 0;
+	size_t usedSize = 0;
+	size_t allocationCount = 0;
+};
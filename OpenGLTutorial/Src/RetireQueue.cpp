@@ -0,0 +1,127 @@
+/**
+*	@file RetireQueue.cpp
+*/
+#include "RetireQueue.h"
+#include <algorithm>
+#include <iterator>
+
+/**
+*デストラクタ
+*
+*終了時はGPUの完了を待たずに、残っているものを全て解放する
+*/
+RetireQueue::~RetireQueue()
+{
+	for (FencedGroup& e : fencedList)
+	{
+		glDeleteSync(e.fence);
+		Release(e.entryList);
+	}
+	Release(pendingList);
+}
+
+/**
+*オブジェクトを解放待ちにする
+*
+*@param	object	手放すオブジェクト(最後の参照なら、安全になった時点で描画スレッドで破棄される)
+*/
+void RetireQueue::Retire(std::shared_ptr<void> object)
+{
+	if (object)
+	{
+		Push({ 0, std::move(object), nullptr });
+	}
+}
+
+/**
+*解放処理を登録する
+*
+*@param	func	安全になった時点で描画スレッドで実行する関数
+*/
+void RetireQueue::Schedule(ReleaseFunc func)
+{
+	if (func)
+	{
+		Push({ 0, nullptr, std::move(func) });
+	}
+}
+
+/**
+*現在書き込み中のスナップショットの世代を付けて、解放待ちリストに追加する
+*
+*@param	entry	追加するオブジェクト
+*/
+void RetireQueue::Push(Entry&& entry)
+{
+	//公開済みの次の世代が書き込み中なので、そこまでは参照されている可能性がある
+	entry.generation = publishedGeneration.load(std::memory_order_acquire) + 1;
+	std::lock_guard<std::mutex> lock(mutex);
+	pendingList.push_back(std::move(entry));
+}
+
+/**
+*スナップショットの世代を進める(シミュレーションスレッド専用)
+*
+*@return 公開するスナップショットの世代
+*
+*スナップショットを公開する直前に呼び出し、戻り値をスナップショットに記録してCollectに渡すこと
+*/
+uint64_t RetireQueue::Publish()
+{
+	return publishedGeneration.fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+/**
+*安全になったオブジェクトを解放する(描画スレッド専用)
+*
+*@param	renderGeneration	これから描画するスナップショットの世代
+*
+*毎フレーム1回、スナップショットを受け取った後で呼び出すこと
+*GPUの完了はフェンスを調べるだけで待たないので、描画スレッドは止まらない
+*/
+void RetireQueue::Collect(uint64_t renderGeneration)
+{
+	//これより古いスナップショットはもう描画しないので、発行済みの描画の完了を待てばよい
+	std::vector<Entry> readyList;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto itr = std::stable_partition(pendingList.begin(), pendingList.end(),
+			[renderGeneration](const Entry& e) { return e.generation >= renderGeneration; });
+		readyList.assign(std::make_move_iterator(itr), std::make_move_iterator(pendingList.end()));
+		pendingList.erase(itr, pendingList.end());
+	}
+	if (!readyList.empty())
+	{
+		fencedList.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(readyList) });
+	}
+
+	while (!fencedList.empty())
+	{
+		const GLenum result = glClientWaitSync(fencedList.front().fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+		glDeleteSync(fencedList.front().fence);
+		Release(fencedList.front().entryList);
+		fencedList.pop_front();
+	}
+}
+
+/**
+*オブジェクトを解放する
+*
+*@param	entryList	解放するオブジェクトのリスト(空になる)
+*/
+void RetireQueue::Release(std::vector<Entry>& entryList)
+{
+	for (Entry& e : entryList)
+	{
+		if (e.func)
+		{
+			e.func();
+		}
+		e.object.reset();
+	}
+	entryList.clear();
+}
@@ -0,0 +1,72 @@
+/**
+*	@file RetireQueue.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+/**
+*	描画スレッドのスナップショットが参照しているかもしれないオブジェクトを、安全になってから解放するキュー
+*
+*	スナップショットにはメッシュやシェーダの生ポインタ、テクスチャのIdが入っていて、
+*	描画スレッドはシミュレーションスレッドが新しいスナップショットを公開するまで同じものを描画し続ける
+*	そのため、シミュレーションスレッドで参照を手放すと、古いスナップショットの描画中に解放されてしまう
+*
+*	RetireやScheduleで登録したオブジェクトは、その時点で書き込み中の世代のスナップショットから参照されうるものとして記録される
+*	描画スレッドがそれより新しい世代を描画し始めたらフェンスを発行し、GPUがフェンスを通過してから描画スレッドで解放する
+*	GLオブジェクトの削除もGLコンテキストのある描画スレッドで行われる
+*
+*	Publishはシミュレーションスレッドから、Collectは描画スレッドから、RetireとScheduleはどのスレッドからでも呼び出せる
+*/
+class RetireQueue
+{
+public:
+	typedef std::function<void()> ReleaseFunc;	///<解放処理
+
+	RetireQueue() = default;
+	~RetireQueue();
+	RetireQueue(const RetireQueue&) = delete;
+	RetireQueue& operator = (const RetireQueue&) = delete;
+
+	void Retire(std::shared_ptr<void> object);
+	void Schedule(ReleaseFunc func);
+	uint64_t Publish();
+	void Collect(uint64_t renderGeneration);
+
+private:
+	/**
+	*	解放待ちのオブジェクト1つ分
+	*/
+	struct Entry
+	{
+		uint64_t generation;	///<このオブジェクトを参照しうる最も新しいスナップショットの世代
+		std::shared_ptr<void> object;	///<最後の参照
+		ReleaseFunc func;	///<解放処理(objectを手放すだけならnullptr)
+	};
+
+	/**
+	*	同じフェンスを待っているオブジェクトの集まり
+	*/
+	struct FencedGroup
+	{
+		GLsync fence;	///<これらのオブジェクトを使う描画の完了を待つフェンス
+		std::vector<Entry> entryList;
+	};
+
+	void Push(Entry&& entry);
+	static void Release(std::vector<Entry>& entryList);
+
+	std::atomic<uint64_t> publishedGeneration{ 0 };	///<最後に公開されたスナップショットの世代
+
+	std::mutex mutex;	///<pendingListを保護する
+	std::vector<Entry> pendingList;	///<まだスナップショットから参照されうるもの
+
+	//以下は描画スレッドから使う
+	std::deque<FencedGroup> fencedList;	///<GPUの完了を待っているもの(古い順)
+};
@@ -11,12 +11,12 @@
 namespace Shader {
 
 	/**
-	*VF[_vO쐬
+	*シェーダプログラムを作成する
 	*
-	*@param	vsCode		_VF[_R[hւ̃|C^
-	*@param	fsCode		tOgVF[_R[hւ̃|C^
+	*@param	vsCode		頂点シェーダコードへのポインタ
+	*@param	fsCode		フラグメントシェーダコードへのポインタ
 	*
-	*@return		쐬vOIuWFNg
+	*@return		作成したプログラムオブジェクト
 	*/
 	ProgramPtr Program::Create(const char* vsFilename, const char* fsFilename)
 	{
@@ -24,7 +24,7 @@ namespace Shader {
 		ProgramPtr p = std::make_shared<Impl>();
 		if (!p)
 		{
-			std::cerr << "ERROR : vO'" << vsFilename << "'̍쐬Ɏs" << std::endl;
+			std::cerr << "ERROR : プログラム'" << vsFilename << "'の作成に失敗" << std::endl;
 			return{};
 		}
 		p->program = CreateProgramFromFile(vsFilename, fsFilename);
@@ -32,7 +32,7 @@ namespace Shader {
 		{
 			return{};
 		}
-		//Tv[̐ƈʒu擾
+		//サンプラーの数と位置を取得する
 		GLint activeUniforms;
 		glGetProgramiv(p->program, GL_ACTIVE_UNIFORMS, &activeUniforms);
 		for (int i = 0;i < activeUniforms; ++i)
@@ -41,19 +41,19 @@ namespace Shader {
 			GLenum type;
 			GLchar name[128];
 			glGetActiveUniform(p->program, i, sizeof(name), nullptr, &size, &type, name);
-			if (type == GL_SAMPLER_2D)
+			if (type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY)
 			{
 				p->samplerCount = size;
 				p->samplerLocation = glGetUniformLocation(p->program, name);
 				if (p->samplerLocation < 0)
 				{
-					std::cerr << "ERROR : vO '" << vsFilename << "' ̍쐬Ɏs" << std::endl;
+					std::cerr << "ERROR : プログラム '" << vsFilename << "' の作成に失敗" << std::endl;
 					return{};
 				}
 				break;
 			}
 		}
-		//_VF[_t@C̖".vert"菜̂vOƂ
+		//頂点シェーダファイル名の末尾から".vert"を取り除いたものをプログラムっ名とする
 		p->name = vsFilename;
 		p->name.resize(p->name.size() - 4);
 
@@ -61,7 +61,7 @@ namespace Shader {
 	}
 
 	/**
-	*fXgN^
+	*デストラクタ
 	*/
 	Program::~Program()
 	{
@@ -72,36 +72,36 @@ namespace Shader {
 	}
 
 	/**
-	*Uniform ubNoCfBOE|CgɊ蓖Ă
+	*Uniform ブロックをバインディング・ポイントに割り当てる
 	*
-	*@param	boackName	蓖ĂUniformubN̖O
-	*@param	bindingPoint	̃oCfBOE|Cg
+	*@param	boackName	割り当てるUniformブロックの名前
+	*@param	bindingPoint	割当先のバインディング・ポイント
 	*
-	*@retval true	蓖Đ
-	*@retval false	蓖Ďs
+	*@retval true	割り当て成功
+	*@retval false	割り当て失敗
 	*/
 	bool Program::UniformBlockBinding(const char* blockName, GLuint bindingPoint)
 	{
 		const GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
 		if (blockIndex == GL_INVALID_INDEX)
 		{
-			std::cerr << "ERROR(" << name << ")UniformubN'" << blockName <<
-				"'܂" << std::endl;
+			std::cerr << "ERROR(" << name << ")Uniformブロック'" << blockName <<
+				"'が見つかりません" << std::endl;
 			return  false;
 		}
 		glUniformBlockBinding(program, blockIndex, bindingPoint);
 		const GLenum result = glGetError();
 		if (result != GL_NO_ERROR)
 		{
-			std::cerr << "ERROR(" << name << ")UniformubN'" << blockName <<
-				"'̃oChɎs" << std::endl;
+			std::cerr << "ERROR(" << name << ")Uniformブロック'" << blockName <<
+				"'のバインドに失敗" << std::endl;
 			return false;
 		}
 		return true;
 	}
 
 	/**
-	*`pvOɐݒ肷
+	*描画用プログラムに設定する
 	*/
 	void Program::UseProgram()
 	{
@@ -113,11 +113,11 @@ namespace Shader {
 	}
 
 	/**
-	*eNX`eNX`EC[WEjbgɊ蓖Ă
+	*テクスチャをテクスチャ・イメージ・ユニットに割り当てる
 	*
-	*@param	unit	̃eNX`EC[WEjbgԍ(GL_TEXTURE0~)
-	*@param	type	蓖ĂeNX`̎(GL_TEXTURE_1D,GL_TEXTURE_2D,etc)
-	*@param	texture	蓖ĂeNX`IuWFNg
+	*@param	unit	割当先のテクスチャ・イメージ・ユニット番号(GL_TEXTURE0~)
+	*@param	type	割り当てるテクスチャの種類(GL_TEXTURE_1D,GL_TEXTURE_2D,etc)
+	*@param	texture	割り当てるテクスチャオブジェクト
 	*/
 	void Program::BindTexture(GLenum unit, GLenum type, GLuint texture)
 	{
@@ -130,12 +130,12 @@ namespace Shader {
 
 
 	/**
-	*VF[_[RpC
+	*シェーダーをコンパイルする
 	*
-	*@param	type	VF[_̎
-	*@param	string	VF[_R[hւ̃|C^
+	*@param	type	シェーダの種類
+	*@param	string	シェーダコードへのポインタ
 	*
-	*@return	쐬VF[_IuWFNg
+	*@return	作成したシェーダオブジェクト
 	*/
 	GLuint CompileShader(GLenum type, const GLchar* string)
 	{
@@ -155,7 +155,7 @@ namespace Shader {
 				if (static_cast<int>(buf.size()) >= infoLen)
 				{
 					glGetShaderInfoLog(shader, infoLen, NULL, buf.data());
-					std::cerr << "ERROR: VF[_̃RpCɎs\n" << buf.data() << std::endl;
+					std::cerr << "ERROR: シェーダのコンパイルに失敗\n" << buf.data() << std::endl;
 				}
 			}
 			glDeleteShader(shader);
@@ -165,12 +165,12 @@ namespace Shader {
 	}
 
 	/**
-	*vOIuWFNg쐬
+	*プログラムオブジェクトを作成する
 	*
-	*@param	vsCode	_VF[_R[hւ̃|C^
-	*@param	fsCode	tOgVF[_R[hւ̃|C^
+	*@param	vsCode	頂点シェーダコードへのポインタ
+	*@param	fsCode	フラグメントシェーダコードへのポインタ
 	*
-	*@return 쐬vOIuWFNg
+	*@return 作成したプログラムオブジェクト
 	*/
 	GLuint CreateShaderProgram(const GLchar* vsCode, const GLchar* fsCode)
 	{
@@ -199,7 +199,7 @@ namespace Shader {
 				if (static_cast<int>(buf.size()) >= infoLen)
 				{
 					glGetProgramInfoLog(program, infoLen, NULL, buf.data());
-					std::cerr << "ERROR: VF[_̃NɎs\n" << buf.data() << std::endl;
+					std::cerr << "ERROR: シェーダのリンクに失敗\n" << buf.data() << std::endl;
 				}
 			}
 			glDeleteProgram(program);
@@ -209,13 +209,13 @@ namespace Shader {
 	}
 
 	/**
-	*t@Cǂݍ
+	*ファイルを読み込む
 	*
-	*@param	filename	ǂݍރt@C
-	*@param	buf			ǂݍݐobt@
+	*@param	filename	読み込むファイル名
+	*@param	buf			読み込み先バッファ
 	*
-	*@retval true		ǂݍݐ
-	*@retval false		ǂݍݎs
+	*@retval true		読み込み成功
+	*@retval false		読み込み失敗
 	*/
 	bool ReadFile(const char* filename, std::vector<char>& buf)
 	{
@@ -241,12 +241,12 @@ namespace Shader {
 	}
 
 	/**
-	*t@C炵[ՂO쐬
+	*ファイルからしぇーだぷおろグラムを作成する
 	*
-	*@param vsCode	_VF[_t@C
-	*@param	fsCode	tOgVF[_t@C
+	*@param vsCode	頂点シェーダファイル名
+	*@param	fsCode	フラグメントシェーダファイル名
 	*
-	*@return 쐬vOIuWFNg
+	*@return 作成したプログラムオブジェクト
 	*/
 	GLuint CreateProgramFromFile(const char* vsFilename, const char* fsFilename)
 	{
@@ -254,14 +254,14 @@ namespace Shader {
 		if (!ReadFile(vsFilename, vsBuf))
 		{
 			std::cerr << "ERROR in Shader::CreateProgramFromFile:\n" <<
-				vsFilename << "ǂݍ߂܂" << std::endl;
+				vsFilename << "を読み込めません" << std::endl;
 			return 0;
 		}
 		std::vector<char>fsBuf;
 		if (!ReadFile(fsFilename, fsBuf))
 		{
 			std::cerr<< "ERROR in Shader::CreateProgramFromFile:\n" <<
-				vsFilename << "ǂݍ߂܂" << std::endl;
+				vsFilename << "を読み込めません" << std::endl;
 			return 0;
 		}
 		return CreateShaderProgram(vsBuf.data(), fsBuf.data());
@@ -10,7 +10,7 @@
 namespace Shader
 {
 	class Program;
-	typedef std::shared_ptr<Program> ProgramPtr;	///<vOIuWFNg|C^^
+	typedef std::shared_ptr<Program> ProgramPtr;	///<プログラムオブジェクトポインタ型
 
 	class Program
 	{
@@ -28,10 +28,10 @@ namespace Shader
 		Program& operator = (const Program&) = delete;
 
 	private:
-		GLuint program = 0;	///<vOIuWFNg
-		GLint samplerLocation = -1;	///<Tv[̈ʒu
-		int samplerCount = 0;	///<Tv[̐
-		std::string name;	///<vO
+		GLuint program = 0;	///<プログラムオブジェクト
+		GLint samplerLocation = -1;	///<サンプラーの位置
+		int samplerCount = 0;	///<サンプラーの数
+		std::string name;	///<プログラム名
 	};
 
 	GLuint CreateProgramFromFile(const char* vsFilename, const char* fsFilename);
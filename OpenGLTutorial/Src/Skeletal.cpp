@@ -0,0 +1,1523 @@
+/**
+*	@file Skeletal.cpp
+*/
+#include "Skeletal.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include <fbxsdk.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SKELETAL_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace Skeletal
+{
+	/**
+	*名前からボーンを探す
+	*
+	*@param	name	ボーン名
+	*
+	*@return ボーンの番号
+	*		見つからなければ-1
+	*/
+	int Skeleton::FindBone(const std::string& name) const
+	{
+		for (size_t i = 0; i < boneList.size(); ++i)
+		{
+			if (boneList[i].name == name)
+			{
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+
+	/**
+	*姿勢から行列パレットを計算する
+	*
+	*@param	skeleton	スケルトン
+	*@param	pose		各ボーンの姿勢
+	*@param	matGlobal	作業用のボーン行列の格納先(ボーン数の要素が必要)
+	*@param	palette		行列パレットの格納先(ボーン数の要素が必要)
+	*/
+	void CalcPalette(const Skeleton& skeleton, const Transform* pose, glm::mat4* matGlobal,
+		PaletteMatrix* palette)
+	{
+		const size_t boneCount = skeleton.boneList.size();
+		for (size_t i = 0; i < boneCount; ++i)
+		{
+			const Bone& bone = skeleton.boneList[i];
+			glm::mat4 matLocal = glm::mat4_cast(pose[i].rotation);
+			matLocal[0] *= pose[i].scale.x;
+			matLocal[1] *= pose[i].scale.y;
+			matLocal[2] *= pose[i].scale.z;
+			matLocal[3] = glm::vec4(pose[i].translation, 1);
+			matGlobal[i] = bone.parent >= 0 ? matGlobal[bone.parent] * matLocal : matLocal;
+			palette[i] = PaletteMatrix(glm::transpose(matGlobal[i] * bone.matInverseBindPose));
+		}
+	}
+
+	/**
+	*頂点をスキニングする(参照実装)
+	*
+	*@param	src		バインドポーズの頂点
+	*@param	count	頂点数
+	*@param	palette	行列パレット
+	*@param	dst		変形した頂点の格納先
+	*
+	*SkinVerticesの結果を検証するために使う
+	*/
+	void SkinVerticesReference(const SkinVertex* src, size_t count, const PaletteMatrix* palette,
+		SkinnedVertex* dst)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const SkinVertex& v = src[i];
+			const PaletteMatrix m =
+				palette[v.bone[0]] * v.weight.x + palette[v.bone[1]] * v.weight.y +
+				palette[v.bone[2]] * v.weight.z + palette[v.bone[3]] * v.weight.w;
+			dst[i].position = glm::vec4(v.position * m, 1);
+			dst[i].normal = glm::vec4(v.normal * m, 0);
+		}
+	}
+
+	/**
+	*頂点をスキニングする
+	*
+	*@param	src		バインドポーズの頂点
+	*@param	count	頂点数
+	*@param	palette	行列パレット
+	*@param	dst		変形した頂点の格納先
+	*
+	*影響するボーンの行列を重み付きで合成してから、座標と法線に掛ける(行列ブレンド)
+	*SSEが使える場合は1頂点を4要素のベクトル演算で処理する
+	*dstが16バイト境界に揃っていれば、キャッシュを汚さない書き込み命令を使う
+	*(GLのバッファをマップしたメモリは書き込み結合なので、この方が速い)
+	*/
+	void SkinVertices(const SkinVertex* src, size_t count, const PaletteMatrix* palette,
+		SkinnedVertex* dst)
+	{
+#ifdef SKELETAL_USE_SSE
+		const float* const base = &palette[0][0][0];
+		const bool isAligned = (reinterpret_cast<uintptr_t>(dst) & 15) == 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const SkinVertex& v = src[i];
+			const __m128 weight = _mm_loadu_ps(&v.weight[0]);
+			__m128 row0 = _mm_setzero_ps();
+			__m128 row1 = _mm_setzero_ps();
+			__m128 row2 = _mm_setzero_ps();
+#define SKELETAL_BLEND_BONE(n) { \
+				const float* m = base + v.bone[n] * 12; \
+				const __m128 w = _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(n, n, n, n)); \
+				row0 = _mm_add_ps(row0, _mm_mul_ps(_mm_loadu_ps(m + 0), w)); \
+				row1 = _mm_add_ps(row1, _mm_mul_ps(_mm_loadu_ps(m + 4), w)); \
+				row2 = _mm_add_ps(row2, _mm_mul_ps(_mm_loadu_ps(m + 8), w)); }
+			SKELETAL_BLEND_BONE(0);
+			SKELETAL_BLEND_BONE(1);
+			SKELETAL_BLEND_BONE(2);
+			SKELETAL_BLEND_BONE(3);
+#undef SKELETAL_BLEND_BONE
+
+			//3つの内積を転置してまとめて求める(4番目の要素は0になる)
+			const __m128 position = _mm_loadu_ps(&v.position[0]);
+			__m128 px = _mm_mul_ps(row0, position);
+			__m128 py = _mm_mul_ps(row1, position);
+			__m128 pz = _mm_mul_ps(row2, position);
+			__m128 pw = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+			const __m128 outPosition = _mm_add_ps(_mm_add_ps(px, py), _mm_add_ps(pz, pw));
+
+			const __m128 normal = _mm_loadu_ps(&v.normal[0]);
+			__m128 nx = _mm_mul_ps(row0, normal);
+			__m128 ny = _mm_mul_ps(row1, normal);
+			__m128 nz = _mm_mul_ps(row2, normal);
+			__m128 nw = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+			const __m128 outNormal = _mm_add_ps(_mm_add_ps(nx, ny), _mm_add_ps(nz, nw));
+
+			float* out = &dst[i].position[0];
+			if (isAligned)
+			{
+				_mm_stream_ps(out, outPosition);
+				_mm_stream_ps(out + 4, outNormal);
+			}
+			else
+			{
+				_mm_storeu_ps(out, outPosition);
+				_mm_storeu_ps(out + 4, outNormal);
+			}
+		}
+		_mm_sfence();
+#else
+		SkinVerticesReference(src, count, palette, dst);
+#endif
+	}
+
+	/**
+	*デストラクタ
+	*/
+	SkinnedMesh::~SkinnedMesh()
+	{
+		if (gpuVao)
+		{
+			glDeleteVertexArrays(1, &gpuVao);
+		}
+		if (cpuVao)
+		{
+			glDeleteVertexArrays(1, &cpuVao);
+		}
+		if (ibo)
+		{
+			glDeleteBuffers(1, &ibo);
+		}
+		if (attributeVbo)
+		{
+			glDeleteBuffers(1, &attributeVbo);
+		}
+		if (bindPoseVbo)
+		{
+			glDeleteBuffers(1, &bindPoseVbo);
+		}
+	}
+
+	/**
+	*名前からクリップを探す
+	*
+	*@param	clipName	クリップ名
+	*
+	*@return クリップ
+	*		見つからなければnullptr
+	*/
+	ClipPtr SkinnedMesh::FindClip(const std::string& clipName) const
+	{
+		for (const ClipPtr& e : clipList)
+		{
+			if (e->Name() == clipName)
+			{
+				return e;
+			}
+		}
+		return{};
+	}
+
+	/**
+	*クリップを再生する
+	*
+	*@param	clip		再生するクリップ(nullptrならバインドポーズに戻す)
+	*@param	loop		ループ再生するならtrue
+	*@param	startTime	再生を始める位置(秒)
+	*/
+	void Character::Play(const ClipPtr& clip, bool loop, double startTime)
+	{
+		this->clip = clip;
+		isLoop = loop;
+		time = startTime;
+	}
+
+	/**
+	*キャラクターを破棄する
+	*
+	*この関数を呼び出した後は、キャラクターを操作してはならない
+	*/
+	void Character::Destroy()
+	{
+		if (pBuffer)
+		{
+			pBuffer->RemoveCharacter(this);
+		}
+	}
+
+	/**
+	*	FBXオブジェクトを破棄するためのヘルパー構造体
+	*/
+	template<typename T>
+	struct Deleter
+	{
+		void operator()(T* p) { if (p) { p->Destroy(); } }
+	};
+
+	/**
+	*FBXの行列をglmの行列に変換する
+	*/
+	glm::mat4 ToMat4(const FbxAMatrix& m)
+	{
+		glm::mat4 result;
+		for (int col = 0; col < 4; ++col)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				result[col][row] = static_cast<float>(m.Get(col, row));
+			}
+		}
+		return result;
+	}
+
+	/**
+	*FBXの行列を姿勢に分解する
+	*/
+	Transform ToTransform(const FbxAMatrix& m)
+	{
+		const FbxVector4 t = m.GetT();
+		const FbxQuaternion q = m.GetQ();
+		const FbxVector4 s = m.GetS();
+		Transform result;
+		result.translation = glm::vec3(static_cast<float>(t[0]), static_cast<float>(t[1]),
+			static_cast<float>(t[2]));
+		result.rotation = glm::quat(static_cast<float>(q[3]), static_cast<float>(q[0]),
+			static_cast<float>(q[1]), static_cast<float>(q[2]));
+		result.scale = glm::vec3(static_cast<float>(s[0]), static_cast<float>(s[1]),
+			static_cast<float>(s[2]));
+		return result;
+	}
+
+	/**
+	*	スキンメッシュの読み込み中に使う頂点データ
+	*
+	*	MeshOptimizerで重複を除くため、パディングを含めて0で初期化して使う
+	*/
+	struct ImportVertex
+	{
+		SkinVertex skin;
+		VertexAttribute attribute;
+	};
+
+	/**
+	*	スキンメッシュ読み込み1回分の記録
+	*/
+	struct ImportRecord
+	{
+		std::string filename;
+		size_t boneCount;
+		size_t vertexCount;
+		size_t clipCount;
+	};
+
+	/**
+	*	アニメーションクリップの圧縮1回分の記録
+	*/
+	struct ClipRecord
+	{
+		std::string name;
+		size_t frameCount;
+		CompressionStats stats;
+	};
+	std::mutex importRecordMutex;
+	std::vector<ImportRecord> importRecordList;
+	std::vector<ClipRecord> clipRecordList;
+
+	/**
+	*	FBXファイルからスケルトン、スキン、アニメーションを読み込むクラス
+	*/
+	struct SkinLoader
+	{
+		bool Load(const char* filename, SkinnedMesh& mesh);
+		void CollectMeshNodes(FbxNode* node);
+		void CollectBones(FbxNode* node, int parent);
+		bool LoadMesh(FbxNode* node);
+		void LoadClips(FbxScene* scene);
+
+		/**
+		*	マテリアル1つ分の仮データ
+		*/
+		struct MaterialData
+		{
+			glm::vec4 color;
+			std::vector<uint32_t> indexList;
+		};
+
+		Skeleton skeleton;
+		std::vector<FbxNode*> boneNodeList;	///<boneListの各ボーンに対応するノード
+		std::unordered_set<FbxNode*> linkNodeSet;	///<スキンから参照されているノード
+		std::unordered_map<FbxNode*, int> boneIndexMap;	///<ノードからボーン番号への対応表
+		std::vector<FbxNode*> meshNodeList;	///<スキンを持つメッシュのノード
+		std::vector<ImportVertex> vertexList;
+		std::vector<MaterialData> materialList;
+		std::vector<ClipPtr> clipList;
+	};
+
+	/**
+	*FBXファイルを読み込む
+	*
+	*@param	filename	FBXファイル名
+	*@param	mesh		読み込んだデータの格納先
+	*
+	*@retval true	読み込み成功
+	*@retval false	読み込み失敗
+	*/
+	bool SkinLoader::Load(const char* filename, SkinnedMesh& mesh)
+	{
+		std::unique_ptr<FbxManager, Deleter<FbxManager>> fbxManager(FbxManager::Create());
+		if (!fbxManager)
+		{
+			std::cerr << "ERROR: " << filename << " の読み込みに失敗(FbxManagerの作成に失敗)" <<
+				std::endl;
+			return false;
+		}
+		FbxScene* fbxScene = FbxScene::Create(fbxManager.get(), "");
+		if (!fbxScene)
+		{
+			std::cerr << "ERROR: " << filename << " の読み込みに失敗(FbxSceneの作成に失敗)" <<
+				std::endl;
+			return false;
+		}
+		{
+			std::unique_ptr<FbxImporter, Deleter<FbxImporter>> fbxImporter(
+				FbxImporter::Create(fbxManager.get(), ""));
+			if (!fbxImporter->Initialize(filename) || !fbxImporter->Import(fbxScene))
+			{
+				std::cerr << "ERROR: " << filename << " の読み込みに失敗\n(" <<
+					fbxImporter->GetStatus().GetErrorString() << ")" << std::endl;
+				return false;
+			}
+		}
+		FbxGeometryConverter geometryConverter(fbxManager.get());
+		geometryConverter.Triangulate(fbxScene, true);
+
+		//スキンが参照するノードと、スケルトン属性を持つノードをボーンにする
+		CollectMeshNodes(fbxScene->GetRootNode());
+		if (meshNodeList.empty())
+		{
+			std::cerr << "ERROR: " << filename << " にはスキンを持つメッシュがありません" << std::endl;
+			return false;
+		}
+		CollectBones(fbxScene->GetRootNode(), -1);
+		if (skeleton.boneList.empty() || skeleton.boneList.size() > static_cast<size_t>(maxBoneCount))
+		{
+			std::cerr << "ERROR: " << filename << " のボーン数(" << skeleton.boneList.size() <<
+				")が0か、上限(" << maxBoneCount << ")を超えています" << std::endl;
+			return false;
+		}
+		for (FbxNode* e : meshNodeList)
+		{
+			if (!LoadMesh(e))
+			{
+				std::cerr << "ERROR: " << filename << " の変換に失敗" << std::endl;
+				return false;
+			}
+		}
+		LoadClips(fbxScene);
+
+		//マテリアルごとのインデックスを1つの配列にまとめる
+		mesh.name = filename;
+		mesh.skeleton = std::move(skeleton);
+		mesh.clipList = std::move(clipList);
+		mesh.skinVertexList.reserve(vertexList.size());
+		mesh.attributeList.reserve(vertexList.size());
+		for (const ImportVertex& e : vertexList)
+		{
+			mesh.skinVertexList.push_back(e.skin);
+			mesh.attributeList.push_back(e.attribute);
+		}
+		for (const MaterialData& e : materialList)
+		{
+			if (e.indexList.empty())
+			{
+				continue;
+			}
+			SkinnedMesh::Material material;
+			material.count = static_cast<GLsizei>(e.indexList.size());
+			material.offset = static_cast<GLintptr>(mesh.indexList.size() * sizeof(uint32_t));
+			material.color = e.color;
+			mesh.materialList.push_back(material);
+			mesh.indexList.insert(mesh.indexList.end(), e.indexList.begin(), e.indexList.end());
+		}
+		return true;
+	}
+
+	/**
+	*スキンを持つメッシュのノードと、スキンが参照するノードを集める
+	*
+	*@param	fbxNode	走査するノード
+	*/
+	void SkinLoader::CollectMeshNodes(FbxNode* fbxNode)
+	{
+		if (!fbxNode)
+		{
+			return;
+		}
+		if (FbxMesh* fbxMesh = fbxNode->GetMesh())
+		{
+			const int skinCount = fbxMesh->GetDeformerCount(FbxDeformer::eSkin);
+			if (skinCount > 0)
+			{
+				meshNodeList.push_back(fbxNode);
+				for (int i = 0; i < skinCount; ++i)
+				{
+					FbxSkin* fbxSkin = static_cast<FbxSkin*>(fbxMesh->GetDeformer(i, FbxDeformer::eSkin));
+					const int clusterCount = fbxSkin->GetClusterCount();
+					for (int j = 0; j < clusterCount; ++j)
+					{
+						if (FbxNode* link = fbxSkin->GetCluster(j)->GetLink())
+						{
+							linkNodeSet.insert(link);
+						}
+					}
+				}
+			}
+			else
+			{
+				std::cerr << "WARNING: " << fbxNode->GetName() <<
+					" はスキンを持たないので、スキンメッシュとしては読み込みません" << std::endl;
+			}
+		}
+		const int childCount = fbxNode->GetChildCount();
+		for (int i = 0; i < childCount; ++i)
+		{
+			CollectMeshNodes(fbxNode->GetChild(i));
+		}
+	}
+
+	/**
+	*ボーンになるノードを深さ優先で集める
+	*
+	*@param	fbxNode	走査するノード
+	*@param	parent	最も近い祖先のボーン番号
+	*
+	*深さ優先で追加するので、親は必ず子より前に並ぶ
+	*バインドポーズはシーンの初期姿勢で仮に設定し、クラスタがあれば後で上書きする
+	*/
+	void SkinLoader::CollectBones(FbxNode* fbxNode, int parent)
+	{
+		if (!fbxNode)
+		{
+			return;
+		}
+		if (fbxNode->GetSkeleton() || linkNodeSet.count(fbxNode))
+		{
+			const FbxAMatrix matGlobal = fbxNode->EvaluateGlobalTransform();
+			Bone bone;
+			bone.name = fbxNode->GetName();
+			bone.parent = parent;
+			bone.matInverseBindPose = ToMat4(matGlobal.Inverse());
+			if (parent >= 0)
+			{
+				const FbxAMatrix matParent = boneNodeList[parent]->EvaluateGlobalTransform();
+				bone.bindPose = ToTransform(matParent.Inverse() * matGlobal);
+			}
+			else
+			{
+				bone.bindPose = ToTransform(matGlobal);
+			}
+			parent = static_cast<int>(skeleton.boneList.size());
+			boneIndexMap[fbxNode] = parent;
+			boneNodeList.push_back(fbxNode);
+			skeleton.boneList.push_back(bone);
+		}
+		const int childCount = fbxNode->GetChildCount();
+		for (int i = 0; i < childCount; ++i)
+		{
+			CollectBones(fbxNode->GetChild(i), parent);
+		}
+	}
+
+	/**
+	*スキンメッシュを変換する
+	*
+	*@param	fbxNode	変換するメッシュのノード
+	*
+	*@retval true	変換成功
+	*@retval false	変換失敗
+	*
+	*頂点はバインドポーズのシーン座標系に変換しておき、ボーン行列だけで変形できるようにする
+	*/
+	bool SkinLoader::LoadMesh(FbxNode* fbxNode)
+	{
+		FbxMesh* fbxMesh = fbxNode->GetMesh();
+		const int controlPointCount = fbxMesh->GetControlPointsCount();
+
+		//コントロールポイントごとに、影響の大きい順に最大4つのボーンを選ぶ
+		struct Influence
+		{
+			int bone[maxInfluenceCount];
+			float weight[maxInfluenceCount];
+		};
+		std::vector<Influence> influenceList(controlPointCount, Influence{ {}, {} });
+		FbxAMatrix matMesh = fbxNode->EvaluateGlobalTransform();
+		bool hasMeshMatrix = false;
+		const int skinCount = fbxMesh->GetDeformerCount(FbxDeformer::eSkin);
+		for (int i = 0; i < skinCount; ++i)
+		{
+			FbxSkin* fbxSkin = static_cast<FbxSkin*>(fbxMesh->GetDeformer(i, FbxDeformer::eSkin));
+			const int clusterCount = fbxSkin->GetClusterCount();
+			for (int j = 0; j < clusterCount; ++j)
+			{
+				FbxCluster* fbxCluster = fbxSkin->GetCluster(j);
+				const auto itr = boneIndexMap.find(fbxCluster->GetLink());
+				if (itr == boneIndexMap.end())
+				{
+					continue;
+				}
+				const int boneIndex = itr->second;
+				FbxAMatrix matLink;
+				fbxCluster->GetTransformLinkMatrix(matLink);
+				skeleton.boneList[boneIndex].matInverseBindPose = ToMat4(matLink.Inverse());
+				if (!hasMeshMatrix)
+				{
+					fbxCluster->GetTransformMatrix(matMesh);
+					hasMeshMatrix = true;
+				}
+
+				const int count = fbxCluster->GetControlPointIndicesCount();
+				const int* indices = fbxCluster->GetControlPointIndices();
+				const double* weights = fbxCluster->GetControlPointWeights();
+				for (int k = 0; k < count; ++k)
+				{
+					if (indices[k] < 0 || indices[k] >= controlPointCount)
+					{
+						continue;
+					}
+					Influence& influence = influenceList[indices[k]];
+					const float weight = static_cast<float>(weights[k]);
+					int minIndex = 0;
+					for (int n = 1; n < maxInfluenceCount; ++n)
+					{
+						if (influence.weight[n] < influence.weight[minIndex])
+						{
+							minIndex = n;
+						}
+					}
+					if (weight > influence.weight[minIndex])
+					{
+						influence.bone[minIndex] = boneIndex;
+						influence.weight[minIndex] = weight;
+					}
+				}
+			}
+		}
+		for (Influence& e : influenceList)
+		{
+			const float total = e.weight[0] + e.weight[1] + e.weight[2] + e.weight[3];
+			if (total > 0)
+			{
+				for (float& w : e.weight)
+				{
+					w /= total;
+				}
+			}
+			else
+			{
+				//どのボーンにも属さない頂点は、最初のボーンに固定する
+				e.weight[0] = 1;
+			}
+		}
+
+		//マテリアル情報を読み取る
+		const size_t baseMaterial = materialList.size();
+		const int materialCount = std::max(fbxNode->GetMaterialCount(), 1);
+		for (int i = 0; i < materialCount; ++i)
+		{
+			MaterialData material;
+			material.color = glm::vec4(1);
+			if (FbxSurfaceMaterial* fbxMaterial = fbxNode->GetMaterial(i))
+			{
+				const FbxClassId classId = fbxMaterial->GetClassId();
+				if (classId == FbxSurfaceLambert::ClassId || classId == FbxSurfacePhong::ClassId)
+				{
+					const FbxSurfaceLambert* pLambert = static_cast<const FbxSurfaceLambert*>(fbxMaterial);
+					const FbxDouble3 diffuse = pLambert->Diffuse.Get();
+					material.color = glm::vec4(static_cast<float>(diffuse[0]),
+						static_cast<float>(diffuse[1]), static_cast<float>(diffuse[2]),
+						static_cast<float>(1.0 - pLambert->TransparencyFactor.Get()));
+				}
+			}
+			materialList.push_back(material);
+		}
+
+		//頂点要素を読み取る準備
+		const bool hasColor = fbxMesh->GetElementVertexColorCount() > 0;
+		const bool hasNormal = fbxMesh->GetElementNormalCount() > 0;
+		FbxStringList uvSetNameList;
+		fbxMesh->GetUVSetNames(uvSetNameList);
+		const bool hasTexcoord = fbxMesh->GetElementUVCount() > 0 && uvSetNameList.GetCount() > 0;
+		FbxGeometryElement::EMappingMode colorMappingMode = FbxLayerElement::eNone;
+		bool isColorDirectRef = true;
+		const FbxLayerElementArrayTemplate<int>* colorIndexList = nullptr;
+		const FbxLayerElementArrayTemplate<FbxColor>* colorList = nullptr;
+		if (hasColor)
+		{
+			const FbxLayerElementVertexColor* fbxColorList = fbxMesh->GetElementVertexColor();
+			colorMappingMode = fbxColorList->GetMappingMode();
+			isColorDirectRef = fbxColorList->GetReferenceMode() == FbxLayerElement::eDirect;
+			colorIndexList = &fbxColorList->GetIndexArray();
+			colorList = &fbxColorList->GetDirectArray();
+		}
+		const FbxLayerElementArrayTemplate<int>* materialIndexList = nullptr;
+		if (FbxGeometryElementMaterial* fbxMaterialLayer = fbxMesh->GetElementMaterial())
+		{
+			materialIndexList = &fbxMaterialLayer->GetIndexArray();
+		}
+
+		//ポリゴン頂点ごとに頂点を作り、マテリアルごとにインデックスを振り分ける
+		const FbxAMatrix matR(FbxVector4(0, 0, 0), matMesh.GetR(), FbxVector4(1, 1, 1));
+		const FbxVector4* const fbxControlPoints = fbxMesh->GetControlPoints();
+		const int polygonCount = fbxMesh->GetPolygonCount();
+		std::vector<ImportVertex> nodeVertexList;
+		nodeVertexList.reserve(polygonCount * 3);
+		std::vector<std::vector<uint32_t>> nodeIndexList(materialCount);
+		int polygonVertex = 0;
+		for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+		{
+			int materialIndex = materialIndexList ? (*materialIndexList)[polygonIndex] : 0;
+			if (materialIndex < 0 || materialIndex >= materialCount)
+			{
+				materialIndex = 0;
+			}
+			for (int pos = 0; pos < 3; ++pos, ++polygonVertex)
+			{
+				ImportVertex v;
+				memset(&v, 0, sizeof(v));
+				const int cpIndex = fbxMesh->GetPolygonVertex(polygonIndex, pos);
+
+				const FbxVector4 position = matMesh.MultT(fbxControlPoints[cpIndex]);
+				v.skin.position = glm::vec4(static_cast<float>(position[0]),
+					static_cast<float>(position[1]), static_cast<float>(position[2]), 1);
+
+				v.skin.normal = glm::vec4(0, 0, 1, 0);
+				if (hasNormal)
+				{
+					FbxVector4 normal;
+					fbxMesh->GetPolygonVertexNormal(polygonIndex, pos, normal);
+					normal = matR.MultT(normal);
+					v.skin.normal = glm::vec4(glm::normalize(glm::vec3(static_cast<float>(normal[0]),
+						static_cast<float>(normal[1]), static_cast<float>(normal[2]))), 0);
+				}
+
+				const Influence& influence = influenceList[cpIndex];
+				for (int n = 0; n < maxInfluenceCount; ++n)
+				{
+					v.skin.bone[n] = static_cast<uint16_t>(influence.bone[n]);
+					v.skin.weight[n] = influence.weight[n];
+				}
+
+				v.attribute.color = glm::vec4(1);
+				if (hasColor)
+				{
+					int colorIndex = -1;
+					if (colorMappingMode == FbxLayerElement::eByControlPoint)
+					{
+						colorIndex = isColorDirectRef ? cpIndex : (*colorIndexList)[cpIndex];
+					}
+					else if (colorMappingMode == FbxLayerElement::eByPolygonVertex)
+					{
+						colorIndex = isColorDirectRef ? polygonVertex : (*colorIndexList)[polygonVertex];
+					}
+					if (colorIndex >= 0)
+					{
+						const FbxColor color = (*colorList)[colorIndex];
+						v.attribute.color = glm::vec4(static_cast<float>(color.mRed),
+							static_cast<float>(color.mGreen), static_cast<float>(color.mBlue),
+							static_cast<float>(color.mAlpha));
+					}
+				}
+
+				if (hasTexcoord)
+				{
+					FbxVector2 uv;
+					bool unmapped;
+					fbxMesh->GetPolygonVertexUV(polygonIndex, pos, uvSetNameList[0], uv, unmapped);
+					v.attribute.texCoord = glm::vec2(static_cast<float>(uv[0]), static_cast<float>(uv[1]));
+				}
+
+				nodeIndexList[materialIndex].push_back(static_cast<uint32_t>(nodeVertexList.size()));
+				nodeVertexList.push_back(v);
+			}
+		}
+
+		//重複する頂点をまとめ、マテリアルごとに頂点キャッシュ向けに並べ替える
+		std::vector<uint32_t> indices;
+		std::vector<size_t> rangeList;
+		for (const std::vector<uint32_t>& e : nodeIndexList)
+		{
+			rangeList.push_back(indices.size());
+			indices.insert(indices.end(), e.begin(), e.end());
+		}
+		rangeList.push_back(indices.size());
+		size_t vertexCount = MeshOptimizer::WeldVertices(nodeVertexList.data(), nodeVertexList.size(),
+			sizeof(ImportVertex), indices.data(), indices.size());
+		for (size_t i = 0; i + 1 < rangeList.size(); ++i)
+		{
+			MeshOptimizer::OptimizeVertexCache(indices.data() + rangeList[i],
+				rangeList[i + 1] - rangeList[i], vertexCount);
+		}
+		vertexCount = MeshOptimizer::OptimizeVertexFetch(nodeVertexList.data(), vertexCount,
+			sizeof(ImportVertex), indices.data(), indices.size());
+		nodeVertexList.resize(vertexCount);
+
+		const uint32_t baseVertex = static_cast<uint32_t>(vertexList.size());
+		vertexList.insert(vertexList.end(), nodeVertexList.begin(), nodeVertexList.end());
+		for (size_t i = 0; i + 1 < rangeList.size(); ++i)
+		{
+			std::vector<uint32_t>& dst = materialList[baseMaterial + i].indexList;
+			dst.reserve(rangeList[i + 1] - rangeList[i]);
+			for (size_t j = rangeList[i]; j < rangeList[i + 1]; ++j)
+			{
+				dst.push_back(indices[j] + baseVertex);
+			}
+		}
+		return true;
+	}
+
+	/**
+	*アニメーションスタックをクリップに変換する
+	*
+	*@param	fbxScene	読み込んだシーン
+	*
+	*FBXの評価関数はスレッドセーフではないので、ここで一定間隔にサンプリングしてから圧縮しておく
+	*以後は圧縮したキーを補間するだけなので、複数のスレッドから並列に再生できる
+	*/
+	void SkinLoader::LoadClips(FbxScene* fbxScene)
+	{
+		static const float frameRate = 30;
+		const size_t boneCount = skeleton.boneList.size();
+		std::vector<FbxAMatrix> matGlobalList(boneCount);
+		const int stackCount = fbxScene->GetSrcObjectCount<FbxAnimStack>();
+		for (int i = 0; i < stackCount; ++i)
+		{
+			FbxAnimStack* fbxStack = fbxScene->GetSrcObject<FbxAnimStack>(i);
+			if (!fbxStack)
+			{
+				continue;
+			}
+			fbxScene->SetCurrentAnimationStack(fbxStack);
+			const FbxTimeSpan span = fbxStack->GetLocalTimeSpan();
+			const double start = span.GetStart().GetSecondDouble();
+			const double stop = span.GetStop().GetSecondDouble();
+
+			RawClip raw;
+			raw.name = fbxStack->GetName();
+			raw.frameRate = frameRate;
+			raw.frameCount = static_cast<size_t>(std::max(0.0, stop - start) * frameRate) + 1;
+			raw.boneCount = boneCount;
+			raw.keyList.resize(raw.frameCount * boneCount);
+			for (size_t frame = 0; frame < raw.frameCount; ++frame)
+			{
+				FbxTime time;
+				time.SetSecondDouble(start + static_cast<double>(frame) / frameRate);
+				Transform* key = &raw.keyList[frame * boneCount];
+				for (size_t bone = 0; bone < boneCount; ++bone)
+				{
+					//間にボーンでないノードがあっても正しくなるよう、ワールド行列から親との相対値を求める
+					matGlobalList[bone] = boneNodeList[bone]->EvaluateGlobalTransform(time);
+					const int parent = skeleton.boneList[bone].parent;
+					key[bone] = ToTransform(parent >= 0 ?
+						matGlobalList[parent].Inverse() * matGlobalList[bone] : matGlobalList[bone]);
+				}
+			}
+			CompressionStats stats;
+			ClipPtr clip = Clip::Create(raw, CompressionSettings(), &stats);
+			if (!clip)
+			{
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(importRecordMutex);
+				clipRecordList.push_back({ raw.name, raw.frameCount, stats });
+			}
+			clipList.push_back(clip);
+		}
+	}
+
+	/**
+	*要素数が多い場合だけ並列に処理する
+	*
+	*@param	jobSystem	使用するジョブシステム(nullptrなら呼び出したスレッドで処理する)
+	*@param	count		処理する要素数
+	*@param	grain		1つのジョブで処理する要素数
+	*@param	func		[begin, end)の範囲を処理する関数
+	*/
+	void ParallelForSkeletal(JobSystem* jobSystem, size_t count, size_t grain,
+		const JobSystem::RangeFuncType& func)
+	{
+		if (jobSystem && count > grain)
+		{
+			jobSystem->ParallelFor(count, grain, func);
+		}
+		else
+		{
+			func(0, count);
+		}
+	}
+
+	/**
+	*スキンメッシュバッファを作成する
+	*
+	*@param	maxCharacterCount		キャラクターの最大数
+	*@param	maxSkinnedVertexCount	1フレームにCPUでスキニングできる頂点数の上限
+	*@param	vertexDataBindingPoint	頂点シェーダのパラメータを割り当てるバインディング・ポイント
+	*@param	paletteBindingPoint		行列パレットを割り当てるバインディング・ポイント
+	*
+	*@return 作成したバッファへのポインタ
+	*/
+	BufferPtr Buffer::Create(size_t maxCharacterCount, size_t maxSkinnedVertexCount,
+		GLuint vertexDataBindingPoint, GLuint paletteBindingPoint)
+	{
+		struct Impl : Buffer { Impl() {} ~Impl() {} };
+		BufferPtr p = std::make_shared<Impl>();
+		if (!p)
+		{
+			std::cerr << "ERROR: Skeletal::Buffer の作成に失敗" << std::endl;
+			return{};
+		}
+
+		//UBOの範囲はGL_UNIFORM_BUFFER_OFFSET_ALIGNMENTの倍数で割り当てる必要がある
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		const GLsizeiptr align = std::max<GLsizeiptr>(alignment, 16);
+		p->vertexDataStride = (sizeof(Uniform::VertexData) + align - 1) / align * align;
+		p->paletteStride = (sizeof(PaletteMatrix) * maxBoneCount + align - 1) / align * align;
+		p->uboVertexData = UniformBuffer::Create(p->vertexDataStride * maxCharacterCount,
+			vertexDataBindingPoint, "VertexData");
+		p->uboPalette = UniformBuffer::Create(p->paletteStride * maxCharacterCount,
+			paletteBindingPoint, "SkinningData");
+
+		p->segmentVertexCount = maxSkinnedVertexCount;
+		glGenBuffers(1, &p->streamVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, p->streamVbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(SkinnedVertex) * maxSkinnedVertexCount * streamSegmentCount,
+			nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (!p->uboVertexData || !p->uboPalette || !p->streamVbo)
+		{
+			std::cerr << "ERROR: Skeletal::Buffer の作成に失敗" << std::endl;
+			return{};
+		}
+
+		p->characterList.resize(maxCharacterCount);
+		p->freeList.reserve(maxCharacterCount);
+		for (size_t i = maxCharacterCount; i > 0; --i)
+		{
+			p->characterList[i - 1].pBuffer = p.get();
+			p->freeList.push_back(i - 1);
+		}
+		p->updateList.reserve(maxCharacterCount);
+		return p;
+	}
+
+	/**
+	*デストラクタ
+	*/
+	Buffer::~Buffer()
+	{
+		for (GLsync& e : fenceList)
+		{
+			if (e)
+			{
+				glDeleteSync(e);
+			}
+		}
+		if (streamVbo)
+		{
+			glDeleteBuffers(1, &streamVbo);
+		}
+	}
+
+	/**
+	*FBXファイルからスキンメッシュを読み込む
+	*
+	*@param	filename	FBXファイル名
+	*
+	*@return 読み込んだスキンメッシュ
+	*		失敗した場合はnullptr
+	*
+	*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+	*描画する前にUploadでGPUに転送すること
+	*/
+	SkinnedMeshPtr Buffer::ImportFromFile(const char* filename)
+	{
+		struct Impl : SkinnedMesh { Impl() {} ~Impl() {} };
+		SkinnedMeshPtr mesh = std::make_shared<Impl>();
+		SkinLoader loader;
+		if (!loader.Load(filename, *mesh))
+		{
+			return{};
+		}
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		importRecordList.push_back({ filename, mesh->skeleton.boneList.size(),
+			mesh->skinVertexList.size(), mesh->clipList.size() });
+		return mesh;
+	}
+
+	/**
+	*スキンメッシュをGPUに転送する
+	*
+	*@param	mesh	ImportFromFileで読み込んだスキンメッシュ
+	*
+	*@retval true	転送成功
+	*@retval false	転送失敗
+	*
+	*スキニングしない頂点要素とインデックスは、転送後にCPU側から削除する
+	*/
+	bool Buffer::Upload(const SkinnedMeshPtr& mesh)
+	{
+		if (!mesh || mesh->skinVertexList.empty())
+		{
+			return false;
+		}
+		if (mesh->skinVertexList.size() > segmentVertexCount)
+		{
+			std::cerr << "WARNING: " << mesh->name << " の頂点数(" << mesh->skinVertexList.size() <<
+				")がCPUスキニングの上限を超えています(GPUスキニングでのみ描画できます)" << std::endl;
+		}
+		GLuint buffers[3];
+		glGenBuffers(3, buffers);
+		mesh->bindPoseVbo = buffers[0];
+		mesh->attributeVbo = buffers[1];
+		mesh->ibo = buffers[2];
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->bindPoseVbo);
+		glBufferData(GL_ARRAY_BUFFER, mesh->skinVertexList.size() * sizeof(SkinVertex),
+			mesh->skinVertexList.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->attributeVbo);
+		glBufferData(GL_ARRAY_BUFFER, mesh->attributeList.size() * sizeof(VertexAttribute),
+			mesh->attributeList.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		GLuint vaos[2];
+		glGenVertexArrays(2, vaos);
+		mesh->cpuVao = vaos[0];
+		mesh->gpuVao = vaos[1];
+		const GLsizei attributeStride = sizeof(VertexAttribute);
+		const GLsizei skinStride = sizeof(SkinVertex);
+		for (GLuint vao : vaos)
+		{
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh->attributeVbo);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, attributeStride,
+				reinterpret_cast<GLvoid*>(offsetof(VertexAttribute, color)));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, attributeStride,
+				reinterpret_cast<GLvoid*>(offsetof(VertexAttribute, texCoord)));
+			//座標と法線は、CPUスキニングでは描画のたびにストリーミングVBOの位置を設定する
+			glEnableVertexAttribArray(0);
+			glEnableVertexAttribArray(3);
+			if (vao == mesh->gpuVao)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, mesh->bindPoseVbo);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, skinStride,
+					reinterpret_cast<GLvoid*>(offsetof(SkinVertex, position)));
+				glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, skinStride,
+					reinterpret_cast<GLvoid*>(offsetof(SkinVertex, normal)));
+				glEnableVertexAttribArray(4);
+				glVertexAttribIPointer(4, 4, GL_UNSIGNED_SHORT, skinStride,
+					reinterpret_cast<GLvoid*>(offsetof(SkinVertex, bone)));
+				glEnableVertexAttribArray(5);
+				glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, skinStride,
+					reinterpret_cast<GLvoid*>(offsetof(SkinVertex, weight)));
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+			if (vao == mesh->cpuVao)
+			{
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indexList.size() * sizeof(uint32_t),
+					mesh->indexList.data(), GL_STATIC_DRAW);
+			}
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		const GLenum error = glGetError();
+		if (error != GL_NO_ERROR)
+		{
+			std::cerr << "ERROR: " << mesh->name << " の転送に失敗(0x" << std::hex << error <<
+				std::dec << ")" << std::endl;
+			return false;
+		}
+
+		Memory::Vector<VertexAttribute, Memory::Tag::Animation>().swap(mesh->attributeList);
+		Memory::Vector<uint32_t, Memory::Tag::Animation>().swap(mesh->indexList);
+		return true;
+	}
+
+	/**
+	*スキンメッシュを登録する
+	*
+	*@param	mesh	Uploadで転送済みのスキンメッシュ
+	*
+	*@return 登録したハンドル
+	*/
+	Asset::Handle Buffer::AddMesh(const SkinnedMeshPtr& mesh)
+	{
+		if (!mesh)
+		{
+			return Asset::invalidHandle;
+		}
+		return meshList.Add(mesh->name.c_str(), mesh);
+	}
+
+	/**
+	*スキンメッシュを読み込んで登録する
+	*
+	*@param	filename	FBXファイル名
+	*
+	*@retval true	読み込み成功
+	*@retval false	読み込み失敗
+	*/
+	bool Buffer::LoadFromFile(const char* filename)
+	{
+		const SkinnedMeshPtr mesh = ImportFromFile(filename);
+		if (!mesh || !Upload(mesh))
+		{
+			return false;
+		}
+		return AddMesh(mesh) != Asset::invalidHandle;
+	}
+
+	/**
+	*スキンメッシュを取得する
+	*
+	*@param	name	スキンメッシュ名(ファイル名)
+	*
+	*@return 名前に対応するスキンメッシュ
+	*		見つからなければnullptr
+	*/
+	const SkinnedMeshPtr& Buffer::GetMesh(Asset::Name name) const
+	{
+		return meshList.Get(meshList.Find(name));
+	}
+
+	/**
+	*キャラクターを追加する
+	*
+	*@param	mesh		表示するスキンメッシュ
+	*@param	texture		表示に使うテクスチャ
+	*@param	position	座標
+	*
+	*@return 追加したキャラクター
+	*		これ以上追加できない場合はnullptr
+	*
+	*最初のクリップがあればループ再生する
+	*/
+	Character* Buffer::AddCharacter(const SkinnedMeshPtr& mesh, const TexturePtr& texture,
+		const glm::vec3& position)
+	{
+		if (!mesh || freeList.empty())
+		{
+			std::cerr << "WARNING: キャラクターを追加できません" << std::endl;
+			return nullptr;
+		}
+		Character& e = characterList[freeList.back()];
+		freeList.pop_back();
+		e.mesh = mesh;
+		e.texture = texture;
+		e.clip = mesh->clipList.empty() ? ClipPtr() : mesh->clipList[0];
+		e.time = 0;
+		e.speed = 1;
+		e.isLoop = true;
+		e.position = position;
+		e.rotation = glm::quat();
+		e.scale = glm::vec3(1);
+		e.color = glm::vec4(1);
+		e.isActive = true;
+		return &e;
+	}
+
+	/**
+	*キャラクターを削除する
+	*
+	*@param	character	削除するキャラクター
+	*/
+	void Buffer::RemoveCharacter(Character* character)
+	{
+		if (!character || !character->isActive || character->pBuffer != this)
+		{
+			return;
+		}
+		character->isActive = false;
+		//描画スレッドのスナップショットがまだ使っているかもしれないので、解放は描画スレッドに任せる
+		if (retireQueue)
+		{
+			retireQueue->Retire(std::move(character->mesh));
+			retireQueue->Retire(std::move(character->texture));
+		}
+		character->mesh.reset();
+		character->texture.reset();
+		character->clip.reset();
+		freeList.push_back(static_cast<size_t>(character - characterList.data()));
+	}
+
+	/**
+	*キャラクターのアニメーションを進め、描画データを作る
+	*
+	*@param	delta		前回の更新からの経過時間(秒)
+	*@param	matView		ビュー行列
+	*@param	matProj		プロジェクション行列
+	*@param	renderData	描画データの格納先
+	*@param	jobSystem	並列処理に使うジョブシステム(nullptrなら並列化しない)
+	*
+	*クリップのサンプリングと行列パレットの計算は、キャラクター単位で並列に行う
+	*/
+	void Buffer::Update(double delta, const glm::mat4& matView, const glm::mat4& matProj,
+		RenderData& renderData, JobSystem* jobSystem)
+	{
+		updateList.clear();
+		for (Character& e : characterList)
+		{
+			if (e.isActive)
+			{
+				updateList.push_back(&e);
+			}
+		}
+
+		//各キャラクターの行列パレットと出力頂点の位置を決める
+		renderData.mode = mode;
+		renderData.drawList.resize(updateList.size());
+		//SkinToStreamが二分探索できるよう、出力先の位置は描画命令の順に増えるようにする
+		//(区画に収まらなくなったら、以降のキャラクターはすべてCPUスキニングの対象外にする)
+		size_t paletteCount = 0;
+		size_t vertexCount = 0;
+		bool isSegmentFull = false;
+		for (size_t i = 0; i < updateList.size(); ++i)
+		{
+			const Character& e = *updateList[i];
+			DrawPacket& packet = renderData.drawList[i];
+			packet.mesh = e.mesh.get();
+			if (e.texture)
+			{
+				e.texture->MarkUsed();
+			}
+			packet.texture = e.texture ? e.texture->Id() : 0;
+			packet.textureTarget = e.texture ? e.texture->Target() : GL_TEXTURE_2D;
+			packet.vertexData.textureLayer = glm::ivec4(e.texture ? e.texture->Layer() : 0, 0, 0, 0);
+			packet.paletteOffset = paletteCount;
+			packet.vertexOffset = vertexCount;
+			paletteCount += e.mesh->skeleton.boneList.size();
+			if (!isSegmentFull && vertexCount + e.mesh->skinVertexList.size() <= segmentVertexCount)
+			{
+				vertexCount += e.mesh->skinVertexList.size();
+			}
+			else
+			{
+				isSegmentFull = true;
+				packet.vertexOffset = segmentVertexCount;
+			}
+		}
+		renderData.skinnedVertexCount = vertexCount;
+		renderData.paletteList.resize(paletteCount);
+
+		const glm::mat4 matVP = matProj * matView;
+		PaletteMatrix* const palette = renderData.paletteList.data();
+		DrawPacket* const packet = renderData.drawList.data();
+		ParallelForSkeletal(jobSystem, updateList.size(), 1,
+			[this, delta, &matVP, palette, packet](size_t begin, size_t end) {
+			std::vector<Transform> pose(maxBoneCount);
+			std::vector<glm::mat4> matGlobal(maxBoneCount);
+			for (size_t i = begin; i < end; ++i)
+			{
+				Character& e = *updateList[i];
+				const Skeleton& skeleton = e.mesh->skeleton;
+				e.time += delta * e.speed;
+				if (e.clip && e.clip->BoneCount() == skeleton.boneList.size())
+				{
+					e.clip->Sample(e.time, e.isLoop, pose.data());
+				}
+				else
+				{
+					for (size_t bone = 0; bone < skeleton.boneList.size(); ++bone)
+					{
+						pose[bone] = skeleton.boneList[bone].bindPose;
+					}
+				}
+				CalcPalette(skeleton, pose.data(), matGlobal.data(), palette + packet[i].paletteOffset);
+
+				Uniform::VertexData& data = packet[i].vertexData;
+				const glm::mat4 matR = glm::mat4_cast(e.rotation);
+				data.matModel = glm::translate(glm::mat4(), e.position) * matR * glm::scale(glm::mat4(), e.scale);
+				data.matNormal = matR;
+				data.matMVP = matVP * data.matModel;
+				data.color = e.color;
+			}
+		});
+	}
+
+	/**
+	*CPUスキニングの結果をストリーミングVBOに書き込む
+	*
+	*@param	renderData	描画データ
+	*@param	dst			マップした区画の先頭
+	*@param	jobSystem	並列処理に使うジョブシステム(nullptrなら並列化しない)
+	*
+	*出力先の頂点範囲を一定数ごとに区切ってジョブにする
+	*大きなメッシュは複数のジョブに、小さなメッシュは1つのジョブにまとめて処理される
+	*/
+	void Buffer::SkinToStream(const RenderData& renderData, SkinnedVertex* dst, JobSystem* jobSystem)
+	{
+		static const size_t verticesPerJob = 4096;
+		const size_t jobCount = (renderData.skinnedVertexCount + verticesPerJob - 1) / verticesPerJob;
+		const DrawPacket* const packetBegin = renderData.drawList.data();
+		const DrawPacket* const packetEnd = packetBegin + renderData.drawList.size();
+		const PaletteMatrix* const palette = renderData.paletteList.data();
+		const size_t totalCount = renderData.skinnedVertexCount;
+		ParallelForSkeletal(jobSystem, jobCount, 1,
+			[packetBegin, packetEnd, palette, totalCount, dst](size_t begin, size_t end) {
+			const size_t rangeBegin = begin * verticesPerJob;
+			const size_t rangeEnd = std::min(end * verticesPerJob, totalCount);
+			//範囲の先頭を含む描画命令を探す
+			const DrawPacket* p = std::upper_bound(packetBegin, packetEnd, rangeBegin,
+				[](size_t offset, const DrawPacket& e) { return offset < e.vertexOffset; });
+			if (p != packetBegin)
+			{
+				--p;
+			}
+			for (; p != packetEnd && p->vertexOffset < rangeEnd; ++p)
+			{
+				const size_t meshEnd = p->vertexOffset + p->mesh->VertexCount();
+				const size_t first = std::max(p->vertexOffset, rangeBegin);
+				const size_t last = std::min(meshEnd, rangeEnd);
+				if (first >= last)
+				{
+					continue;
+				}
+				SkinVertices(p->mesh->skinVertexList.data() + (first - p->vertexOffset), last - first,
+					palette + p->paletteOffset, dst + first);
+			}
+		});
+	}
+
+	/**
+	*キャラクターを描画する
+	*
+	*@param	renderData	Updateで作成した描画データ
+	*@param	progCpu		CPUスキニングした頂点の描画に使うシェーダ
+	*@param	progGpu		GPUスキニングに使うシェーダ
+	*@param	jobSystem	CPUスキニングに使うジョブシステム(nullptrなら並列化しない)
+	*
+	*CPUスキニングでは、ストリーミングVBOを3つの区画に分けて順番に使う
+	*GPUが読み終わるまで区画を再利用しないよう、区画ごとにフェンスで待つ
+	*/
+	void Buffer::Draw(const RenderData& renderData, const Shader::ProgramPtr& progCpu,
+		const Shader::ProgramPtr& progGpu, JobSystem* jobSystem)
+	{
+		const size_t count = renderData.drawList.size();
+		if (count == 0)
+		{
+			return;
+		}
+
+		//全キャラクターのパラメータをまとめて転送する
+		const bool isGpu = renderData.mode == SkinningMode::Gpu;
+		uboStaging.resize(count * vertexDataStride);
+		for (size_t i = 0; i < count; ++i)
+		{
+			memcpy(&uboStaging[i * vertexDataStride], &renderData.drawList[i].vertexData,
+				sizeof(Uniform::VertexData));
+		}
+		uboVertexData->BufferSubData(uboStaging.data(), 0, count * vertexDataStride);
+		if (isGpu)
+		{
+			uboStaging.resize(count * paletteStride);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const DrawPacket& e = renderData.drawList[i];
+				memcpy(&uboStaging[i * paletteStride], &renderData.paletteList[e.paletteOffset],
+					e.mesh->skeleton.boneList.size() * sizeof(PaletteMatrix));
+			}
+			uboPalette->BufferSubData(uboStaging.data(), 0, count * paletteStride);
+		}
+
+		GLintptr segmentOffset = 0;
+		const int segment = currentSegment;
+		if (!isGpu && renderData.skinnedVertexCount > 0)
+		{
+			currentSegment = (currentSegment + 1) % streamSegmentCount;
+			if (fenceList[segment])
+			{
+				glClientWaitSync(fenceList[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				glDeleteSync(fenceList[segment]);
+				fenceList[segment] = 0;
+			}
+			segmentOffset = segment * segmentVertexCount * sizeof(SkinnedVertex);
+			glBindBuffer(GL_ARRAY_BUFFER, streamVbo);
+			void* p = glMapBufferRange(GL_ARRAY_BUFFER, segmentOffset,
+				renderData.skinnedVertexCount * sizeof(SkinnedVertex),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (!p)
+			{
+				std::cerr << "ERROR: ストリーミングVBOのマップに失敗" << std::endl;
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+				return;
+			}
+			SkinToStream(renderData, static_cast<SkinnedVertex*>(p), jobSystem);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		const Shader::ProgramPtr& program = isGpu ? progGpu : progCpu;
+		program->UseProgram();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const DrawPacket& e = renderData.drawList[i];
+			if (!e.texture)
+			{
+				continue;
+			}
+			if (isGpu)
+			{
+				glBindVertexArray(e.mesh->gpuVao);
+				uboPalette->BindBufferRange(i * paletteStride, paletteStride);
+			}
+			else
+			{
+				if (e.vertexOffset >= segmentVertexCount)
+				{
+					continue;
+				}
+				glBindVertexArray(e.mesh->cpuVao);
+				glBindBuffer(GL_ARRAY_BUFFER, streamVbo);
+				const GLintptr offset = segmentOffset + e.vertexOffset * sizeof(SkinnedVertex);
+				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex),
+					reinterpret_cast<GLvoid*>(offset + offsetof(SkinnedVertex, position)));
+				glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex),
+					reinterpret_cast<GLvoid*>(offset + offsetof(SkinnedVertex, normal)));
+			}
+			program->BindTexture(GL_TEXTURE0, e.textureTarget, e.texture);
+			uboVertexData->BindBufferRange(i * vertexDataStride, sizeof(Uniform::VertexData));
+			for (const SkinnedMesh::Material& m : e.mesh->materialList)
+			{
+				glDrawElements(GL_TRIANGLES, m.count, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid*>(m.offset));
+			}
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (!isGpu && renderData.skinnedVertexCount > 0)
+		{
+			fenceList[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+	}
+
+	/**
+	*スキンメッシュとアニメーションクリップの読み込み結果を出力する
+	*
+	*@param	os	出力先
+	*
+	*クリップごとに、キーの削減数と圧縮後のバイト数、圧縮による最大誤差を表示する
+	*/
+	void DumpImportStats(std::ostream& os)
+	{
+		std::lock_guard<std::mutex> lock(importRecordMutex);
+		os << "Skinned mesh import:" << std::endl;
+		for (const ImportRecord& e : importRecordList)
+		{
+			os << "  " << e.filename << ": bones " << e.boneCount << ", vertices " << e.vertexCount <<
+				", clips " << e.clipCount << std::endl;
+		}
+		for (const ClipRecord& e : clipRecordList)
+		{
+			const CompressionStats& s = e.stats;
+			os << "  clip " << e.name << ": frames " << e.frameCount << ", keys " << s.keyCount << '/' <<
+				s.rawKeyCount << ", " << s.rawBytes / 1024 << "KB -> " << s.compressedBytes / 1024 <<
+				"KB (x" << s.ratio << "), max error t=" << s.maxTranslationError << " r=" <<
+				s.maxRotationError << " s=" << s.maxScaleError << std::endl;
+		}
+	}
+
+	/**
+	*スキニングの速度を計測して出力する
+	*
+	*@param	os			出力先
+	*@param	jobSystem	並列処理の計測に使うジョブシステム(nullptrなら並列の計測を省く)
+	*
+	*GPUを使わず、合成したメッシュとランダムな行列パレットでCPUスキニングだけを計測する
+	*参照実装、SIMD(1スレッド)、SIMD(ジョブシステム)の順に、1ミリ秒あたりの頂点数を表示する
+	*/
+	void RunSkinningBenchmark(std::ostream& os, JobSystem* jobSystem)
+	{
+		static const size_t characterCount = 64;
+		static const size_t vertexCount = 8192;
+		static const size_t boneCount = 64;
+		static const int iteration = 10;
+
+		//頂点と影響するボーンを決まった規則で作る
+		Memory::Vector<SkinVertex, Memory::Tag::Animation> source(vertexCount);
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			SkinVertex& v = source[i];
+			const float t = static_cast<float>(i) / vertexCount;
+			v.position = glm::vec4(sinf(t * 50.0f), t * 2.0f - 1.0f, cosf(t * 50.0f), 1);
+			v.normal = glm::vec4(glm::normalize(glm::vec3(v.position.x, 0.2f, v.position.z)), 0);
+			for (int n = 0; n < maxInfluenceCount; ++n)
+			{
+				v.bone[n] = static_cast<uint16_t>((i / 64 + n * 7) % boneCount);
+			}
+			v.weight = glm::vec4(0.4f, 0.3f, 0.2f, 0.1f);
+		}
+		Memory::Vector<PaletteMatrix, Memory::Tag::Animation> palette(boneCount * characterCount);
+		for (size_t i = 0; i < palette.size(); ++i)
+		{
+			const float angle = static_cast<float>(i) * 0.1f;
+			const glm::mat4 m = glm::translate(glm::mat4(), glm::vec3(angle, 0, 1)) *
+				glm::mat4_cast(glm::angleAxis(angle, glm::vec3(0, 1, 0)));
+			palette[i] = PaletteMatrix(glm::transpose(m));
+		}
+		Memory::Vector<SkinnedVertex, Memory::Tag::Animation> result(vertexCount * characterCount);
+		Memory::Vector<SkinnedVertex, Memory::Tag::Animation> reference(vertexCount * characterCount);
+
+		//全キャラクターを1回スキニングする時間の最小値を計測する
+		const auto measure = [](const std::function<void()>& func) {
+			double best = 1e9;
+			for (int i = 0; i < iteration; ++i)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				func();
+				const std::chrono::duration<double, std::milli> elapsed =
+					std::chrono::steady_clock::now() - start;
+				best = std::min(best, elapsed.count());
+			}
+			return best;
+		};
+		const double totalVertices = static_cast<double>(vertexCount * characterCount);
+		const double referenceTime = measure([&]() {
+			for (size_t i = 0; i < characterCount; ++i)
+			{
+				SkinVerticesReference(source.data(), vertexCount, &palette[i * boneCount],
+					&reference[i * vertexCount]);
+			}
+		});
+		const double simdTime = measure([&]() {
+			for (size_t i = 0; i < characterCount; ++i)
+			{
+				SkinVertices(source.data(), vertexCount, &palette[i * boneCount], &result[i * vertexCount]);
+			}
+		});
+		float maxError = 0;
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			maxError = std::max(maxError, glm::length(result[i].position - reference[i].position));
+			maxError = std::max(maxError, glm::length(result[i].normal - reference[i].normal));
+		}
+
+		os << "Skinning benchmark (" << characterCount << " characters x " << vertexCount <<
+			" vertices, " << boneCount << " bones)\n" << std::fixed << std::setprecision(1);
+		os << "  reference   : " << std::setw(10) << totalVertices / referenceTime << " vertices/ms\n";
+		os << "  simd        : " << std::setw(10) << totalVertices / simdTime << " vertices/ms\n";
+		if (jobSystem)
+		{
+			static const size_t verticesPerJob = 4096;
+			const size_t jobsPerCharacter = (vertexCount + verticesPerJob - 1) / verticesPerJob;
+			const double parallelTime = measure([&]() {
+				jobSystem->ParallelFor(characterCount * jobsPerCharacter, 1, [&](size_t begin, size_t end) {
+					for (size_t job = begin; job < end; ++job)
+					{
+						const size_t character = job / jobsPerCharacter;
+						const size_t first = (job % jobsPerCharacter) * verticesPerJob;
+						const size_t count = std::min(verticesPerJob, vertexCount - first);
+						SkinVertices(source.data() + first, count, &palette[character * boneCount],
+							&result[character * vertexCount + first]);
+					}
+				});
+			});
+			os << "  simd + jobs : " << std::setw(10) << totalVertices / parallelTime << " vertices/ms\n";
+		}
+		os << std::defaultfloat << "  max error   : " << maxError << std::endl;
+	}
+}
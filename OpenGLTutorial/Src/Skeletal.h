@@ -0,0 +1,293 @@
+/**
+*	@file Skeletal.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include "Asset.h"
+#include "Texture.h"
+#include "Shader.h"
+#include "UniformBuffer.h"
+#include "RetireQueue.h"
+#include "Uniform.h"
+#include "Memory.h"
+#include "AnimationClip.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iosfwd>
+#include <stdint.h>
+
+class JobSystem;
+
+/**
+*	スケルタルアニメーションのための名前空間
+*/
+namespace Skeletal
+{
+	class SkinnedMesh;
+	class Character;
+	class Buffer;
+	struct SkinLoader;
+	typedef std::shared_ptr<SkinnedMesh> SkinnedMeshPtr;	///<スキンメッシュポインタ型
+	typedef std::shared_ptr<Buffer> BufferPtr;	///<スキンメッシュバッファポインタ型
+
+	//1つのスケルトンが持てるボーンの最大数(GPUスキニングのUBOの大きさで決まる)
+	static const int maxBoneCount = 256;
+	//1頂点に影響するボーンの最大数
+	static const int maxInfluenceCount = 4;
+
+	/**
+	*	スキニングを行う場所
+	*/
+	enum class SkinningMode
+	{
+		Cpu,	///<ワーカースレッドで頂点を変形し、ストリーミングVBOに書き込む
+		Gpu,	///<行列パレットをUBOに転送し、頂点シェーダで変形する
+	};
+
+	/**
+	*	ボーン
+	*/
+	struct Bone
+	{
+		std::string name;	///<ボーン名
+		int parent = -1;	///<親ボーンの番号(ルートなら-1)
+		glm::mat4 matInverseBindPose = glm::mat4(1);	///<バインドポーズの逆行列
+		Transform bindPose;	///<バインドポーズの姿勢
+	};
+
+	/**
+	*	スケルトン
+	*
+	*	boneListは親が必ず子より前に並ぶ
+	*/
+	struct Skeleton
+	{
+		int FindBone(const std::string& name) const;
+
+		std::vector<Bone> boneList;	///<ボーンのリスト
+	};
+
+	/**
+	*	スキニングの入力頂点(バインドポーズ)
+	*
+	*	GPUスキニングではこのままVBOに転送して使う
+	*	行列との積を分岐なしで計算できるよう、座標のwは1、法線のwは0にしておく
+	*/
+	struct SkinVertex
+	{
+		glm::vec4 position;	///<座標(w=1)
+		glm::vec4 normal;	///<法線(w=0)
+		glm::vec4 weight;	///<各ボーンの影響度(合計1に正規化済み)
+		uint16_t bone[maxInfluenceCount];	///<影響するボーンの番号
+	};
+
+	/**
+	*	CPUスキニングの出力頂点
+	*
+	*	SIMDでまとめて書き込めるよう、座標と法線を16バイトずつにしている
+	*/
+	struct SkinnedVertex
+	{
+		glm::vec4 position;	///<座標(wは未使用)
+		glm::vec4 normal;	///<法線(wは未使用)
+	};
+
+	/**
+	*	スキニングしない頂点要素
+	*/
+	struct VertexAttribute
+	{
+		glm::vec4 color;	///<色
+		glm::vec2 texCoord;	///<テクスチャ座標
+	};
+
+	/**
+	*	行列パレットの要素
+	*
+	*	アフィン変換行列の転置の上3行で、各列が変換行列の各行になる
+	*	GLSLのmat3x4と同じ並びなので、そのままUBOに転送できる
+	*/
+	typedef glm::mat3x4 PaletteMatrix;
+
+	void CalcPalette(const Skeleton& skeleton, const Transform* pose, glm::mat4* matGlobal,
+		PaletteMatrix* palette);
+	void SkinVertices(const SkinVertex* src, size_t count, const PaletteMatrix* palette,
+		SkinnedVertex* dst);
+	void SkinVerticesReference(const SkinVertex* src, size_t count, const PaletteMatrix* palette,
+		SkinnedVertex* dst);
+
+	/**
+	*	スキンメッシュ
+	*
+	*	頂点データとスケルトン、アニメーションクリップを持ち、複数のキャラクターで共有する
+	*/
+	class SkinnedMesh
+	{
+		friend class Buffer;
+		friend struct SkinLoader;
+	public:
+		/**
+		*	マテリアル
+		*/
+		struct Material
+		{
+			GLsizei count;	///<描画するインデックス数
+			GLintptr offset;	///<描画開始インデックスのバイトオフセット
+			glm::vec4 color;	///<マテリアルの色
+		};
+
+		const std::string& Name() const { return name; }
+		const Skeleton& GetSkeleton() const { return skeleton; }
+		size_t VertexCount() const { return skinVertexList.size(); }
+		size_t ClipCount() const { return clipList.size(); }
+		const ClipPtr& GetClip(size_t index) const { return clipList[index]; }
+		ClipPtr FindClip(const std::string& clipName) const;
+
+	private:
+		SkinnedMesh() = default;
+		~SkinnedMesh();
+		SkinnedMesh(const SkinnedMesh&) = delete;
+		SkinnedMesh& operator = (const SkinnedMesh&) = delete;
+
+	private:
+		std::string name;	///<メッシュ名(ファイル名)
+		Skeleton skeleton;	///<スケルトン
+		std::vector<ClipPtr> clipList;	///<アニメーションクリップのリスト
+		Memory::Vector<SkinVertex, Memory::Tag::Animation> skinVertexList;	///<CPUスキニングの入力
+		Memory::Vector<VertexAttribute, Memory::Tag::Animation> attributeList;	///<GPUに転送するまでの頂点要素
+		Memory::Vector<uint32_t, Memory::Tag::Animation> indexList;	///<GPUに転送するまでのインデックス
+		std::vector<Material> materialList;	///<マテリアルのリスト
+		GLuint bindPoseVbo = 0;	///<SkinVertexを格納するVBO(GPUスキニング用)
+		GLuint attributeVbo = 0;	///<色とテクスチャ座標を格納するVBO(共通)
+		GLuint ibo = 0;	///<インデックスデータを格納するIBO
+		GLuint cpuVao = 0;	///<CPUスキニング用VAO(座標と法線は描画のたびに設定する)
+		GLuint gpuVao = 0;	///<GPUスキニング用VAO
+	};
+
+	/**
+	*	スキンメッシュを表示するキャラクター
+	*/
+	class Character
+	{
+		friend class Buffer;
+	public:
+		void Position(const glm::vec3& v) { position = v; }
+		const glm::vec3& Position() const { return position; }
+		void Rotation(const glm::quat& q) { rotation = q; }
+		const glm::quat& Rotation() const { return rotation; }
+		void Scale(const glm::vec3& v) { scale = v; }
+		const glm::vec3& Scale() const { return scale; }
+		void Color(const glm::vec4& c) { color = c; }
+		const glm::vec4& Color() const { return color; }
+		void Speed(float s) { speed = s; }
+		float Speed() const { return speed; }
+		double Time() const { return time; }
+
+		void Play(const ClipPtr& clip, bool loop = true, double startTime = 0);
+		void Destroy();
+
+	private:
+		Buffer* pBuffer = nullptr;	///<生成元のバッファ
+		SkinnedMeshPtr mesh;	///<表示するスキンメッシュ
+		TexturePtr texture;	///<表示に使うテクスチャ
+		ClipPtr clip;	///<再生中のクリップ(nullptrならバインドポーズ)
+		double time = 0;	///<再生位置(秒)
+		float speed = 1;	///<再生速度
+		bool isLoop = true;	///<ループ再生するならtrue
+		glm::vec3 position = glm::vec3(0);	///<座標
+		glm::quat rotation;	///<回転
+		glm::vec3 scale = glm::vec3(1);	///<拡大率
+		glm::vec4 color = glm::vec4(1);	///<色
+		bool isActive = false;	///<使用中ならtrue
+	};
+
+	/**
+	*	描画スレッドに渡すキャラクター1体分の描画命令
+	*/
+	struct DrawPacket
+	{
+		const SkinnedMesh* mesh;	///<描画するメッシュ
+		GLuint texture;	///<描画に使うテクスチャ
+		GLenum textureTarget;	///<テクスチャの種類
+		size_t paletteOffset;	///<RenderData::paletteList内の行列パレットの位置
+		size_t vertexOffset;	///<ストリーミングVBOの区画内の出力先頂点番号(CPUスキニング用)
+		Uniform::VertexData vertexData;	///<頂点シェーダのパラメータ
+	};
+
+	/**
+	*	1フレーム分のスキンメッシュの描画データ
+	*/
+	struct RenderData
+	{
+		SkinningMode mode = SkinningMode::Cpu;	///<スキニングを行う場所
+		size_t skinnedVertexCount = 0;	///<CPUスキニングで書き込む頂点数
+		Memory::Vector<PaletteMatrix, Memory::Tag::Animation> paletteList;	///<全キャラクターの行列パレット
+		Memory::Vector<DrawPacket, Memory::Tag::Animation> drawList;	///<描画命令の配列
+	};
+
+	/**
+	*	スキンメッシュとキャラクターを管理するバッファ
+	*
+	*	UploadとDrawは描画スレッド、AddMeshやAddCharacter、Updateはシミュレーションスレッドから呼び出す
+	*	ImportFromFileはGLの関数を呼び出さないので、ワーカースレッドから呼び出してもよい
+	*/
+	class Buffer
+	{
+	public:
+		static BufferPtr Create(size_t maxCharacterCount, size_t maxSkinnedVertexCount,
+			GLuint vertexDataBindingPoint, GLuint paletteBindingPoint);
+
+		static SkinnedMeshPtr ImportFromFile(const char* filename);
+		bool Upload(const SkinnedMeshPtr& mesh);
+		Asset::Handle AddMesh(const SkinnedMeshPtr& mesh);
+		bool LoadFromFile(const char* filename);
+		const SkinnedMeshPtr& GetMesh(Asset::Name name) const;
+		Character* AddCharacter(const SkinnedMeshPtr& mesh, const TexturePtr& texture,
+			const glm::vec3& position);
+		void RemoveCharacter(Character* character);
+		void SetRetireQueue(RetireQueue* queue) { retireQueue = queue; }
+		void Mode(SkinningMode m) { mode = m; }
+		SkinningMode Mode() const { return mode; }
+
+		void Update(double delta, const glm::mat4& matView, const glm::mat4& matProj,
+			RenderData& renderData, JobSystem* jobSystem = nullptr);
+		void Draw(const RenderData& renderData, const Shader::ProgramPtr& progCpu,
+			const Shader::ProgramPtr& progGpu, JobSystem* jobSystem = nullptr);
+
+	private:
+		Buffer() = default;
+		~Buffer();
+		Buffer(const Buffer&) = delete;
+		Buffer& operator = (const Buffer&) = delete;
+
+		void SkinToStream(const RenderData& renderData, SkinnedVertex* dst, JobSystem* jobSystem);
+
+	private:
+		//ストリーミングVBOの区画数(GPUが前の区画を読んでいる間に次の区画へ書き込む)
+		static const int streamSegmentCount = 3;
+
+		Asset::Registry<SkinnedMeshPtr> meshList;	///<スキンメッシュのリスト
+		std::vector<Character> characterList;	///<キャラクターの配列(要素数は固定)
+		std::vector<size_t> freeList;	///<未使用のキャラクターの番号
+		std::vector<Character*> updateList;	///<Updateで処理するキャラクター
+		SkinningMode mode = SkinningMode::Cpu;	///<スキニングを行う場所
+		RetireQueue* retireQueue = nullptr;	///<削除したキャラクターのメッシュとテクスチャを描画スレッドで手放す
+
+		//以下は描画スレッドから使う
+		GLuint streamVbo = 0;	///<CPUスキニングの出力先
+		size_t segmentVertexCount = 0;	///<ストリーミングVBOの1区画の頂点数
+		int currentSegment = 0;	///<次に書き込む区画
+		GLsync fenceList[streamSegmentCount] = {};	///<各区画を使う描画の完了を待つためのフェンス
+		UniformBufferPtr uboVertexData;	///<キャラクターごとの頂点シェーダのパラメータ
+		UniformBufferPtr uboPalette;	///<キャラクターごとの行列パレット(GPUスキニング用)
+		GLsizeiptr vertexDataStride = 0;	///<uboVertexData内のキャラクター1体分のバイト数
+		GLsizeiptr paletteStride = 0;	///<uboPalette内のキャラクター1体分のバイト数
+		std::vector<uint8_t> uboStaging;	///<UBOに転送するデータを組み立てる作業領域
+	};
+
+	void DumpImportStats(std::ostream& os);
+	void RunSkinningBenchmark(std::ostream& os, JobSystem* jobSystem);
+}
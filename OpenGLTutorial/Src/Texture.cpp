@@ -2,21 +2,30 @@
 *@file Texture.cpp
 */
 #include "Texture.h"
+#include "Memory.h"
+#include "MappedFile.h"
+#include "ImageDecoder.h"
 #include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
 
 #include <vector>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
 #include <sys/stat.h>
 
 /**
-*oCg񂩂琔l𕜌
+*バイト列から数値を復元する
 *
-*@param	p		oCgւ̃|C^
-*@param	offset	l̃ItZbg
-*@param	size	l̃oCg(1~4)
+*@param	p		バイト列へのポインタ
+*@param	offset	数値のオフセット
+*@param	size	数値のバイト数(1~4)
 *
-*@return	l
+*@return	復元した数値
 */
 uint32_t Get(const uint8_t* p, size_t offset,size_t size)
 {
@@ -30,7 +39,620 @@ uint32_t Get(const uint8_t* p, size_t offset,size_t size)
 }
 
 /**
-*RXgN^
+*バイト列から64bitの数値を復元する
+*
+*@param	p		バイト列へのポインタ
+*@param	offset	数値のオフセット
+*
+*@return	復元した数値
+*/
+uint64_t Get64(const uint8_t* p, size_t offset)
+{
+	return Get(p, offset, 4) | (uint64_t(Get(p, offset + 4, 4)) << 32);
+}
+
+/**
+*BCn圧縮形式の4x4ブロック1つのバイト数を取得する
+*
+*@param	iformat	テクスチャのデータ形式
+*
+*@return ブロックのバイト数
+*		圧縮形式でなければ0
+*/
+size_t GetBlockBytes(GLenum iformat)
+{
+	switch (iformat)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+		return 8;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_RG_RGTC2:
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+/**
+*ミップマップ1段分の圧縮データのバイト数を計算する
+*
+*@param	width		その段の幅
+*@param	height		その段の高さ
+*@param	blockBytes	ブロックのバイト数
+*
+*@return バイト数
+*/
+size_t GetCompressedLevelSize(int width, int height, size_t blockBytes)
+{
+	return size_t((width + 3) / 4) * size_t((height + 3) / 4) * blockBytes;
+}
+
+/**
+*圧縮データの各段の位置を設定する
+*
+*@param	image		幅、高さ、形式、段数を設定済みの画像データ
+*@param	dataOffset	最初の段の位置(段が隙間なく並んでいる場合だけ使う)
+*
+*@retval true	全段がbufferに収まっている
+*@retval false	ファイルが途中で切れている
+*/
+bool SetupPackedLevels(Texture::Image& image, size_t dataOffset)
+{
+	const size_t blockBytes = GetBlockBytes(image.iformat);
+	size_t offset = dataOffset;
+	for (int i = 0; i < image.levelCount; ++i)
+	{
+		const int w = std::max(1, image.width >> i);
+		const int h = std::max(1, image.height >> i);
+		image.levelList[i].offset = offset;
+		image.levelList[i].size = GetCompressedLevelSize(w, h, blockBytes);
+		offset += image.levelList[i].size;
+	}
+	return offset <= image.Size();
+}
+
+/**
+*完全なミップマップの段数を計算する
+*
+*@param	width	幅
+*@param	height	高さ
+*
+*@return 1x1までの段数(Texture::maxLevelCountを超えない)
+*/
+int GetFullLevelCount(int width, int height)
+{
+	int count = 1;
+	for (int size = std::max(width, height); size > 1 && count < Texture::maxLevelCount; size /= 2)
+	{
+		++count;
+	}
+	return count;
+}
+
+/**
+*テクスチャのパラメーターを設定する
+*
+*@param	target		テクスチャの種類
+*@param	levelCount	ミップマップの段数
+*@param	iformat		テクスチャのデータ形式
+*
+*GL_R8(8bitグレースケールのBMP)は、赤の値をRGBすべてに振り分けて読み出すようにする
+*/
+void SetTextureParameters(GLenum target, int levelCount, GLenum iformat)
+{
+	if (iformat == GL_R8)
+	{
+		static const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+/**
+*BMPファイルの内容を解析する
+*
+*@param	image	fileにファイルをマップした画像データ
+*
+*@retval true	解析成功
+*@retval false	対応していない形式か、壊れている
+*
+*8bit(パレット),24bit,32bitの非圧縮形式と、上から下に並んだ(高さが負の)形式に対応する
+*行末の詰め物はGL_UNPACK_ALIGNMENTで読み飛ばすので、画素はマップしたファイルから直接転送できる
+*パレットがグレースケールでない8bit形式だけは、24bitに展開してbufferに格納する
+*/
+bool DecodeBmp(Texture::Image& image)
+{
+	const uint8_t* const pHeader = image.Data();
+	const size_t fileSize = image.Size();
+	const size_t bmpFileHeaderSze = 14;		//ビットマップファイルヘッダのバイト数
+	const size_t windowsV1HeaderSize = 40;	//ビットマップ情報ヘッダのバイト数
+	if (fileSize < bmpFileHeaderSze + windowsV1HeaderSize)
+	{
+		return false;
+	}
+
+	//本当にBMPファイルなのか？
+	if (pHeader[0] != 'B' || pHeader[1] != 'M')
+	{
+		return false;
+	}
+
+	//BMPファイルの情報を取得する
+	const size_t offsetBytes = Get(pHeader, 10, 4);
+	const uint32_t infoSize = Get(pHeader, 14, 4);
+	const int32_t width = static_cast<int32_t>(Get(pHeader, 18, 4));
+	const int32_t height = static_cast<int32_t>(Get(pHeader, 22, 4));
+	const uint32_t bitCount = Get(pHeader, 28, 2);
+	const uint32_t compression = Get(pHeader, 30, 4);
+	const uint32_t colorsUsed = Get(pHeader, 46, 4);
+	const uint32_t biRgb = 0;
+	const uint32_t biBitfields = 3;
+	const uint32_t biAlphaBitfields = 6;
+	if (infoSize < windowsV1HeaderSize || width <= 0 || height == 0 ||
+		(bitCount != 8 && bitCount != 24 && bitCount != 32) ||
+		(compression != biRgb && !(bitCount == 32 && (compression == biBitfields || compression == biAlphaBitfields))))
+	{
+		return false;
+	}
+	const int absHeight = height < 0 ? -height : height;
+
+	//画像データのサイズ検査(各行は4バイト境界に揃えられている)
+	const size_t rowBytes = (width * bitCount / 8 + 3) & ~size_t(3);
+	const size_t imageSize = rowBytes * absHeight;
+	if (fileSize < offsetBytes + imageSize)
+	{
+		return false;
+	}
+
+	image.width = width;
+	image.height = absHeight;
+	image.isTopDown = height < 0;
+	image.alignment = 4;
+	image.rowLength = 0;
+	image.isCompressed = false;
+	image.levelCount = 1;
+	image.levelList[0].offset = offsetBytes;
+	image.levelList[0].size = imageSize;
+	image.offset = offsetBytes;
+	if (bitCount == 24)
+	{
+		image.iformat = GL_RGB8;
+		image.format = GL_BGR;
+		return true;
+	}
+
+	if (bitCount == 32)
+	{
+		//画素の並びはBGRAだけに対応する
+		uint32_t alphaMask = 0;
+		if (compression != biRgb)
+		{
+			if (fileSize < bmpFileHeaderSze + windowsV1HeaderSize + 16 ||
+				Get(pHeader, 54, 4) != 0x00ff0000 || Get(pHeader, 58, 4) != 0x0000ff00 || Get(pHeader, 62, 4) != 0x000000ff)
+			{
+				return false;
+			}
+			if (infoSize >= 56 || compression == biAlphaBitfields)
+			{
+				alphaMask = Get(pHeader, 66, 4);
+			}
+			if (alphaMask != 0 && alphaMask != 0xff000000)
+			{
+				return false;
+			}
+		}
+		image.iformat = alphaMask ? GL_RGBA8 : GL_RGB8;	//アルファがない場合、4バイト目はGLが無視する
+		image.format = GL_BGRA;
+		return true;
+	}
+
+	//8bitはパレットを調べる
+	const size_t paletteOffset = bmpFileHeaderSze + infoSize;
+	const uint32_t paletteCount = colorsUsed ? std::min<uint32_t>(colorsUsed, 256) : 256;
+	if (fileSize < paletteOffset + paletteCount * 4)
+	{
+		return false;
+	}
+	const uint8_t* const palette = pHeader + paletteOffset;
+	bool isGrayscale = true;
+	for (uint32_t i = 0; i < paletteCount && isGrayscale; ++i)
+	{
+		const uint8_t* e = palette + i * 4;
+		isGrayscale = e[0] == i && e[1] == i && e[2] == i;
+	}
+	if (isGrayscale)
+	{
+		image.iformat = GL_R8;
+		image.format = GL_RED;
+		return true;
+	}
+
+	//カラーパレットはGLで扱えないので、BGRに展開する
+	const size_t dstRowBytes = (width * 3 + 3) & ~size_t(3);
+	Memory::Vector<uint8_t, Memory::Tag::Texture> buffer(dstRowBytes * absHeight);
+	for (int y = 0; y < absHeight; ++y)
+	{
+		const uint8_t* src = pHeader + offsetBytes + rowBytes * y;
+		uint8_t* dst = buffer.data() + dstRowBytes * y;
+		for (int x = 0; x < width; ++x, dst += 3)
+		{
+			static const uint8_t black[4] = {};
+			const uint8_t* e = src[x] < paletteCount ? palette + src[x] * 4 : black;
+			dst[0] = e[0];
+			dst[1] = e[1];
+			dst[2] = e[2];
+		}
+	}
+	image.buffer.swap(buffer);
+	image.file.reset();
+	image.iformat = GL_RGB8;
+	image.format = GL_BGR;
+	image.offset = 0;
+	image.levelList[0].offset = 0;
+	image.levelList[0].size = image.buffer.size();
+	return true;
+}
+
+/**
+*DDSファイルの内容を解析する
+*
+*@param	image	fileにファイルをマップした画像データ
+*
+*@retval true	解析成功
+*@retval false	対応していない形式か、壊れている
+*
+*BC1,BC3,BC4,BC5,BC7の2Dテクスチャに対応する(キューブマップ、配列、ボリュームは非対応)
+*sRGB形式は、BMPと同じ見た目になるよう(このプロジェクトはガンマ補正をしていない)UNORMとして扱う
+*/
+bool DecodeDds(Texture::Image& image)
+{
+	const uint8_t* const p = image.Data();
+	const size_t fileSize = image.Size();
+	const size_t headerSize = 4 + 124;
+	const size_t dx10HeaderSize = 20;
+	if (fileSize < headerSize || memcmp(p, "DDS ", 4) != 0 || Get(p, 4, 4) != 124)
+	{
+		return false;
+	}
+	const uint32_t flags = Get(p, 8, 4);
+	const uint32_t height = Get(p, 12, 4);
+	const uint32_t width = Get(p, 16, 4);
+	const uint32_t depth = Get(p, 24, 4);
+	const uint32_t mipMapCount = Get(p, 28, 4);
+	const uint32_t pixelFlags = Get(p, 80, 4);
+	const uint32_t caps2 = Get(p, 112, 4);
+	const uint32_t ddsdMipMapCount = 0x20000;
+	const uint32_t ddpfFourCC = 0x4;
+	const uint32_t ddscaps2Cubemap = 0x200;
+	const uint32_t ddscaps2Volume = 0x200000;
+	if (!(pixelFlags & ddpfFourCC) || (caps2 & (ddscaps2Cubemap | ddscaps2Volume)) || depth > 1 ||
+		width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	size_t dataOffset = headerSize;
+	GLenum iformat = GL_NONE;
+	const char* fourCC = reinterpret_cast<const char*>(p + 84);
+	if (memcmp(fourCC, "DXT1", 4) == 0)
+	{
+		iformat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	}
+	else if (memcmp(fourCC, "DXT5", 4) == 0)
+	{
+		iformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	else if (memcmp(fourCC, "ATI1", 4) == 0 || memcmp(fourCC, "BC4U", 4) == 0)
+	{
+		iformat = GL_COMPRESSED_RED_RGTC1;
+	}
+	else if (memcmp(fourCC, "ATI2", 4) == 0 || memcmp(fourCC, "BC5U", 4) == 0)
+	{
+		iformat = GL_COMPRESSED_RG_RGTC2;
+	}
+	else if (memcmp(fourCC, "DX10", 4) == 0)
+	{
+		if (fileSize < headerSize + dx10HeaderSize)
+		{
+			return false;
+		}
+		const uint32_t dxgiFormat = Get(p, headerSize, 4);
+		const uint32_t dimension = Get(p, headerSize + 4, 4);
+		const uint32_t miscFlag = Get(p, headerSize + 8, 4);
+		const uint32_t arraySize = Get(p, headerSize + 12, 4);
+		const uint32_t dimensionTexture2D = 3;
+		const uint32_t miscTextureCube = 0x4;
+		if (dimension != dimensionTexture2D || (miscFlag & miscTextureCube) || arraySize > 1)
+		{
+			return false;
+		}
+		switch (dxgiFormat)
+		{
+		case 71: case 72: iformat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;	//BC1_UNORM(_SRGB)
+		case 77: case 78: iformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;	//BC3_UNORM(_SRGB)
+		case 80: iformat = GL_COMPRESSED_RED_RGTC1; break;	//BC4_UNORM
+		case 83: iformat = GL_COMPRESSED_RG_RGTC2; break;	//BC5_UNORM
+		case 98: case 99: iformat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;	//BC7_UNORM(_SRGB)
+		default: return false;
+		}
+		dataOffset += dx10HeaderSize;
+	}
+	else
+	{
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.iformat = iformat;
+	image.format = GL_NONE;
+	image.isCompressed = true;
+	image.levelCount = (flags & ddsdMipMapCount) && mipMapCount > 0 ? mipMapCount : 1;
+	image.levelCount = std::min(image.levelCount, GetFullLevelCount(width, height));
+	image.offset = dataOffset;
+	return SetupPackedLevels(image, dataOffset);
+}
+
+/**
+*KTX2ファイルの内容を解析する
+*
+*@param	image	fileにファイルをマップした画像データ
+*
+*@retval true	解析成功
+*@retval false	対応していない形式か、壊れている
+*
+*BC1,BC3,BC4,BC5,BC7の2Dテクスチャで、超圧縮(supercompression)していないものに対応する
+*/
+bool DecodeKtx2(Texture::Image& image)
+{
+	static const uint8_t identifier[12] = {
+		0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+	const uint8_t* const p = image.Data();
+	const size_t fileSize = image.Size();
+	const size_t headerSize = 80;
+	const size_t levelIndexSize = 24;
+	if (fileSize < headerSize || memcmp(p, identifier, sizeof(identifier)) != 0)
+	{
+		return false;
+	}
+	const uint32_t vkFormat = Get(p, 12, 4);
+	const uint32_t width = Get(p, 20, 4);
+	const uint32_t height = Get(p, 24, 4);
+	const uint32_t depth = Get(p, 28, 4);
+	const uint32_t layerCount = Get(p, 32, 4);
+	const uint32_t faceCount = Get(p, 36, 4);
+	const uint32_t levelCount = std::max<uint32_t>(1, Get(p, 40, 4));
+	const uint32_t supercompression = Get(p, 44, 4);
+	if (width == 0 || height == 0 || depth > 0 || layerCount > 1 || faceCount != 1 || supercompression != 0 ||
+		fileSize < headerSize + levelIndexSize * levelCount)
+	{
+		return false;
+	}
+	GLenum iformat = GL_NONE;
+	switch (vkFormat)
+	{
+	case 131: case 132: iformat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;	//BC1_RGB_UNORM(SRGB)
+	case 133: case 134: iformat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;	//BC1_RGBA_UNORM(SRGB)
+	case 137: case 138: iformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;	//BC3_UNORM(SRGB)
+	case 139: iformat = GL_COMPRESSED_RED_RGTC1; break;	//BC4_UNORM
+	case 141: iformat = GL_COMPRESSED_RG_RGTC2; break;	//BC5_UNORM
+	case 145: case 146: iformat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;	//BC7_UNORM(SRGB)
+	default: return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.iformat = iformat;
+	image.format = GL_NONE;
+	image.isCompressed = true;
+	image.levelCount = std::min<int>(levelCount, GetFullLevelCount(width, height));
+	const size_t blockBytes = GetBlockBytes(iformat);
+	for (int i = 0; i < image.levelCount; ++i)
+	{
+		//レベルインデックスは大きい段から並んでいる(データの並びは小さい段から)
+		const uint64_t offset = Get64(p, headerSize + levelIndexSize * i);
+		const uint64_t size = Get64(p, headerSize + levelIndexSize * i + 8);
+		const int w = std::max(1, image.width >> i);
+		const int h = std::max(1, image.height >> i);
+		if (size != GetCompressedLevelSize(w, h, blockBytes) || offset + size > fileSize)
+		{
+			return false;
+		}
+		image.levelList[i].offset = static_cast<size_t>(offset);
+		image.levelList[i].size = static_cast<size_t>(size);
+	}
+	image.offset = image.levelList[0].offset;
+	return true;
+}
+
+/**
+*JPEGとPNGの展開時間の記録
+*/
+struct DecodeRecord
+{
+	std::string filename;
+	ImageDecoder::Format format;
+	int width;
+	int height;
+	int intervalCount;	///<JPEGのリスタート区間の数
+	double seconds;
+};
+std::mutex decodeRecordMutex;
+std::vector<DecodeRecord> decodeRecordList;
+
+/**
+*JPEGまたはPNGを非圧縮の画素データに展開する
+*
+*@param	filename	ファイル名(記録用)
+*@param	image		メモリにマップしたファイルを持つ画像データ
+*@param	jobSystem	並列に展開するためのジョブシステム(nullptrなら並列化しない)
+*
+*@retval true	展開成功
+*@retval false	JPEGでもPNGでもないか、展開に失敗した
+*
+*画素データはimage.bufferに展開し、マップしたファイルは閉じる
+*/
+bool DecodeJpegOrPng(const char* filename, Texture::Image& image, JobSystem* jobSystem)
+{
+	const MappedFile& file = *image.file;
+	ImageDecoder::Info info;
+	if (!ImageDecoder::ReadInfo(file.Data(), file.Size(), info))
+	{
+		return false;
+	}
+	const auto start = std::chrono::steady_clock::now();
+	file.Prefetch(0, file.Size());
+	image.buffer.resize(info.ImageBytes());
+	if (!ImageDecoder::Decode(file.Data(), file.Size(), info, image.buffer.data(), jobSystem))
+	{
+		std::cerr << "ERROR: " << filename << "を展開できません" << std::endl;
+		return false;
+	}
+	image.file.reset();
+	image.width = info.width;
+	image.height = info.height;
+	switch (info.channelCount)
+	{
+	case 1: image.iformat = GL_R8; image.format = GL_RED; break;
+	case 3: image.iformat = GL_RGB8; image.format = GL_RGB; break;
+	default: image.iformat = GL_RGBA8; image.format = GL_RGBA; break;
+	}
+	image.offset = 0;
+	image.levelList[0].offset = 0;
+	image.levelList[0].size = image.buffer.size();
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::lock_guard<std::mutex> lock(decodeRecordMutex);
+	decodeRecordList.push_back({ filename, info.format, info.width, info.height,
+		info.restartIntervalCount, elapsed.count() });
+	return true;
+}
+
+/**
+*画像ファイルをメモリにマップし、形式を判別して解析する
+*
+*@param	filename	ファイル名
+*@param	image		読み込んだ画像データの格納先
+*@param	jobSystem	JPEGを並列に展開するためのジョブシステム(nullptrなら並列化しない)
+*
+*@retval true	読み込み成功
+*@retval false	読み込み失敗
+*
+*GLへの転送は描画スレッドで行うので、画素データのページの読み込みはここで済ませておく
+*/
+bool LoadImageFile(const char* filename, Texture::Image& image, JobSystem* jobSystem)
+{
+	const std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(filename))
+	{
+		return false;
+	}
+	image.file = file;
+	if (!DecodeBmp(image) && !DecodeDds(image) && !DecodeKtx2(image) &&
+		!DecodeJpegOrPng(filename, image, jobSystem))
+	{
+		return false;
+	}
+	if (image.file)
+	{
+		image.file->Prefetch(image.offset, image.file->Size() - image.offset);
+	}
+	return true;
+}
+
+/**
+*非圧縮の画素データを転送する
+*
+*@param	target	GL_TEXTURE_2DかGL_TEXTURE_2D_ARRAY
+*@param	layer	転送先のレイヤー(GL_TEXTURE_2D_ARRAYの場合)
+*@param	image	転送する画像データ(1段目だけを転送する)
+*
+*行の詰め物はGL_UNPACK_ALIGNMENTとGL_UNPACK_ROW_LENGTHで読み飛ばす
+*上から下に並んだ画像は、1行ずつ上下を入れ替えながら転送する
+*/
+void UploadPixels(GLenum target, GLint layer, const Texture::Image& image)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, image.alignment);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, image.rowLength);
+	const uint8_t* data = image.Data() + image.offset;
+	const int rowCount = image.isTopDown ? image.height : 1;
+	const int rowHeight = image.isTopDown ? 1 : image.height;
+	for (int i = 0; i < rowCount; ++i)
+	{
+		const int y = image.isTopDown ? image.height - 1 - i : 0;
+		const uint8_t* src = image.isTopDown ? image.Row(y) : data;
+		if (target == GL_TEXTURE_2D_ARRAY)
+		{
+			glTexSubImage3D(target, 0, 0, y, layer, image.width, rowHeight, 1, image.format, GL_UNSIGNED_BYTE, src);
+		}
+		else
+		{
+			glTexSubImage2D(target, 0, 0, y, image.width, rowHeight, image.format, GL_UNSIGNED_BYTE, src);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+/**
+*画素データの先頭を取得する
+*/
+const uint8_t* Texture::Image::Data() const
+{
+	return file ? file->Data() : buffer.data();
+}
+
+/**
+*画素データを含むメモリのバイト数を取得する
+*/
+size_t Texture::Image::Size() const
+{
+	return file ? file->Size() : buffer.size();
+}
+
+/**
+*非圧縮の画像の1行のバイト数を取得する
+*
+*GL_UNPACK_ALIGNMENTとGL_UNPACK_ROW_LENGTHで計算される値と同じになる
+*/
+size_t Texture::Image::RowBytes() const
+{
+	size_t pixelBytes = 4;
+	switch (format)
+	{
+	case GL_RED: pixelBytes = 1; break;
+	case GL_RG: pixelBytes = 2; break;
+	case GL_RGB: case GL_BGR: pixelBytes = 3; break;
+	default: break;
+	}
+	const size_t bytes = pixelBytes * (rowLength ? rowLength : width);
+	return (bytes + alignment - 1) / alignment * alignment;
+}
+
+/**
+*非圧縮の画像の行の先頭を取得する
+*
+*@param	y	行の番号(0が一番下の行)
+*
+*@return 行の先頭のアドレス(isTopDownに関わらず、下から数えた行を返す)
+*/
+const uint8_t* Texture::Image::Row(int y) const
+{
+	const int row = isTopDown ? height - 1 - y : y;
+	return Data() + offset + RowBytes() * row;
+}
+
+std::atomic<uint32_t> Texture::currentFrame{ 1 };
+
+/**
+*コンストラクタ
 */
 Texture::Texture() : texId(0), width(0), height(0)
 {
@@ -38,33 +660,57 @@ Texture::Texture() : texId(0), width(0), height(0)
 }
 
 /**
-*fXgN^
+*GLのテクスチャを他のテクスチャと入れ替える
+*
+*@param	other	入れ替える相手
+*
+*TexturePtrを持っている側に知らせずに中身だけを差し替えるために使う
+*使用フレームの記録は入れ替えない
+*/
+void Texture::SwapStorage(Texture& other)
+{
+	std::swap(texId, other.texId);
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(target, other.target);
+	std::swap(layer, other.layer);
+	array.swap(other.array);
+	page.swap(other.page);
+	std::swap(uvRect, other.uvRect);
+}
+
+/**
+*デストラクタ
 */
 Texture::~Texture()
 {
-	if (texId)
+	if (array)
+	{
+		array->FreeLayer(layer);
+	}
+	else if (texId && !page)
 	{
 		glDeleteTextures(1, &texId);
 	}
 }
 
 /**
-*2DeNX`쐬
+*2Dテクスチャを作成する
 *
-*@param	width	eNX`̕(sNZ)
-*@param	height	eNX`̍(sNZ)
-*@param	iformat	eNX`̃f[^`
-*@param	format	ANZXvf
-*@param	data	eNX`f[^ւ̃|C^
+*@param	width	テクスチャの幅(ピクセル数)
+*@param	height	テクスチャの高さ(ピクセル数)
+*@param	iformat	テクスチャのデータ形式
+*@param	format	アクセスする要素
+*@param	data	テクスチャデータへのポインタ
 *
-*@return 쐬ɐꍇ̓eNX`|C^Ԃ
-*			sꍇnullptrԂ
+*@return 作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合はnullptrを返す
 */
 TexturePtr Texture::Create(
 	int width, int height, GLenum iformat, GLenum format, const void* data)
 {
 	struct Impl : Texture{
-		//vs2015privatełƂقȂƌĂ̂ŉLĊmF
+		//vs2015だとprivateですよとかあほなこと言ってくるので下記を書いて確認させる
 		Impl(){}
 		~Impl(){}
 	};
@@ -82,16 +728,12 @@ TexturePtr Texture::Create(
 
 	if (result != GL_NO_ERROR)
 	{
-		std::cerr << "ERROR eNX`쐬Ɏs: 0x" << std::hex << result << std::endl;
+		std::cerr << "ERROR テクスチャ作成に失敗: 0x" << std::hex << result << std::endl;
 		return{};
 	}
 
-	//p[^[ݒ
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	//パラメーター設定
+	SetTextureParameters(GL_TEXTURE_2D, 1, iformat);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -99,75 +741,516 @@ TexturePtr Texture::Create(
 }
 
 /**
-*t@C2DeNX`ǂݍ
+*画像データから2Dテクスチャを作成する
+*
+*@param	image	DecodeFileで読み込んだ画像データ
 *
-*@param	filename t@C
+*@return 作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合はnullptrを返す
 *
-*@return 쐬ɐꍇ̓eNX`|C^Ԃ
-*		sꍇnullotrԂ
+*圧縮データやミップマップ付きのデータは、glTexStorage2Dで確保した不変の領域に各段を転送する
 */
-TexturePtr Texture::LoadFromFile(const char* filename)
+TexturePtr Texture::Create(const Image& image)
 {
-	FILE* fp = fopen(filename, "rb");
-	if (!fp)
+	if (!image.isCompressed && image.levelCount <= 1)
+	{
+		TexturePtr p = Create(image.width, image.height, image.iformat, image.format, nullptr);
+		if (p)
+		{
+			glBindTexture(GL_TEXTURE_2D, p->texId);
+			UploadPixels(GL_TEXTURE_2D, 0, image);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		return p;
+	}
+	if (!IsFormatSupported(image.iformat))
 	{
+		std::cerr << "ERROR テクスチャ形式0x" << std::hex << image.iformat << std::dec <<
+			"はこの環境では使えません" << std::endl;
 		return{};
 	}
 
-	//t@CJ
-	struct stat st;
-	if (stat(filename, &st))
+	struct Impl : Texture { Impl() {} ~Impl() {} };
+	TexturePtr p = std::make_shared<Impl>();
+	p->width = image.width;
+	p->height = image.height;
+	glGenTextures(1, &p->texId);
+	glBindTexture(GL_TEXTURE_2D, p->texId);
+	glTexStorage2D(GL_TEXTURE_2D, image.levelCount, image.iformat, image.width, image.height);
+	for (int i = 0; i < image.levelCount; ++i)
 	{
+		const int w = std::max(1, image.width >> i);
+		const int h = std::max(1, image.height >> i);
+		const Level& level = image.levelList[i];
+		const uint8_t* data = image.Data() + level.offset;
+		if (image.isCompressed)
+		{
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, w, h, image.iformat,
+				static_cast<GLsizei>(level.size), data);
+		}
+		else
+		{
+			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, w, h, image.format, GL_UNSIGNED_BYTE, data);
+		}
+	}
+	const GLenum result = glGetError();
+	if (result != GL_NO_ERROR)
+	{
+		std::cerr << "ERROR テクスチャ作成に失敗: 0x" << std::hex << result << std::dec << std::endl;
+		glBindTexture(GL_TEXTURE_2D, 0);
 		return{};
 	}
-	
-	const size_t bmpFileHeaderSze = 14;		//rbg}bvt@Cwb_̃oCg
-	const size_t windowsV1HeaderSize = 40;	//rbg}bvwb_̃oCg
-	if (st.st_size < bmpFileHeaderSze + windowsV1HeaderSize)
+	SetTextureParameters(GL_TEXTURE_2D, image.levelCount, image.iformat);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return p;
+}
+
+/**
+*アトラスのページの一部を指すテクスチャを作成する
+*
+*@param	page	アトラスのページ
+*@param	x		領域の左下のX座標(ピクセル数)
+*@param	y		領域の左下のY座標(ピクセル数)
+*@param	width	領域の幅(ピクセル数)
+*@param	height	領域の高さ(ピクセル数)
+*
+*@return 作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合はnullptrを返す
+*
+*IdとTargetはページと同じものを返すので、割り当てはページと同じように行い、
+*テクスチャ座標はTransformUvでページ内の座標に変換すること
+*/
+TexturePtr Texture::CreateRegion(const TexturePtr& page, int x, int y, int width, int height)
+{
+	if (!page || page->page || x < 0 || y < 0 || x + width > page->width || y + height > page->height)
 	{
+		std::cerr << "ERROR テクスチャの領域がページの範囲外です" << std::endl;
 		return{};
 	}
+	struct Impl : Texture { Impl() {} ~Impl() {} };
+	TexturePtr p = std::make_shared<Impl>();
+	p->texId = page->texId;
+	p->width = width;
+	p->height = height;
+	p->target = page->target;
+	p->layer = page->layer;
+	p->page = page;
+	const glm::vec2 pageSize(static_cast<float>(page->width), static_cast<float>(page->height));
+	p->uvRect = glm::vec4(glm::vec2(x, y) / pageSize, glm::vec2(width, height) / pageSize);
+	return p;
+}
 
-	//ǂݍ
-	std::vector<uint8_t>buf;
-	buf.resize(st.st_size);
-	const size_t readSize = fread(buf.data(), 1, st.st_size, fp);
-	fclose(fp);
-	if (readSize != st.st_size)
+/**
+*ファイルから2Dテクスチャを読み込む
+*
+*@param	filename ファイル名
+*
+*@return 作成に成功した場合はテクスチャポインタを返す
+*		失敗した場合はnullotr返す
+*/
+TexturePtr Texture::LoadFromFile(const char* filename)
+{
+	Image image;
+	if (!DecodeFile(filename, image, true))
 	{
 		return{};
 	}
+	//テクスチャを作成する
+	return Create(image);
+}
 
-	//{BMPt@CȂ̂H
-	const uint8_t* pHeader = buf.data();
-	if (pHeader[0] != 'B' || pHeader[1] != 'M')
+/**
+*ファイルから画像データを読み込む
+*
+*@param	filename	ファイル名
+*@param	image		読み込んだ画像データの格納先
+*@param	preferCompressed	true:拡張子が.bmp/.jpg/.jpeg/.pngなら、同じ名前の.ktx2か.ddsを先に探す
+*@param	jobSystem	JPEGとPNGを並列に展開するためのジョブシステム(nullptrなら並列化しない)
+*
+*@retval true	読み込み成功
+*@retval false	読み込み失敗
+*
+*ファイルの形式(BMP,DDS,KTX2,JPEG,PNG)は内容から判別する
+*圧縮版が見つからないか、この環境で使えない形式だった場合は元の画像を読み込む
+*JPEGとPNGは展開に時間がかかるので、ワーカースレッドで読み込むこと
+*DDSとKTX2の画素はBMPと同じく下の行から順に並んでいるものとする(上下反転は行わない)
+*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+*/
+bool Texture::DecodeFile(const char* filename, Image& image, bool preferCompressed, JobSystem* jobSystem)
+{
+	const char* dot = strrchr(filename, '.');
+	if (preferCompressed && dot)
+	{
+		std::string ext(dot);
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+		if (ext == ".bmp" || ext == ".jpg" || ext == ".jpeg" || ext == ".png")
+		{
+			const std::string base(filename, dot);
+			for (const char* compressedExt : { ".ktx2", ".dds" })
+			{
+				image = Image();
+				if (LoadImageFile((base + compressedExt).c_str(), image, nullptr) &&
+					image.isCompressed && IsFormatSupported(image.iformat))
+				{
+					return true;
+				}
+			}
+		}
+	}
+	image = Image();
+	return LoadImageFile(filename, image, jobSystem);
+}
+
+/**
+*JPEGとPNGの展開時間を出力する
+*
+*@param	os	出力先
+*/
+void Texture::DumpDecodeStats(std::ostream& os)
+{
+	std::lock_guard<std::mutex> lock(decodeRecordMutex);
+	double total = 0;
+	double megapixels = 0;
+	os << "Image decode:" << std::endl;
+	for (const DecodeRecord& e : decodeRecordList)
+	{
+		os << "  " << std::setw(4) << (e.format == ImageDecoder::Format::Jpeg ? "jpeg" : "png") <<
+			std::setw(10) << std::fixed << std::setprecision(2) << e.seconds * 1000 << "ms  " <<
+			e.width << "x" << e.height;
+		if (e.intervalCount > 1)
+		{
+			os << " (" << e.intervalCount << " intervals)";
+		}
+		os << "  " << e.filename << std::endl;
+		total += e.seconds;
+		megapixels += e.width * e.height / 1000000.0;
+	}
+	os << "  " << decodeRecordList.size() << " files " << total * 1000 << "ms";
+	if (total > 0)
+	{
+		os << " (" << megapixels / total << "MP/s)";
+	}
+	os << std::endl;
+	os.unsetf(std::ios::floatfield);
+}
+
+/**
+*テクスチャ形式がこの環境で使えるか調べる
+*
+*@param	iformat	テクスチャのデータ形式
+*
+*@retval true	使える
+*@retval false	使えない
+*
+*圧縮形式は拡張機能に加えて、不変の領域を確保するglTexStorageが必要
+*/
+bool Texture::IsFormatSupported(GLenum iformat)
+{
+	if (!GetBlockBytes(iformat))
+	{
+		return true;
+	}
+	if (!GLEW_VERSION_4_2 && !GLEW_ARB_texture_storage)
+	{
+		return false;
+	}
+	switch (iformat)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc != 0;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+	default:
+		return true;	//RGTCはGL3.0から標準
+	}
+}
+
+/**
+*テクスチャがGPU上で使うバイト数を計算する
+*
+*@param	iformat		テクスチャのデータ形式
+*@param	width		幅(ピクセル数)
+*@param	height		高さ(ピクセル数)
+*@param	levelCount	ミップマップの段数
+*
+*@return 全ての段の合計バイト数
+*
+*RGB8は多くのドライバが4バイトに広げて持つので、4バイトとして数える(目安であり正確な確保量ではない)
+*/
+size_t Texture::MemorySize(GLenum iformat, int width, int height, int levelCount)
+{
+	const size_t blockBytes = GetBlockBytes(iformat);
+	size_t pixelBytes = 4;
+	switch (iformat)
+	{
+	case GL_R8: pixelBytes = 1; break;
+	case GL_RG8: pixelBytes = 2; break;
+	default: break;
+	}
+	size_t total = 0;
+	for (int i = 0; i < levelCount; ++i)
+	{
+		const size_t w = std::max(1, width >> i);
+		const size_t h = std::max(1, height >> i);
+		total += blockBytes ? ((w + 3) / 4) * ((h + 3) / 4) * blockBytes : w * h * pixelBytes;
+	}
+	return total;
+}
+
+/**
+*2Dテクスチャ配列を作成する
+*
+*@param	width		各レイヤーの幅(ピクセル数)
+*@param	height		各レイヤーの高さ(ピクセル数)
+*@param	iformat		テクスチャのデータ形式
+*@param	layerCount	レイヤー数
+*@param	levelCount	ミップマップの段数
+*@param	isCompressed	iformatが圧縮形式ならtrue
+*
+*@return 作成に成功した場合はテクスチャ配列ポインタを返す
+*			失敗した場合はnullptrを返す
+*
+*画素データは確保するだけで、レイヤーの内容はTexturePool::AddかTextureUploaderで転送する
+*/
+TextureArrayPtr TextureArray::Create(int width, int height, GLenum iformat, int layerCount,
+	int levelCount, bool isCompressed)
+{
+	struct Impl : TextureArray { Impl() {} ~Impl() {} };
+	TextureArrayPtr p = std::make_shared<Impl>();
+
+	p->width = width;
+	p->height = height;
+	p->iformat = iformat;
+	p->layerCount = layerCount;
+	p->levelCount = levelCount;
+	p->isCompressed = isCompressed;
+	glGenTextures(1, &p->texId);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, p->texId);
+	if (isCompressed || levelCount > 1)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, iformat, width, height, layerCount);
+	}
+	else
 	{
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, iformat, width, height, layerCount, 0,
+			GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	const GLenum result = glGetError();
+	if (result != GL_NO_ERROR)
+	{
+		std::cerr << "ERROR テクスチャ配列の作成に失敗: 0x" << std::hex << result << std::dec << std::endl;
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 		return{};
 	}
 
-	//BMPt@C̏擾
-	const size_t offsetBytes = Get(pHeader, 10, 4);
-	const uint32_t infoSize = Get(pHeader, 14, 4);
-	const uint32_t width = Get(pHeader, 18, 4);
-	const uint32_t height = Get(pHeader, 22, 4);
-	const uint32_t bitCount = Get(pHeader, 28, 4);
-	const uint32_t compression = Get(pHeader, 30, 4);
-	const size_t pixelBytes = bitCount / 8;
-	if (infoSize != windowsV1HeaderSize ||
-		bitCount != 24 ||
-		compression ||
-		(width * pixelBytes) % 4)	//4ȊOɂ4̔{ȂȂ
+	//パラメーター設定(Texture::Createと同じ)
+	SetTextureParameters(GL_TEXTURE_2D_ARRAY, levelCount, iformat);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	//小さい番号から使うよう、逆順に積んでおく
+	p->freeLayerList.reserve(layerCount);
+	for (GLint i = layerCount - 1; i >= 0; --i)
+	{
+		p->freeLayerList.push_back(i);
+	}
+	return p;
+}
+
+/**
+*デストラクタ
+*/
+TextureArray::~TextureArray()
+{
+	if (texId)
+	{
+		glDeleteTextures(1, &texId);
+	}
+}
+
+/**
+*空いているレイヤー数を取得する
+*
+*@return 空いているレイヤー数
+*/
+int TextureArray::FreeLayerCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<int>(freeLayerList.size());
+}
+
+/**
+*レイヤーを割り当てる
+*
+*@return 割り当てたレイヤー番号
+*		空きがなければ-1を返す
+*/
+GLint TextureArray::AllocateLayer()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (freeLayerList.empty())
+	{
+		return -1;
+	}
+	const GLint layer = freeLayerList.back();
+	freeLayerList.pop_back();
+	return layer;
+}
+
+/**
+*レイヤーを空きに戻す
+*
+*@param	layer	AllocateLayerで割り当てたレイヤー番号
+*/
+void TextureArray::FreeLayer(GLint layer)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	freeLayerList.push_back(layer);
+}
+
+/**
+*テクスチャプールを作成する
+*
+*@param	layersPerArray	1つのテクスチャ配列が持つレイヤー数
+*
+*@return 作成したテクスチャプールへのポインタ
+*/
+TexturePoolPtr TexturePool::Create(int layersPerArray)
+{
+	struct Impl : TexturePool { Impl() {} ~Impl() {} };
+	TexturePoolPtr p = std::make_shared<Impl>();
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	p->layersPerArray = std::max(1, maxLayers > 0 ? std::min(layersPerArray, maxLayers) : layersPerArray);
+	return p;
+}
+
+/**
+*画像をテクスチャ配列のレイヤーに転送する
+*
+*@param	image	DecodeFileで読み込んだ画像データ
+*
+*@return 作成に成功した場合はレイヤーを指すテクスチャポインタを返す
+*			失敗した場合はnullptrを返す
+*
+*返したテクスチャのIdは配列のテクスチャオブジェクトなので、GL_TEXTURE_2D_ARRAYとして割り当て、
+*シェーダではLayerの値をレイヤー番号として使うこと
+*/
+TexturePtr TexturePool::Add(const Texture::Image& image)
+{
+	TexturePtr p = Allocate(image);
+	if (!p)
 	{
 		return{};
 	}
 
-	//摜f[^̃TCY
-	const size_t imageSize = width * height * pixelBytes;
-	if (buf.size() < offsetBytes + imageSize)
+	glBindTexture(GL_TEXTURE_2D_ARRAY, p->texId);
+	for (int i = 0; i < image.levelCount; ++i)
+	{
+		const int w = std::max(1, image.width >> i);
+		const int h = std::max(1, image.height >> i);
+		const Texture::Level& level = image.levelList[i];
+		const uint8_t* data = image.Data() + level.offset;
+		if (image.isCompressed)
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, p->layer, w, h, 1, image.iformat,
+				static_cast<GLsizei>(level.size), data);
+		}
+		else
+		{
+			UploadPixels(GL_TEXTURE_2D_ARRAY, p->layer, image);
+		}
+	}
+	const GLenum result = glGetError();
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	if (result != GL_NO_ERROR)
+	{
+		std::cerr << "ERROR テクスチャ配列への転送に失敗: 0x" << std::hex << result << std::dec << std::endl;
+		return{};	//pの破棄でレイヤーは空きに戻る
+	}
+	return p;
+}
+
+/**
+*画像を入れるテクスチャ配列のレイヤーを確保する
+*
+*@param	image	DecodeFileで読み込んだ画像データ(大きさと形式だけを使う)
+*
+*@return 確保に成功した場合はレイヤーを指すテクスチャポインタを返す
+*			失敗した場合はnullptrを返す
+*
+*レイヤーの内容は不定なので、TextureUploaderなどで画素データを転送してから使うこと
+*/
+TexturePtr TexturePool::Allocate(const Texture::Image& image)
+{
+	if (!Texture::IsFormatSupported(image.iformat))
 	{
+		std::cerr << "ERROR テクスチャ形式0x" << std::hex << image.iformat << std::dec <<
+			"はこの環境では使えません" << std::endl;
 		return{};
 	}
 
-	//eNX`쐬
-	return Create(width, height, GL_RGB8, GL_BGR, buf.data() + offsetBytes);
+	//同じ大きさと形式で、空きのある配列を探す
+	TextureArrayPtr array;
+	GLint layer = -1;
+	for (auto itr = arrayList.begin(); itr != arrayList.end();)
+	{
+		TextureArrayPtr e = itr->lock();
+		if (!e)
+		{
+			itr = arrayList.erase(itr);
+			continue;
+		}
+		if (e->Width() == image.width && e->Height() == image.height && e->InternalFormat() == image.iformat &&
+			e->LevelCount() == image.levelCount)
+		{
+			layer = e->AllocateLayer();
+			if (layer >= 0)
+			{
+				array = e;
+				break;
+			}
+		}
+		++itr;
+	}
+	if (!array)
+	{
+		array = TextureArray::Create(image.width, image.height, image.iformat, layersPerArray,
+			image.levelCount, image.isCompressed);
+		if (!array)
+		{
+			return{};
+		}
+		arrayList.push_back(array);
+		layer = array->AllocateLayer();
+	}
+
+	struct Impl : Texture { Impl() {} ~Impl() {} };
+	TexturePtr p = std::make_shared<Impl>();
+	p->texId = array->Id();
+	p->width = image.width;
+	p->height = image.height;
+	p->target = GL_TEXTURE_2D_ARRAY;
+	p->layer = layer;
+	p->array = array;
+	return p;
+}
+
+/**
+*使用中のテクスチャ配列の数を取得する
+*
+*@return テクスチャ配列の数
+*/
+size_t TexturePool::ArrayCount() const
+{
+	size_t count = 0;
+	for (const auto& e : arrayList)
+	{
+		if (!e.expired())
+		{
+			++count;
+		}
+	}
+	return count;
 }
\ No newline at end of file
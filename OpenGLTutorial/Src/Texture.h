@@ -6,35 +6,186 @@
 #ifndef  TEXTURE_H_INCLUDED
 #define  TEXTURE_H_INCLUDED
 #include <GL/glew.h>
+#include "Memory.h"
+#include <glm/glm.hpp>
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <ostream>
 
+class MappedFile;
+class JobSystem;
 class Texture;
-typedef std::shared_ptr<Texture>TexturePtr; ///<eNX`|C^
+typedef std::shared_ptr<Texture>TexturePtr; ///<テクスチャポインタ
+class TextureArray;
+typedef std::shared_ptr<TextureArray> TextureArrayPtr;	///<テクスチャ配列ポインタ
+class TexturePool;
+typedef std::shared_ptr<TexturePool> TexturePoolPtr;	///<テクスチャプールポインタ
 
 /**
-*eNX`NX
+*テクスチャクラス
 */
 class Texture
 {
 public:
+	//画像データが持てるミップマップの最大数(32768x32768まで)
+	static const int maxLevelCount = 16;
+
+	/**
+	*	ミップマップ1段分の画素データの位置
+	*/
+	struct Level
+	{
+		size_t offset = 0;	///<Data()内の位置
+		size_t size = 0;	///<バイト数
+	};
+
+	/**
+	*	ファイルから読み込んだ、GLに転送する前の画像データ
+	*
+	*	BMP,JPEG,PNGは1段だけの非圧縮データ、DDSとKTX2はミップマップ付きのBCn圧縮データを持つ
+	*	画素データは普通はメモリにマップしたファイルを直接指し、ヒープにはコピーしない
+	*	(JPEGとPNGは展開した画素をbufferに持つ)
+	*/
+	struct Image
+	{
+		int width = 0;	///<幅(ピクセル数)
+		int height = 0;	///<高さ(ピクセル数)
+		GLenum iformat = GL_RGB8;	///<テクスチャのデータ形式
+		GLenum format = GL_BGR;	///<画素の並び(圧縮形式では使わない)
+		bool isCompressed = false;	///<iformatが圧縮形式ならtrue
+		int levelCount = 1;	///<ミップマップの段数
+		Level levelList[maxLevelCount];	///<各段の画素データ(levelList[0]はoffsetと同じ位置)
+		std::shared_ptr<MappedFile> file;	///<メモリにマップしたファイル(nullptrならbufferを使う)
+		Memory::Vector<uint8_t, Memory::Tag::Texture> buffer;	///<fileを使わない場合の画素データ
+		size_t offset = 0;	///<Data()内の画素データの位置
+		int alignment = 4;	///<行の先頭の境界(GL_UNPACK_ALIGNMENT)
+		int rowLength = 0;	///<1行のピクセル数(GL_UNPACK_ROW_LENGTH、0ならwidth)
+		bool isTopDown = false;	///<true:上の行から順に並んでいる
+
+		const uint8_t* Data() const;
+		size_t Size() const;
+		size_t RowBytes() const;
+		const uint8_t* Row(int y) const;
+	};
+
 	static TexturePtr Create(
 		int width, int height, GLenum iformat, GLenum format, const void* data);
+	static TexturePtr Create(const Image& image);
+	static TexturePtr CreateRegion(const TexturePtr& page, int x, int y, int width, int height);
 
 	static TexturePtr LoadFromFile(const char*);
+	static bool DecodeFile(const char* filename, Image& image, bool preferCompressed = false,
+		JobSystem* jobSystem = nullptr);
+	static void DumpDecodeStats(std::ostream& os);
+	static bool IsFormatSupported(GLenum iformat);
+	static size_t MemorySize(GLenum iformat, int width, int height, int levelCount);
+
+	static uint32_t CurrentFrame() { return currentFrame.load(std::memory_order_relaxed); }
+	static void AdvanceFrame() { currentFrame.fetch_add(1, std::memory_order_relaxed); }
+	void MarkUsed() const { lastUsedFrame.store(CurrentFrame(), std::memory_order_relaxed); }
+	uint32_t LastUsedFrame() const { return lastUsedFrame.load(std::memory_order_relaxed); }
 
 	GLuint Id() const { return texId; }
 	GLsizei Width() const { return width; }
 	GLsizei Height() const { return height; }
+	GLenum Target() const { return target; }
+	GLint Layer() const { return layer; }
+	const glm::vec4& UvRect() const { return uvRect; }
+	glm::vec2 TransformUv(const glm::vec2& uv) const { return glm::vec2(uvRect) + uv * glm::vec2(uvRect.z, uvRect.w); }
 
 private:
+	friend class TexturePool;
+	friend class TextureManager;
+
 	Texture();
 	~Texture();
 	Texture(const Texture&) = delete;
 	Texture& operator = (const Texture&) = delete;
 
+	void SwapStorage(Texture& other);
+
 	GLuint texId;
 	int width;
 	int height;
+	GLenum target = GL_TEXTURE_2D;	///<テクスチャの種類(GL_TEXTURE_2DまたはGL_TEXTURE_2D_ARRAY)
+	GLint layer = 0;	///<テクスチャ配列内のレイヤー番号
+	TextureArrayPtr array;	///<レイヤーを借りているテクスチャ配列(単独のテクスチャならnullptr)
+	TexturePtr page;	///<領域を借りているアトラスのページ(単独のテクスチャならnullptr)
+	glm::vec4 uvRect = glm::vec4(0, 0, 1, 1);	///<ページ内のUV範囲(xy:左下の座標 zw:幅と高さ)
+	mutable std::atomic<uint32_t> lastUsedFrame{ 0 };	///<最後に描画命令を作ったフレーム番号
+
+	static std::atomic<uint32_t> currentFrame;	///<MarkUsedで記録するフレーム番号
+};
+
+/**
+*	同じ大きさと形式の画像を重ねた2Dテクスチャ配列
+*
+*	レイヤーはTexturePoolを通して割り当てられ、レイヤーを使うTextureが破棄されると空きに戻る
+*/
+class TextureArray
+{
+public:
+	static TextureArrayPtr Create(int width, int height, GLenum iformat, int layerCount,
+		int levelCount = 1, bool isCompressed = false);
+
+	GLuint Id() const { return texId; }
+	GLsizei Width() const { return width; }
+	GLsizei Height() const { return height; }
+	GLenum InternalFormat() const { return iformat; }
+	int LayerCount() const { return layerCount; }
+	int LevelCount() const { return levelCount; }
+	bool IsCompressed() const { return isCompressed; }
+	int FreeLayerCount() const;
+
+private:
+	friend class Texture;
+	friend class TexturePool;
+
+	TextureArray() = default;
+	~TextureArray();
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator = (const TextureArray&) = delete;
+
+	GLint AllocateLayer();
+	void FreeLayer(GLint layer);
+
+	GLuint texId = 0;	///<テクスチャ配列オブジェクト
+	int width = 0;	///<幅(ピクセル数)
+	int height = 0;	///<高さ(ピクセル数)
+	GLenum iformat = GL_RGB8;	///<テクスチャのデータ形式
+	int layerCount = 0;	///<レイヤー数
+	int levelCount = 1;	///<ミップマップの段数
+	bool isCompressed = false;	///<iformatが圧縮形式ならtrue
+	std::vector<GLint> freeLayerList;	///<空いているレイヤー番号
+	mutable std::mutex mutex;	///<freeLayerListを保護する(Textureはどのスレッドで破棄されてもよい)
+};
+
+/**
+*	テクスチャ配列のプール
+*
+*	同じ大きさと形式(ミップマップの段数を含む)の画像を同じテクスチャ配列のレイヤーに詰めることで、
+*	異なる画像を使う描画でもテクスチャの割り当てを1回で済ませられるようにする
+*	配列のレイヤー数は作成時に固定し、空きがなくなったら同じ大きさの配列をもう1つ作る
+*/
+class TexturePool
+{
+public:
+	static TexturePoolPtr Create(int layersPerArray);
+
+	TexturePtr Add(const Texture::Image& image);
+	TexturePtr Allocate(const Texture::Image& image);
+	size_t ArrayCount() const;
+
+private:
+	TexturePool() = default;
+	~TexturePool() = default;
+	TexturePool(const TexturePool&) = delete;
+	TexturePool& operator = (const TexturePool&) = delete;
+
+	int layersPerArray = 16;	///<1つの配列が持つレイヤー数
+	std::vector<std::weak_ptr<TextureArray>> arrayList;	///<作成した配列(使うレイヤーがなくなれば破棄される)
 };
 
 #endif // ! TEXTURE_H_INCLUDED
@@ -0,0 +1,698 @@
+/**
+*	@file TextureAtlas.cpp
+*/
+#include "TextureAtlas.h"
+#include "MappedFile.h"
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace TextureAtlas
+{
+	namespace /* unnamed */
+	{
+		/**
+		*	変換済みアトラスファイルの形式
+		*
+		*	AtlasHeader, AtlasSource[sourceCount], AtlasEntry[entryCount], 画像名の文字列, ページの画素データ の順に並ぶ
+		*	AtlasSourceの先頭は一覧ファイル、以降は一覧に書かれた順の画像ファイル
+		*	画素データはGL_BGRの24bitで、下の行から順に並ぶ(BMPと同じ)
+		*/
+		const char atlasMagic[4] = { 'A', 'T', 'L', 'C' };
+		const uint32_t atlasVersion = 1;
+		const char cacheDirectory[] = "Res/Cache";
+		const size_t pixelAlignment = 16;
+
+		struct AtlasHeader
+		{
+			char magic[4];	///<識別子("ATLC")
+			uint32_t version;	///<形式のバージョン
+			uint32_t pageWidth;	///<ページの幅
+			uint32_t pageHeight;	///<ページの高さ
+			uint32_t pageCount;	///<ページ数
+			uint32_t entryCount;	///<画像数
+			uint32_t sourceCount;	///<変換元ファイル数
+			uint32_t padding;	///<作成時の余白
+			uint64_t nameOffset;	///<画像名の文字列の位置
+			uint64_t pixelOffset;	///<画素データの位置
+			uint64_t fileSize;	///<ファイル全体のバイト数
+		};
+
+		struct AtlasSource
+		{
+			uint64_t size;	///<ファイルのバイト数
+			int64_t time;	///<ファイルの更新時刻
+		};
+
+		struct AtlasEntry
+		{
+			uint32_t nameOffset;	///<画像名の文字列内の位置
+			uint32_t nameLength;	///<画像名の文字数
+			uint32_t page;
+			uint32_t x;
+			uint32_t y;
+			uint32_t width;
+			uint32_t height;
+			uint32_t reserved;
+		};
+
+		/**
+		*ファイルのサイズと更新時刻を取得する
+		*
+		*@param	filename	ファイル名
+		*
+		*@return ファイルの情報(存在しなければサイズと時刻を0にする)
+		*/
+		AtlasSource GetSource(const char* filename)
+		{
+			AtlasSource source = {};
+			struct stat st;
+			if (stat(filename, &st) == 0)
+			{
+				source.size = static_cast<uint64_t>(st.st_size);
+				source.time = static_cast<int64_t>(st.st_mtime);
+			}
+			return source;
+		}
+
+		/**
+		*画像の一覧ファイルを読み込む
+		*
+		*@param	filename	一覧ファイル名
+		*@param	out			画像ファイル名の格納先
+		*
+		*@retval true	読み込み成功
+		*@retval false	ファイルを開けなかった
+		*
+		*空行と'#'で始まる行は無視する
+		*/
+		bool ReadList(const char* filename, std::vector<std::string>& out)
+		{
+			FILE* fp = fopen(filename, "r");
+			if (!fp)
+			{
+				std::cerr << "ERROR: '" << filename << "' のオープンに失敗" << std::endl;
+				return false;
+			}
+			out.clear();
+			char line[256];
+			while (fgets(line, sizeof(line), fp))
+			{
+				std::string s(line);
+				const size_t first = s.find_first_not_of(" \t\r\n");
+				if (first == std::string::npos || s[first] == '#')
+				{
+					continue;
+				}
+				const size_t last = s.find_last_not_of(" \t\r\n");
+				out.push_back(s.substr(first, last - first + 1));
+			}
+			fclose(fp);
+			return true;
+		}
+
+		/**
+		*一覧ファイルと画像ファイルの情報を集める
+		*
+		*@param	listFilename	一覧ファイル名
+		*@param	fileList		一覧に書かれた画像ファイル名
+		*
+		*@return 変換元ファイルの情報
+		*/
+		std::vector<AtlasSource> GetSourceList(const char* listFilename, const std::vector<std::string>& fileList)
+		{
+			std::vector<AtlasSource> sourceList;
+			sourceList.reserve(fileList.size() + 1);
+			sourceList.push_back(GetSource(listFilename));
+			for (const std::string& e : fileList)
+			{
+				sourceList.push_back(GetSource(e.c_str()));
+			}
+			return sourceList;
+		}
+
+		/**
+		*画像を余白ごとページに書き込む
+		*
+		*@param	page		書き込み先のページ
+		*@param	pageWidth	ページの幅
+		*@param	image		書き込む画像
+		*@param	rect		画像を置く位置(余白を含まない)
+		*@param	padding		余白の幅
+		*
+		*線形補間で隣の画像の色が混ざらないよう、余白は画像の縁の画素を引き延ばして埋める
+		*/
+		void Blit(Texture::Image& page, int pageWidth, const Texture::Image& image, const Rect& rect, int padding)
+		{
+			const size_t pixelBytes = 3;
+			const size_t dstRowBytes = (pageWidth * pixelBytes + 3) & ~size_t(3);
+			uint8_t* dst = page.buffer.data();
+			for (int y = -padding; y < rect.height + padding; ++y)
+			{
+				const int sy = std::min(std::max(y, 0), rect.height - 1);
+				const uint8_t* srcRow = image.Row(sy);
+				uint8_t* dstRow = dst + (rect.y + y) * dstRowBytes;
+				for (int x = -padding; x < rect.width + padding; ++x)
+				{
+					const int sx = std::min(std::max(x, 0), rect.width - 1);
+					memcpy(dstRow + (rect.x + x) * pixelBytes, srcRow + sx * pixelBytes, pixelBytes);
+				}
+			}
+		}
+
+		/**
+		*ファイルの現在位置を揃える
+		*
+		*@param	fp		ファイル
+		*@param	pos		現在位置(揃えた後の位置に更新される)
+		*@param	align	揃える単位
+		*/
+		void WritePadding(FILE* fp, uint64_t& pos, size_t align)
+		{
+			static const uint8_t zero[pixelAlignment] = {};
+			const size_t padding = static_cast<size_t>((align - pos % align) % align);
+			fwrite(zero, 1, padding, fp);
+			pos += padding;
+		}
+
+		/**
+		*変換済みアトラスを読み込む
+		*
+		*@param	filename	変換済みアトラスのファイル名
+		*@param	sourceList	現在の変換元ファイルの情報
+		*@param	settings	作成時の設定
+		*@param	atlas		読み込んだアトラスの格納先
+		*
+		*@retval true	読み込み成功
+		*@retval false	ファイルが存在しないか、古いか壊れていた
+		*/
+		bool LoadCooked(const char* filename, const std::vector<AtlasSource>& sourceList,
+			const CookSettings& settings, Atlas& atlas)
+		{
+			const std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+			if (!file->Open(filename))
+			{
+				return false;
+			}
+			const uint8_t* base = file->Data();
+			const size_t fileSize = file->Size();
+			if (fileSize < sizeof(AtlasHeader))
+			{
+				return false;
+			}
+			AtlasHeader header;
+			memcpy(&header, base, sizeof(header));
+			if (memcmp(header.magic, atlasMagic, sizeof(atlasMagic)) != 0 || header.version != atlasVersion ||
+				header.fileSize != fileSize || header.sourceCount != sourceList.size() ||
+				header.pageWidth != static_cast<uint32_t>(settings.pageSize) ||
+				header.pageHeight != static_cast<uint32_t>(settings.pageSize) ||
+				header.padding != static_cast<uint32_t>(settings.padding))
+			{
+				return false;
+			}
+			const uint64_t tableEnd = sizeof(AtlasHeader) +
+				header.sourceCount * sizeof(AtlasSource) + header.entryCount * sizeof(AtlasEntry);
+			const size_t rowBytes = (header.pageWidth * 3 + 3) & ~size_t(3);
+			const uint64_t pageBytes = uint64_t(rowBytes) * header.pageHeight;
+			if (tableEnd > header.nameOffset || header.nameOffset > header.pixelOffset ||
+				header.pixelOffset + pageBytes * header.pageCount != fileSize)
+			{
+				return false;
+			}
+
+			//変換元が1つでも変わっていれば作り直す
+			const AtlasSource* sources = reinterpret_cast<const AtlasSource*>(base + sizeof(AtlasHeader));
+			for (size_t i = 0; i < sourceList.size(); ++i)
+			{
+				AtlasSource s;
+				memcpy(&s, sources + i, sizeof(s));
+				if (s.size != sourceList[i].size || s.time != sourceList[i].time)
+				{
+					return false;
+				}
+			}
+
+			const AtlasEntry* entries = reinterpret_cast<const AtlasEntry*>(sources + header.sourceCount);
+			const char* names = reinterpret_cast<const char*>(base + header.nameOffset);
+			const size_t nameBytes = static_cast<size_t>(header.pixelOffset - header.nameOffset);
+			atlas.entryList.clear();
+			atlas.entryList.reserve(header.entryCount);
+			for (uint32_t i = 0; i < header.entryCount; ++i)
+			{
+				AtlasEntry e;
+				memcpy(&e, entries + i, sizeof(e));
+				if (e.nameOffset + uint64_t(e.nameLength) > nameBytes || e.page >= header.pageCount ||
+					e.x + e.width > header.pageWidth || e.y + e.height > header.pageHeight)
+				{
+					return false;
+				}
+				Entry entry;
+				entry.name.assign(names + e.nameOffset, e.nameLength);
+				entry.page = e.page;
+				entry.rect.x = e.x;
+				entry.rect.y = e.y;
+				entry.rect.width = e.width;
+				entry.rect.height = e.height;
+				atlas.entryList.push_back(entry);
+			}
+
+			atlas.pageWidth = header.pageWidth;
+			atlas.pageHeight = header.pageHeight;
+			atlas.pageList.resize(header.pageCount);
+			for (uint32_t i = 0; i < header.pageCount; ++i)
+			{
+				Texture::Image& page = atlas.pageList[i];
+				page.width = header.pageWidth;
+				page.height = header.pageHeight;
+				page.iformat = GL_RGB8;
+				page.format = GL_BGR;
+				page.file = file;	//画素はマップしたファイルから直接転送する
+				page.offset = static_cast<size_t>(header.pixelOffset + pageBytes * i);
+				page.levelList[0].offset = page.offset;
+				page.levelList[0].size = static_cast<size_t>(pageBytes);
+			}
+			return true;
+		}
+
+	} // unnamed namespace
+
+	/**
+	*コンストラクタ
+	*
+	*@param	width	ページの幅
+	*@param	height	ページの高さ
+	*/
+	Packer::Packer(int width, int height) : width(width), height(height)
+	{
+		Rect r;
+		r.width = width;
+		r.height = height;
+		freeList.push_back(r);
+	}
+
+	/**
+	*矩形を配置する
+	*
+	*@param	width	配置する矩形の幅
+	*@param	height	配置する矩形の高さ
+	*@param	out		配置した位置の格納先
+	*
+	*@retval true	配置成功
+	*@retval false	収まる空き領域がない
+	*/
+	bool Packer::Insert(int width, int height, Rect& out)
+	{
+		int bestShort = INT_MAX;
+		int bestLong = INT_MAX;
+		const Rect* best = nullptr;
+		for (const Rect& e : freeList)
+		{
+			if (e.width < width || e.height < height)
+			{
+				continue;
+			}
+			const int dw = e.width - width;
+			const int dh = e.height - height;
+			const int shortSide = std::min(dw, dh);
+			const int longSide = std::max(dw, dh);
+			if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+			{
+				bestShort = shortSide;
+				bestLong = longSide;
+				best = &e;
+			}
+		}
+		if (!best)
+		{
+			return false;
+		}
+		out.x = best->x;
+		out.y = best->y;
+		out.width = width;
+		out.height = height;
+		SplitFreeRect(out);
+		PruneFreeList();
+		usedArea += size_t(width) * height;
+		return true;
+	}
+
+	/**
+	*配置した矩形と重なる空き領域を分割する
+	*
+	*@param	used	配置した矩形
+	*
+	*重なった空き領域は、配置した矩形の上下左右に残る最大4つの極大矩形に置き換える
+	*/
+	void Packer::SplitFreeRect(const Rect& used)
+	{
+		const size_t count = freeList.size();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Rect e = freeList[i];
+			if (used.x >= e.x + e.width || used.x + used.width <= e.x ||
+				used.y >= e.y + e.height || used.y + used.height <= e.y)
+			{
+				continue;
+			}
+			if (used.x > e.x)
+			{
+				Rect r = e;
+				r.width = used.x - e.x;
+				freeList.push_back(r);
+			}
+			if (used.x + used.width < e.x + e.width)
+			{
+				Rect r = e;
+				r.x = used.x + used.width;
+				r.width = e.x + e.width - r.x;
+				freeList.push_back(r);
+			}
+			if (used.y > e.y)
+			{
+				Rect r = e;
+				r.height = used.y - e.y;
+				freeList.push_back(r);
+			}
+			if (used.y + used.height < e.y + e.height)
+			{
+				Rect r = e;
+				r.y = used.y + used.height;
+				r.height = e.y + e.height - r.y;
+				freeList.push_back(r);
+			}
+			freeList[i].width = 0;	//削除の印
+		}
+		freeList.erase(std::remove_if(freeList.begin(), freeList.end(),
+			[](const Rect& r) { return r.width == 0; }), freeList.end());
+	}
+
+	/**
+	*他の空き領域に完全に含まれる空き領域を取り除く
+	*/
+	void Packer::PruneFreeList()
+	{
+		const auto contains = [](const Rect& a, const Rect& b) {
+			return b.x >= a.x && b.y >= a.y &&
+				b.x + b.width <= a.x + a.width && b.y + b.height <= a.y + a.height;
+		};
+		for (size_t i = 0; i < freeList.size(); ++i)
+		{
+			for (size_t j = i + 1; j < freeList.size();)
+			{
+				if (contains(freeList[j], freeList[i]))
+				{
+					freeList.erase(freeList.begin() + i);
+					--i;
+					break;
+				}
+				if (contains(freeList[i], freeList[j]))
+				{
+					freeList.erase(freeList.begin() + j);
+					continue;
+				}
+				++j;
+			}
+		}
+	}
+
+	/**
+	*ページの使用率を取得する
+	*
+	*@return 配置済みの面積 / ページの面積
+	*/
+	float Packer::Occupancy() const
+	{
+		return static_cast<float>(usedArea) / (static_cast<float>(width) * static_cast<float>(height));
+	}
+
+	/**
+	*アトラスを作成してファイルに書き込む
+	*
+	*@param	listFilename	画像の一覧ファイル名
+	*@param	outputFilename	変換済みアトラスのファイル名
+	*@param	settings		作成の設定
+	*
+	*@retval true	作成成功
+	*@retval false	作成失敗
+	*
+	*読み込めない画像や大きすぎる画像は警告を出して除外する(除外した画像は通常のテクスチャとして読み込むこと)
+	*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+	*/
+	bool Cook(const char* listFilename, const char* outputFilename, const CookSettings& settings)
+	{
+		std::vector<std::string> fileList;
+		if (!ReadList(listFilename, fileList))
+		{
+			return false;
+		}
+		const int pageSize = settings.pageSize;
+		const int padding = settings.padding;
+		if (pageSize <= 0 || pageSize % 4 || padding < 0)
+		{
+			std::cerr << "ERROR: アトラスの設定が不正です(pageSize=" << pageSize << ")" << std::endl;
+			return false;
+		}
+
+		//画像を読み込み、大きいものから順に詰める
+		std::vector<Texture::Image> imageList(fileList.size());
+		std::vector<size_t> order;
+		for (size_t i = 0; i < fileList.size(); ++i)
+		{
+			Texture::Image& image = imageList[i];
+			if (!Texture::DecodeFile(fileList[i].c_str(), image) ||
+				image.iformat != GL_RGB8 || image.format != GL_BGR)
+			{
+				std::cerr << "WARNING: '" << fileList[i] << "' はアトラスに入れられない形式です" << std::endl;
+				continue;
+			}
+			const int maxSize = std::min(settings.maxImageSize, pageSize - padding * 2);
+			if (image.width > maxSize || image.height > maxSize)
+			{
+				std::cerr << "WARNING: '" << fileList[i] << "' はアトラスに入れるには大きすぎます" << std::endl;
+				continue;
+			}
+			order.push_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [&imageList](size_t lhs, size_t rhs) {
+			const Texture::Image& a = imageList[lhs];
+			const Texture::Image& b = imageList[rhs];
+			const int sa = std::max(a.width, a.height);
+			const int sb = std::max(b.width, b.height);
+			return sa != sb ? sa > sb : a.width * a.height > b.width * b.height;
+		});
+
+		std::vector<Packer> packerList;
+		std::vector<Entry> entryList;
+		for (size_t i : order)
+		{
+			const Texture::Image& image = imageList[i];
+			const int w = image.width + padding * 2;
+			const int h = image.height + padding * 2;
+			Rect r;
+			size_t page = 0;
+			for (; page < packerList.size(); ++page)
+			{
+				if (packerList[page].Insert(w, h, r))
+				{
+					break;
+				}
+			}
+			if (page == packerList.size())
+			{
+				packerList.push_back(Packer(pageSize, pageSize));
+				packerList.back().Insert(w, h, r);
+			}
+			Entry e;
+			e.name = fileList[i];
+			e.page = static_cast<uint32_t>(page);
+			e.rect.x = r.x + padding;
+			e.rect.y = r.y + padding;
+			e.rect.width = image.width;
+			e.rect.height = image.height;
+			entryList.push_back(e);
+		}
+
+		//ページの画素を作る
+		const size_t rowBytes = (pageSize * 3 + 3) & ~size_t(3);
+		const size_t pageBytes = rowBytes * pageSize;
+		std::vector<Texture::Image> pageList(packerList.size());
+		for (Texture::Image& page : pageList)
+		{
+			page.width = pageSize;
+			page.height = pageSize;
+			page.buffer.resize(pageBytes);
+		}
+		for (size_t i = 0; i < entryList.size(); ++i)
+		{
+			const Entry& e = entryList[i];
+			Blit(pageList[e.page], pageSize, imageList[order[i]], e.rect, padding);
+		}
+
+		//書き込み途中のファイルが読まれないよう、一時ファイルに書いてから名前を変える
+#ifdef _WIN32
+		_mkdir(cacheDirectory);
+#else
+		mkdir(cacheDirectory, 0755);
+#endif
+		const std::vector<AtlasSource> sourceList = GetSourceList(listFilename, fileList);
+		std::vector<AtlasEntry> entries;
+		std::string names;
+		for (const Entry& e : entryList)
+		{
+			AtlasEntry a = {};
+			a.nameOffset = static_cast<uint32_t>(names.size());
+			a.nameLength = static_cast<uint32_t>(e.name.size());
+			a.page = e.page;
+			a.x = e.rect.x;
+			a.y = e.rect.y;
+			a.width = e.rect.width;
+			a.height = e.rect.height;
+			entries.push_back(a);
+			names += e.name;
+		}
+		AtlasHeader header = {};
+		memcpy(header.magic, atlasMagic, sizeof(atlasMagic));
+		header.version = atlasVersion;
+		header.pageWidth = pageSize;
+		header.pageHeight = pageSize;
+		header.pageCount = static_cast<uint32_t>(pageList.size());
+		header.entryCount = static_cast<uint32_t>(entries.size());
+		header.sourceCount = static_cast<uint32_t>(sourceList.size());
+		header.padding = padding;
+		header.nameOffset = sizeof(AtlasHeader) +
+			sourceList.size() * sizeof(AtlasSource) + entries.size() * sizeof(AtlasEntry);
+		header.pixelOffset = header.nameOffset + names.size();
+		header.pixelOffset += (pixelAlignment - header.pixelOffset % pixelAlignment) % pixelAlignment;
+		header.fileSize = header.pixelOffset + uint64_t(pageBytes) * pageList.size();
+
+		const std::string tmpPath = std::string(outputFilename) + ".tmp";
+		FILE* fp = fopen(tmpPath.c_str(), "wb");
+		if (!fp)
+		{
+			std::cerr << "WARNING: " << outputFilename << "を作成できません" << std::endl;
+			return false;
+		}
+		uint64_t pos = 0;
+		pos += fwrite(&header, 1, sizeof(header), fp);
+		pos += fwrite(sourceList.data(), 1, sourceList.size() * sizeof(AtlasSource), fp);
+		pos += fwrite(entries.data(), 1, entries.size() * sizeof(AtlasEntry), fp);
+		pos += fwrite(names.data(), 1, names.size(), fp);
+		WritePadding(fp, pos, pixelAlignment);
+		for (const Texture::Image& page : pageList)
+		{
+			pos += fwrite(page.buffer.data(), 1, page.buffer.size(), fp);
+		}
+		const bool isSucceeded = (fclose(fp) == 0) && (pos == header.fileSize);
+		if (!isSucceeded)
+		{
+			std::cerr << "WARNING: " << outputFilename << "の書き込みに失敗しました" << std::endl;
+			remove(tmpPath.c_str());
+			return false;
+		}
+		remove(outputFilename);
+		if (rename(tmpPath.c_str(), outputFilename) != 0)
+		{
+			remove(tmpPath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	*アトラスを読み込む
+	*
+	*@param	listFilename	画像の一覧ファイル名
+	*@param	atlas			読み込んだアトラスの格納先
+	*@param	settings		作り直す場合の設定
+	*
+	*@retval true	読み込み成功
+	*@retval false	読み込み失敗
+	*
+	*変換済みのアトラスがないか古ければ、Cookで作り直してから読み込む
+	*GLの関数は呼び出さないので、ワーカースレッドから呼び出してもよい
+	*/
+	bool Load(const char* listFilename, Atlas& atlas, const CookSettings& settings)
+	{
+		std::vector<std::string> fileList;
+		if (!ReadList(listFilename, fileList))
+		{
+			return false;
+		}
+		const std::vector<AtlasSource> sourceList = GetSourceList(listFilename, fileList);
+		const std::string path = GetCachePath(listFilename);
+		if (LoadCooked(path.c_str(), sourceList, settings, atlas))
+		{
+			return true;
+		}
+		if (!Cook(listFilename, path.c_str(), settings))
+		{
+			return false;
+		}
+		if (!LoadCooked(path.c_str(), sourceList, settings, atlas))
+		{
+			std::cerr << "ERROR: '" << path << "' の読み込みに失敗" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	*アトラスの使用状況を取得する
+	*
+	*@param	atlas	調べるアトラス
+	*
+	*@return 使用状況
+	*/
+	Stats GetStats(const Atlas& atlas)
+	{
+		Stats stats;
+		stats.imageCount = atlas.entryList.size();
+		stats.pageCount = atlas.pageList.size();
+		stats.occupancyList.resize(stats.pageCount);
+		const float pageArea = static_cast<float>(atlas.pageWidth) * static_cast<float>(atlas.pageHeight);
+		if (pageArea <= 0)
+		{
+			return stats;
+		}
+		for (const Entry& e : atlas.entryList)
+		{
+			if (e.page < stats.pageCount)
+			{
+				stats.occupancyList[e.page] += static_cast<float>(e.rect.width) * static_cast<float>(e.rect.height) / pageArea;
+			}
+		}
+		return stats;
+	}
+
+	/**
+	*一覧ファイル名に対応する変換済みアトラスのファイル名を作成する
+	*
+	*@param	listFilename	画像の一覧ファイル名
+	*
+	*@return 変換済みアトラスのファイル名
+	*/
+	std::string GetCachePath(const char* listFilename)
+	{
+		static const char hex[] = "0123456789abcdef";
+		uint64_t hash = 14695981039346656037ULL;
+		for (const char* p = listFilename; *p; ++p)
+		{
+			hash ^= static_cast<uint8_t>(*p);
+			hash *= 1099511628211ULL;
+		}
+		std::string path = cacheDirectory;
+		path += '/';
+		for (int shift = 60; shift >= 0; shift -= 4)
+		{
+			path += hex[(hash >> shift) & 0xf];
+		}
+		path += ".atlc";
+		return path;
+	}
+}
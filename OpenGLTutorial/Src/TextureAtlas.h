@@ -0,0 +1,99 @@
+/**
+*	@file TextureAtlas.h
+*/
+#pragma once
+#include "Texture.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+/**
+*	小さな画像を大きなページに詰め合わせるテクスチャアトラス
+*
+*	画像の一覧ファイル(1行に1つの画像ファイル名)から、変換済みのアトラスをRes/Cacheに作成する
+*	一覧ファイルか画像が更新されていれば、読み込み時に自動的に作り直す
+*/
+namespace TextureAtlas
+{
+	/**
+	*	ページ内の矩形(ピクセル単位、左下が原点)
+	*/
+	struct Rect
+	{
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	/**
+	*	MaxRects法による矩形の詰め込み
+	*
+	*	空き領域を互いに重なってよい極大矩形の集合として管理し、
+	*	短い辺の余りが最も小さくなる空き領域(Best Short Side Fit)に配置する
+	*/
+	class Packer
+	{
+	public:
+		Packer(int width, int height);
+
+		bool Insert(int width, int height, Rect& out);
+		float Occupancy() const;
+
+	private:
+		void SplitFreeRect(const Rect& used);
+		void PruneFreeList();
+
+		int width;	///<ページの幅
+		int height;	///<ページの高さ
+		size_t usedArea = 0;	///<配置済みの面積
+		std::vector<Rect> freeList;	///<空き領域の極大矩形
+	};
+
+	/**
+	*	アトラスを作る設定
+	*/
+	struct CookSettings
+	{
+		int pageSize = 1024;	///<ページの幅と高さ(4の倍数)
+		int padding = 2;	///<画像の周囲に確保する余白(縁の画素を引き延ばして埋める)
+		int maxImageSize = 512;	///<アトラスに入れる画像の最大の幅と高さ
+	};
+
+	/**
+	*	アトラスに入れた画像1つ分の情報
+	*/
+	struct Entry
+	{
+		std::string name;	///<元の画像ファイル名
+		uint32_t page = 0;	///<ページ番号
+		Rect rect;	///<ページ内の位置(余白を含まない)
+	};
+
+	/**
+	*	読み込んだアトラス
+	*/
+	struct Atlas
+	{
+		int pageWidth = 0;	///<ページの幅
+		int pageHeight = 0;	///<ページの高さ
+		std::vector<Texture::Image> pageList;	///<ページの画素データ(そのままテクスチャを作成できる)
+		std::vector<Entry> entryList;	///<画像の配置とUVの変換表
+	};
+
+	/**
+	*	アトラスの使用状況
+	*/
+	struct Stats
+	{
+		size_t imageCount = 0;	///<アトラスに入っている画像の数
+		size_t pageCount = 0;	///<ページ数
+		std::vector<float> occupancyList;	///<ページごとの、画像が占める面積の割合(余白を含まない)
+	};
+
+	bool Cook(const char* listFilename, const char* outputFilename,
+		const CookSettings& settings = CookSettings());
+	bool Load(const char* listFilename, Atlas& atlas, const CookSettings& settings = CookSettings());
+	Stats GetStats(const Atlas& atlas);
+	std::string GetCachePath(const char* listFilename);
+}
@@ -0,0 +1,943 @@
+/**
+*	@file TextureCooker.cpp
+*/
+#include "TextureCooker.h"
+#include "JobSystem.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TEXTURECOOKER_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace TextureCooker
+{
+	namespace /* unnamed */
+	{
+		const float kaiserRadius = 2.0f;	///<カイザーフィルタの半径(縮小先の画素単位)
+		const float kaiserAlpha = 4.0f;	///<カイザー窓の形を決める値(大きいほど裾が狭い)
+		const int linearToSrgbTableSize = 8192;
+
+		/**
+		*	リニア空間とsRGB空間の変換表
+		*/
+		struct ColorTable
+		{
+			ColorTable()
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					const float c = static_cast<float>(i) / 255.0f;
+					toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+				}
+				for (int i = 0; i < linearToSrgbTableSize; ++i)
+				{
+					const float c = static_cast<float>(i) / (linearToSrgbTableSize - 1);
+					const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+					toSrgb[i] = static_cast<uint8_t>(std::min(255.0f, s * 255.0f + 0.5f));
+				}
+			}
+			float toLinear[256];
+			uint8_t toSrgb[linearToSrgbTableSize];
+		};
+
+		const ColorTable& GetColorTable()
+		{
+			static const ColorTable table;
+			return table;
+		}
+
+		/**
+		*	縮小先の画素1つに影響する縮小元の画素の範囲
+		*/
+		struct Tap
+		{
+			int index;	///<縮小元の画素の位置(範囲外は端の画素に丸めてある)
+			float weight;	///<重み(合計すると1になる)
+		};
+
+		/**
+		*	1次元の縮小フィルタ
+		*
+		*	縦横それぞれに作り、横方向、縦方向の順に適用する
+		*/
+		struct Kernel
+		{
+			std::vector<int> firstList;	///<縮小先の画素ごとのtapListの開始位置
+			std::vector<int> countList;	///<縮小先の画素ごとのタップ数
+			std::vector<Tap> tapList;
+		};
+
+		/**
+		*	0次の第1種変形ベッセル関数
+		*/
+		float BesselI0(float x)
+		{
+			float sum = 1.0f;
+			float term = 1.0f;
+			const float halfX = x * 0.5f;
+			for (int k = 1; k < 32; ++k)
+			{
+				term *= (halfX / k) * (halfX / k);
+				sum += term;
+				if (term < sum * 1e-7f)
+				{
+					break;
+				}
+			}
+			return sum;
+		}
+
+		/**
+		*	フィルタの重みを計算する
+		*
+		*@param	filter	フィルタの種類
+		*@param	d		縮小先の画素の中心からの距離(縮小先の画素単位)
+		*/
+		float FilterWeight(MipFilter filter, float d)
+		{
+			d = fabsf(d);
+			if (filter == MipFilter::Box)
+			{
+				return d < 0.5f ? 1.0f : 0.0f;
+			}
+			if (d >= kaiserRadius)
+			{
+				return 0.0f;
+			}
+			const float pi = 3.14159265f;
+			const float sinc = d < 1e-5f ? 1.0f : sinf(pi * d) / (pi * d);
+			const float t = d / kaiserRadius;
+			return sinc * BesselI0(kaiserAlpha * sqrtf(1.0f - t * t)) / BesselI0(kaiserAlpha);
+		}
+
+		/**
+		*	1次元の縮小フィルタを作る
+		*
+		*@param	srcSize	縮小元の画素数
+		*@param	dstSize	縮小先の画素数
+		*@param	filter	フィルタの種類
+		*/
+		Kernel MakeKernel(int srcSize, int dstSize, MipFilter filter)
+		{
+			Kernel kernel;
+			kernel.firstList.resize(dstSize);
+			kernel.countList.resize(dstSize);
+			const float scale = static_cast<float>(srcSize) / static_cast<float>(dstSize);
+			const float radius = (filter == MipFilter::Box ? 0.5f : kaiserRadius) * scale;
+			for (int x = 0; x < dstSize; ++x)
+			{
+				const float center = (x + 0.5f) * scale;
+				const int begin = static_cast<int>(ceilf(center - radius - 0.5f));
+				const int end = static_cast<int>(floorf(center + radius - 0.5f));
+				const size_t first = kernel.tapList.size();
+				float total = 0;
+				for (int i = begin; i <= end; ++i)
+				{
+					const float w = FilterWeight(filter, (i + 0.5f - center) / scale);
+					if (w == 0.0f)
+					{
+						continue;
+					}
+					const int index = std::min(std::max(i, 0), srcSize - 1);
+					if (kernel.tapList.size() > first && kernel.tapList.back().index == index)
+					{
+						kernel.tapList.back().weight += w;	//端で丸めた画素はまとめる
+					}
+					else
+					{
+						kernel.tapList.push_back({ index, w });
+					}
+					total += w;
+				}
+				if (kernel.tapList.size() == first)
+				{
+					kernel.tapList.push_back({ std::min(static_cast<int>(center), srcSize - 1), 1.0f });
+					total = 1.0f;
+				}
+				for (size_t i = first; i < kernel.tapList.size(); ++i)
+				{
+					kernel.tapList[i].weight /= total;
+				}
+				kernel.firstList[x] = static_cast<int>(first);
+				kernel.countList[x] = static_cast<int>(kernel.tapList.size() - first);
+			}
+			return kernel;
+		}
+
+		/**
+		*	RGBAの画素1つ分の積和(acc += src * w)
+		*/
+		inline void MulAdd(float* acc, const float* src, float w)
+		{
+#ifdef TEXTURECOOKER_USE_SSE
+			_mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(w))));
+#else
+			acc[0] += src[0] * w;
+			acc[1] += src[1] * w;
+			acc[2] += src[2] * w;
+			acc[3] += src[3] * w;
+#endif
+		}
+
+		typedef Memory::Vector<float, Memory::Tag::Texture> FloatBuffer;
+
+		/**
+		*	JobSystemがあれば並列に、なければこのスレッドで実行する
+		*/
+		void ForEach(JobSystem* jobSystem, size_t count, size_t grainSize, const JobSystem::RangeFuncType& func)
+		{
+			if (jobSystem && count > grainSize)
+			{
+				jobSystem->ParallelFor(count, grainSize, func);
+			}
+			else
+			{
+				func(0, count);
+			}
+		}
+
+		/**
+		*	RGBAのfloat画像を縮小する
+		*
+		*@param	src			縮小元の画素
+		*@param	srcWidth	縮小元の幅
+		*@param	srcHeight	縮小元の高さ
+		*@param	dst			縮小先の画素の格納先
+		*@param	dstWidth	縮小先の幅
+		*@param	dstHeight	縮小先の高さ
+		*@param	filter		フィルタの種類
+		*@param	jobSystem	行ごとに並列に処理するためのジョブシステム(nullptrなら並列化しない)
+		*/
+		void Downsample(const FloatBuffer& src, int srcWidth, int srcHeight,
+			FloatBuffer& dst, int dstWidth, int dstHeight, MipFilter filter, JobSystem* jobSystem)
+		{
+			const Kernel kernelX = MakeKernel(srcWidth, dstWidth, filter);
+			const Kernel kernelY = MakeKernel(srcHeight, dstHeight, filter);
+
+			//横方向に縮小する
+			FloatBuffer tmp(size_t(dstWidth) * srcHeight * 4);
+			ForEach(jobSystem, srcHeight, 8, [&](size_t begin, size_t end) {
+				for (size_t y = begin; y < end; ++y)
+				{
+					const float* srcRow = &src[y * srcWidth * 4];
+					float* tmpRow = &tmp[y * dstWidth * 4];
+					for (int x = 0; x < dstWidth; ++x)
+					{
+						float* acc = tmpRow + x * 4;
+						acc[0] = acc[1] = acc[2] = acc[3] = 0;
+						const Tap* tap = &kernelX.tapList[kernelX.firstList[x]];
+						for (int i = 0; i < kernelX.countList[x]; ++i)
+						{
+							MulAdd(acc, srcRow + tap[i].index * 4, tap[i].weight);
+						}
+					}
+				}
+			});
+
+			//縦方向に縮小する
+			dst.assign(size_t(dstWidth) * dstHeight * 4, 0.0f);
+			ForEach(jobSystem, dstHeight, 8, [&](size_t begin, size_t end) {
+				for (size_t y = begin; y < end; ++y)
+				{
+					float* dstRow = &dst[y * dstWidth * 4];
+					const Tap* tap = &kernelY.tapList[kernelY.firstList[y]];
+					for (int i = 0; i < kernelY.countList[y]; ++i)
+					{
+						const float* tmpRow = &tmp[size_t(tap[i].index) * dstWidth * 4];
+						for (int x = 0; x < dstWidth; ++x)
+						{
+							MulAdd(dstRow + x * 4, tmpRow + x * 4, tap[i].weight);
+						}
+					}
+				}
+			});
+		}
+
+		/**
+		*	float画像をRGBA8に変換する
+		*/
+		void StoreSurface(const FloatBuffer& src, int width, int height, bool isSrgb,
+			Surface& surface, JobSystem* jobSystem)
+		{
+			const ColorTable& table = GetColorTable();
+			surface.width = width;
+			surface.height = height;
+			surface.pixels.resize(size_t(width) * height * 4);
+			ForEach(jobSystem, height, 16, [&](size_t begin, size_t end) {
+				for (size_t i = begin * width * 4; i < end * width * 4; ++i)
+				{
+					const float v = std::min(std::max(src[i], 0.0f), 1.0f);
+					if (isSrgb && (i % 4) != 3)
+					{
+						surface.pixels[i] = table.toSrgb[static_cast<int>(v * (linearToSrgbTableSize - 1) + 0.5f)];
+					}
+					else
+					{
+						surface.pixels[i] = static_cast<uint8_t>(v * 255.0f + 0.5f);
+					}
+				}
+			});
+		}
+
+		/**
+		*	4x4画素のブロックを取り出す(画像の外は端の画素で埋める)
+		*/
+		void FetchBlock(const Surface& surface, int bx, int by, uint8_t* block)
+		{
+			for (int y = 0; y < 4; ++y)
+			{
+				const int sy = std::min(by * 4 + y, surface.height - 1);
+				for (int x = 0; x < 4; ++x)
+				{
+					const int sx = std::min(bx * 4 + x, surface.width - 1);
+					memcpy(block + (y * 4 + x) * 4, &surface.pixels[(size_t(sy) * surface.width + sx) * 4], 4);
+				}
+			}
+		}
+
+		/**
+		*	RGB888をRGB565に変換する
+		*/
+		uint16_t To565(int r, int g, int b)
+		{
+			return static_cast<uint16_t>((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) |
+				((b * 31 + 127) / 255));
+		}
+
+		/**
+		*	RGB565をRGB888に戻す
+		*/
+		void From565(uint16_t c, int* rgb)
+		{
+			const int r = (c >> 11) & 31;
+			const int g = (c >> 5) & 63;
+			const int b = c & 31;
+			rgb[0] = (r << 3) | (r >> 2);
+			rgb[1] = (g << 2) | (g >> 4);
+			rgb[2] = (b << 3) | (b >> 2);
+		}
+
+		/**
+		*	BC1の色ブロックを作る
+		*
+		*@param	block	4x4画素のRGBA8
+		*@param	out		8バイトの出力先
+		*
+		*範囲を1/16ずつ内側に縮めたバウンディングボックスの対角線を端点とし、
+		*各画素には量子化後のパレットで最も近い色を割り当てる
+		*常に4色モード(color0 > color1)で出力するので、BC3の色ブロックにもそのまま使える
+		*/
+		void EncodeColorBlock(const uint8_t* block, uint8_t* out)
+		{
+			int minColor[3] = { 255, 255, 255 };
+			int maxColor[3] = { 0, 0, 0 };
+			int mean[3] = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					minColor[c] = std::min(minColor[c], int(block[i * 4 + c]));
+					maxColor[c] = std::max(maxColor[c], int(block[i * 4 + c]));
+					mean[c] += block[i * 4 + c];
+				}
+			}
+
+			//緑との相関が負の成分は、対角線の向きを反転する
+			int covRG = 0;
+			int covBG = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				const int g = block[i * 4 + 1] * 16 - mean[1];
+				covRG += (block[i * 4 + 0] * 16 - mean[0]) * g;
+				covBG += (block[i * 4 + 2] * 16 - mean[2]) * g;
+			}
+			if (covRG < 0)
+			{
+				std::swap(minColor[0], maxColor[0]);
+			}
+			if (covBG < 0)
+			{
+				std::swap(minColor[2], maxColor[2]);
+			}
+			for (int c = 0; c < 3; ++c)
+			{
+				const int inset = (maxColor[c] - minColor[c]) / 16;
+				minColor[c] += inset;
+				maxColor[c] -= inset;
+			}
+
+			uint16_t c0 = To565(maxColor[0], maxColor[1], maxColor[2]);
+			uint16_t c1 = To565(minColor[0], minColor[1], minColor[2]);
+			if (c0 < c1)
+			{
+				std::swap(c0, c1);
+			}
+			uint32_t indices = 0;
+			if (c0 != c1)
+			{
+				int palette[4][3];
+				From565(c0, palette[0]);
+				From565(c1, palette[1]);
+				for (int c = 0; c < 3; ++c)
+				{
+					palette[2][c] = (palette[0][c] * 2 + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + palette[1][c] * 2) / 3;
+				}
+				for (int i = 0; i < 16; ++i)
+				{
+					int best = 0;
+					int bestDistance = INT32_MAX;
+					for (int n = 0; n < 4; ++n)
+					{
+						const int dr = block[i * 4 + 0] - palette[n][0];
+						const int dg = block[i * 4 + 1] - palette[n][1];
+						const int db = block[i * 4 + 2] - palette[n][2];
+						const int distance = dr * dr + dg * dg + db * db;
+						if (distance < bestDistance)
+						{
+							best = n;
+							bestDistance = distance;
+						}
+					}
+					indices |= best << (i * 2);
+				}
+			}
+			out[0] = static_cast<uint8_t>(c0);
+			out[1] = static_cast<uint8_t>(c0 >> 8);
+			out[2] = static_cast<uint8_t>(c1);
+			out[3] = static_cast<uint8_t>(c1 >> 8);
+			for (int i = 0; i < 4; ++i)
+			{
+				out[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+			}
+		}
+
+		/**
+		*	BC3のアルファブロックを作る
+		*
+		*@param	block	4x4画素のRGBA8
+		*@param	out		8バイトの出力先
+		*
+		*最小値と最大値を端点とする8段階モード(alpha0 > alpha1)で出力する
+		*/
+		void EncodeAlphaBlock(const uint8_t* block, uint8_t* out)
+		{
+			int a0 = 0;
+			int a1 = 255;
+			for (int i = 0; i < 16; ++i)
+			{
+				a0 = std::max(a0, int(block[i * 4 + 3]));
+				a1 = std::min(a1, int(block[i * 4 + 3]));
+			}
+			uint64_t indices = 0;
+			if (a0 != a1)
+			{
+				int palette[8] = { a0, a1 };
+				for (int n = 2; n < 8; ++n)
+				{
+					palette[n] = ((8 - n) * a0 + (n - 1) * a1) / 7;
+				}
+				for (int i = 0; i < 16; ++i)
+				{
+					int best = 0;
+					int bestDistance = 256;
+					for (int n = 0; n < 8; ++n)
+					{
+						const int distance = abs(block[i * 4 + 3] - palette[n]);
+						if (distance < bestDistance)
+						{
+							best = n;
+							bestDistance = distance;
+						}
+					}
+					indices |= uint64_t(best) << (i * 3);
+				}
+			}
+			out[0] = static_cast<uint8_t>(a0);
+			out[1] = static_cast<uint8_t>(a1);
+			for (int i = 0; i < 6; ++i)
+			{
+				out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+			}
+		}
+
+		/**
+		*	ファイルの更新日時を取得する
+		*
+		*@return 更新日時(ファイルがなければ-1)
+		*/
+		int64_t GetModifiedTime(const char* filename)
+		{
+			struct stat st;
+			if (stat(filename, &st))
+			{
+				return -1;
+			}
+			return static_cast<int64_t>(st.st_mtime);
+		}
+
+		/**
+		*	変換元になる画像ファイルか調べる
+		*/
+		bool IsSourceImage(const std::string& filename)
+		{
+			const size_t dot = filename.find_last_of('.');
+			if (dot == std::string::npos)
+			{
+				return false;
+			}
+			std::string ext = filename.substr(dot);
+			std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+			return ext == ".bmp" || ext == ".jpg" || ext == ".jpeg" || ext == ".png";
+		}
+
+		/**
+		*	ディレクトリ以下の画像ファイルを集める(キャッシュのディレクトリは除く)
+		*/
+		void ListSourceFiles(const std::string& directory, std::vector<std::string>& fileList)
+		{
+#ifdef _WIN32
+			_finddata_t data;
+			const intptr_t handle = _findfirst((directory + "/*").c_str(), &data);
+			if (handle == -1)
+			{
+				return;
+			}
+			do
+			{
+				const std::string name = data.name;
+				if (name == "." || name == "..")
+				{
+					continue;
+				}
+				const std::string path = directory + "/" + name;
+				if (data.attrib & _A_SUBDIR)
+				{
+					if (name != "Cache")
+					{
+						ListSourceFiles(path, fileList);
+					}
+				}
+				else if (IsSourceImage(name))
+				{
+					fileList.push_back(path);
+				}
+			} while (_findnext(handle, &data) == 0);
+			_findclose(handle);
+#else
+			DIR* dir = opendir(directory.c_str());
+			if (!dir)
+			{
+				return;
+			}
+			while (const dirent* e = readdir(dir))
+			{
+				const std::string name = e->d_name;
+				if (name == "." || name == "..")
+				{
+					continue;
+				}
+				const std::string path = directory + "/" + name;
+				struct stat st;
+				if (stat(path.c_str(), &st))
+				{
+					continue;
+				}
+				if (S_ISDIR(st.st_mode))
+				{
+					if (name != "Cache")
+					{
+						ListSourceFiles(path, fileList);
+					}
+				}
+				else if (IsSourceImage(name))
+				{
+					fileList.push_back(path);
+				}
+			}
+			closedir(dir);
+#endif
+		}
+
+		/**
+		*	ミップマップ付きのBC1/BC3圧縮データをDDSファイルに書き込む
+		*
+		*@param	filename	出力ファイル名
+		*@param	chain		ミップマップの各段(大きさだけ使う)
+		*@param	format		圧縮形式
+		*@param	levelList	各段の圧縮データ
+		*/
+		bool WriteDds(const char* filename, const std::vector<Surface>& chain, BlockFormat format,
+			const std::vector<Memory::Vector<uint8_t, Memory::Tag::Texture>>& levelList)
+		{
+			uint32_t header[32] = {};
+			memcpy(&header[0], "DDS ", 4);
+			header[1] = 124;	//ヘッダのサイズ
+			header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;	//CAPS|HEIGHT|WIDTH|PIXELFORMAT|MIPMAPCOUNT|LINEARSIZE
+			header[3] = chain[0].height;
+			header[4] = chain[0].width;
+			header[5] = static_cast<uint32_t>(levelList[0].size());
+			header[7] = static_cast<uint32_t>(chain.size());
+			header[19] = 32;	//ピクセルフォーマットのサイズ
+			header[20] = 0x4;	//FOURCC
+			memcpy(&header[21], format == BlockFormat::BC1 ? "DXT1" : "DXT5", 4);
+			header[27] = 0x1000 | 0x400000 | 0x8;	//TEXTURE|MIPMAP|COMPLEX
+
+			//書き込み途中のファイルが読まれないよう、一時ファイルに書いてから名前を変える
+			const std::string tmpPath = std::string(filename) + ".tmp";
+			FILE* fp = fopen(tmpPath.c_str(), "wb");
+			if (!fp)
+			{
+				std::cerr << "WARNING: " << filename << "を作成できません" << std::endl;
+				return false;
+			}
+			size_t expectedSize = sizeof(header);
+			size_t writtenSize = fwrite(header, 1, sizeof(header), fp);
+			for (const auto& e : levelList)
+			{
+				expectedSize += e.size();
+				writtenSize += fwrite(e.data(), 1, e.size(), fp);
+			}
+			if (fclose(fp) != 0 || writtenSize != expectedSize)
+			{
+				std::cerr << "WARNING: " << filename << "の書き込みに失敗しました" << std::endl;
+				remove(tmpPath.c_str());
+				return false;
+			}
+			remove(filename);
+			if (rename(tmpPath.c_str(), filename) != 0)
+			{
+				remove(tmpPath.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		/**
+		*	経過時間を秒単位で取得する
+		*/
+		double SecondsSince(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+	} // unnamed namespace
+
+	/**
+	*DecodeFileで読み込んだ画像をRGBA8に変換する
+	*
+	*@param	image	画像データ(非圧縮で、BGR,BGRA,RGB,RGBA,REDのいずれか)
+	*@param	surface	変換した画像の格納先(下の行から順に並ぶ)
+	*
+	*@retval true	変換成功
+	*@retval false	対応していない形式
+	*
+	*REDはグレースケールとしてRGBすべてに同じ値を入れる
+	*/
+	bool ConvertImage(const Texture::Image& image, Surface& surface)
+	{
+		if (image.isCompressed || image.width <= 0 || image.height <= 0)
+		{
+			return false;
+		}
+		int pixelBytes = 0;
+		int r = 0, g = 1, b = 2;
+		switch (image.format)
+		{
+		case GL_BGR: pixelBytes = 3; r = 2; b = 0; break;
+		case GL_BGRA: pixelBytes = 4; r = 2; b = 0; break;
+		case GL_RGB: pixelBytes = 3; break;
+		case GL_RGBA: pixelBytes = 4; break;
+		case GL_RED: pixelBytes = 1; g = 0; b = 0; break;
+		default: return false;
+		}
+		if (image.Size() < image.offset + image.RowBytes() * image.height)
+		{
+			return false;
+		}
+		const bool hasAlpha = pixelBytes == 4 && image.iformat != GL_RGB8;
+		surface.width = image.width;
+		surface.height = image.height;
+		surface.pixels.resize(size_t(image.width) * image.height * 4);
+		for (int y = 0; y < image.height; ++y)
+		{
+			const uint8_t* src = image.Row(y);
+			uint8_t* dst = &surface.pixels[size_t(y) * image.width * 4];
+			for (int x = 0; x < image.width; ++x, src += pixelBytes, dst += 4)
+			{
+				dst[0] = src[r];
+				dst[1] = src[g];
+				dst[2] = src[b];
+				dst[3] = hasAlpha ? src[3] : 255;
+			}
+		}
+		return true;
+	}
+
+	/**
+	*1x1までのミップマップを作る
+	*
+	*@param	base		最も大きい段の画像
+	*@param	settings	変換の設定(filterとisSrgbを使う)
+	*@param	chain		作成したミップマップの格納先(chain[0]はbaseのコピー)
+	*@param	jobSystem	行ごとに並列に処理するためのジョブシステム(nullptrなら並列化しない)
+	*
+	*各段はひとつ前の段のfloat画像から作るので、8bitに丸めた誤差は蓄積しない
+	*段数はTexture::maxLevelCountを超えない
+	*/
+	void GenerateMipChain(const Surface& base, const Settings& settings,
+		std::vector<Surface>& chain, JobSystem* jobSystem)
+	{
+		chain.clear();
+		chain.push_back(base);
+
+		const ColorTable& table = GetColorTable();
+		FloatBuffer src(base.pixels.size());
+		ForEach(jobSystem, base.height, 16, [&](size_t begin, size_t end) {
+			for (size_t i = begin * base.width * 4; i < end * base.width * 4; ++i)
+			{
+				const uint8_t v = base.pixels[i];
+				src[i] = settings.isSrgb && (i % 4) != 3 ? table.toLinear[v] : v / 255.0f;
+			}
+		});
+
+		FloatBuffer dst;
+		int width = base.width;
+		int height = base.height;
+		while ((width > 1 || height > 1) && static_cast<int>(chain.size()) < Texture::maxLevelCount)
+		{
+			const int dstWidth = std::max(1, width / 2);
+			const int dstHeight = std::max(1, height / 2);
+			Downsample(src, width, height, dst, dstWidth, dstHeight, settings.filter, jobSystem);
+			chain.push_back(Surface());
+			StoreSurface(dst, dstWidth, dstHeight, settings.isSrgb, chain.back(), jobSystem);
+			src.swap(dst);
+			width = dstWidth;
+			height = dstHeight;
+		}
+	}
+
+	/**
+	*画像に透明な画素があるか調べる
+	*/
+	bool HasAlpha(const Surface& surface)
+	{
+		for (size_t i = 3; i < surface.pixels.size(); i += 4)
+		{
+			if (surface.pixels[i] != 255)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	*圧縮後のバイト数を計算する
+	*
+	*@param	width	画像の幅
+	*@param	height	画像の高さ
+	*@param	format	圧縮形式(BC1かBC3)
+	*/
+	size_t CompressedSize(int width, int height, BlockFormat format)
+	{
+		return size_t((width + 3) / 4) * size_t((height + 3) / 4) * (format == BlockFormat::BC1 ? 8 : 16);
+	}
+
+	/**
+	*ミップマップの全段をBC1かBC3に圧縮する
+	*
+	*@param	chain		ミップマップの各段
+	*@param	format		圧縮形式(Autoの場合はchain[0]に透明な画素があるかで決める)
+	*@param	output		段ごとの圧縮データの格納先
+	*@param	jobSystem	並列に処理するためのジョブシステム(nullptrなら並列化しない)
+	*
+	*全段のブロック行をひとつのParallelForで処理するので、小さい段も大きい段と並行して圧縮される
+	*/
+	void Compress(const std::vector<Surface>& chain, BlockFormat format,
+		std::vector<Memory::Vector<uint8_t, Memory::Tag::Texture>>& output, JobSystem* jobSystem)
+	{
+		if (format == BlockFormat::Auto)
+		{
+			format = !chain.empty() && HasAlpha(chain[0]) ? BlockFormat::BC3 : BlockFormat::BC1;
+		}
+		const size_t blockBytes = format == BlockFormat::BC1 ? 8 : 16;
+
+		//全段のブロック行に通し番号をつける
+		struct Row
+		{
+			size_t level;
+			int blockY;
+		};
+		std::vector<Row> rowList;
+		output.resize(chain.size());
+		for (size_t i = 0; i < chain.size(); ++i)
+		{
+			output[i].resize(CompressedSize(chain[i].width, chain[i].height, format));
+			for (int y = 0; y < (chain[i].height + 3) / 4; ++y)
+			{
+				rowList.push_back({ i, y });
+			}
+		}
+
+		ForEach(jobSystem, rowList.size(), 4, [&](size_t begin, size_t end) {
+			uint8_t block[16 * 4];
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Surface& surface = chain[rowList[i].level];
+				const int blockY = rowList[i].blockY;
+				const int blockCountX = (surface.width + 3) / 4;
+				uint8_t* out = output[rowList[i].level].data() + size_t(blockY) * blockCountX * blockBytes;
+				for (int blockX = 0; blockX < blockCountX; ++blockX, out += blockBytes)
+				{
+					FetchBlock(surface, blockX, blockY, block);
+					if (format == BlockFormat::BC3)
+					{
+						EncodeAlphaBlock(block, out);
+						EncodeColorBlock(block, out + 8);
+					}
+					else
+					{
+						EncodeColorBlock(block, out);
+					}
+				}
+			}
+		});
+	}
+
+	/**
+	*画像ファイルをミップマップ付きの圧縮DDSに変換する
+	*
+	*@param	filename		変換元の画像ファイル名
+	*@param	outputFilename	出力するDDSファイル名
+	*@param	settings		変換の設定
+	*@param	jobSystem		並列に処理するためのジョブシステム(nullptrなら並列化しない)
+	*@param	stats			統計を加算する先(nullptrなら記録しない)
+	*
+	*@retval true	変換成功(または既に最新)
+	*@retval false	変換失敗
+	*/
+	bool CookFile(const char* filename, const char* outputFilename, const Settings& settings,
+		JobSystem* jobSystem, Stats* stats)
+	{
+		Stats dummy;
+		Stats& s = stats ? *stats : dummy;
+		const int64_t sourceTime = GetModifiedTime(filename);
+		if (!settings.isForced && sourceTime >= 0 && GetModifiedTime(outputFilename) >= sourceTime)
+		{
+			++s.skipCount;
+			return true;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		Texture::Image image;
+		Surface base;
+		if (!Texture::DecodeFile(filename, image, false, jobSystem) || !ConvertImage(image, base))
+		{
+			std::cerr << "WARNING: '" << filename << "' は変換できない形式です" << std::endl;
+			++s.errorCount;
+			return false;
+		}
+
+		const auto mipStart = std::chrono::steady_clock::now();
+		std::vector<Surface> chain;
+		GenerateMipChain(base, settings, chain, jobSystem);
+		s.mipSeconds += SecondsSince(mipStart);
+
+		BlockFormat format = settings.format;
+		if (format == BlockFormat::Auto)
+		{
+			format = HasAlpha(base) ? BlockFormat::BC3 : BlockFormat::BC1;
+		}
+		const auto compressStart = std::chrono::steady_clock::now();
+		std::vector<Memory::Vector<uint8_t, Memory::Tag::Texture>> levelList;
+		Compress(chain, format, levelList, jobSystem);
+		s.compressSeconds += SecondsSince(compressStart);
+
+		if (!WriteDds(outputFilename, chain, format, levelList))
+		{
+			++s.errorCount;
+			return false;
+		}
+		s.totalSeconds += SecondsSince(start);
+		s.sourceMegapixels += static_cast<double>(base.width) * base.height / 1000000.0;
+		++s.fileCount;
+		return true;
+	}
+
+	/**
+	*ディレクトリ以下の画像ファイルをすべてDDSに変換する
+	*
+	*@param	directory	変換するディレクトリ(サブディレクトリも含む)
+	*@param	settings	変換の設定
+	*@param	jobSystem	並列に処理するためのジョブシステム(nullptrなら並列化しない)
+	*@param	os			結果と処理速度(百万画素/秒)の出力先
+	*
+	*@retval true	すべて変換できた
+	*@retval false	変換できないファイルがあった
+	*/
+	bool CookDirectory(const char* directory, const Settings& settings, JobSystem* jobSystem,
+		std::ostream& os)
+	{
+		std::vector<std::string> fileList;
+		ListSourceFiles(directory, fileList);
+		std::sort(fileList.begin(), fileList.end());
+
+		Stats stats;
+		for (const std::string& e : fileList)
+		{
+			const std::string outputPath = GetOutputPath(e.c_str());
+			const size_t count = stats.fileCount;
+			if (CookFile(e.c_str(), outputPath.c_str(), settings, jobSystem, &stats) && stats.fileCount > count)
+			{
+				os << "  " << e << " -> " << outputPath << "\n";
+			}
+		}
+
+		const auto throughput = [&stats](double seconds) {
+			return seconds > 0 ? stats.sourceMegapixels / seconds : 0.0;
+		};
+		os << "Texture cook '" << directory << "': " << stats.fileCount << " converted, " <<
+			stats.skipCount << " up to date, " << stats.errorCount << " failed\n" <<
+			std::fixed << std::setprecision(1);
+		os << "  mip generation : " << std::setw(8) << throughput(stats.mipSeconds) << " MP/s\n";
+		os << "  compression    : " << std::setw(8) << throughput(stats.compressSeconds) << " MP/s\n";
+		os << "  total          : " << std::setw(8) << throughput(stats.totalSeconds) << " MP/s (" <<
+			std::setprecision(2) << stats.sourceMegapixels << " MP in " << stats.totalSeconds << " s)" <<
+			std::defaultfloat << std::endl;
+		return stats.errorCount == 0;
+	}
+
+	/**
+	*画像ファイルに対応するDDSファイル名を取得する
+	*
+	*@param	filename	画像ファイル名
+	*
+	*@return 拡張子を.ddsに変えたファイル名
+	*/
+	std::string GetOutputPath(const char* filename)
+	{
+		std::string path(filename);
+		const size_t dot = path.find_last_of('.');
+		const size_t slash = path.find_last_of("/\\");
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		{
+			path.resize(dot);
+		}
+		return path + ".dds";
+	}
+}
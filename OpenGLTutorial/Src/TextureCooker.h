@@ -0,0 +1,90 @@
+/**
+*	@file TextureCooker.h
+*/
+#pragma once
+#include "Texture.h"
+#include "Memory.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+
+class JobSystem;
+
+/**
+*	画像からミップマップ付きのBC1/BC3圧縮テクスチャ(DDS)を作成する
+*
+*	作成したDDSは元の画像と同じ場所に拡張子を変えて置くので、
+*	Texture::DecodeFileのpreferCompressedで元の画像の代わりに読み込まれる
+*	画素は元の画像と同じく下の行から順に並ぶ
+*/
+namespace TextureCooker
+{
+	/**
+	*	ミップマップを作るときの縮小フィルタ
+	*/
+	enum class MipFilter
+	{
+		Box,	///<縮小元の画素の単純平均(高速だがぼやけやすい)
+		Kaiser,	///<カイザー窓をかけたsinc(シャープで折り返しが少ない)
+	};
+
+	/**
+	*	圧縮形式
+	*/
+	enum class BlockFormat
+	{
+		Auto,	///<透明な画素があればBC3、なければBC1
+		BC1,	///<RGB 4bit/画素(アルファは捨てる)
+		BC3,	///<RGBA 8bit/画素
+	};
+
+	/**
+	*	変換の設定
+	*/
+	struct Settings
+	{
+		MipFilter filter = MipFilter::Kaiser;
+		BlockFormat format = BlockFormat::Auto;
+		bool isSrgb = true;	///<true:色をリニア空間に変換してから縮小する(アルファは常にリニア)
+		bool isForced = false;	///<true:DDSが元の画像より新しくても作り直す
+	};
+
+	/**
+	*	RGBA8の画像1枚(下の行から順に並ぶ)
+	*/
+	struct Surface
+	{
+		int width = 0;
+		int height = 0;
+		Memory::Vector<uint8_t, Memory::Tag::Texture> pixels;	///<width*height*4バイト
+	};
+
+	/**
+	*	変換の統計
+	*/
+	struct Stats
+	{
+		size_t fileCount = 0;	///<変換したファイル数
+		size_t skipCount = 0;	///<最新なので変換しなかったファイル数
+		size_t errorCount = 0;	///<変換できなかったファイル数
+		double sourceMegapixels = 0;	///<変換元の画素数(百万画素単位)
+		double mipSeconds = 0;	///<ミップマップ作成にかかった時間
+		double compressSeconds = 0;	///<圧縮にかかった時間
+		double totalSeconds = 0;	///<読み書きを含む全体の時間
+	};
+
+	bool ConvertImage(const Texture::Image& image, Surface& surface);
+	void GenerateMipChain(const Surface& base, const Settings& settings,
+		std::vector<Surface>& chain, JobSystem* jobSystem = nullptr);
+	bool HasAlpha(const Surface& surface);
+	size_t CompressedSize(int width, int height, BlockFormat format);
+	void Compress(const std::vector<Surface>& chain, BlockFormat format,
+		std::vector<Memory::Vector<uint8_t, Memory::Tag::Texture>>& output, JobSystem* jobSystem = nullptr);
+
+	bool CookFile(const char* filename, const char* outputFilename, const Settings& settings,
+		JobSystem* jobSystem = nullptr, Stats* stats = nullptr);
+	bool CookDirectory(const char* directory, const Settings& settings, JobSystem* jobSystem,
+		std::ostream& os);
+	std::string GetOutputPath(const char* filename);
+}
@@ -0,0 +1,505 @@
+/**
+*	@file TextureManager.cpp
+*/
+#include "TextureManager.h"
+#include "AssetLoader.h"
+#include "JobSystem.h"
+#include <iostream>
+#include <algorithm>
+
+namespace /* unnamed */ {
+
+//アンロードしたテクスチャの代わりに使う画像の大きさ
+const int placeholderSize = 4;
+
+} // unnamed namespace
+
+/**
+*テクスチャ管理オブジェクトを作成する
+*
+*@param	loader		置き換えに使うアセットローダー
+*@param	pool		置き換え後の中身を確保するテクスチャプール
+*@param	jobSystem	読み込み直しの展開に使うジョブシステム
+*@param	uploader	読み込み直しの転送に使うテクスチャ転送オブジェクト(nullptrなら一括で転送する)
+*@param	retireQueue	置き換えられた古い中身の解放に使うキュー
+*
+*@return 作成したオブジェクトへのポインタ
+*/
+TextureManagerPtr TextureManager::Create(AssetLoader& loader, const TexturePoolPtr& pool,
+	JobSystem& jobSystem, const TextureUploaderPtr& uploader, RetireQueue& retireQueue)
+{
+	struct Impl : TextureManager { Impl() {} ~Impl() {} };
+	TextureManagerPtr p = std::make_shared<Impl>();
+	p->assetLoader = &loader;
+	p->pool = pool;
+	p->jobSystem = &jobSystem;
+	p->uploader = uploader;
+	p->retireQueue = &retireQueue;
+	return p;
+}
+
+/**
+*デストラクタ
+*/
+TextureManager::~TextureManager()
+{
+	if (framebuffer[0])
+	{
+		glDeleteFramebuffers(2, framebuffer);
+	}
+}
+
+/**
+*テクスチャを管理対象に登録する
+*
+*@param	filename	テクスチャのファイル名(アンロードした後はここから読み込み直す)
+*@param	texture		登録するテクスチャ
+*
+*@retval true	登録した
+*@retval false	テクスチャ配列に入っていないので管理できない
+*/
+bool TextureManager::Register(const char* filename, const TexturePtr& texture)
+{
+	if (!texture || !texture->array)
+	{
+		return false;
+	}
+	EntryPtr e = std::make_shared<Entry>();
+	e->filename = filename;
+	e->texture = texture;
+	e->iformat = texture->array->InternalFormat();
+	e->isCompressed = texture->array->IsCompressed();
+	e->fullWidth = texture->width;
+	e->fullHeight = texture->height;
+	e->fullLevelCount = texture->array->LevelCount();
+	e->fullBytes = Texture::MemorySize(e->iformat, e->fullWidth, e->fullHeight, e->fullLevelCount);
+	e->bytes = e->fullBytes;
+	entryList.push_back(e);
+
+	//読み込んだ直後に追い出されないよう、使ったことにしておく
+	texture->MarkUsed();
+	return true;
+}
+
+/**
+*テクスチャを管理対象から外す
+*
+*@param	texture	外すテクスチャ
+*
+*@retval true	外した
+*@retval false	登録されていない
+*
+*置き換えの途中なら、置き換えが終わった時点で古い中身と一緒に手放す
+*/
+bool TextureManager::Unregister(const TexturePtr& texture)
+{
+	const auto itr = std::find_if(entryList.begin(), entryList.end(),
+		[&texture](const EntryPtr& e) { return e->texture == texture; });
+	if (itr == entryList.end())
+	{
+		return false;
+	}
+	const EntryPtr e = *itr;
+	entryList.erase(itr);
+	e->isUnregistered = true;
+	if (!e->isBusy)
+	{
+		retireQueue->Retire(std::move(e->texture));
+	}
+	return true;
+}
+
+/**
+*常駐状況を更新する
+*
+*シミュレーションスレッドから、毎フレームの更新の終わり(描画命令を作った後)に呼び出すこと
+*このフレームで使われた縮小版とアンロード済みのテクスチャは、上限に収まるなら読み込み直す
+*使用量が上限を超えていれば、しばらく使われていないテクスチャを古い順に追い出す
+*/
+void TextureManager::Update()
+{
+	const uint32_t frame = Texture::CurrentFrame();
+	size_t projected = ProjectedBytes();
+	for (const EntryPtr& e : entryList)
+	{
+		if (e->isBusy || e->isReloadFailed || (e->reduction == 0 && !e->isUnloaded) ||
+			frame - e->texture->LastUsedFrame() > 1)
+		{
+			continue;
+		}
+		const size_t extra = e->fullBytes > e->bytes ? e->fullBytes - e->bytes : 0;
+		if (projected + extra > settings.budgetBytes)
+		{
+			projected -= std::min(projected, Evict(projected + extra - settings.budgetBytes, frame));
+		}
+		if (projected + extra <= settings.budgetBytes)
+		{
+			Reload(e);
+			projected += extra;
+		}
+	}
+	if (projected > settings.budgetBytes)
+	{
+		Evict(projected - settings.budgetBytes, frame);
+	}
+
+	size_t residentBytes = 0;
+	for (const EntryPtr& e : entryList)
+	{
+		residentBytes += e->bytes;
+	}
+	counters.peakBytes = std::max(counters.peakBytes, residentBytes);
+	Texture::AdvanceFrame();
+}
+
+/**
+*置き換え中のものを置き換え後の大きさで数えた使用量を計算する
+*/
+size_t TextureManager::ProjectedBytes() const
+{
+	size_t total = 0;
+	for (const EntryPtr& e : entryList)
+	{
+		total += e->isBusy ? e->pendingBytes : e->bytes;
+	}
+	return total;
+}
+
+/**
+*しばらく使われていないテクスチャを古い順に追い出す
+*
+*@param	bytes	減らしたいバイト数
+*@param	frame	現在のフレーム番号
+*
+*@return 置き換えが終わったときに減るバイト数の合計
+*
+*1回の呼び出しでは、1つのテクスチャを1段だけ縮小する(またはアンロードする)
+*/
+size_t TextureManager::Evict(size_t bytes, uint32_t frame)
+{
+	std::vector<EntryPtr> candidateList;
+	for (const EntryPtr& e : entryList)
+	{
+		if (!e->isBusy && !e->isUnloaded && frame - e->texture->LastUsedFrame() >= settings.idleFrameCount)
+		{
+			candidateList.push_back(e);
+		}
+	}
+	std::sort(candidateList.begin(), candidateList.end(), [](const EntryPtr& a, const EntryPtr& b) {
+		return a->texture->LastUsedFrame() < b->texture->LastUsedFrame();
+	});
+
+	size_t freed = 0;
+	for (const EntryPtr& e : candidateList)
+	{
+		if (freed >= bytes)
+		{
+			break;
+		}
+		//ミップマップの段を複製するにはglCopyImageSubData(GL4.3)が、1段だけの画像を縮小するには描画できる形式が必要
+		const int next = e->reduction + 1;
+		const int levelCount = std::max(1, e->fullLevelCount - e->reduction);
+		const bool canReduce =
+			std::min(e->fullWidth >> next, e->fullHeight >> next) >= settings.minReducedSize &&
+			(levelCount > 1 ? GLEW_VERSION_4_3 != 0 : !e->isCompressed);
+		freed += canReduce ? Reduce(e) : Unload(e);
+	}
+	return freed;
+}
+
+/**
+*ミップマップを1段落とした縮小版に置き換える
+*
+*@param	entry	置き換えるテクスチャ
+*
+*@return 置き換えが終わったときに減るバイト数
+*/
+size_t TextureManager::Reduce(const EntryPtr& entry)
+{
+	struct Data
+	{
+		Texture::Image desc;	///<縮小版の大きさと形式(画素データは持たない)
+		TexturePtr texture;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	const int reduction = entry->reduction + 1;
+	data->desc.width = std::max(1, entry->fullWidth >> reduction);
+	data->desc.height = std::max(1, entry->fullHeight >> reduction);
+	data->desc.iformat = entry->iformat;
+	data->desc.isCompressed = entry->isCompressed;
+	data->desc.levelCount = std::max(1, entry->fullLevelCount - reduction);
+	entry->isBusy = true;
+	entry->pendingBytes = Texture::MemorySize(entry->iformat, data->desc.width, data->desc.height, data->desc.levelCount);
+	assetLoader->Load(
+		nullptr,
+		[this, entry, data]() {
+			data->texture = pool->Allocate(data->desc);
+			return data->texture && CopyReduced(*entry->texture, *data->texture);
+		},
+		[this, entry, data, reduction](bool result) {
+			if (!Replace(entry, data->texture, result))
+			{
+				return false;
+			}
+			entry->reduction = reduction;
+			++counters.reduceCount;
+			return true;
+		});
+	return entry->bytes - entry->pendingBytes;
+}
+
+/**
+*小さな灰色の代用品に置き換える
+*
+*@param	entry	置き換えるテクスチャ
+*
+*@return 置き換えが終わったときに減るバイト数
+*/
+size_t TextureManager::Unload(const EntryPtr& entry)
+{
+	struct Data
+	{
+		Texture::Image desc;
+		TexturePtr texture;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	data->desc.width = placeholderSize;
+	data->desc.height = placeholderSize;
+	data->desc.iformat = GL_RGBA8;
+	data->desc.format = GL_RGBA;
+	entry->isBusy = true;
+	entry->pendingBytes = Texture::MemorySize(GL_RGBA8, placeholderSize, placeholderSize, 1);
+	assetLoader->Load(
+		nullptr,
+		[this, data]() {
+			data->texture = pool->Allocate(data->desc);
+			if (!data->texture)
+			{
+				return false;
+			}
+			static const uint8_t gray[placeholderSize * placeholderSize * 4] = {
+				128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255,
+				128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255,
+				128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255,
+				128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255, 128, 128, 128, 255,
+			};
+			glBindTexture(GL_TEXTURE_2D_ARRAY, data->texture->Id());
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, data->texture->Layer(),
+				placeholderSize, placeholderSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			return true;
+		},
+		[this, entry, data](bool result) {
+			if (!Replace(entry, data->texture, result))
+			{
+				return false;
+			}
+			entry->isUnloaded = true;
+			++counters.unloadCount;
+			return true;
+		});
+	return entry->bytes > entry->pendingBytes ? entry->bytes - entry->pendingBytes : 0;
+}
+
+/**
+*元のファイルから読み込み直す
+*
+*@param	entry	読み込み直すテクスチャ
+*
+*展開はワーカースレッドで、転送は描画スレッドで1フレームの上限に収まるよう分割して行う
+*/
+void TextureManager::Reload(const EntryPtr& entry)
+{
+	struct Data
+	{
+		Texture::Image image;
+		TexturePtr texture;
+		TextureUploader::Progress progress;
+	};
+	const std::shared_ptr<Data> data = std::make_shared<Data>();
+	entry->isBusy = true;
+	entry->pendingBytes = entry->fullBytes;
+	assetLoader->Load(
+		[this, entry, data]() {
+			return Texture::DecodeFile(entry->filename.c_str(), data->image, true, jobSystem);
+		},
+		[this, data]() {
+			if (!uploader)
+			{
+				data->texture = pool->Add(data->image);
+				data->image = Texture::Image();
+				return static_cast<bool>(data->texture);
+			}
+			if (!data->texture)
+			{
+				data->texture = pool->Allocate(data->image);
+				if (!data->texture)
+				{
+					return false;
+				}
+			}
+			if (!uploader->Upload(data->texture, data->image, data->progress))
+			{
+				assetLoader->Defer();
+				return true;
+			}
+			data->image = Texture::Image();
+			return true;
+		},
+		[this, entry, data](bool result) {
+			if (!Replace(entry, data->texture, result))
+			{
+				if (!entry->isUnregistered)
+				{
+					std::cerr << "ERROR: '" << entry->filename << "' の読み込み直しに失敗" << std::endl;
+					entry->isReloadFailed = true;
+				}
+				return false;
+			}
+			entry->reduction = 0;
+			entry->isUnloaded = false;
+			++counters.reloadCount;
+			return true;
+		});
+}
+
+/**
+*置き換えの結果を登録されたテクスチャに反映する(シミュレーションスレッド専用)
+*
+*@param	entry	置き換えるテクスチャ
+*@param	storage	置き換え後の中身を持つテクスチャ(古い中身と入れ替えて解放待ちにする)
+*@param	result	描画スレッドでの処理が成功したかどうか
+*
+*@retval true	置き換えた
+*@retval false	描画スレッドでの処理が失敗していたか、途中で登録を解除されたので、置き換えなかった
+*
+*描画命令はシミュレーションスレッドでテクスチャのIdを読むので、ここで入れ替えればそれ以降の描画に反映される
+*/
+bool TextureManager::Replace(const EntryPtr& entry, TexturePtr& storage, bool result)
+{
+	entry->isBusy = false;
+	if (entry->isUnregistered)
+	{
+		Retire(storage);
+		retireQueue->Retire(std::move(entry->texture));
+		return false;
+	}
+	if (!result || !storage)
+	{
+		++counters.failCount;
+		Retire(storage);
+		return false;
+	}
+	entry->texture->SwapStorage(*storage);
+	Retire(storage);
+	const Texture& t = *entry->texture;
+	entry->bytes = Texture::MemorySize(t.array->InternalFormat(), t.width, t.height, t.array->LevelCount());
+	return true;
+}
+
+/**
+*テクスチャの中身をミップマップ1段分縮小して複製する(描画スレッド専用)
+*
+*@param	src	複製元
+*@param	dst	複製先(src.width/2 x src.height/2で、段数が1つ少ないかどちらも1段)
+*
+*@retval true	複製した
+*@retval false	GLのエラーが発生した
+*
+*複製元にミップマップがあれば2段目以降をそのまま複製し、なければ線形補間で縮小して描き込む
+*/
+bool TextureManager::CopyReduced(const Texture& src, const Texture& dst)
+{
+	if (src.array->LevelCount() > 1)
+	{
+		for (int i = 0; i < dst.array->LevelCount(); ++i)
+		{
+			glCopyImageSubData(src.texId, GL_TEXTURE_2D_ARRAY, i + 1, 0, 0, src.layer,
+				dst.texId, GL_TEXTURE_2D_ARRAY, i, 0, 0, dst.layer,
+				std::max(1, dst.width >> i), std::max(1, dst.height >> i), 1);
+		}
+	}
+	else
+	{
+		if (!framebuffer[0])
+		{
+			glGenFramebuffers(2, framebuffer);
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer[0]);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, src.texId, 0, src.layer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer[1]);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, dst.texId, 0, dst.layer);
+		glBlitFramebuffer(0, 0, src.width, src.height, 0, 0, dst.width, dst.height,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	}
+	const GLenum result = glGetError();
+	if (result != GL_NO_ERROR)
+	{
+		std::cerr << "ERROR: テクスチャの縮小に失敗: 0x" << std::hex << result << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+*使われなくなったテクスチャの中身を解放待ちにする
+*
+*@param	storage	解放するテクスチャ(nullptrになる)
+*
+*描画スレッドに渡されたスナップショットがまだ古いIdとレイヤーを使っている可能性があるので、
+*それらが描画されなくなり、GPUが描画を終えてから解放する
+*/
+void TextureManager::Retire(TexturePtr& storage)
+{
+	retireQueue->Retire(std::move(storage));
+	storage.reset();
+}
+
+/**
+*常駐状況と追い出しの統計を取得する
+*
+*@return 統計
+*/
+TextureManager::Stats TextureManager::GetStats() const
+{
+	Stats s = counters;
+	s.textureCount = entryList.size();
+	s.budgetBytes = settings.budgetBytes;
+	for (const EntryPtr& e : entryList)
+	{
+		if (e->isUnloaded)
+		{
+			++s.unloadedCount;
+		}
+		else if (e->reduction > 0)
+		{
+			++s.reducedCount;
+		}
+		else
+		{
+			++s.fullCount;
+		}
+		s.residentBytes += e->bytes;
+		s.fullBytes += e->fullBytes;
+	}
+	return s;
+}
+
+/**
+*常駐状況と追い出しの統計を出力する
+*
+*@param	os	出力先
+*/
+void TextureManager::DumpStats(std::ostream& os) const
+{
+	const Stats s = GetStats();
+	os << "Texture residency:" << std::endl;
+	os << "  textures: " << s.textureCount << " (full " << s.fullCount << ", reduced " <<
+		s.reducedCount << ", unloaded " << s.unloadedCount << ")" << std::endl;
+	os << "  memory: " << s.residentBytes / 1024 << "KB / budget " << s.budgetBytes / 1024 <<
+		"KB (peak " << s.peakBytes / 1024 << "KB, all full " << s.fullBytes / 1024 << "KB)" << std::endl;
+	os << "  reduce: " << s.reduceCount << ", unload: " << s.unloadCount << ", reload: " <<
+		s.reloadCount << ", failed: " << s.failCount << std::endl;
+}
@@ -0,0 +1,127 @@
+/**
+*	@file TextureManager.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include "Texture.h"
+#include "TextureUploader.h"
+#include "RetireQueue.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <ostream>
+
+class AssetLoader;
+class JobSystem;
+class TextureManager;
+typedef std::shared_ptr<TextureManager> TextureManagerPtr;	///<テクスチャ管理ポインタ
+
+/**
+*	テクスチャのGPUメモリ使用量を上限内に収めるクラス
+*
+*	登録したテクスチャごとにミップマップを含むバイト数と最後に使われたフレームを記録し、
+*	使用量が上限を超えたら、しばらく使われていないものから順にミップマップを1段落とした縮小版に置き換える
+*	それ以上縮小できないものは小さな灰色の代用品に置き換え(アンロード)、
+*	縮小版や代用品が再び使われたら、上限に収まる場合に限り元のファイルから読み込み直す
+*	置き換えはTextureの中身を差し替えるので、TexturePtrを持っている側は何もしなくてよい
+*	置き換えに使う転送と複製はAssetLoaderを通して描画スレッドで行う
+*	置き換えられた古い中身は、描画中のスナップショットが使わなくなるまでRetireQueueで解放を待つ
+*
+*	全ての関数はシミュレーションスレッドから呼び出す
+*	管理できるのはTexturePoolのテクスチャ配列に入ったテクスチャだけ
+*/
+class TextureManager
+{
+public:
+	/**
+	*	管理の設定
+	*/
+	struct Settings
+	{
+		size_t budgetBytes = 64 * 1024 * 1024;	///<GPUメモリ使用量の上限
+		uint32_t idleFrameCount = 30;	///<このフレーム数以上使われていないテクスチャだけを追い出す
+		int minReducedSize = 32;	///<縮小版の幅と高さの下限(これより小さくなる場合はアンロードする)
+	};
+
+	/**
+	*	常駐状況と追い出しの統計
+	*/
+	struct Stats
+	{
+		size_t textureCount = 0;	///<管理しているテクスチャの数
+		size_t fullCount = 0;	///<元の大きさで常駐しているテクスチャの数
+		size_t reducedCount = 0;	///<縮小版に置き換えたテクスチャの数
+		size_t unloadedCount = 0;	///<アンロードしたテクスチャの数
+		size_t residentBytes = 0;	///<現在のGPUメモリ使用量
+		size_t fullBytes = 0;	///<全てを元の大きさで常駐させた場合の使用量
+		size_t peakBytes = 0;	///<residentBytesの最大値
+		size_t budgetBytes = 0;	///<使用量の上限
+		size_t reduceCount = 0;	///<縮小した回数
+		size_t unloadCount = 0;	///<アンロードした回数
+		size_t reloadCount = 0;	///<読み込み直した回数
+		size_t failCount = 0;	///<置き換えに失敗した回数
+	};
+
+	static TextureManagerPtr Create(AssetLoader& loader, const TexturePoolPtr& pool,
+		JobSystem& jobSystem, const TextureUploaderPtr& uploader, RetireQueue& retireQueue);
+
+	bool Register(const char* filename, const TexturePtr& texture);
+	bool Unregister(const TexturePtr& texture);
+	void Update();
+
+	void SetSettings(const Settings& s) { settings = s; }
+	const Settings& GetSettings() const { return settings; }
+	Stats GetStats() const;
+	void DumpStats(std::ostream& os) const;
+
+private:
+	/**
+	*	管理しているテクスチャ1つ分の情報
+	*/
+	struct Entry
+	{
+		std::string filename;	///<読み込み直すときのファイル名
+		TexturePtr texture;	///<登録されたテクスチャ(中身を差し替える)
+		GLenum iformat;	///<テクスチャのデータ形式
+		bool isCompressed;	///<iformatが圧縮形式ならtrue
+		int fullWidth;	///<元の幅(ピクセル数)
+		int fullHeight;	///<元の高さ(ピクセル数)
+		int fullLevelCount;	///<元のミップマップの段数
+		size_t fullBytes;	///<元の大きさでのバイト数
+		size_t bytes;	///<現在のバイト数
+		size_t pendingBytes = 0;	///<置き換え中の場合、置き換え後のバイト数
+		int reduction = 0;	///<元の大きさから縮小した段数
+		bool isUnloaded = false;	///<代用品に置き換えている
+		bool isBusy = false;	///<置き換えの途中
+		bool isReloadFailed = false;	///<読み込み直しに失敗した(縮小版のまま使い続ける)
+		bool isUnregistered = false;	///<置き換えの途中で登録を解除された
+	};
+	typedef std::shared_ptr<Entry> EntryPtr;
+
+	TextureManager() = default;
+	~TextureManager();
+	TextureManager(const TextureManager&) = delete;
+	TextureManager& operator = (const TextureManager&) = delete;
+
+	size_t ProjectedBytes() const;
+	size_t Evict(size_t bytes, uint32_t frame);
+	size_t Reduce(const EntryPtr& entry);
+	size_t Unload(const EntryPtr& entry);
+	void Reload(const EntryPtr& entry);
+	bool Replace(const EntryPtr& entry, TexturePtr& storage, bool result);
+	bool CopyReduced(const Texture& src, const Texture& dst);
+	void Retire(TexturePtr& storage);
+
+	AssetLoader* assetLoader = nullptr;
+	TexturePoolPtr pool;
+	JobSystem* jobSystem = nullptr;
+	TextureUploaderPtr uploader;	///<読み込み直しの転送に使う(nullptrなら一括で転送する)
+	RetireQueue* retireQueue = nullptr;	///<置き換えられた古い中身を描画スレッドで解放する
+
+	Settings settings;
+	std::vector<EntryPtr> entryList;
+	Stats counters;	///<回数の統計(数と使用量はGetStatsで集計する)
+
+	//以下は描画スレッドから使う
+	GLuint framebuffer[2] = {};	///<縮小版を作るときの読み込み元と書き込み先
+};
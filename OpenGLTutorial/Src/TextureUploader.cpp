@@ -0,0 +1,324 @@
+/**
+*	@file TextureUploader.cpp
+*/
+#include "TextureUploader.h"
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+
+namespace /* unnamed */ {
+
+//リングの区画の先頭の境界
+const GLsizeiptr blockAlignment = 64;
+
+/**
+*非圧縮の画素1つのバイト数を取得する
+*/
+size_t PixelBytes(GLenum format)
+{
+	switch (format)
+	{
+	case GL_RED: return 1;
+	case GL_RG: return 2;
+	case GL_RGB: case GL_BGR: return 3;
+	default: return 4;
+	}
+}
+
+} // unnamed namespace
+
+/**
+*テクスチャ転送オブジェクトを作成する
+*
+*@param	ringSize	リングに使うピクセルアンパックバッファのバイト数
+*
+*@return 作成したオブジェクトへのポインタ
+*		永続的なマップ(GL4.4またはARB_buffer_storage)が使えない場合はnullptr
+*/
+TextureUploaderPtr TextureUploader::Create(GLsizeiptr ringSize)
+{
+	if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage)
+	{
+		std::cerr << "WARNING: 永続的なマップが使えないため、テクスチャは一括で転送します" << std::endl;
+		return{};
+	}
+	struct Impl : TextureUploader { Impl() {} ~Impl() {} };
+	TextureUploaderPtr p = std::make_shared<Impl>();
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &p->pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p->pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, nullptr, flags);
+	p->mappedData = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!p->mappedData)
+	{
+		std::cerr << "ERROR: ピクセルアンパックバッファのマップに失敗" << std::endl;
+		return{};
+	}
+	p->ringSize = ringSize;
+	return p;
+}
+
+/**
+*デストラクタ
+*/
+TextureUploader::~TextureUploader()
+{
+	for (const Block& e : blockList)
+	{
+		glDeleteSync(e.fence);
+	}
+	if (mappedData)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &pbo);
+}
+
+/**
+*フレームの転送を開始する
+*
+*@param	budgetBytes	このフレームに転送してよいバイト数
+*
+*毎フレーム、Uploadを呼び出す前に呼び出すこと
+*/
+void TextureUploader::BeginFrame(size_t budgetBytes)
+{
+	frameBudget = budgetBytes;
+	frameBytes = 0;
+	Retire();
+}
+
+/**
+*画像の続きを転送する
+*
+*@param	texture		転送先のテクスチャ(TexturePool::AllocateやTexture::Createで確保したもの)
+*@param	image		転送する画像データ
+*@param	progress	転送の進み具合(最初は既定値のものを渡し、完了するまで同じものを渡し続ける)
+*
+*@retval true	全ての段の転送を発行した
+*@retval false	1フレームの上限に達したかリングに空きがないので、次のフレームに続きを転送する
+*
+*1フレームに少なくとも1行は転送するので、上限が小さくても転送は必ず終わる
+*1行がリングより大きい場合、その行はクライアントメモリから直接転送する
+*imageとtextureは、trueを返すまで破棄しないこと
+*/
+bool TextureUploader::Upload(const TexturePtr& texture, const Texture::Image& image, Progress& progress)
+{
+	const GLenum target = texture->Target();
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBindTexture(target, texture->Id());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	while (progress.level < image.levelCount)
+	{
+		const int level = progress.level;
+		const int w = std::max(1, image.width >> level);
+		const int h = std::max(1, image.height >> level);
+		const Texture::Level& levelData = image.levelList[level];
+
+		//圧縮形式は4x4ブロックの行を、非圧縮形式は画素の行を単位とする
+		const int unitHeight = image.isCompressed ? 4 : 1;
+		const int unitCount = (h + unitHeight - 1) / unitHeight;
+		const size_t copyBytes = image.isCompressed ? levelData.size / unitCount : PixelBytes(image.format) * w;
+		const size_t rowBytes = image.isCompressed ? copyBytes : (copyBytes + 3) & ~size_t(3);
+		if (progress.row >= unitCount)
+		{
+			++progress.level;
+			progress.row = 0;
+			continue;
+		}
+
+		//このフレームの残りの上限に収まる行数を求める
+		const size_t budgetLeft = frameBudget > frameBytes ? frameBudget - frameBytes : 0;
+		size_t rowCount = std::min<size_t>(unitCount - progress.row, budgetLeft / rowBytes);
+		if (rowCount == 0)
+		{
+			if (frameBytes > 0)
+			{
+				++stats.budgetDeferCount;
+				break;
+			}
+			rowCount = 1;
+		}
+
+		//リングから区画を確保する(空きが足りなければ行数を減らして試す)
+		const bool isDirect = rowBytes > size_t(ringSize);
+		GLsizeiptr offset = -1;
+		if (!isDirect)
+		{
+			rowCount = std::min<size_t>(rowCount, ringSize / rowBytes);
+			for (; rowCount > 0; rowCount /= 2)
+			{
+				offset = Allocate(static_cast<GLsizeiptr>(rowCount * rowBytes));
+				if (offset >= 0)
+				{
+					break;
+				}
+			}
+			if (offset < 0)
+			{
+				++stats.ringDeferCount;
+				break;
+			}
+		}
+		else
+		{
+			rowCount = 1;
+		}
+
+		//画素データをリングに書き込む
+		const uint8_t* levelSource = image.Data() + levelData.offset;
+		const GLvoid* pixels = nullptr;
+		if (isDirect)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			pixels = image.isCompressed || level > 0 ? levelSource + rowBytes * progress.row : image.Row(progress.row);
+			stats.directBytes += copyBytes;
+		}
+		else
+		{
+			uint8_t* dst = mappedData + offset;
+			if (image.isCompressed)
+			{
+				memcpy(dst, levelSource + rowBytes * progress.row, rowBytes * rowCount);
+			}
+			else
+			{
+				for (size_t i = 0; i < rowCount; ++i)
+				{
+					const int y = progress.row + static_cast<int>(i);
+					const uint8_t* src = level > 0 ? levelSource + rowBytes * y : image.Row(y);
+					memcpy(dst + rowBytes * i, src, copyBytes);
+				}
+			}
+			pixels = reinterpret_cast<const GLvoid*>(offset);
+		}
+
+		//リングから転送する
+		const int y = progress.row * unitHeight;
+		const int height = std::min(static_cast<int>(rowCount) * unitHeight, h - y);
+		const GLsizei size = static_cast<GLsizei>(rowBytes * rowCount);
+		if (image.isCompressed)
+		{
+			if (target == GL_TEXTURE_2D_ARRAY)
+			{
+				glCompressedTexSubImage3D(target, level, 0, y, texture->Layer(), w, height, 1, image.iformat, size, pixels);
+			}
+			else
+			{
+				glCompressedTexSubImage2D(target, level, 0, y, w, height, image.iformat, size, pixels);
+			}
+		}
+		else
+		{
+			if (target == GL_TEXTURE_2D_ARRAY)
+			{
+				glTexSubImage3D(target, level, 0, y, texture->Layer(), w, height, 1, image.format, GL_UNSIGNED_BYTE, pixels);
+			}
+			else
+			{
+				glTexSubImage2D(target, level, 0, y, w, height, image.format, GL_UNSIGNED_BYTE, pixels);
+			}
+		}
+		if (isDirect)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+		else
+		{
+			blockList.back().fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		progress.row += static_cast<int>(rowCount);
+		progress.uploadedBytes += size;
+		frameBytes += size;
+		stats.uploadedBytes += size;
+		++stats.chunkCount;
+	}
+	glBindTexture(target, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (progress.level < image.levelCount)
+	{
+		return false;
+	}
+	++stats.textureCount;
+	return true;
+}
+
+/**
+*転送が完了した区画を解放する
+*
+*フェンスは待たずに調べるだけなので、GPUが遅れていても止まらない
+*/
+void TextureUploader::Retire()
+{
+	while (!blockList.empty())
+	{
+		const GLenum result = glClientWaitSync(blockList.front().fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+		glDeleteSync(blockList.front().fence);
+		blockList.pop_front();
+	}
+}
+
+/**
+*リングから区画を確保する
+*
+*@param	size	確保するバイト数
+*
+*@return 確保した区画のオフセット(空きがなければ-1)
+*
+*区画は確保した順に並ぶので、空きは最後の区画の後ろか、リングの先頭に戻って最初の区画の前にある
+*確保した区画のフェンスは、転送を発行した後で呼び出し側が設定する
+*/
+GLsizeiptr TextureUploader::Allocate(GLsizeiptr size)
+{
+	Retire();
+	GLsizeiptr offset = 0;
+	if (!blockList.empty())
+	{
+		const GLsizeiptr first = blockList.front().offset;
+		const GLsizeiptr lastEnd = blockList.back().offset + blockList.back().size;
+		const GLsizeiptr next = (lastEnd + blockAlignment - 1) / blockAlignment * blockAlignment;
+		if (lastEnd > first)
+		{
+			//最後の区画が最初の区画より後ろにある(まだ先頭に戻っていない)
+			if (next + size <= ringSize)
+			{
+				offset = next;
+			}
+			else if (size <= first)
+			{
+				offset = 0;
+			}
+			else
+			{
+				return -1;
+			}
+		}
+		else if (next + size <= first)
+		{
+			offset = next;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+	blockList.push_back({ offset, size, nullptr });
+
+	const GLsizeiptr first = blockList.front().offset;
+	const GLsizeiptr lastEnd = offset + size;
+	const GLsizeiptr usedBytes = lastEnd > first ? lastEnd - first : ringSize - first + lastEnd;
+	stats.peakRingBytes = std::max(stats.peakRingBytes, static_cast<size_t>(usedBytes));
+	return offset;
+}
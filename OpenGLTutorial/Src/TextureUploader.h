@@ -0,0 +1,84 @@
+/**
+*	@file TextureUploader.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include "Texture.h"
+#include <memory>
+#include <deque>
+
+class TextureUploader;
+typedef std::shared_ptr<TextureUploader> TextureUploaderPtr;	///<テクスチャ転送ポインタ
+
+/**
+*	ピクセルアンパックバッファのリングを通して、テクスチャを少しずつ転送するクラス
+*
+*	画素データを永続的にマップしたGL_PIXEL_UNPACK_BUFFERに書き込み、そこからglTexSubImageで転送する
+*	転送はミップマップの段ごとに行(圧縮形式ではブロックの行)単位で分割し、
+*	1フレームに転送するバイト数がBeginFrameで指定した量を超えないようにする
+*	リングの区画はフェンスで転送の完了を確認してから再利用するので、GPUの完了を待って止まることはない
+*	描画スレッドからだけ使うこと
+*/
+class TextureUploader
+{
+public:
+	/**
+	*	1つの画像の転送の進み具合
+	*/
+	struct Progress
+	{
+		int level = 0;	///<次に転送するミップマップの段
+		int row = 0;	///<次に転送する行(圧縮形式ではブロックの行)
+		size_t uploadedBytes = 0;	///<転送済みのバイト数
+	};
+
+	/**
+	*	転送の統計
+	*/
+	struct Stats
+	{
+		size_t textureCount = 0;	///<転送を終えたテクスチャの数
+		size_t chunkCount = 0;	///<発行したglTexSubImageの数
+		size_t uploadedBytes = 0;	///<転送したバイト数
+		size_t directBytes = 0;	///<リングに入らず、クライアントメモリから直接転送したバイト数
+		size_t budgetDeferCount = 0;	///<1フレームの上限に達して次のフレームに回した回数
+		size_t ringDeferCount = 0;	///<リングの空きがなく次のフレームに回した回数
+		size_t peakRingBytes = 0;	///<転送中のデータが占めたリングの最大バイト数
+	};
+
+	static TextureUploaderPtr Create(GLsizeiptr ringSize);
+
+	void BeginFrame(size_t budgetBytes);
+	bool Upload(const TexturePtr& texture, const Texture::Image& image, Progress& progress);
+
+	GLsizeiptr RingSize() const { return ringSize; }
+	const Stats& GetStats() const { return stats; }
+
+private:
+	/**
+	*	転送中のリングの区画
+	*/
+	struct Block
+	{
+		GLsizeiptr offset;
+		GLsizeiptr size;
+		GLsync fence;	///<この区画を読む転送の完了を待つフェンス
+	};
+
+	TextureUploader() = default;
+	~TextureUploader();
+	TextureUploader(const TextureUploader&) = delete;
+	TextureUploader& operator = (const TextureUploader&) = delete;
+
+	void Retire();
+	GLsizeiptr Allocate(GLsizeiptr size);
+
+	GLuint pbo = 0;
+	uint8_t* mappedData = nullptr;	///<永続的にマップしたpboの先頭
+	GLsizeiptr ringSize = 0;	///<pboのバイト数
+	std::deque<Block> blockList;	///<転送中の区画(古い順)
+
+	size_t frameBudget = 0;	///<このフレームに転送してよいバイト数
+	size_t frameBytes = 0;	///<このフレームに転送したバイト数
+	Stats stats;
+};
@@ -0,0 +1,82 @@
+/**
+*	@file TripleBuffer.h
+*/
+#pragma once
+#include <atomic>
+
+/**
+*	書き込み側と読み込み側が互いを待たずにデータを受け渡すための三重バッファ
+*
+*	書き込み側はWriteBufferに書き込んでPublishで公開する
+*	読み込み側はAcquireで最新の公開データを受け取り、ReadBufferで参照する
+*	書き込み側と読み込み側はそれぞれ1つのスレッドでなければならない
+*/
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : state(middleInitial), writeIndex(2), readIndex(0) {}
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator = (const TripleBuffer&) = delete;
+
+	/**
+	*書き込み用のバッファを取得する(書き込み側専用)
+	*
+	*@return 書き込み用のバッファ
+	*		前回の内容が残っているので、必要なら書き込み側で消去すること
+	*/
+	T& WriteBuffer() { return buffer[writeIndex]; }
+
+	/**
+	*書き込み用のバッファを公開する(書き込み側専用)
+	*
+	*読み込み側が受け取る前に再度公開された場合、古い方は読まれずに上書きされる
+	*/
+	void Publish()
+	{
+		const int prev = state.exchange(writeIndex | dirtyBit, std::memory_order_acq_rel);
+		writeIndex = prev & indexMask;
+	}
+
+	/**
+	*公開された最新のバッファを受け取る(読み込み側専用)
+	*
+	*@retval true	新しいバッファを受け取った
+	*@retval false	前回のAcquireから公開されていない(ReadBufferは前回のまま)
+	*/
+	bool Acquire()
+	{
+		if (!HasPending())
+		{
+			return false;
+		}
+		const int prev = state.exchange(readIndex, std::memory_order_acq_rel);
+		readIndex = prev & indexMask;
+		return true;
+	}
+
+	/**
+	*読み込み用のバッファを取得する(読み込み側専用)
+	*
+	*@return 最後にAcquireで受け取ったバッファ
+	*/
+	const T& ReadBuffer() const { return buffer[readIndex]; }
+
+	/**
+	*公開されたバッファがまだ受け取られていないか調べる
+	*
+	*@retval true	受け取られていない
+	*@retval false	受け取り済み
+	*/
+	bool HasPending() const { return (state.load(std::memory_order_acquire) & dirtyBit) != 0; }
+
+private:
+	static const int indexMask = 3;	///<stateのうち中間バッファの番号を表すビット
+	static const int dirtyBit = 4;	///<中間バッファが未読であることを表すビット
+	static const int middleInitial = 1;	///<中間バッファの初期番号
+
+	T buffer[3];
+	std::atomic<int> state;	///<中間バッファの番号と未読フラグ
+	int writeIndex;	///<書き込み側が使っているバッファの番号
+	int readIndex;	///<読み込み側が使っているバッファの番号
+};
@@ -5,41 +5,42 @@
 #include <glm/glm.hpp>
 namespace Uniform
 {
-	//_VF[_̃p[^^
+	//頂点シェーダのパラメータ型
 	struct VertexData
 	{
 		glm::mat4 matMVP;
 		glm::mat4 matModel;
 		glm::mat3x4 matNormal;
 		glm::vec4 color;
+		glm::ivec4 textureLayer;	///<x:テクスチャ配列のレイヤー番号(yzwは未使用)
 	};
 
 	/**
-	*Cgf[^(_)
+	*ライトデータ(点光源)
 	*/
 	struct PointLight
 	{
-		glm::vec4 position;	///<W([hWn)
-		glm::vec4 color;	///<邳
+		glm::vec4 position;	///<座標(ワールド座標系)
+		glm::vec4 color;	///<明るさ
 	};
 
-	const int maxLightCount = 4;	///<Cg̐
+	const int maxLightCount = 4;	///<ライトの数
 
 	/**
-	*CeBOp[^
+	*ライティングパラメータ
 	*/
 	struct LightData
 	{
-		glm::vec4 ambientColor;		///<
-		PointLight light[maxLightCount];	///<Cg̃Xg
+		glm::vec4 ambientColor;		///<環境光
+		PointLight light[maxLightCount];	///<ライトのリスト
 	};
 
 	/**
-	*|XgGtFNgf[^
+	*ポストエフェクトデータ
 	*/
 	struct PostEffectData
 	{
-		glm::mat4x4 matColor; ///< Fϊs
+		glm::mat4x4 matColor; ///< 色変換行列
 	};
 
 }
\ No newline at end of file
@@ -5,13 +5,13 @@
 #include <iostream>
 
 /**
-*Uniformobt@쐬
+*Uniformバッファを作成する
 *
-*@param	size			obt@̃TCY
-*@param	bindingPoint	obt@蓖ĂoCfBOE|Cg
-*@param	name			obt@(fobOp)
+*@param	size			バッファのサイズ
+*@param	bindingPoint	バッファを割り当てるバインディング・ポイント
+*@param	name			バッファ名(デバッグ用)
 *
-*@return 쐬Uniformobt@ւ̃|C^
+*@return 作成したUniformバッファへのポインタ
 */
 UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, const char* name)
 {
@@ -19,7 +19,7 @@ UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, con
 	UniformBufferPtr p = std::make_shared<Impl>();
 	if (!p)
 	{
-		std::cerr << "ERROR : UBO '" << name << "'̍쐬Ɏs" << std::endl;
+		std::cerr << "ERROR : UBO '" << name << "'の作成に失敗" << std::endl;
 		return{};
 	}
 	glGenBuffers(1, &p->ubo);
@@ -29,7 +29,7 @@ UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, con
 	const GLenum result = glGetError();
 	if (result != GL_NO_ERROR)
 	{
-		std::cerr << "ERROR : UBO '" << name << "'̍쐬Ɏs" << std::endl;
+		std::cerr << "ERROR : UBO '" << name << "'の作成に失敗" << std::endl;
 		return{};
 	}
 
@@ -42,7 +42,7 @@ UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, con
 }
 
 /**
-*fXgN^
+*デストラクタ
 */
 UniformBuffer::~UniformBuffer()
 {
@@ -53,22 +53,22 @@ UniformBuffer::~UniformBuffer()
 }
 
 /**
-*Uniformobt@Ƀf[^]
+*Uniformバッファにデータを転送する
 *
-*@param	data	]f[^ւ̃|C^
-*@param	offset	]̃oCgItZbg
-*@param	size	]oCg
+*@param	data	転送するデータへのポインタ
+*@param	offset	転送先のバイトオフセット
+*@param	size	転送するバイト数
 *
-*@retval	true	]
-*@retval	false	]s
+*@retval	true	転送成功
+*@retval	false	転送失敗
 *
-*offsetsize̗0̏ꍇAobt@TCY=UBOTCYƂē]
+*offsetとsizeの両方が0の場合、バッファサイズ=UBOサイズとして転送される
 */
 bool UniformBuffer::BufferSubData(const GLvoid* data, GLintptr offset, GLsizeiptr size)
 {
 	if (offset * size > this->size)
 	{
-		std::cerr << "ERROR(" << name << "):]͈͂obt@TCY𒴂Ă܂(buffer=" <<
+		std::cerr << "ERROR(" << name << "):転送範囲がバッファサイズを超えています(buffer=" <<
 			this->size << " offset=" << offset << " size=" << size << ")" << std::endl;
 		return true;
 	}
@@ -82,10 +82,10 @@ bool UniformBuffer::BufferSubData(const GLvoid* data, GLintptr offset, GLsizeipt
 }
 
 /**
-*w肳ꂽ͈͂oCfBOE|CgɊ蓖Ă
+*指定された範囲をバインディング・ポイントに割り当てる
 *
-*@param	offset	蓖Ă͈͂̃oCgItZbg
-*@param	size	蓖Ă͈͂̃oCg
+*@param	offset	割り当てる範囲のバイトオフセット
+*@param	size	割り当てる範囲のバイト数
 */
 void UniformBuffer::BindBufferRange(GLintptr offset, GLsizeiptr size) const
 {
@@ -93,9 +93,9 @@ void UniformBuffer::BindBufferRange(GLintptr offset, GLsizeiptr size) const
 }
 
 /**
-*UBOVXeɃ}bv
+*UBOをシステムメモリにマップする
 *
-*@return }bvւ̃|C^
+*@return マップしたメモリへのポインタ
 */
 void* UniformBuffer::MapBuffer() const
 {
@@ -105,7 +105,7 @@ void* UniformBuffer::MapBuffer() const
 }
 
 /**
-*obt@̊
+*バッファの割当を解除する
 */
 void UniformBuffer::UnmapBuffer() const
 {
@@ -7,10 +7,10 @@
 #include <memory>
 
 class UniformBuffer;
-typedef std::shared_ptr<UniformBuffer> UniformBufferPtr; ///<UBO|C^^
+typedef std::shared_ptr<UniformBuffer> UniformBufferPtr; ///<UBOポインタ型
 
 /**
-*UBONX
+*UBOクラス
 */
 class UniformBuffer
 {
@@ -24,6 +24,7 @@ public:
 	void UnmapBuffer() const;
 
 	GLsizeiptr Size() const { return size; }
+	GLuint Id() const { return ubo; }
 
 	
 private:
@@ -34,7 +35,7 @@ private:
 
 private:
 	GLuint ubo = 0;	///< Uniform BufferObject
-	GLsizeiptr size = 0;	///<UBÕoCgTCY
-	GLuint bindingpoint;	///<UBO̊oCfBOE|Cg
-	std::string name; ///<UBO
+	GLsizeiptr size = 0;	///<UBOのバイトサイズ
+	GLuint bindingpoint;	///<UBOの割当先バインディング・ポイント
+	std::string name; ///<UBO名
 };
\ No newline at end of file